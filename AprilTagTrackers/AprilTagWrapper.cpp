@@ -1,68 +1,84 @@
 #include "AprilTagWrapper.hpp"
 
-#include "tagCustom29h10.hpp"
+#include "MarkerFamilyCache.hpp"
 #include "utils/Assert.hpp"
-#include "utils/Cross.hpp"
+#include "utils/TaskScheduler.hpp"
+#include "utils/Test.hpp"
 
 #include <apriltag/apriltag.h>
-#include <apriltag/tagCircle21h7.h>
 #include <apriltag/tagStandard41h12.h>
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <algorithm>
 #include <vector>
 
-AprilTagWrapper::AprilTagWrapper(MarkerFamily family, double quadDecimate, int threadCount)
-    : mDetector(apriltag_detector_create()), mFamilyType(family)
+AprilTagWrapper::AprilTagWrapper(MarkerFamily family, double quadDecimate, int threadCount, int markerIdCount)
+    : mDetector(apriltag_detector_create()),
+      mFamilyTable(MarkerFamilyCache::Get().GetTable(family, markerIdCount))
 {
     mDetector->quad_decimate = static_cast<float>(quadDecimate);
     mDetector->nthreads = threadCount;
-
-    if (mFamilyType == MarkerFamily::Standard41h12)
-    {
-        mFamilyPtr = tagStandard41h12_create();
-    }
-    else if (mFamilyType == MarkerFamily::Circle21h7)
-    {
-        mFamilyPtr = tagCircle21h7_create();
-    }
-    else if (mFamilyType == MarkerFamily::Custom29h10)
-    {
-        mFamilyPtr = tagCustom29h10_create();
-    }
-    else
-    {
-        utils::Unreachable();
-    }
-    apriltag_detector_add_family(mDetector, mFamilyPtr);
+    mFamilyTable->AttachTo(mDetector);
 }
 
 AprilTagWrapper::~AprilTagWrapper()
 {
     if (mDetector != nullptr)
     {
+        // the family table is shared, and outlives the detector
+        MarkerFamilyTable::DetachAll(mDetector);
         apriltag_detector_destroy(mDetector);
         mDetector = nullptr;
     }
-    if (mFamilyPtr != nullptr)
+}
+
+void AprilTagWrapper::SetQuadDecimate(double quadDecimate)
+{
+    mDetector->quad_decimate = static_cast<float>(quadDecimate);
+}
+
+void AprilTagWrapper::SetThreadCount(int threadCount)
+{
+    mDetector->nthreads = threadCount;
+}
+
+void MarkerDetectionList::Resize(int size)
+{
+    const cv::Point2f* const previousData = corners.data();
+    const int previousSize = Size();
+    ids.resize(size);
+    corners.resize(static_cast<size_t>(size) * math::NUM_CORNERS);
+    centers.resize(size);
+
+    // views are headers only, rebuilt when the corners move
+    UpdateCornerViews((corners.data() == previousData) ? std::min(previousSize, size) : 0);
+}
+
+MarkerDetectionList::MarkerDetectionList(const MarkerDetectionList& other)
+    : ids(other.ids), corners(other.corners), centers(other.centers)
+{
+    UpdateCornerViews(0);
+}
+
+MarkerDetectionList& MarkerDetectionList::operator=(const MarkerDetectionList& rhs)
+{
+    if (this == &rhs) return *this;
+    ids = rhs.ids;
+    corners = rhs.corners;
+    centers = rhs.centers;
+    UpdateCornerViews(0);
+    return *this;
+}
+
+void MarkerDetectionList::UpdateCornerViews(int first)
+{
+    // ids and corners may have been assigned directly, only markers with all their corners get a view
+    const int count = std::min(Size(), static_cast<int>(corners.size()) / math::NUM_CORNERS);
+    mCornerViews.resize(count);
+    for (int i = first; i < count; ++i)
     {
-        if (mFamilyType == MarkerFamily::Standard41h12)
-        {
-            tagStandard41h12_destroy(mFamilyPtr);
-        }
-        else if (mFamilyType == MarkerFamily::Circle21h7)
-        {
-            tagCircle21h7_destroy(mFamilyPtr);
-        }
-        else if (mFamilyType == MarkerFamily::Custom29h10)
-        {
-            tagCustom29h10_destroy(mFamilyPtr);
-        }
-        else
-        {
-            utils::Unreachable();
-        }
-        mFamilyPtr = nullptr;
+        mCornerViews[i] = cv::Mat(1, math::NUM_CORNERS, CV_32FC2, corners.data() + (i * math::NUM_CORNERS));
     }
 }
 
@@ -77,9 +93,7 @@ void AprilTagWrapper::DetectMarkers(cv::Mat& frame, MarkerDetectionList& outList
 
     zarray_t* const detections = apriltag_detector_detect(mDetector, &frameRef);
     const int size = zarray_size(detections);
-    outList.ids.resize(size);
-    outList.corners.resize(size);
-    outList.centers.resize(size);
+    outList.Resize(size);
 
     for (int i = 0; i < size; ++i)
     {
@@ -88,16 +102,15 @@ void AprilTagWrapper::DetectMarkers(cv::Mat& frame, MarkerDetectionList& outList
         ATT_ASSERT(det != nullptr);
 
         outList.ids[i] = det->id;
-        outList.centers[i] = cv::Point2d(det->c[0], det->c[1]);
+        outList.centers[i] = cv::Point2f(static_cast<float>(det->c[0]), static_cast<float>(det->c[1]));
 
-        constexpr int numCorners = 4;
-        outList.corners[i].resize(numCorners);
-        for (int cornerIdx = 0; cornerIdx < numCorners; ++cornerIdx)
+        const std::span<cv::Point2f, math::NUM_CORNERS> corners = outList.GetCorners(i);
+        for (int cornerIdx = 0; cornerIdx < math::NUM_CORNERS; ++cornerIdx)
         {
             /// apriltag returns CCW order, while we need CW for opencv
-            const int detCornerIdx = (numCorners - 1) - cornerIdx;
-            outList.corners[i][cornerIdx] = cv::Point2d(
-                det->p[detCornerIdx][0], det->p[detCornerIdx][1]);
+            const int detCornerIdx = (math::NUM_CORNERS - 1) - cornerIdx;
+            corners[cornerIdx] = cv::Point2f(
+                static_cast<float>(det->p[detCornerIdx][0]), static_cast<float>(det->p[detCornerIdx][1]));
         }
     }
     apriltag_detections_destroy(detections);
@@ -139,3 +152,162 @@ void AprilTagWrapper::DrawTimeProfile(cv::Mat& image, const cv::Point2d& textOri
         cursor.y += dy;
     }
 }
+
+void AprilTagPool::Releaser::operator()(AprilTagWrapper* detector) const
+{
+    pool->Release(Idle{family, markerIdCount, std::unique_ptr<AprilTagWrapper>(detector)});
+}
+
+AprilTagPool& AprilTagPool::Get()
+{
+    static AprilTagPool pool{};
+    return pool;
+}
+
+AprilTagPool::Lease AprilTagPool::Acquire(MarkerFamily family, double quadDecimate, int markerIdCount)
+{
+    const int threadCount = utils::TaskScheduler::Get().GetThreadCount();
+    std::unique_ptr<AprilTagWrapper> detector;
+    {
+        const std::lock_guard lock{mMutex};
+        const auto it = std::find_if(mIdle.begin(), mIdle.end(), [&](const Idle& idle) {
+            return idle.family == family && idle.markerIdCount == markerIdCount;
+        });
+        if (it != mIdle.end())
+        {
+            detector = std::move(it->detector);
+            mIdle.erase(it);
+        }
+    }
+
+    if (detector)
+    {
+        detector->SetQuadDecimate(quadDecimate);
+        detector->SetThreadCount(threadCount);
+    }
+    else
+    {
+        detector = std::make_unique<AprilTagWrapper>(family, quadDecimate, threadCount, markerIdCount);
+    }
+    return Lease{detector.release(), Releaser{this, family, markerIdCount}};
+}
+
+void AprilTagPool::Release(Idle idle)
+{
+    std::unique_ptr<AprilTagWrapper> dropped;
+    const std::lock_guard lock{mMutex};
+    if (static_cast<int>(mIdle.size()) >= MAX_IDLE)
+    {
+        // destroyed after the lock is released, declared before it
+        dropped = std::move(mIdle.front().detector);
+        mIdle.erase(mIdle.begin());
+    }
+    mIdle.push_back(std::move(idle));
+}
+
+namespace
+{
+
+/// draw a marker with a white quiet zone, scaled up so every bit is cellSize pixels
+[[maybe_unused]] void DrawFamilyMarker(apriltag_family* family, int id, cv::Mat& image, cv::Point origin, int cellSize)
+{
+    image_u8_t* const marker = apriltag_to_image(family, id);
+    const cv::Mat markerRef{marker->height, marker->width, CV_8UC1, marker->buf, static_cast<size_t>(marker->stride)};
+    cv::Mat scaled;
+    cv::resize(markerRef, scaled, cv::Size(), cellSize, cellSize, cv::INTER_NEAREST);
+    scaled.copyTo(image(cv::Rect(origin + cv::Point(2 * cellSize, 2 * cellSize), scaled.size())));
+    image_u8_destroy(marker);
+}
+
+} // namespace
+
+TEST_CASE("AprilTagWrapper decodes only the marker ids in use")
+{
+    constexpr int cellSize = 10;
+    constexpr int markerIdCount = 10;
+    constexpr int usedId = 3;
+    constexpr int unusedId = 20;
+
+    apriltag_family* const family = tagStandard41h12_create();
+    cv::Mat image{200, 400, CV_8UC1, cv::Scalar(255)};
+    DrawFamilyMarker(family, usedId, image, {0, 0}, cellSize);
+    DrawFamilyMarker(family, unusedId, image, {200, 0}, cellSize);
+    tagStandard41h12_destroy(family);
+
+    MarkerDetectionList dets;
+    AprilTagWrapper allIds{MarkerFamily::Standard41h12, 1, 1, unusedId + 1};
+    allIds.DetectMarkers(image, dets);
+    std::sort(dets.ids.begin(), dets.ids.end());
+    CHECK(dets.ids == std::vector<int>{usedId, unusedId});
+
+    AprilTagWrapper usedIds{MarkerFamily::Standard41h12, 1, 1, markerIdCount};
+    usedIds.DetectMarkers(image, dets);
+    CHECK(dets.ids == std::vector<int>{usedId});
+}
+
+TEST_CASE("AprilTagPool reuses released detectors")
+{
+    AprilTagPool& pool = AprilTagPool::Get();
+    const AprilTagWrapper* reused = nullptr;
+    {
+        const AprilTagPool::Lease lease = pool.Acquire(MarkerFamily::Standard41h12, 1, 10);
+        reused = lease.get();
+    }
+    const AprilTagPool::Lease sameConfig = pool.Acquire(MarkerFamily::Standard41h12, 2, 10);
+    CHECK(sameConfig.get() == reused);
+
+    const AprilTagPool::Lease otherIds = pool.Acquire(MarkerFamily::Standard41h12, 1, 20);
+    CHECK(otherIds.get() != reused);
+}
+
+TEST_CASE("MarkerDetectionList reuses its storage")
+{
+    MarkerDetectionList dets;
+    dets.Resize(8);
+    for (int i = 0; i < dets.Size(); ++i)
+    {
+        dets.ids[i] = i;
+        for (cv::Point2f& corner : dets.GetCorners(i)) corner = cv::Point2f(static_cast<float>(i), 1);
+    }
+    const cv::Point2f* const cornersData = dets.corners.data();
+
+    dets.Resize(3);
+    dets.Resize(8);
+    CHECK(dets.corners.data() == cornersData);
+
+    // views are what opencv sees as vector<vector<Point2f>>
+    const cv::_InputArray views{dets.GetCornerViews()};
+    REQUIRE(views.total() == 8);
+    for (int i = 0; i < dets.Size(); ++i)
+    {
+        const cv::Mat view = views.getMat(i);
+        CHECK(view.checkVector(2, CV_32F) == math::NUM_CORNERS);
+        CHECK(view.ptr<cv::Point2f>() == dets.GetCorners(i).data());
+    }
+
+    // growing past capacity moves the corners, every view follows
+    dets.Resize(100);
+    CHECK(dets.GetCornerViews()[0].ptr<cv::Point2f>() == dets.corners.data());
+    CHECK(dets.GetCornerViews()[99].ptr<cv::Point2f>() == dets.GetCorners(99).data());
+}
+
+TEST_CASE("MarkerDetectionList copies point into their own corners")
+{
+    MarkerDetectionList copy;
+    {
+        MarkerDetectionList dets;
+        dets.Resize(3);
+        dets.corners[4] = cv::Point2f(1, 2);
+        copy = dets;
+        const MarkerDetectionList constructed(dets);
+        REQUIRE(constructed.GetCornerViews().size() == 3);
+        CHECK(constructed.GetCornerViews()[1].ptr<cv::Point2f>() == constructed.GetCorners(1).data());
+    }
+    // the source is gone, the views must not point into it
+    REQUIRE(copy.GetCornerViews().size() == 3);
+    CHECK(copy.GetCornerViews()[1].ptr<cv::Point2f>() == copy.GetCorners(1).data());
+    CHECK(copy.GetCornerViews()[1].at<cv::Point2f>(0) == cv::Point2f(1, 2));
+
+    const MarkerDetectionList moved(std::move(copy));
+    CHECK(moved.GetCornerViews()[2].ptr<cv::Point2f>() == moved.GetCorners(2).data());
+}
@@ -1,12 +1,16 @@
 #pragma once
 
 #include "math/CVTypes.hpp"
+#include "utils/Assert.hpp"
 
 #include <opencv2/aruco.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -23,33 +27,69 @@ enum class MarkerFamily
     Custom29h10,
 };
 
+/// Detected markers as flat arrays, capacity is kept between frames so steady state detection does not allocate.
 struct MarkerDetectionList
 {
     std::vector<int> ids{};
-    std::vector<MarkerCorners2f> corners{}; /// 4 corners in CCW order
-    std::vector<cv::Point2d> centers{};
+    /// 4 corners per marker in CW order, marker i owns [i * NUM_CORNERS, (i + 1) * NUM_CORNERS)
+    std::vector<cv::Point2f> corners{};
+    std::vector<cv::Point2f> centers{};
+
+    MarkerDetectionList() = default;
+    /// the copy gets views into its own corners
+    MarkerDetectionList(const MarkerDetectionList& other);
+    MarkerDetectionList& operator=(const MarkerDetectionList& rhs);
+    /// moving a vector keeps its buffer, so the views stay valid
+    MarkerDetectionList(MarkerDetectionList&&) noexcept = default;
+    MarkerDetectionList& operator=(MarkerDetectionList&&) noexcept = default;
+    ~MarkerDetectionList() = default;
+
+    int Size() const { return static_cast<int>(ids.size()); }
+    bool Empty() const { return ids.empty(); }
+    /// set the number of markers, contents are left to be overwritten
+    void Resize(int size);
+
+    std::span<cv::Point2f, math::NUM_CORNERS> GetCorners(int index)
+    {
+        ATT_ASSERT(index >= 0 && index < Size());
+        return std::span<cv::Point2f, math::NUM_CORNERS>{corners.data() + (index * math::NUM_CORNERS), math::NUM_CORNERS};
+    }
+    std::span<const cv::Point2f, math::NUM_CORNERS> GetCorners(int index) const
+    {
+        ATT_ASSERT(index >= 0 && index < Size());
+        return std::span<const cv::Point2f, math::NUM_CORNERS>{corners.data() + (index * math::NUM_CORNERS), math::NUM_CORNERS};
+    }
+    /// corners of each marker as a 1x4 CV_32FC2 header into corners, for opencv functions taking vector<vector<Point2f>>.
+    /// Valid until the next Resize
+    const std::vector<cv::Mat>& GetCornerViews() const { return mCornerViews; }
+
+private:
+    /// point the views of markers [first, Size()) into corners
+    void UpdateCornerViews(int first);
+
+    std::vector<cv::Mat> mCornerViews{};
 };
 
 struct apriltag_detector;
-struct apriltag_family;
+class MarkerFamilyTable;
 
 class AprilTagWrapper
 {
 public:
-    AprilTagWrapper(MarkerFamily family, double quadDecimate, int threadCount);
+    /// @param markerIdCount only decode ids [0, markerIdCount), 0 decodes the whole family.
+    ///   Trackers use ids [0, trackerNum * markersPerTracker), see MarkerIdCount
+    AprilTagWrapper(MarkerFamily family, double quadDecimate, int threadCount, int markerIdCount = 0);
     ~AprilTagWrapper();
     AprilTagWrapper(AprilTagWrapper&& other) noexcept
         : mDetector(other.mDetector),
-          mFamilyType(other.mFamilyType), mFamilyPtr(other.mFamilyPtr)
+          mFamilyTable(std::move(other.mFamilyTable))
     {
         other.mDetector = nullptr;
-        other.mFamilyPtr = nullptr;
     }
     AprilTagWrapper& operator=(AprilTagWrapper&& rhs) noexcept
     {
         std::swap(mDetector, rhs.mDetector);
-        mFamilyType = rhs.mFamilyType;
-        std::swap(mFamilyPtr, rhs.mFamilyPtr);
+        std::swap(mFamilyTable, rhs.mFamilyTable);
         return *this;
     }
 
@@ -63,10 +103,35 @@ class AprilTagWrapper
         return MarkerFamily::Standard41h12;
     }
 
-    /// convert BGR image to single channel grayscale
+    /// number of ids used by the trackers, tracker i uses ids [i * markersPerTracker, (i + 1) * markersPerTracker)
+    static int MarkerIdCount(int trackerNum, int markersPerTracker)
+    {
+        return trackerNum * markersPerTracker;
+    }
+
+    /// convert BGR image to single channel grayscale, copies images that are already grayscale
     static void ConvertGrayscale(const cv::Mat& image, cv::Mat& outImage)
     {
-        cv::cvtColor(image, outImage, cv::COLOR_BGR2GRAY);
+        if (image.channels() == 1)
+        {
+            image.copyTo(outImage);
+        }
+        else
+        {
+            cv::cvtColor(image, outImage, cv::COLOR_BGR2GRAY);
+        }
+    }
+    /// copy image to draw on in color, single channel grayscale is expanded to BGR
+    static void ConvertDrawImage(const cv::Mat& image, cv::Mat& outImage)
+    {
+        if (image.channels() == 1)
+        {
+            cv::cvtColor(image, outImage, cv::COLOR_GRAY2BGR);
+        }
+        else
+        {
+            image.copyTo(outImage);
+        }
     }
     /// convert BGR image to single channel chroma red extracted from YCrCb
     static void ConvertChromaRed(const cv::Mat& image, cv::Mat& outImage)
@@ -79,11 +144,53 @@ class AprilTagWrapper
 
     void DetectMarkers(cv::Mat& frame, MarkerDetectionList& outList);
 
+    void SetQuadDecimate(double quadDecimate);
+    /// apriltag keeps its worker threads alive until the count changes
+    void SetThreadCount(int threadCount);
+
     std::vector<std::string> GetTimeProfile();
     void DrawTimeProfile(cv::Mat& image, const cv::Point2d& textOrigin);
 
 private:
     apriltag_detector* mDetector; /// owning
-    MarkerFamily mFamilyType;
-    apriltag_family* mFamilyPtr = nullptr; /// owning
+    /// family and quick decode table, shared with every detector of the same family
+    std::shared_ptr<const MarkerFamilyTable> mFamilyTable;
+};
+
+/// Keeps detectors alive between tracker modes, along with their apriltag worker threads,
+/// rather than creating and destroying them every time a mode starts.
+class AprilTagPool
+{
+public:
+    struct Releaser
+    {
+        void operator()(AprilTagWrapper* detector) const;
+        AprilTagPool* pool;
+        MarkerFamily family;
+        int markerIdCount;
+    };
+    /// returns the detector to the pool once destroyed
+    using Lease = std::unique_ptr<AprilTagWrapper, Releaser>;
+
+    static AprilTagPool& Get();
+
+    /// reuse an idle detector of the same family and ids, or create one,
+    /// uses as many apriltag threads as the shared TaskScheduler
+    Lease Acquire(MarkerFamily family, double quadDecimate, int markerIdCount = 0);
+
+private:
+    /// idle detectors of stale configs are dropped, oldest first
+    static constexpr int MAX_IDLE = 4;
+
+    struct Idle
+    {
+        MarkerFamily family;
+        int markerIdCount;
+        std::unique_ptr<AprilTagWrapper> detector;
+    };
+
+    void Release(Idle idle);
+
+    std::mutex mMutex;
+    std::vector<Idle> mIdle;
 };
@@ -46,11 +46,17 @@ class UserConfig : public serial::Serializable<UserConfig>
     REFLECTABLE_FIELD(cfg::Validated<double>, markerSize){5.0, cfg::GreaterEqual(0.01)};
     REFLECTABLE_FIELD(int, numOfPrevValues) = 5;
     REFLECTABLE_FIELD(bool, usePredictive) = true;
+    ATT_SERIAL_COMMENT("predict tracker poses from their recent motion, and only ask the driver when a tracker was lost, or now and then");
+    REFLECTABLE_FIELD(bool, localPrediction) = true;
+    ATT_SERIAL_COMMENT("refine detected marker corners along the marker edges projected at the predicted pose, most useful for small and distant markers, experimental");
+    REFLECTABLE_FIELD(bool, refineCorners) = false;
     REFLECTABLE_FIELD(bool, ignoreTracker0) = false;
     REFLECTABLE_FIELD(bool, coloredMarkers) = true;
     REFLECTABLE_FIELD(cfg::ManualCalib, manualCalib){};
     REFLECTABLE_FIELD(bool, chessboardCalib) = false;
     REFLECTABLE_FIELD(cfg::Validated<double>, smoothingFactor){0.5, cfg::Clamp(0.0, 1.0)};
+    ATT_SERIAL_COMMENT("shorten smoothingFactor down to half for confidently tracked trackers, for less latency, off by default so existing smoothing is unchanged");
+    REFLECTABLE_FIELD(bool, adaptiveSmoothing) = false;
     REFLECTABLE_FIELD(bool, circularMarkers) = false;
     REFLECTABLE_FIELD(cfg::Validated<double>, trackerCalibDistance){0.5, cfg::GreaterEqual(0.5)};
     /// TODO: change to not validated, gets set during calibration, to indicate if the user has done calibration
@@ -58,14 +64,24 @@ class UserConfig : public serial::Serializable<UserConfig>
     REFLECTABLE_FIELD(bool, trackerCalibCenters) = false;
     REFLECTABLE_FIELD(cfg::Validated<double>, depthSmoothing){0, cfg::Clamp(0.0, 1.0)};
     REFLECTABLE_FIELD(float, additionalSmoothing) = 0;
+    ATT_SERIAL_COMMENT("cutoff in Hz of the adaptive filter applied before sending poses, for still trackers. Lower is steadier but lags more, 0 disables it");
+    REFLECTABLE_FIELD(cfg::Validated<double>, filterMinCutoff){0, cfg::GreaterEqual(0.0)};
+    ATT_SERIAL_COMMENT("cutoff in Hz for the distance from the camera, which is estimated far less precisely");
+    REFLECTABLE_FIELD(cfg::Validated<double>, filterDepthCutoff){0.5, cfg::GreaterEqual(0.01)};
+    ATT_SERIAL_COMMENT("how much the cutoff rises with speed, in Hz per m/s, higher lags less in fast motion");
+    REFLECTABLE_FIELD(cfg::Validated<double>, filterSpeedCoeff){2.0, cfg::GreaterEqual(0.0)};
     REFLECTABLE_FIELD(int, markerLibrary) = 0;
     /// TODO: if (value <= 0) value = 45;
     REFLECTABLE_FIELD(cfg::Validated<int>, markersPerTracker){45, cfg::GreaterEqual(1)};
     REFLECTABLE_FIELD(bool, disableOpenVrApi) = false;
-    REFLECTABLE_FIELD(cfg::Validated<int>, apriltagThreadCount){4, cfg::Clamp(1, 32)};
     REFLECTABLE_FIELD(cfg::List<cfg::VideoStream>, videoStreams){1};
     REFLECTABLE_FIELD(cfg::List<cfg::TrackerUnit>, trackers){3};
-    REFLECTABLE_FIELD(cfg::Validated<int>, detectorThreads){4, cfg::GreaterEqual(1)};
+    ATT_SERIAL_COMMENT("threads shared by marker detection, pose estimation, frame conversion and preview, 0 uses every core");
+    REFLECTABLE_FIELD(cfg::Validated<int>, workerThreads){0, cfg::Clamp(0, 64)};
+    ATT_SERIAL_COMMENT("record frames, detections and poses while tracking to the recordings folder, for debugging");
+    REFLECTABLE_FIELD(bool, recordSession) = false;
+    ATT_SERIAL_COMMENT("only record the pixels around detected markers, a fraction of the size of whole frames");
+    REFLECTABLE_FIELD(bool, recordRegionsOnly) = false;
     REFLECTABLE_END;
 
     CalibrationConfig calib{};
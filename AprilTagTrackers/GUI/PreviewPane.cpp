@@ -68,7 +68,15 @@ void PreviewPane::UpdateImage(const cv::Mat& newImage)
     if (!IsVisible()) return;
 
     ImageLock lock{imageSwapMutex};
-    newImage.copyTo(writeImage);
+    // bitmap conversion expects BGR, grayscale cameras give single channel images
+    if (newImage.channels() == 1)
+    {
+        cv::cvtColor(newImage, writeImage, cv::COLOR_GRAY2BGR);
+    }
+    else
+    {
+        newImage.copyTo(writeImage);
+    }
     writeImageUpdated = true;
     UpdateRatioIfChanged(std::move(lock));
 }
@@ -82,6 +90,7 @@ void PreviewPane::UpdateImage(const cv::Mat& newImage, int constrainSize)
     ImageLock lock{imageSwapMutex};
     const cv::Size2i size = math::ConstrainSize(GetMatSize(newImage), constrainSize);
     cv::resize(newImage, writeImage, size);
+    if (writeImage.channels() == 1) cv::cvtColor(writeImage, writeImage, cv::COLOR_GRAY2BGR);
     writeImageUpdated = true;
     UpdateRatioIfChanged(std::move(lock));
 }
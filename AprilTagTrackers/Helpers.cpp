@@ -10,8 +10,9 @@ void drawMarker(cv::Mat frame, std::vector<cv::Point2f> corners, cv::Scalar colo
     cv::line(frame, cv::Point2i(int(corners[3].x), int(corners[3].y)), cv::Point2i(int(corners[0].x), int(corners[0].y)), color, 2);
 }
 
-void DrawMarker(const cv::Mat& frame, const MarkerCorners2f& corners, const cv::Scalar& color)
+void DrawMarker(const cv::Mat& frame, std::span<const cv::Point2f> corners, const cv::Scalar& color)
 {
+    ATT_ASSERT(corners.size() == math::NUM_CORNERS);
     for (int i = 0; i < 4; i++)
     {
         const int j = (i + 1) % 4;
@@ -14,6 +14,7 @@
 
 #include <array>
 #include <cmath>
+#include <span>
 
 constexpr double PI = 3.14159265358979323846;
 constexpr double RAD_2_DEG = 180.0 / PI;
@@ -68,7 +69,7 @@ inline Pose::Pose(const RodrPose& pose)
 
 using MarkerCorners = std::array<cv::Point2d, 4>;
 
-void DrawMarker(const cv::Mat& frame, const MarkerCorners2f& corners, const cv::Scalar& color);
+void DrawMarker(const cv::Mat& frame, std::span<const cv::Point2f> corners, const cv::Scalar& color);
 void TransformMarkerSpace(const MarkerCorners3f& modelMarker, const RodrPose& boardToCam, const RodrPose& markerToCam, MarkerCorners3f& outMarker);
 void FindMedianMarker(const std::vector<MarkerCorners3f>& markerList, MarkerCorners3f& outMedianMarker);
 
@@ -16,7 +16,7 @@ constexpr int SEC_TO_MS = 1000;
 WindowsNamedPipe::WindowsNamedPipe(std::string pipeName)
     : mPipeName(R"(\\.\pipe\)" + std::move(pipeName)) {}
 
-std::string_view WindowsNamedPipe::SendRecv(std::string message)
+std::string_view WindowsNamedPipe::SendRecv(const std::string& message)
 {
     // NOLINTNEXTLINE: Remove const-ness as callnamedpipe expects a void*, but it will not be modified
     LPVOID messagePtr = reinterpret_cast<LPVOID>(const_cast<char*>(message.data()));
@@ -0,0 +1,393 @@
+#include "MarkerFamilyCache.hpp"
+
+#include "AprilTagWrapper.hpp"
+#include "tagCustom29h10.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Cross.hpp"
+#include "utils/Env.hpp"
+#include "utils/Error.hpp"
+#include "utils/Log.hpp"
+#include "utils/Test.hpp"
+
+#include <apriltag/apriltag.h>
+#include <apriltag/tagCircle21h7.h>
+#include <apriltag/tagStandard41h12.h>
+
+#ifdef ATT_OS_WINDOWS
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <Windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace detail
+{
+
+/// Mirrors the private quick decode table of apriltag (struct quick_decode in apriltag.c),
+/// an open addressing hash table from every code, with up to bitsCorrected bit errors, to its id.
+/// Only read through after MarkerFamilyTable::HasKnownLayout confirmed the layout.
+struct QuickDecodeEntry
+{
+    uint64_t rcode;
+    uint16_t id;
+    uint8_t hamming;
+    uint8_t rotation;
+};
+struct QuickDecodeTable
+{
+    int nentries;
+    const QuickDecodeEntry* entries;
+};
+
+/// read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static std::unique_ptr<MappedFile> TryOpen(const fs::path& filePath)
+    {
+        std::unique_ptr<MappedFile> mapped{new MappedFile()};
+#ifdef ATT_OS_WINDOWS
+        mapped->mFile = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mapped->mFile == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(mapped->mFile, &size) || size.QuadPart == 0) return nullptr;
+        mapped->mMapping = CreateFileMappingW(mapped->mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapped->mMapping == nullptr) return nullptr;
+        const void* data = MapViewOfFile(mapped->mMapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) return nullptr;
+        mapped->mData = static_cast<const uint8_t*>(data);
+        mapped->mSize = static_cast<size_t>(size.QuadPart);
+#else
+        const int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat status{};
+        if (::fstat(fd, &status) != 0 || status.st_size == 0)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        const size_t size = static_cast<size_t>(status.st_size);
+        void* const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (data == MAP_FAILED) return nullptr;
+        mapped->mData = static_cast<const uint8_t*>(data);
+        mapped->mSize = size;
+#endif
+        return mapped;
+    }
+
+    ~MappedFile()
+    {
+#ifdef ATT_OS_WINDOWS
+        if (mData != nullptr) UnmapViewOfFile(mData);
+        if (mMapping != nullptr) CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+#else
+        if (mData != nullptr) ::munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+    }
+
+    const uint8_t* GetData() const { return mData; }
+    size_t GetSize() const { return mSize; }
+
+private:
+    MappedFile() = default;
+
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+#ifdef ATT_OS_WINDOWS
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+#endif
+};
+
+} // namespace detail
+
+namespace
+{
+
+apriltag_family* CreateFamily(MarkerFamily family)
+{
+    if (family == MarkerFamily::Standard41h12) return tagStandard41h12_create();
+    if (family == MarkerFamily::Circle21h7) return tagCircle21h7_create();
+    if (family == MarkerFamily::Custom29h10) return tagCustom29h10_create();
+    utils::Unreachable();
+}
+
+void DestroyFamily(MarkerFamily family, apriltag_family* familyPtr)
+{
+    if (family == MarkerFamily::Standard41h12) return tagStandard41h12_destroy(familyPtr);
+    if (family == MarkerFamily::Circle21h7) return tagCircle21h7_destroy(familyPtr);
+    if (family == MarkerFamily::Custom29h10) return tagCustom29h10_destroy(familyPtr);
+    utils::Unreachable();
+}
+
+/// number of entries apriltag allocates for the table, 3 times the number of codes it stores
+int64_t ExpectedEntryCount(const apriltag_family* family, int bitsCorrected)
+{
+    const int64_t ncodes = family->ncodes;
+    const int64_t nbits = family->nbits;
+    int64_t capacity = ncodes;
+    if (bitsCorrected >= 1) capacity += ncodes * nbits;
+    if (bitsCorrected >= 2) capacity += ncodes * nbits * (nbits - 1);
+    if (bitsCorrected >= 3) capacity += ncodes * nbits * (nbits - 1) * (nbits - 2);
+    return capacity * 3;
+}
+
+/// identifies the codes of a family, so a stored table is never used with different codes
+uint64_t HashFamilyCodes(const apriltag_family* family)
+{
+    constexpr uint64_t fnvOffset = 14695981039346656037ULL;
+    constexpr uint64_t fnvPrime = 1099511628211ULL;
+    uint64_t hash = fnvOffset;
+    const auto addBytes = [&](const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * fnvPrime;
+        }
+    };
+    addBytes(&family->nbits, sizeof(family->nbits));
+    addBytes(family->codes, sizeof(uint64_t) * family->ncodes);
+    return hash;
+}
+
+struct QuickDecodeFileHeader
+{
+    std::array<char, 8> magic;
+    uint32_t entrySize;
+    uint32_t nbits;
+    uint32_t ncodes;
+    uint32_t bitsCorrected;
+    uint64_t codesHash;
+    uint64_t nentries;
+};
+
+constexpr std::array<char, 8> QUICK_DECODE_FILE_MAGIC{'A', 'T', 'T', 'Q', 'D', 'T', '1', '\0'};
+/// entries start on a cache line after the header
+constexpr size_t QUICK_DECODE_FILE_DATA_OFFSET = 64;
+static_assert(sizeof(QuickDecodeFileHeader) <= QUICK_DECODE_FILE_DATA_OFFSET);
+
+QuickDecodeFileHeader MakeFileHeader(const apriltag_family* family, int bitsCorrected)
+{
+    return QuickDecodeFileHeader{
+        QUICK_DECODE_FILE_MAGIC,
+        sizeof(detail::QuickDecodeEntry),
+        family->nbits,
+        family->ncodes,
+        static_cast<uint32_t>(bitsCorrected),
+        HashFamilyCodes(family),
+        static_cast<uint64_t>(ExpectedEntryCount(family, bitsCorrected))};
+}
+
+bool operator==(const QuickDecodeFileHeader& lhs, const QuickDecodeFileHeader& rhs)
+{
+    return lhs.magic == rhs.magic && lhs.entrySize == rhs.entrySize && lhs.nbits == rhs.nbits &&
+           lhs.ncodes == rhs.ncodes && lhs.bitsCorrected == rhs.bitsCorrected &&
+           lhs.codesHash == rhs.codesHash && lhs.nentries == rhs.nentries;
+}
+
+std::string MakeFileName(const apriltag_family* family, int bitsCorrected)
+{
+    return std::string(family->name) + "_" + std::to_string(family->ncodes) + "_" + std::to_string(bitsCorrected) + ".qdt";
+}
+
+} // namespace
+
+MarkerFamilyTable::MarkerFamilyTable(MarkerFamily familyType, int markerIdCount, int bitsCorrected)
+    : mFamilyType(familyType), mBitsCorrected(bitsCorrected), mFamily(CreateFamily(familyType))
+{
+    if (markerIdCount > 0)
+    {
+        // ids are indices into codes, and the quick decode table is built from the first ncodes,
+        // so the family is truncated to the ids in use. The codes are still freed by the family destroy.
+        mFamily->ncodes = std::min(mFamily->ncodes, static_cast<uint32_t>(markerIdCount));
+    }
+}
+
+MarkerFamilyTable::~MarkerFamilyTable()
+{
+    if (mBuilder != nullptr)
+    {
+        // frees the table apriltag built
+        apriltag_detector_destroy(mBuilder);
+    }
+    else
+    {
+        // mapped table is not owned by apriltag
+        mFamily->impl = nullptr;
+    }
+    DestroyFamily(mFamilyType, mFamily);
+}
+
+void MarkerFamilyTable::AttachTo(apriltag_detector* detector) const
+{
+    ATT_ASSERT(mFamily->impl != nullptr);
+    // apriltag only builds the table if the family doesn't have one yet
+    apriltag_detector_add_family_bits(detector, mFamily, mBitsCorrected);
+}
+
+void MarkerFamilyTable::DetachAll(apriltag_detector* detector)
+{
+    // apriltag_detector_destroy frees the table of every family still added
+    zarray_clear(detector->tag_families);
+}
+
+void MarkerFamilyTable::Build()
+{
+    ATT_ASSERT(mBuilder == nullptr && mFamily->impl == nullptr);
+    mBuilder = apriltag_detector_create();
+    apriltag_detector_add_family_bits(mBuilder, mFamily, mBitsCorrected);
+    if (mFamily->impl == nullptr) throw utils::MakeError("failed to allocate quick decode table for ", mFamily->name);
+}
+
+bool MarkerFamilyTable::HasKnownLayout() const
+{
+    const auto* table = static_cast<const detail::QuickDecodeTable*>(mFamily->impl);
+    // checked before reading anything else, any other layout stores something else first
+    if (table == nullptr || table->nentries != ExpectedEntryCount(mFamily, mBitsCorrected)) return false;
+
+    // every code must be found in its probe sequence without bit errors
+    for (uint32_t id = 0; id < mFamily->ncodes; ++id)
+    {
+        const uint64_t code = mFamily->codes[id];
+        bool found = false;
+        for (uint64_t bucket = code % table->nentries; table->entries[bucket].rcode != UINT64_MAX; bucket = (bucket + 1) % table->nentries)
+        {
+            const detail::QuickDecodeEntry& entry = table->entries[bucket];
+            if (entry.rcode != code) continue;
+            found = entry.id == id && entry.hamming == 0;
+            break;
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+bool MarkerFamilyTable::TryLoad(const fs::path& filePath)
+{
+    ATT_ASSERT(mBuilder == nullptr && mFamily->impl == nullptr);
+    std::unique_ptr<detail::MappedFile> mapping = detail::MappedFile::TryOpen(filePath);
+    if (!mapping) return false;
+
+    const QuickDecodeFileHeader expectedHeader = MakeFileHeader(mFamily, mBitsCorrected);
+    const size_t expectedSize = QUICK_DECODE_FILE_DATA_OFFSET + expectedHeader.nentries * sizeof(detail::QuickDecodeEntry);
+    if (mapping->GetSize() != expectedSize) return false;
+    QuickDecodeFileHeader header{};
+    std::memcpy(&header, mapping->GetData(), sizeof(header));
+    if (!(header == expectedHeader)) return false;
+
+    auto table = std::make_unique<detail::QuickDecodeTable>();
+    table->nentries = static_cast<int>(header.nentries);
+    table->entries = reinterpret_cast<const detail::QuickDecodeEntry*>(mapping->GetData() + QUICK_DECODE_FILE_DATA_OFFSET);
+    mFamily->impl = table.get();
+    if (!HasKnownLayout())
+    {
+        mFamily->impl = nullptr;
+        return false;
+    }
+
+    mMapping = std::move(mapping);
+    mMappedTable = std::move(table);
+    return true;
+}
+
+bool MarkerFamilyTable::TrySave(const fs::path& filePath) const
+{
+    if (!HasKnownLayout()) return false;
+    const auto* table = static_cast<const detail::QuickDecodeTable*>(mFamily->impl);
+
+    std::error_code error;
+    fs::create_directories(filePath.parent_path(), error);
+    if (error) return false;
+
+    // write to a temporary, so another instance never maps a partially written file
+    fs::path tempPath = filePath;
+    tempPath += ".tmp";
+    {
+        std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+        const QuickDecodeFileHeader header = MakeFileHeader(mFamily, mBitsCorrected);
+        std::array<char, QUICK_DECODE_FILE_DATA_OFFSET> headerBlock{};
+        std::memcpy(headerBlock.data(), &header, sizeof(header));
+        file.write(headerBlock.data(), headerBlock.size());
+        file.write(reinterpret_cast<const char*>(table->entries), static_cast<std::streamsize>(sizeof(detail::QuickDecodeEntry) * table->nentries));
+        if (!file) return false;
+    }
+    fs::rename(tempPath, filePath, error);
+    return !error;
+}
+
+MarkerFamilyCache::MarkerFamilyCache(fs::path directory)
+    : mDirectory(std::move(directory)) {}
+
+MarkerFamilyCache& MarkerFamilyCache::Get()
+{
+    static MarkerFamilyCache cache{utils::GetCacheDir()};
+    return cache;
+}
+
+std::shared_ptr<const MarkerFamilyTable> MarkerFamilyCache::GetTable(MarkerFamily family, int markerIdCount, int bitsCorrected)
+{
+    std::lock_guard lock{mMutex};
+    const Key key{family, markerIdCount, bitsCorrected};
+    if (const auto it = mTables.find(key); it != mTables.end()) return it->second;
+
+    std::shared_ptr<MarkerFamilyTable> table{new MarkerFamilyTable(family, markerIdCount, bitsCorrected)};
+    const fs::path filePath = mDirectory / MakeFileName(table->GetFamily(), bitsCorrected);
+    if (!table->TryLoad(filePath))
+    {
+        table->Build();
+        if (!table->TrySave(filePath)) ATT_LOG_WARN("quick decode table not stored in cache: ", filePath.string());
+    }
+    mTables.emplace(key, table);
+    return table;
+}
+
+TEST_CASE("MarkerFamilyCache stores and maps quick decode tables")
+{
+    const fs::path directory = fs::temp_directory_path() / "att_test_marker_family_cache";
+    fs::remove_all(directory);
+    constexpr int markerIdCount = 20;
+
+    {
+        MarkerFamilyCache buildCache{directory};
+        const auto built = buildCache.GetTable(MarkerFamily::Standard41h12, markerIdCount);
+        CHECK_NOT(built->IsMapped());
+        // same table is shared
+        CHECK(buildCache.GetTable(MarkerFamily::Standard41h12, markerIdCount) == built);
+
+        MarkerFamilyCache mapCache{directory};
+        const auto mapped = mapCache.GetTable(MarkerFamily::Standard41h12, markerIdCount);
+        CHECK(mapped->IsMapped());
+        CHECK(mapped->GetFamily()->ncodes == markerIdCount);
+
+        const auto* builtTable = static_cast<const detail::QuickDecodeTable*>(built->GetFamily()->impl);
+        const auto* mappedTable = static_cast<const detail::QuickDecodeTable*>(mapped->GetFamily()->impl);
+        REQUIRE(builtTable->nentries == mappedTable->nentries);
+        CHECK(std::memcmp(builtTable->entries, mappedTable->entries, sizeof(detail::QuickDecodeEntry) * builtTable->nentries) == 0);
+
+        // a table for other ids does not match the stored file
+        const auto other = mapCache.GetTable(MarkerFamily::Standard41h12, markerIdCount + 1);
+        CHECK_NOT(other->IsMapped());
+    }
+    // the tables are unmapped once both caches are gone, so the files can be removed
+    fs::remove_all(directory);
+}
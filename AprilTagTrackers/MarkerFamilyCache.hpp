@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+enum class MarkerFamily;
+struct apriltag_detector;
+struct apriltag_family;
+
+namespace detail
+{
+class MappedFile;
+struct QuickDecodeTable;
+} // namespace detail
+
+/// apriltag family together with its quick decode table.
+/// Read only once created, a single table is shared by every detector that uses the same family.
+class MarkerFamilyTable
+{
+public:
+    MarkerFamilyTable(const MarkerFamilyTable&) = delete;
+    MarkerFamilyTable& operator=(const MarkerFamilyTable&) = delete;
+    ~MarkerFamilyTable();
+
+    /// add the family to a detector, the table is already built so the detector will not build its own
+    void AttachTo(apriltag_detector* detector) const;
+    /// remove every family from a detector without freeing the shared table,
+    /// must be called before apriltag_detector_destroy
+    static void DetachAll(apriltag_detector* detector);
+
+    apriltag_family* GetFamily() const { return mFamily; }
+    int GetBitsCorrected() const { return mBitsCorrected; }
+    /// table was loaded from the cache directory, rather than built
+    bool IsMapped() const { return mMapping != nullptr; }
+
+private:
+    friend class MarkerFamilyCache;
+
+    MarkerFamilyTable(MarkerFamily familyType, int markerIdCount, int bitsCorrected);
+
+    /// build the table with apriltag, owned by mBuilder
+    void Build();
+    /// use a table previously written by Save, false if the file is missing or does not match this family
+    bool TryLoad(const std::filesystem::path& filePath);
+    bool TrySave(const std::filesystem::path& filePath) const;
+    /// check the table has the layout of apriltag's quick decode table, required to save or load
+    bool HasKnownLayout() const;
+
+    MarkerFamily mFamilyType;
+    int mBitsCorrected;
+    apriltag_family* mFamily = nullptr;     /// owning
+    apriltag_detector* mBuilder = nullptr;  /// owning, holds the table when built
+    std::unique_ptr<detail::MappedFile> mMapping;
+    std::unique_ptr<detail::QuickDecodeTable> mMappedTable;
+};
+
+/// Builds quick decode tables once, then stores them in a directory keyed by family, id count and bits corrected.
+/// Later runs memory map the stored table instead of building it, which takes most of the detector construction time.
+class MarkerFamilyCache
+{
+public:
+    /// same as apriltag_detector_add_family
+    static constexpr int DEFAULT_BITS_CORRECTED = 2;
+
+    explicit MarkerFamilyCache(std::filesystem::path directory);
+
+    /// process wide cache, stored in the runtime cache directory
+    static MarkerFamilyCache& Get();
+
+    /// @param markerIdCount only decode ids [0, markerIdCount), 0 decodes the whole family
+    std::shared_ptr<const MarkerFamilyTable> GetTable(MarkerFamily family, int markerIdCount, int bitsCorrected = DEFAULT_BITS_CORRECTED);
+
+private:
+    using Key = std::tuple<MarkerFamily, int, int>;
+
+    std::filesystem::path mDirectory;
+    std::mutex mMutex;
+    /// tables are kept for the lifetime of the cache, so restarting tracking reuses them
+    std::map<Key, std::shared_ptr<const MarkerFamilyTable>> mTables;
+};
@@ -2,11 +2,24 @@
 
 #include "utils/Assert.hpp"
 #include "utils/Log.hpp"
+#include "utils/SteadyTimer.hpp"
 
 #include <opencv2/core/utils/logger.hpp>
 
+#include <string>
+#include <string_view>
+
 wxIMPLEMENT_APP(MyApp); // NOLINT
 
+namespace
+{
+
+/// calibrate from recorded frames and exit, instead of opening the gui, followed by a video file or image sequence
+constexpr std::string_view CALIBRATE_CAMERA_ARG = "--calibrate-camera";
+constexpr std::string_view CALIBRATE_TRACKERS_ARG = "--calibrate-trackers";
+
+} // namespace
+
 int MyApp::OnExit()
 {
     tracker->Stop();
@@ -42,11 +55,47 @@ bool MyApp::OnInit()
     lc.LoadLang(userConfig.langCode);
 
     tracker = std::make_unique<Tracker>(userConfig, userConfig.calib, arucoConfig, lc);
+
+    ParseCommandLine();
+    if (IsOfflineCalibration()) return true; // see OnRun
+
     gui = std::make_unique<GUI>(tracker, lc, userConfig);
 
     return true;
 }
 
+int MyApp::OnRun()
+{
+    if (IsOfflineCalibration()) return RunOfflineCalibration();
+    return wxApp::OnRun();
+}
+
+void MyApp::ParseCommandLine()
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        const std::string arg{argv[i].ToUTF8().data()};
+        if (arg == CALIBRATE_CAMERA_ARG)
+        {
+            cameraCalibFrames = argv[++i].ToUTF8().data();
+        }
+        else if (arg == CALIBRATE_TRACKERS_ARG)
+        {
+            trackerCalibFrames = argv[++i].ToUTF8().data();
+        }
+    }
+}
+
+int MyApp::RunOfflineCalibration()
+{
+    utils::SteadyTimer timer{};
+    // the trackers are calibrated with the new camera calibration, when both are given
+    if (!cameraCalibFrames.empty() && !tracker->CalibrateCameraFromFile(cameraCalibFrames)) return 1;
+    if (!trackerCalibFrames.empty() && !tracker->CalibrateTrackerFromFile(trackerCalibFrames)) return 1;
+    ATT_LOG_INFO("offline calibration done in ", duration_cast<utils::FSeconds>(timer.Get()).count(), " s");
+    return 0;
+}
+
 #ifdef ATT_DEBUG
 
 #    define ATT_FATAL_EXCEPTION(p_throwExpr, p_context)            \
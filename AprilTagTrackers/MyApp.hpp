@@ -10,6 +10,8 @@
 
 #include <wx/app.h>
 
+#include <string>
+
 class MyApp : public wxApp
 {
     utils::EnvVars envVars{};
@@ -22,9 +24,19 @@ class MyApp : public wxApp
     ArucoConfig arucoConfig;
     Localization lc;
 
+    /// recorded frames to calibrate from, given on the command line
+    std::string cameraCalibFrames;
+    std::string trackerCalibFrames;
+
+    void ParseCommandLine();
+    bool IsOfflineCalibration() const { return !cameraCalibFrames.empty() || !trackerCalibFrames.empty(); }
+    /// @return exit code
+    int RunOfflineCalibration();
+
 public:
     int OnExit() override;
     bool OnInit() override;
+    int OnRun() override;
 
 #ifdef ATT_DEBUG
     void OnFatalException() override;
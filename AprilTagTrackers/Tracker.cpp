@@ -5,11 +5,15 @@
 #include "Helpers.hpp"
 #include "ImageDrawing.hpp"
 #include "math/CVHelpers.hpp"
+#include "math/ViewScorer.hpp"
+#include "tracker/CharucoCalibrator.hpp"
 #include "tracker/MainLoopRunner.hpp"
+#include "tracker/TrackerCalibrator.hpp"
 #include "tracker/TrackerUnit.hpp"
 #include "utils/Assert.hpp"
 #include "utils/LogBatch.hpp"
 #include "utils/SteadyTimer.hpp"
+#include "utils/TaskScheduler.hpp"
 #include "utils/Types.hpp"
 
 #include <opencv2/aruco.hpp>
@@ -24,6 +28,8 @@
 #include <algorithm>
 #include <array>
 #include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <mutex>
 #include <random>
@@ -36,6 +42,7 @@ Tracker::Tracker(UserConfig& _userConfig, CalibrationConfig& _calibConfig, Aruco
 {
     SetTrackerUnitsFromConfig();
     mPlayspace.Set(user_config.manualCalib.GetAsReal());
+    utils::TaskScheduler::Get().SetThreadCount(user_config.workerThreads);
 }
 
 void Tracker::StartCamera(RefPtr<cfg::Camera> cam)
@@ -128,7 +135,7 @@ void Tracker::CameraLoop()
             if (gui->IsPreviewVisible(PreviewId::Camera))
             {
                 previewTimer.Restart(stampAfterCap);
-                frame.image.copyTo(drawImg);
+                AprilTagWrapper::ConvertDrawImage(frame.image, drawImg);
                 cv::putText(drawImg, std::to_string(fps),
                             cv::Point(10, 60), cv::FONT_HERSHEY_SIMPLEX, 2, cv::Scalar(0, 255, 0), 2);
                 const std::string resolution = std::to_string(frame.image.cols) + "x" + std::to_string(frame.image.rows);
@@ -187,18 +194,9 @@ void Tracker::CalibrateCameraCharuco()
     cv::Mat gray;
     cv::Mat drawImg;
 
-    cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
-    cv::Ptr<cv::aruco::DetectorParameters> params = cv::aruco::DetectorParameters::create();
-
-    // generate and show our charuco board that will be used for calibration
-    cv::Ptr<cv::aruco::CharucoBoard> board = cv::aruco::CharucoBoard::create(8, 7, 0.04f, 0.02f, dictionary);
-    cv::Mat boardImage;
-
-    // set our detectors marker border bits to 1 since thats what charuco uses
-    params->markerBorderBits = 1;
-
-    // int framesSinceLast = -2 * user_config.camFps;
-    auto timeOfLast = std::chrono::steady_clock::now();
+    tracker::CharucoCalibrator calibrator;
+    tracker::CharucoMarkers markers;
+    tracker::CharucoView view;
 
     bool promptSaveCalib = false;
     gui->ShowPrompt(lc.TRACKER_CAMERA_CALIBRATION_INSTRUCTIONS,
@@ -207,72 +205,30 @@ void Tracker::CalibrateCameraCharuco()
                         mainThreadRunning = false;
                     });
 
-    cv::Mat cameraMatrix, distCoeffs, R, T;
-    cv::Mat1d stdDeviationsIntrinsics, stdDeviationsExtrinsics;
-    std::vector<double> perViewErrors;
-    std::vector<std::vector<cv::Point2f>> allCharucoCorners;
-    std::vector<std::vector<int>> allCharucoIds;
-
-    std::vector<int> markerIds;
-    std::vector<std::vector<cv::Point2f>> markerCorners;
-    std::vector<std::vector<cv::Point2f>> rejectedCorners;
-
     auto preview = gui->CreatePreviewControl();
 
-    int picsTaken = 0;
     while (mainThreadRunning && cameraRunning)
     {
         mCameraFrame.Get(frame);
-        frame.image.copyTo(drawImg);
-        cv::putText(drawImg, std::to_string(picsTaken), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
-
-        drawCalibration(
-            drawImg,
-            cameraMatrix,
-            distCoeffs,
-            stdDeviationsIntrinsics,
-            perViewErrors,
-            allCharucoCorners,
-            allCharucoIds);
+        AprilTagWrapper::ConvertDrawImage(frame.image, drawImg);
+        std::ostringstream status;
+        status << calibrator.GetViewCount();
+        if (calibrator.IsCalibrated()) status << "  " << std::fixed << std::setprecision(2) << calibrator.GetReprojectionError() << " px";
+        cv::putText(drawImg, status.str(), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
 
-        // check the highest per view error and remove it if its higher than 1px.
-
-        if (perViewErrors.size() > 10)
-        {
-            double maxPerViewError = 0;
-            int maxPerViewErrorIdx = 0;
+        // the parts of the image and the tilts of the board still missing, so the user knows where to hold it
+        calibrator.DrawCoverage(drawImg);
+        drawCalibration(drawImg, calibrator.GetCalib());
 
-            for (int i = 0; i < perViewErrors.size(); i++)
-            {
-                if (perViewErrors[i] > maxPerViewError)
-                {
-                    maxPerViewError = perViewErrors[i];
-                    maxPerViewErrorIdx = i;
-                }
-            }
-
-            if (maxPerViewError > 1)
-            {
-                perViewErrors.erase(perViewErrors.begin() + maxPerViewErrorIdx);
-                allCharucoCorners.erase(allCharucoCorners.begin() + maxPerViewErrorIdx);
-                allCharucoIds.erase(allCharucoIds.begin() + maxPerViewErrorIdx);
-
-                // recalibrate camera without the problematic frame
-                cv::aruco::calibrateCameraCharuco(allCharucoCorners, allCharucoIds, board, math::GetMatSize(frame.image),
-                                                  cameraMatrix, distCoeffs, R, T, stdDeviationsIntrinsics, stdDeviationsExtrinsics, perViewErrors,
-                                                  cv::CALIB_USE_LU);
-
-                picsTaken--;
-            }
-        }
+        // check the highest per view error and remove it if its higher than 1px.
+        calibrator.RemoveWorstView();
+        // the camera is solved on a worker, so the preview keeps up with the camera while it solves
+        calibrator.Update(math::GetMatSize(frame.image));
 
-        cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
-        cv::aruco::detectMarkers(gray, dictionary, markerCorners, markerIds, params, rejectedCorners);
+        AprilTagWrapper::ConvertGrayscale(frame.image, gray);
+        calibrator.DetectMarkers(gray, markers);
 
-        // TODO: If markers are detected, the image gets updated, and then the calibration timer below
-        // captures another image, in the time before the opencv loop updates the preview on screen,
-        // then the masked out tags will still be visible, it probably won't effect much though.
-        for (const auto& corners : markerCorners)
+        for (const auto& corners : markers.corners)
         {
             ATT_ASSERT(static_cast<int>(corners.size()) == 4, "A square has four corners.");
             const std::array<cv::Point, 4> points = {corners[0], corners[1], corners[2], corners[3]};
@@ -282,58 +238,21 @@ void Tracker::CalibrateCameraCharuco()
 
         preview.Update(drawImg, DRAW_IMG_SIZE);
 
-        // if more than one second has passed since last calibration image, add current frame to calibration images
-        // framesSinceLast++;
-        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - timeOfLast).count() > 1)
+        // every frame is a candidate, but only views that cover something new are added,
+        // the next update calibrates the camera using our data
+        if (calibrator.FindView(gray, markers, view))
         {
-            // framesSinceLast = 0;
-            timeOfLast = std::chrono::steady_clock::now();
-            // if any button was pressed
-
-            // detect our markers
-            cv::aruco::refineDetectedMarkers(gray, board, markerCorners, markerIds, rejectedCorners);
-
-            if (markerIds.size() > 0)
-            {
-                // if markers were found, try to add calibration data
-                std::vector<cv::Point2f> charucoCorners;
-                std::vector<int> charucoIds;
-                // using data from aruco detection we refine the search of chessboard corners for higher accuracy
-                cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, gray, board, charucoCorners, charucoIds);
-                if (charucoIds.size() > 15)
-                {
-                    // if corners were found, we draw them
-                    // cv::aruco::drawDetectedCornersCharuco(drawImg, charucoCorners, charucoIds);
-                    // we then add our corners to the array
-                    allCharucoCorners.push_back(charucoCorners);
-                    allCharucoIds.push_back(charucoIds);
-                    picsTaken++;
-
-                    if (picsTaken >= 3)
-                    {
-                        try
-                        {
-                            // Calibrate camera using our data
-                            cv::aruco::calibrateCameraCharuco(allCharucoCorners, allCharucoIds, board, math::GetMatSize(frame.image),
-                                                              cameraMatrix, distCoeffs, R, T, stdDeviationsIntrinsics, stdDeviationsExtrinsics, perViewErrors,
-                                                              cv::CALIB_USE_LU);
-                        }
-                        catch (const cv::Exception& e)
-                        {
-                            ATT_LOG_ERROR(e.what());
-                        }
-
-                        std::size_t curI = perViewErrors.size();
-                    }
-                }
-            }
+            const math::ViewScore score = calibrator.ScoreView(view, math::GetMatSize(frame.image));
+            if (calibrator.IsUseful(score)) calibrator.AddView(std::move(view), score);
         }
     }
 
     mainThreadRunning = false;
     if (promptSaveCalib)
     {
-        if (cameraMatrix.empty())
+        // include the views added since the last background calibration
+        if (!frame.image.empty()) calibrator.Calibrate(math::GetMatSize(frame.image));
+        if (!calibrator.IsCalibrated())
         {
             gui->ShowPopup(lc.TRACKER_CAMERA_CALIBRATION_NOTDONE, PopupStyle::Warning);
         }
@@ -380,20 +299,54 @@ void Tracker::CalibrateCameraCharuco()
             }
             */
 
-            // Save calibration to our global params cameraMatrix and distCoeffs
-            RefPtr<cfg::CameraCalib> camCalib = calib_config.cameras[0];
-            camCalib->cameraMatrix = cameraMatrix;
-            camCalib->distortionCoeffs = distCoeffs;
-            camCalib->stdDeviationsIntrinsics = stdDeviationsIntrinsics;
-            camCalib->perViewErrors = perViewErrors;
-            camCalib->allCharucoCorners = allCharucoCorners;
-            camCalib->allCharucoIds = allCharucoIds;
-            calib_config.Save();
+            SaveCameraCalib(calibrator);
             gui->ShowPopup(lc.TRACKER_CAMERA_CALIBRATION_COMPLETE, PopupStyle::Info);
         }
     }
 }
 
+namespace
+{
+
+/// chessboards are searched for on the frame downscaled to this width, so the preview keeps up on 1080p cameras
+constexpr int CHESSBOARD_DETECT_MAX_WIDTH = 640;
+/// full resolution region the corners are refined in, grown by this many pixels around the corners found,
+/// more than half the refinement window plus the error of corners found downscaled
+constexpr int CHESSBOARD_ROI_MARGIN = 20;
+
+/// quick check for the chessboard on a downscaled frame, the corners are only refined at full resolution
+/// around the board when it is found, most frames without a board end at the fast check
+bool FindChessboard(const cv::Mat& gray, cv::Size patternSize, std::vector<cv::Point2f>& outCorners)
+{
+    cv::Mat small;
+    const double scale = math::DownscaleForDetection(gray, small, CHESSBOARD_DETECT_MAX_WIDTH);
+    if (!cv::findChessboardCorners(small, patternSize, outCorners,
+                                   cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK))
+    {
+        return false;
+    }
+    for (cv::Point2f& corner : outCorners)
+    {
+        corner = (corner + cv::Point2f(0.5F, 0.5F)) * static_cast<float>(scale) - cv::Point2f(0.5F, 0.5F);
+    }
+
+    const cv::Rect roi = math::PaddedBoundingRect(outCorners, CHESSBOARD_ROI_MARGIN, math::GetMatSize(gray));
+    const cv::Point2f offset(static_cast<float>(roi.x), static_cast<float>(roi.y));
+    for (cv::Point2f& corner : outCorners)
+    {
+        corner -= offset;
+    }
+    const cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
+    cv::cornerSubPix(gray(roi), outCorners, cv::Size(11, 11), cv::Size(-1, -1), criteria);
+    for (cv::Point2f& corner : outCorners)
+    {
+        corner += offset;
+    }
+    return true;
+}
+
+} // namespace
+
 void Tracker::CalibrateCamera()
 {
     // old calibration function, only still here for legacy reasons.
@@ -437,16 +390,18 @@ void Tracker::CalibrateCamera()
     bool success;
 
     tracker::CapturedFrame frame;
+    cv::Mat gray;
     cv::Mat outImg;
 
     int i = 0;
-    int framesSinceLast = -100;
 
     int picNum = user_config.cameraCalibSamples;
 
     cv::Size2i imageSize;
+    // views are taken when they cover something new, instead of once every 50 frames
+    math::ViewScorer scorer;
 
-    while (i < picNum)
+    while (i < picNum && !scorer.IsComplete())
     {
         if (!mainThreadRunning || !cameraRunning)
         {
@@ -454,37 +409,31 @@ void Tracker::CalibrateCamera()
         }
         mCameraFrame.Get(frame);
         cv::Mat& image = frame.image;
-        cv::putText(image, std::to_string(i) + "/" + std::to_string(picNum), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
-        const cv::Size2i drawSize = math::ConstrainSize(math::GetMatSize(image), DRAW_IMG_SIZE);
-
-        framesSinceLast++;
-        if (framesSinceLast > 50)
-        {
-            framesSinceLast = 0;
-            cv::cvtColor(image, image, cv::COLOR_BGR2GRAY);
+        imageSize = math::GetMatSize(image);
+        if (scorer.GetImageSize() != imageSize) scorer.SetCamera(imageSize, cv::Mat(), cv::Mat());
+        const cv::Size2i drawSize = math::ConstrainSize(imageSize, DRAW_IMG_SIZE);
 
-            success = findChessboardCorners(image, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts);
+        AprilTagWrapper::ConvertGrayscale(image, gray);
+        success = FindChessboard(gray, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts);
 
-            if (success)
+        if (success)
+        {
+            const math::ViewScore score = scorer.Score(objp, corner_pts);
+            if (scorer.IsUseful(score))
             {
                 i++;
-                cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
-
-                cornerSubPix(image, corner_pts, cv::Size(11, 11), cv::Size(-1, -1), criteria);
-
-                drawChessboardCorners(image, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts, success);
-
+                scorer.Add(score);
                 objpoints.push_back(objp);
                 imgpoints.push_back(corner_pts);
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            drawChessboardCorners(image, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts, success);
         }
 
+        scorer.DrawMissing(image);
+        cv::putText(image, std::to_string(i) + "/" + std::to_string(picNum), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
         cv::resize(image, outImg, drawSize);
         gui->UpdatePreview(outImg);
-
-        imageSize = math::GetMatSize(frame.image);
     }
 
     cv::Mat cameraMatrix, distCoeffs, R, T;
@@ -642,6 +591,7 @@ void Tracker::Stop()
 
 void Tracker::UpdateConfig()
 {
+    utils::TaskScheduler::Get().SetThreadCount(user_config.workerThreads);
     if (mVRDriver)
     {
         mVRDriver->SetSmoothing(user_config.smoothingFactor, user_config.additionalSmoothing);
@@ -659,142 +609,208 @@ void Tracker::CalibrateTracker()
                         mainThreadRunning = false;
                     });
 
-    // initialize all parameters needed for tracker calibration
-    std::vector<tracker::TrackerUnit> trackerUnits;
-
-    AprilTagWrapper april{AprilTagWrapper::ConvertFamily(user_config.markerLibrary), user_config.videoStreams[0]->quadDecimate, user_config.detectorThreads};
+    const AprilTagPool::Lease april = AprilTagPool::Get().Acquire(
+        AprilTagWrapper::ConvertFamily(user_config.markerLibrary), user_config.videoStreams[0]->quadDecimate,
+        AprilTagWrapper::MarkerIdCount(user_config.trackerNum, user_config.markersPerTracker));
     MarkerDetectionList dets{};
 
-    const Index trackerNum = user_config.trackerNum;
-    const int markersPerTracker = user_config.markersPerTracker;
-    const double markerSize = user_config.markerSize * 0.01; // centimeters to meters
-
-    const MarkerCorners3f modelMarker = tracker::TrackerUnit::CreateModelMarker(markerSize);
-    constexpr int numCachedToAdd = 50;
-    /// maps marker id to many copies of its corners
-    std::unordered_map<int, std::vector<MarkerCorners3f>> markersCache;
-
-    // add main marker for every tracker
-    for (int i = 0; i < trackerNum; i++)
-    {
-        tracker::TrackerUnit unit;
-        // TODO: dynamically pick the main marker, based on the first seen? need some gui to help as multiple marker tend to get detected in the background while calibrating.
-        // might be helpful to draw the id of the marker on each detected, and then some gui to select which detected marker is the main, and which should be added to this one.
-        // it should be easy to detect if two markers are moving together, and separate from one not moving in the background
-        const int id = i * user_config.markersPerTracker;
-        unit.AddMarker(id, modelMarker);
-        trackerUnits.push_back(std::move(unit));
-    }
+    tracker::TrackerCalibrator calibrator(user_config, *calib_config.cameras[0]);
 
     tracker::CapturedFrame frame;
     cv::Mat grayImage;
-
-    math::EstimatePoseSingleMarkersResult markerPoses;
-    const RefPtr<cfg::CameraCalib> camCalib = calib_config.cameras[0];
     auto preview = gui->CreatePreviewControl();
 
-    // TODO: temporary make code easier by allowing returns and handling exceptions properly within loop
-    // will be refactored to another class, but easier than pulling out to another function due to amount of state
-    const auto doStep = [&] {
-        mCameraFrame.Get(frame);
-        // detect and draw all markers on image
-        AprilTagWrapper::ConvertGrayscale(frame.image, grayImage);
-        april.DetectMarkers(grayImage, dets);
-        if (showTimeProfile)
+    // run loop until we stop it
+    while (cameraRunning && mainThreadRunning)
+    {
+        try
+        {
+            mCameraFrame.Get(frame);
+            // detect and draw all markers on image
+            AprilTagWrapper::ConvertGrayscale(frame.image, grayImage);
+            if (frame.image.channels() == 1) AprilTagWrapper::ConvertDrawImage(grayImage, frame.image);
+            april->DetectMarkers(grayImage, dets);
+            if (showTimeProfile)
+            {
+                april->DrawTimeProfile(frame.image, cv::Point(10, 60));
+            }
+            calibrator.Update(dets, frame.image);
+            if (preview.IsVisible()) preview.Update(frame.image, DRAW_IMG_SIZE);
+        }
+        catch (const std::exception& e)
         {
-            april.DrawTimeProfile(frame.image, cv::Point(10, 60));
+            ATT_LOG_ERROR(e.what());
+            gui->ShowPopup(lc.TRACKER_CALIBRATION_SOMETHINGWRONG, PopupStyle::Error);
+            mainThreadRunning = false;
+            return;
         }
-        // draw all markers blue. We will overwrite this with other colors for markers that are part of any of the trackers that we use
-        cv::aruco::drawDetectedMarkers(frame.image, dets.corners, dets.ids, COLOR_MARKER_DETECTED);
+    }
+    mainThreadRunning = false;
 
-        math::EstimatePoseSingleMarkers(dets.corners, markerSize, *camCalib, markerPoses);
-        ATT_ASSERT(markerPoses.positions.size() == dets.ids.size());
-        ATT_ASSERT(markerPoses.rotations.size() == dets.ids.size());
-        const double maxDist = user_config.trackerCalibDistance;
+    if (promptSaveCalib)
+    {
+        SaveTrackerUnitsToCalib(calibrator.Finish());
+        SetTrackerUnitsFromConfig();
+    }
+}
 
-        // TODO: stop using hardcoded tracker roles
-        /// 0 = waist, 1 = left foot, 2 = right foot
-        for (int trackerIndex = 0; trackerIndex < trackerNum; ++trackerIndex)
-        {
-            auto& unit = trackerUnits[trackerIndex];
-            // on weird images or calibrations, throws exception. This should usually only happen on bad camera calibrations, or in very rare cases
-            auto [boardPose, estimated] = math::EstimatePoseTracker(dets.corners, dets.ids, unit.GetArucoBoard(), *camCalib);
-            if (estimated == 0) continue; // no existing markers in this tracker were detected, can't add new ones to it
+namespace
+{
 
-            cv::drawFrameAxes(frame.image, camCalib->cameraMatrix, camCalib->distortionCoeffs, boardPose.rotation.value, boardPose.position, 0.1F);
+/// recorded frames decoded before processing them on every worker at once
+constexpr int RECORDED_BATCH_FRAMES = 64;
 
-            bool foundMarkerToCalibrate = false;
-            for (Index detIndex = 0; detIndex < static_cast<Index>(dets.ids.size()); ++detIndex)
-            {
-                const int detId = dets.ids[detIndex];
-                const MarkerCorners2f& detCorners = dets.corners[detIndex];
-                const RodrPose detMarkerPose{markerPoses.positions[detIndex], math::RodriguesVec3d(markerPoses.rotations[detIndex])};
+/// Frames of a video file, or of an image sequence like frames/%04d.png, read as fast as they decode.
+class RecordedFrames
+{
+public:
+    explicit RecordedFrames(const std::string& path)
+        : mCapture(path) {}
 
-                // if marker is part of current tracker (usualy, 0 is 0-44, 1 is 45-89 etc), if not, continue to next detection
-                if (detId < (trackerIndex * markersPerTracker) || detId >= ((trackerIndex + 1) * markersPerTracker))
-                {
-                    continue;
-                }
+    bool IsOpen() const { return mCapture.isOpened(); }
+    int GetFramesRead() const { return mFramesRead; }
 
-                // the main markers are already added above
-                if (unit.HasMarkerId(detId)) // already added to a tracker, draw it green and continue to next detection
-                {
-                    DrawMarker(frame.image, detCorners, COLOR_MARKER_ADDED);
-                    continue;
-                }
-                ATT_ASSERT(detId % markersPerTracker != 0, "main marker already added");
+    /// read the next frames in capture order, empty once every frame was read
+    void ReadBatch(std::vector<cv::Mat>& outBatch)
+    {
+        outBatch.clear();
+        while (static_cast<int>(outBatch.size()) < RECORDED_BATCH_FRAMES)
+        {
+            // every frame of the batch needs its own buffer
+            cv::Mat image;
+            if (!mCapture.read(image) || image.empty()) break;
+            outBatch.push_back(std::move(image));
+            ++mFramesRead;
+        }
+    }
 
-                // if marker is too far away from camera, paint it purple, as adding it could have too much error
-                if (Length(detMarkerPose.position) > maxDist)
-                {
-                    DrawMarker(frame.image, detCorners, COLOR_MARKER_FAR);
-                    continue;
-                }
+private:
+    cv::VideoCapture mCapture;
+    int mFramesRead = 0;
+};
 
-                DrawMarker(frame.image, detCorners, COLOR_MARKER_ADDING);
+} // namespace
 
-                if (foundMarkerToCalibrate) continue;
-                foundMarkerToCalibrate = true;
+bool Tracker::CalibrateCameraFromFile(const std::string& path)
+{
+    RecordedFrames frames(path);
+    if (!frames.IsOpen())
+    {
+        ATT_LOG_ERROR("unable to open recorded frames ", path);
+        return false;
+    }
 
-                // append this detection to cornersList for this id
-                auto& cornersList = markersCache[detId]; // add or get
-                MarkerCorners3f& corners = cornersList.emplace_back(math::NUM_CORNERS);
-                TransformMarkerSpace(modelMarker, boardPose, detMarkerPose, corners);
+    try
+    {
+        tracker::CharucoCalibrator calibrator;
+        std::vector<cv::Mat> batch;
+        std::vector<tracker::CharucoView> views(RECORDED_BATCH_FRAMES);
+        std::array<bool, RECORDED_BATCH_FRAMES> found{};
+        cv::Size imageSize;
 
-                if (cornersList.size() >= numCachedToAdd)
-                {
-                    MarkerCorners3f outMedianMarker;
-                    FindMedianMarker(cornersList, outMedianMarker);
-                    unit.AddMarker(detId, std::move(outMedianMarker));
-                }
+        for (frames.ReadBatch(batch); !batch.empty(); frames.ReadBatch(batch))
+        {
+            imageSize = math::GetMatSize(batch.front());
+            utils::TaskScheduler::Get().ParallelFor(static_cast<int>(batch.size()), [&](int index) {
+                cv::Mat gray;
+                tracker::CharucoMarkers markers;
+                AprilTagWrapper::ConvertGrayscale(batch[index], gray);
+                calibrator.DetectMarkers(gray, markers);
+                found[index] = calibrator.FindView(gray, markers, views[index]);
+            });
+            // scored and added in capture order, so the result does not depend on the number of workers.
+            // Scored against a guess of the intrinsics throughout, calibrating in between would depend on timing
+            for (std::size_t index = 0; index < batch.size(); ++index)
+            {
+                if (!found[index]) continue;
+                const math::ViewScore score = calibrator.ScoreView(views[index], imageSize);
+                if (calibrator.IsUseful(score)) calibrator.AddView(std::move(views[index]), score);
             }
         }
 
-        if (preview.IsVisible()) preview.Update(frame.image, DRAW_IMG_SIZE);
-    };
-
-    // run loop until we stop it
-    while (cameraRunning && mainThreadRunning)
-    {
-        try
+        // a single calibration with every view kept, then the same removal of misdetected views as the live calibration
+        calibrator.Calibrate(imageSize);
+        while (calibrator.RemoveWorstView())
         {
-            doStep();
+            calibrator.Calibrate(imageSize);
         }
-        catch (const std::exception& e)
+
+        ATT_LOG_INFO("camera calibration from ", frames.GetFramesRead(), " recorded frames kept ", calibrator.GetViewCount(), " views");
+        if (!calibrator.IsCalibrated())
         {
-            ATT_LOG_ERROR(e.what());
-            gui->ShowPopup(lc.TRACKER_CALIBRATION_SOMETHINGWRONG, PopupStyle::Error);
-            mainThreadRunning = false;
-            return;
+            ATT_LOG_ERROR("not enough views of the charuco board in ", path);
+            return false;
         }
+        SaveCameraCalib(calibrator);
     }
-    mainThreadRunning = false;
+    catch (const std::exception& e)
+    {
+        ATT_LOG_ERROR(e.what());
+        return false;
+    }
+    return true;
+}
 
-    if (promptSaveCalib)
+bool Tracker::CalibrateTrackerFromFile(const std::string& path)
+{
+    if (calib_config.cameras[0]->cameraMatrix.empty())
+    {
+        ATT_LOG_ERROR("camera is not calibrated, trackers can not be calibrated from ", path);
+        return false;
+    }
+    RecordedFrames frames(path);
+    if (!frames.IsOpen())
+    {
+        ATT_LOG_ERROR("unable to open recorded frames ", path);
+        return false;
+    }
+
+    try
     {
-        SaveTrackerUnitsToCalib(trackerUnits);
+        // frames are independent until they are added, detecting one frame per worker scales better than one frame on every worker
+        const int workerCount = utils::TaskScheduler::Get().GetThreadCount();
+        std::vector<AprilTagPool::Lease> detectors;
+        for (int worker = 0; worker < workerCount; ++worker)
+        {
+            detectors.push_back(AprilTagPool::Get().Acquire(
+                AprilTagWrapper::ConvertFamily(user_config.markerLibrary), user_config.videoStreams[0]->quadDecimate,
+                AprilTagWrapper::MarkerIdCount(user_config.trackerNum, user_config.markersPerTracker)));
+            detectors.back()->SetThreadCount(1);
+        }
+
+        tracker::TrackerCalibrator calibrator(user_config, *calib_config.cameras[0]);
+        std::vector<cv::Mat> batch;
+        std::vector<MarkerDetectionList> dets(RECORDED_BATCH_FRAMES);
+        const cv::Mat noDrawImage;
+
+        for (frames.ReadBatch(batch); !batch.empty(); frames.ReadBatch(batch))
+        {
+            const int frameCount = static_cast<int>(batch.size());
+            utils::TaskScheduler::Get().ParallelFor(workerCount, [&](int worker) {
+                cv::Mat gray;
+                for (int index = worker; index < frameCount; index += workerCount)
+                {
+                    AprilTagWrapper::ConvertGrayscale(batch[index], gray);
+                    detectors[worker]->DetectMarkers(gray, dets[index]);
+                }
+            });
+            // markers are added relative to the markers already added, so frames are added in capture order
+            for (int index = 0; index < frameCount; ++index)
+            {
+                calibrator.Update(dets[index], noDrawImage);
+            }
+        }
+
+        ATT_LOG_INFO("tracker calibration from ", frames.GetFramesRead(), " recorded frames");
+        SaveTrackerUnitsToCalib(calibrator.Finish());
         SetTrackerUnitsFromConfig();
     }
+    catch (const std::exception& e)
+    {
+        ATT_LOG_ERROR(e.what());
+        return false;
+    }
+    return true;
 }
 
 void Tracker::MainLoop()
@@ -818,6 +834,129 @@ void Tracker::MainLoop()
     mainThreadRunning = false;
 }
 
+bool Tracker::ReplaySession(const std::string& path, const std::string& framesCsvPath, tracker::ReplayMetrics& outMetrics)
+{
+    using tracker::RecordedTracker;
+
+    try
+    {
+        tracker::SessionReader reader(path);
+        // estimates depend on the intrinsics and the tracker and playspace calibration,
+        // the recording keeps the ones it was tracked with, whatever this machine was calibrated with since
+        const RefPtr<cfg::CameraCalib> camCalib = calib_config.cameras[0];
+        camCalib->cameraMatrix = reader.GetCamera().cameraMatrix.clone();
+        camCalib->distortionCoeffs = reader.GetCamera().distortionCoeffs.clone();
+        const tracker::RecordedCalib& recordedCalib = reader.GetCalib();
+        user_config.trackers.Resize(static_cast<Index>(recordedCalib.trackers.size()));
+        calib_config.trackers.Resize(static_cast<Index>(recordedCalib.trackers.size()));
+        for (Index i = 0; i < calib_config.trackers.GetSize(); ++i)
+        {
+            calib_config.trackers[i]->ids = recordedCalib.trackers[i].ids;
+            calib_config.trackers[i]->corners = recordedCalib.trackers[i].corners;
+        }
+        user_config.trackerCalibCenters = recordedCalib.recenterMarkers;
+        user_config.manualCalib.SetFromReal(recordedCalib.playspace);
+        // recording the replay would write a copy of the session
+        user_config.recordSession = false;
+        SetTrackerUnitsFromConfig();
+        if (!IsTrackerUnitsCalibrated() || mTrackerUnits.empty())
+        {
+            throw utils::MakeError("session was recorded with trackers that were not calibrated: ", path);
+        }
+
+        auto replayClient = std::make_unique<tracker::ReplayDriverClient>(static_cast<int>(mTrackerUnits.size()));
+        tracker::ReplayDriverClient& driverClient = *replayClient;
+        mVRDriver.emplace(user_config.trackers, std::move(replayClient));
+        tracker::MockOpenVRClient vrClient;
+        vrClient.Init();
+        tracker::MainLoopRunner runner(&user_config, &calib_config, &mPlayspace, &mVRDriver.value());
+
+        std::ofstream framesCsv;
+        if (!framesCsvPath.empty())
+        {
+            framesCsv.open(framesCsvPath);
+            if (!framesCsv.is_open()) throw utils::MakeError("unable to open ", framesCsvPath);
+            framesCsv << "frame,tracker,recorded_visible,replayed_visible,driver_asked,position_error_mm,rotation_error_deg,"
+                         "recorded_sent,replayed_sent,sent_position_error_mm,frame_ms\n";
+        }
+
+        // the loop predicts from frame timestamps, so recorded capture times keep the replay deterministic
+        const utils::SteadyTimer::TimePoint base = utils::SteadyTimer::Now();
+        tracker::RecordedFrame recorded;
+        tracker::CapturedFrame captured;
+        std::int64_t lastCaptureTime = 0;
+        for (; reader.ReadFrame(recorded); lastCaptureTime = recorded.captureTime)
+        {
+            if (recorded.trackers.size() != mTrackerUnits.size())
+            {
+                throw utils::MakeError("frame ", recorded.index, " was recorded with ", recorded.trackers.size(),
+                                       " trackers, but ", mTrackerUnits.size(), " are calibrated");
+            }
+            // a new image, the loop may still hold the previous one
+            captured.image.release();
+            recorded.DrawImage(captured.image);
+            captured.timestamp = base + utils::NanoS(recorded.captureTime);
+            driverClient.BeginFrame(recorded, mPlayspace);
+            mCameraFrame.Set(captured);
+
+            runner.Update(&mCameraFrame, gui, &mTrackerUnits, &vrClient, this);
+
+            const auto& stageTimes = runner.GetStageTimes();
+            outMetrics.AddFrameTimes(stageTimes);
+            const double frameMillis = outMetrics.GetFrameTimes().back();
+            for (int index = 0; index < static_cast<int>(mTrackerUnits.size()); ++index)
+            {
+                const tracker::TrackerUnit& unit = mTrackerUnits[index];
+                const RecordedTracker& record = recorded.trackers[index];
+                const bool recordedVisible = (record.flags & RecordedTracker::VISIBLE) != 0;
+                const bool replayedVisible = unit.WasVisibleLastFrame();
+                if (replayedVisible) outMetrics.AddEstimate(index, captured.timestamp, Pose(unit.GetEstimatedPose()));
+                // a pose predicted locally in either started from a guess the other did not have
+                const bool driverAsked = (record.flags & RecordedTracker::DRIVER_ASKED) != 0 && unit.WasDriverAskedLastFrame();
+                double positionError = 0;
+                double rotationError = 0;
+                if (recordedVisible && replayedVisible && !driverAsked)
+                {
+                    outMetrics.AddPredictedPose();
+                }
+                else if (recordedVisible && replayedVisible)
+                {
+                    outMetrics.AddPoseError(unit.GetEstimatedPose(), record.estimatedPose);
+                    positionError = outMetrics.GetPositionErrors().back();
+                    rotationError = outMetrics.GetRotationErrors().back();
+                }
+                else if (recordedVisible != replayedVisible)
+                {
+                    outMetrics.AddVisibilityMismatch();
+                }
+
+                const bool recordedSent = (record.flags & RecordedTracker::SENT) != 0;
+                const std::optional<Pose>& sentPose = driverClient.GetSentPose(index);
+                const double sentError = recordedSent && sentPose
+                                             ? tracker::ReplayMetrics::PositionError(math::ToVec(sentPose->position), math::ToVec(record.sentPose.position))
+                                             : 0;
+
+                if (framesCsv.is_open())
+                {
+                    framesCsv << recorded.index << ',' << index << ',' << recordedVisible << ',' << replayedVisible << ','
+                              << driverAsked << ',' << positionError << ',' << rotationError << ',' << recordedSent << ',' << sentPose.has_value() << ','
+                              << sentError << ',' << frameMillis << '\n';
+                }
+            }
+        }
+
+        const double recordedSeconds = duration_cast<utils::FSeconds>(utils::NanoS(lastCaptureTime)).count();
+        const double replaySeconds = duration_cast<utils::FSeconds>(utils::SteadyTimer::Now() - base).count();
+        outMetrics.Log(tracker::MainLoopRunner::STAGE_NAMES, recordedSeconds, replaySeconds);
+    }
+    catch (const std::exception& e)
+    {
+        ATT_LOG_ERROR(e.what());
+        return false;
+    }
+    return true;
+}
+
 namespace
 {
 
@@ -857,3 +996,17 @@ void Tracker::SaveTrackerUnitsToCalib(const std::vector<tracker::TrackerUnit>& t
     }
     calib_config.Save();
 }
+
+void Tracker::SaveCameraCalib(const tracker::CharucoCalibrator& calibrator)
+{
+    // Save calibration to our global params cameraMatrix and distCoeffs
+    const RefPtr<cfg::CameraCalib> camCalib = calib_config.cameras[0];
+    const cfg::CameraCalib& calib = calibrator.GetCalib();
+    camCalib->cameraMatrix = calib.cameraMatrix;
+    camCalib->distortionCoeffs = calib.distortionCoeffs;
+    camCalib->stdDeviationsIntrinsics = calib.stdDeviationsIntrinsics;
+    camCalib->perViewErrors = calib.perViewErrors;
+    camCalib->allCharucoCorners = calib.allCharucoCorners;
+    camCalib->allCharucoIds = calib.allCharucoIds;
+    calib_config.Save();
+}
@@ -3,8 +3,10 @@
 #include "Config.hpp"
 #include "GUI.hpp"
 #include "RefPtr.hpp"
+#include "tracker/CharucoCalibrator.hpp"
 #include "tracker/OpenVRClient.hpp"
 #include "tracker/PlayspaceCalib.hpp"
+#include "tracker/SessionReplay.hpp"
 #include "tracker/TrackerUnit.hpp"
 #include "tracker/VideoCapture.hpp"
 #include "tracker/VRDriver.hpp"
@@ -20,6 +22,7 @@
 #include <mutex>
 #include <optional>
 #include <ranges>
+#include <string>
 #include <thread>
 
 struct TrackerStatus
@@ -36,11 +39,6 @@ class Tracker : public ITrackerControl
 {
     static constexpr int DRAW_IMG_SIZE = 480;
 
-    static inline const cv::Scalar COLOR_MARKER_DETECTED{0, 0, 255}; /// blue
-    static inline const cv::Scalar COLOR_MARKER_ADDING{255, 0, 255}; /// yellow
-    static inline const cv::Scalar COLOR_MARKER_ADDED{0, 255, 0}; /// green
-    static inline const cv::Scalar COLOR_MARKER_FAR{255, 0, 255}; /// purple
-
 public:
     friend class MainLoopRunner;
     friend class PlayspaceCalibrator;
@@ -58,6 +56,21 @@ class Tracker : public ITrackerControl
     void Stop() override;
     void UpdateConfig() override;
 
+    /// Calibrate the camera from recorded frames, a video file or an image sequence like frames/%04d.png,
+    /// with the same views as the live calibration, detected on every worker at once. Saved like the live calibration.
+    /// @return if the camera was calibrated
+    bool CalibrateCameraFromFile(const std::string& path);
+    /// Calibrate the trackers from recorded frames, with the current camera calibration.
+    /// Markers are detected on every worker at once, and added in the order they were recorded.
+    /// @return if the trackers were calibrated
+    bool CalibrateTrackerFromFile(const std::string& path);
+    /// Run the main loop over a session recorded by SessionRecorder, as fast as it goes, with the driver replaced
+    /// by the driver poses that were recorded, and compare the poses estimated with the ones recorded.
+    /// Uses the camera calibration of the recording, and the current tracker calibration, which should be the recorded one.
+    /// @param framesCsvPath write the errors of every tracker in every frame here, unless empty
+    /// @return if the whole session was replayed
+    bool ReplaySession(const std::string& path, const std::string& framesCsvPath, tracker::ReplayMetrics& outMetrics);
+
     bool mainThreadRunning = false;
     bool cameraRunning = false;
     bool showTimeProfile = false;
@@ -71,6 +84,7 @@ class Tracker : public ITrackerControl
 
     void SetTrackerUnitsFromConfig();
     void SaveTrackerUnitsToCalib(const std::vector<tracker::TrackerUnit>&);
+    void SaveCameraCalib(const tracker::CharucoCalibrator& calibrator);
     bool IsTrackerUnitsCalibrated() const
     {
         return std::all_of(mTrackerUnits.begin(), mTrackerUnits.end(),
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utils/Reflectable.hpp"
+#include "Validated.hpp"
 
 #include <opencv2/core.hpp>
 
@@ -28,6 +29,10 @@ struct Camera
     REFLECTABLE_FIELD(int, rotateCl) = -1;
     REFLECTABLE_FIELD(bool, mirror) = false;
     REFLECTABLE_FIELD(bool, openDirectShowSettings) = false;
+    /// capture single channel grayscale frames, skipping the color conversion (only PS3 Eye)
+    REFLECTABLE_FIELD(bool, grayscale) = false;
+    /// horizontal bands each frame is split into when converting from bayer, run on the shared worker threads (only PS3 Eye)
+    REFLECTABLE_FIELD(cfg::Validated<int>, conversionThreads){2, cfg::Clamp(1, 8)};
     REFLECTABLE_FIELD(Extra, extraSettings){};
     REFLECTABLE_END;
 };
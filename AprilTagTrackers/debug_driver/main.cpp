@@ -548,19 +548,23 @@ class OpenVRDriver
         std::string name;
         msg >> name;
         // pose = x y z qw qx qy qz
-        // 'updatepose' id pose time smoothing -> 'updated'
+        // 'updatepose' id pose time smoothing confidence -> 'updated'
+        // confidence: [0, 1] how much the pose is trusted, 1 if sent by an app that predates it
         if (name == "updatepose")
         {
             int inId = 0;
             Pose inPose = Pose::Ident();
             double inTimeOffset = 0;
             double inSmoothing = 0; // ignored
+            double inConfidence = 1;
             msg >> inId >> inPose >> inTimeOffset >> inSmoothing;
+            if (!(msg >> inConfidence)) inConfidence = 1;
             auto& device = mTrackers.at(inId);
             device.pose = inPose;
             device.timeOffset = utils::FSeconds(inTimeOffset);
             device.lastUpdate = utils::FSeconds(std::chrono::steady_clock::now().time_since_epoch());
             ATT_LOG_BATCH("cmd: updatepose", inId);
+            ATT_LOG_BATCH("cmd: updatepose confidence", inConfidence);
             return "updated";
         }
         // 'settings' saved factor additional -> 'changed'
@@ -0,0 +1,576 @@
+#include "BoardBundle.hpp"
+
+#include "CVHelpers.hpp"
+#include "utils/Assert.hpp"
+#include "utils/TaskScheduler.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace math
+{
+
+namespace
+{
+
+constexpr int MAX_ITERATIONS = 50;
+constexpr double INITIAL_DAMPING = 1e-3;
+constexpr double MAX_DAMPING = 1e10;
+/// stop once an iteration lowers the squared error by less than this fraction
+constexpr double MIN_IMPROVEMENT = 1e-10;
+/// points closer to the camera plane than this can not be projected
+constexpr double MIN_DEPTH = 1e-6;
+/// parameters of a pose, small rotation then translation
+constexpr int POSE_PARAMS = 6;
+
+using Jacobian26 = cv::Matx<double, 2, POSE_PARAMS>;
+using Jacobian36 = cv::Matx<double, 3, POSE_PARAMS>;
+
+/// maps points as rotation * point + translation
+struct RigidTransform
+{
+    cv::Matx33d rotation = cv::Matx33d::eye();
+    cv::Vec3d translation{};
+
+    static RigidTransform FromPose(const RodrPose& pose)
+    {
+        return {QuatFromRvec(pose.rotation.value).toRotMat3x3(), pose.position};
+    }
+
+    cv::Vec3d Apply(const cv::Vec3d& point) const { return rotation * point + translation; }
+    /// rotated by a small rotation vector in the space the transform maps to, then translated
+    RigidTransform Perturbed(const cv::Matx61d& delta) const
+    {
+        const cv::Matx33d step = QuatFromRvec(cv::Vec3d(delta(0), delta(1), delta(2))).toRotMat3x3();
+        return {step * rotation, translation + cv::Vec3d(delta(3), delta(4), delta(5))};
+    }
+};
+
+cv::Vec3d ToVec3d(const cv::Point3f& point)
+{
+    return {point.x, point.y, point.z};
+}
+
+cv::Matx33d Skew(const cv::Vec3d& vec)
+{
+    return {0, -vec[Z], vec[Y],
+            vec[Z], 0, -vec[X],
+            -vec[Y], vec[X], 0};
+}
+
+/// least squares rotation and translation from the corners of one marker to another, with the Kabsch algorithm
+RigidTransform FitRigid(const MarkerCorners3f& from, const MarkerCorners3f& to)
+{
+    ATT_ASSERT(from.size() == NUM_CORNERS && to.size() == NUM_CORNERS);
+    cv::Vec3d fromCenter{};
+    cv::Vec3d toCenter{};
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        fromCenter += ToVec3d(from[i]) / NUM_CORNERS;
+        toCenter += ToVec3d(to[i]) / NUM_CORNERS;
+    }
+    cv::Matx33d covariance = cv::Matx33d::zeros();
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        covariance += (ToVec3d(from[i]) - fromCenter) * (ToVec3d(to[i]) - toCenter).t();
+    }
+    cv::Matx31d singular;
+    cv::Matx33d left;
+    cv::Matx33d rightT;
+    cv::SVD::compute(covariance, singular, left, rightT);
+    cv::Matx33d right = rightT.t();
+    // a marker is flat, so the smallest singular vector is only known up to sign, pick the one that does not mirror
+    if (cv::determinant(right * left.t()) < 0)
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            right(row, 2) = -right(row, 2);
+        }
+    }
+    const cv::Matx33d rotation = right * left.t();
+    return {rotation, toCenter - rotation * fromCenter};
+}
+
+/// jacobian of the normalized projection of a point in camera space
+cv::Matx23d ProjectionJacobian(const cv::Vec3d& point)
+{
+    const double invZ = 1 / point[Z];
+    return {invZ, 0, -point[X] * invZ * invZ,
+            0, invZ, -point[Y] * invZ * invZ};
+}
+
+/// jacobian of a transformed point to the perturbation of the transform, see RigidTransform::Perturbed
+/// @param rotated the point rotated by the transform, before it is translated
+Jacobian36 PoseJacobian(const cv::Vec3d& rotated)
+{
+    const cv::Matx33d skew = Skew(rotated);
+    Jacobian36 jacobian;
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 3; ++col)
+        {
+            jacobian(row, col) = -skew(row, col);
+            jacobian(row, col + 3) = (row == col) ? 1 : 0;
+        }
+    }
+    return jacobian;
+}
+
+void AddBlock(cv::Mat& mat, int rowBlock, int colBlock, const cv::Matx66d& block)
+{
+    for (int row = 0; row < POSE_PARAMS; ++row)
+    {
+        double* const out = mat.ptr<double>(rowBlock * POSE_PARAMS + row) + colBlock * POSE_PARAMS;
+        for (int col = 0; col < POSE_PARAMS; ++col)
+        {
+            out[col] += block(row, col);
+        }
+    }
+}
+void AddBlock(cv::Mat& vec, int rowBlock, const cv::Matx61d& block)
+{
+    double* const out = vec.ptr<double>(rowBlock * POSE_PARAMS);
+    for (int row = 0; row < POSE_PARAMS; ++row)
+    {
+        out[row] += block(row);
+    }
+}
+cv::Matx61d GetBlock(const cv::Mat& vec, int rowBlock)
+{
+    return cv::Matx61d(vec.ptr<double>(rowBlock * POSE_PARAMS));
+}
+
+/// Levenberg-Marquardt damping, scales the diagonal so every parameter is damped relative to its own curvature
+cv::Matx66d Damped(cv::Matx66d hessian, double damping)
+{
+    for (int i = 0; i < POSE_PARAMS; ++i)
+    {
+        hessian(i, i) += damping * std::max(hessian(i, i), 1e-12);
+    }
+    return hessian;
+}
+
+struct BundleState
+{
+    std::vector<RigidTransform> markers;
+    std::vector<RigidTransform> frames;
+};
+
+/// normal equations of the observations of one frame
+struct FrameSystem
+{
+    cv::Matx66d frameHessian = cv::Matx66d::zeros();
+    cv::Matx61d frameGradient = cv::Matx61d::zeros();
+    /// per observation of the frame
+    std::vector<cv::Matx66d> markerHessians;
+    std::vector<cv::Matx61d> markerGradients;
+    /// marker rows, frame columns
+    std::vector<cv::Matx66d> cross;
+};
+
+} // namespace
+
+int BoardBundle::AddFrame(const RodrPose& boardPose)
+{
+    // frames kept are the ones offered at a multiple of the stride
+    const int offered = mFramesOffered++;
+    if (offered % mFrameStride != 0) return -1;
+    if (GetFrameCount() >= mMaxFrames)
+    {
+        DropEveryOtherFrame();
+        mFrameStride *= 2;
+        if (offered % mFrameStride != 0) return -1;
+    }
+    mFramePoses.push_back(boardPose);
+    return static_cast<int>(mFramePoses.size()) - 1;
+}
+
+void BoardBundle::DropEveryOtherFrame()
+{
+    for (int frame = 0; frame < GetFrameCount(); frame += 2)
+    {
+        mFramePoses[frame / 2] = mFramePoses[frame];
+    }
+    mFramePoses.resize((mFramePoses.size() + 1) / 2);
+    std::erase_if(mObservations, [](const Observation& observation) { return observation.frame % 2 != 0; });
+    for (Observation& observation : mObservations)
+    {
+        observation.frame /= 2;
+    }
+}
+
+void BoardBundle::AddObservation(int frame, int id, std::span<const cv::Point2f, NUM_CORNERS> corners)
+{
+    ATT_ASSERT(frame >= 0 && frame < GetFrameCount());
+    Observation& observation = mObservations.emplace_back();
+    observation.frame = frame;
+    observation.id = id;
+    std::copy(corners.begin(), corners.end(), observation.corners.begin());
+}
+
+BoardBundleResult BoardBundle::Adjust(const std::vector<int>& ids, const std::vector<MarkerCorners3f>& markers, double focalLength) const
+{
+    ATT_ASSERT(ids.size() == markers.size());
+    const int markerCount = static_cast<int>(ids.size());
+    const int frameCount = GetFrameCount();
+
+    BoardBundleResult result;
+    result.markers = markers;
+    result.markerErrors.assign(markerCount, 0);
+    if (markerCount == 0) return result;
+
+    // observations of the markers on the board, grouped by frame
+    std::vector<int> markerOfObservation(mObservations.size(), -1);
+    std::vector<std::vector<int>> frameObservations(frameCount);
+    std::vector<int> observationCounts(markerCount, 0);
+    for (int obs = 0; obs < static_cast<int>(mObservations.size()); ++obs)
+    {
+        const auto marker = std::find(ids.begin(), ids.end(), mObservations[obs].id);
+        if (marker == ids.end()) continue;
+        markerOfObservation[obs] = static_cast<int>(marker - ids.begin());
+        frameObservations[mObservations[obs].frame].push_back(obs);
+        ++observationCounts[markerOfObservation[obs]];
+    }
+
+    // the first marker defines the board space, markers that were never observed have nothing to refine them
+    std::vector<int> blockOfMarker(markerCount, -1);
+    int blockCount = 0;
+    for (int marker = 1; marker < markerCount; ++marker)
+    {
+        if (observationCounts[marker] > 0) blockOfMarker[marker] = blockCount++;
+    }
+
+    std::vector<cv::Vec3d> model(NUM_CORNERS);
+    std::transform(mModelMarker.begin(), mModelMarker.end(), model.begin(), ToVec3d);
+    BundleState state;
+    for (const MarkerCorners3f& corners : markers)
+    {
+        state.markers.push_back(FitRigid(mModelMarker, corners));
+    }
+    for (const RodrPose& pose : mFramePoses)
+    {
+        state.frames.push_back(RigidTransform::FromPose(pose));
+    }
+
+    utils::TaskScheduler& scheduler = utils::TaskScheduler::Get();
+    const auto forEachCorner = [&](const BundleState& current, int obs, auto&& func) {
+        const Observation& observation = mObservations[obs];
+        const RigidTransform& marker = current.markers[markerOfObservation[obs]];
+        const RigidTransform& frame = current.frames[observation.frame];
+        for (int corner = 0; corner < NUM_CORNERS; ++corner)
+        {
+            const cv::Vec3d rotatedModel = marker.rotation * model[corner];
+            const cv::Vec3d rotatedBoard = frame.rotation * (rotatedModel + marker.translation);
+            const cv::Vec3d camPoint = rotatedBoard + frame.translation;
+            if (camPoint[Z] < MIN_DEPTH)
+            {
+                func(std::numeric_limits<double>::infinity(), cv::Matx21d::zeros(), cv::Vec3d{}, rotatedModel, rotatedBoard, frame);
+                continue;
+            }
+            const cv::Point2d& detected = observation.corners[corner];
+            const cv::Matx21d residual{camPoint[X] / camPoint[Z] - detected.x, camPoint[Y] / camPoint[Z] - detected.y};
+            func(residual.dot(residual), residual, camPoint, rotatedModel, rotatedBoard, frame);
+        }
+    };
+    /// squared error of every observation, infinite if a corner is behind the camera
+    const auto squaredError = [&](const BundleState& current) {
+        std::vector<double> frameErrors(frameCount, 0);
+        scheduler.ParallelFor(frameCount, [&](int frame) {
+            for (const int obs : frameObservations[frame])
+            {
+                forEachCorner(current, obs, [&](double error, auto&&...) { frameErrors[frame] += error; });
+            }
+        });
+        return std::accumulate(frameErrors.begin(), frameErrors.end(), 0.0);
+    };
+    const int pointCount = std::max(1, static_cast<int>(std::count_if(markerOfObservation.begin(), markerOfObservation.end(),
+                                                                      [](int marker) { return marker >= 0; })) *
+                                           NUM_CORNERS);
+
+    double error = squaredError(state);
+    result.initialError = std::sqrt(error / pointCount) * focalLength;
+    double damping = INITIAL_DAMPING;
+    std::vector<FrameSystem> systems(frameCount);
+    for (; result.iterations < MAX_ITERATIONS && blockCount > 0 && std::isfinite(error); ++result.iterations)
+    {
+        // linearize each frame on its own, every observation only touches its frame and marker
+        scheduler.ParallelFor(frameCount, [&](int frame) {
+            FrameSystem& system = systems[frame];
+            system = FrameSystem{};
+            for (const int obs : frameObservations[frame])
+            {
+                cv::Matx66d& markerHessian = system.markerHessians.emplace_back(cv::Matx66d::zeros());
+                cv::Matx61d& markerGradient = system.markerGradients.emplace_back(cv::Matx61d::zeros());
+                cv::Matx66d& cross = system.cross.emplace_back(cv::Matx66d::zeros());
+                forEachCorner(state, obs, [&](double pointError, const cv::Matx21d& residual, const cv::Vec3d& camPoint,
+                                              const cv::Vec3d& rotatedModel, const cv::Vec3d& rotatedBoard, const RigidTransform& frameTransform) {
+                    if (!std::isfinite(pointError)) return;
+                    const cv::Matx23d projection = ProjectionJacobian(camPoint);
+                    const Jacobian26 frameJacobian = projection * PoseJacobian(rotatedBoard);
+                    const Jacobian26 markerJacobian = (projection * frameTransform.rotation) * PoseJacobian(rotatedModel);
+                    system.frameHessian += frameJacobian.t() * frameJacobian;
+                    system.frameGradient += frameJacobian.t() * residual;
+                    markerHessian += markerJacobian.t() * markerJacobian;
+                    markerGradient += markerJacobian.t() * residual;
+                    cross += markerJacobian.t() * frameJacobian;
+                });
+            }
+        });
+
+        std::vector<cv::Matx66d> markerHessians(markerCount, cv::Matx66d::zeros());
+        std::vector<cv::Matx61d> markerGradients(markerCount, cv::Matx61d::zeros());
+        for (int frame = 0; frame < frameCount; ++frame)
+        {
+            for (std::size_t i = 0; i < frameObservations[frame].size(); ++i)
+            {
+                const int marker = markerOfObservation[frameObservations[frame][i]];
+                markerHessians[marker] += systems[frame].markerHessians[i];
+                markerGradients[marker] += systems[frame].markerGradients[i];
+            }
+        }
+
+        bool improved = false;
+        while (!improved && damping < MAX_DAMPING)
+        {
+            // reduce to the markers: (U - W V^-1 W^T) dm = -g_m + W V^-1 g_f
+            cv::Mat schur = cv::Mat::zeros(blockCount * POSE_PARAMS, blockCount * POSE_PARAMS, CV_64F);
+            cv::Mat rhs = cv::Mat::zeros(blockCount * POSE_PARAMS, 1, CV_64F);
+            for (int marker = 0; marker < markerCount; ++marker)
+            {
+                const int block = blockOfMarker[marker];
+                if (block < 0) continue;
+                AddBlock(schur, block, block, Damped(markerHessians[marker], damping));
+                AddBlock(rhs, block, -markerGradients[marker]);
+            }
+            std::vector<cv::Matx66d> frameInverses(frameCount, cv::Matx66d::zeros());
+            bool solvable = true;
+            for (int frame = 0; frame < frameCount && solvable; ++frame)
+            {
+                if (frameObservations[frame].empty()) continue;
+                const FrameSystem& system = systems[frame];
+                frameInverses[frame] = Damped(system.frameHessian, damping).inv(cv::DECOMP_CHOLESKY, &solvable);
+                const cv::Matx66d& frameInverse = frameInverses[frame];
+                for (std::size_t a = 0; a < frameObservations[frame].size(); ++a)
+                {
+                    const int blockA = blockOfMarker[markerOfObservation[frameObservations[frame][a]]];
+                    if (blockA < 0) continue;
+                    const cv::Matx66d crossInverse = system.cross[a] * frameInverse;
+                    AddBlock(rhs, blockA, crossInverse * system.frameGradient);
+                    for (std::size_t b = 0; b < frameObservations[frame].size(); ++b)
+                    {
+                        const int blockB = blockOfMarker[markerOfObservation[frameObservations[frame][b]]];
+                        if (blockB < 0) continue;
+                        AddBlock(schur, blockA, blockB, -(crossInverse * system.cross[b].t()));
+                    }
+                }
+            }
+            cv::Mat markerStep;
+            if (solvable) solvable = cv::solve(schur, rhs, markerStep, cv::DECOMP_CHOLESKY);
+            if (!solvable)
+            {
+                damping *= 10;
+                continue;
+            }
+
+            BundleState candidate = state;
+            for (int marker = 0; marker < markerCount; ++marker)
+            {
+                const int block = blockOfMarker[marker];
+                if (block >= 0) candidate.markers[marker] = state.markers[marker].Perturbed(GetBlock(markerStep, block));
+            }
+            // back substitute the frames: dv = V^-1 (-g_f - W^T dm)
+            for (int frame = 0; frame < frameCount; ++frame)
+            {
+                if (frameObservations[frame].empty()) continue;
+                const FrameSystem& system = systems[frame];
+                cv::Matx61d frameRhs = -system.frameGradient;
+                for (std::size_t i = 0; i < frameObservations[frame].size(); ++i)
+                {
+                    const int block = blockOfMarker[markerOfObservation[frameObservations[frame][i]]];
+                    if (block >= 0) frameRhs -= system.cross[i].t() * GetBlock(markerStep, block);
+                }
+                candidate.frames[frame] = state.frames[frame].Perturbed(frameInverses[frame] * frameRhs);
+            }
+
+            const double candidateError = squaredError(candidate);
+            if (candidateError < error)
+            {
+                improved = true;
+                const double improvement = (error - candidateError) / error;
+                state = std::move(candidate);
+                error = candidateError;
+                damping = std::max(damping / 10, 1e-12);
+                if (improvement < MIN_IMPROVEMENT) damping = MAX_DAMPING;
+            }
+            else
+            {
+                damping *= 10;
+            }
+        }
+        if (!improved || damping >= MAX_DAMPING) break;
+    }
+
+    result.finalError = std::sqrt(error / pointCount) * focalLength;
+    for (int marker = 0; marker < markerCount; ++marker)
+    {
+        if (blockOfMarker[marker] < 0) continue;
+        MarkerCorners3f& corners = result.markers[marker];
+        corners.resize(NUM_CORNERS);
+        for (int corner = 0; corner < NUM_CORNERS; ++corner)
+        {
+            const cv::Vec3d point = state.markers[marker].Apply(model[corner]);
+            corners[corner] = cv::Point3f(static_cast<float>(point[X]), static_cast<float>(point[Y]), static_cast<float>(point[Z]));
+        }
+    }
+    std::vector<double> markerSquaredErrors(markerCount, 0);
+    for (int obs = 0; obs < static_cast<int>(mObservations.size()); ++obs)
+    {
+        if (markerOfObservation[obs] < 0) continue;
+        forEachCorner(state, obs, [&](double pointError, auto&&...) { markerSquaredErrors[markerOfObservation[obs]] += pointError; });
+    }
+    for (int marker = 0; marker < markerCount; ++marker)
+    {
+        if (observationCounts[marker] == 0) continue;
+        result.markerErrors[marker] = std::sqrt(markerSquaredErrors[marker] / (observationCounts[marker] * NUM_CORNERS)) * focalLength;
+    }
+    return result;
+}
+
+namespace
+{
+
+/// a tracker with markers placed a few millimeters and degrees off, seen from random poses
+struct SyntheticTracker
+{
+    static constexpr double HALF = 0.025;
+    static constexpr double FOCAL_LENGTH = 600;
+
+    const MarkerCorners3f model{{-HALF, HALF, 0}, {HALF, HALF, 0}, {HALF, -HALF, 0}, {-HALF, -HALF, 0}};
+    // the main marker and three around it, tilted away like on a tracker
+    const std::vector<int> ids{0, 1, 2, 3};
+    const std::vector<RodrPose> markerPoses{
+        RodrPose{cv::Vec3d(0, 0, 0), RodriguesVec3d(cv::Vec3d(0, 0, 0))},
+        RodrPose{cv::Vec3d(0.06, 0, -0.02), RodriguesVec3d(cv::Vec3d(0, 1.0, 0))},
+        RodrPose{cv::Vec3d(-0.06, 0, -0.02), RodriguesVec3d(cv::Vec3d(0, -1.0, 0))},
+        RodrPose{cv::Vec3d(0, 0.05, -0.02), RodriguesVec3d(cv::Vec3d(-0.9, 0, 0))}};
+    std::vector<MarkerCorners3f> truth;
+    std::vector<MarkerCorners3f> placed;
+    cv::RNG rng{21};
+
+    SyntheticTracker()
+    {
+        for (int marker = 0; marker < static_cast<int>(markerPoses.size()); ++marker)
+        {
+            const RigidTransform transform = RigidTransform::FromPose(markerPoses[marker]);
+            // every marker but the main one is off by a few millimeters and degrees
+            const RigidTransform error = (marker == 0) ? RigidTransform{} : RigidTransform{}.Perturbed(cv::Matx61d(
+                rng.gaussian(0.03), rng.gaussian(0.03), rng.gaussian(0.03), rng.gaussian(0.005), rng.gaussian(0.005), rng.gaussian(0.005)));
+            MarkerCorners3f& truthCorners = truth.emplace_back();
+            MarkerCorners3f& placedCorners = placed.emplace_back();
+            for (const cv::Point3f& corner : model)
+            {
+                const cv::Vec3d point = transform.Apply(ToVec3d(corner));
+                const cv::Vec3d placedPoint = error.Apply(point);
+                truthCorners.emplace_back(static_cast<float>(point[X]), static_cast<float>(point[Y]), static_cast<float>(point[Z]));
+                placedCorners.emplace_back(static_cast<float>(placedPoint[X]), static_cast<float>(placedPoint[Y]), static_cast<float>(placedPoint[Z]));
+            }
+        }
+    }
+
+    /// add a frame from a random pose, with the observations of the markers facing the camera
+    /// @param markerCount only the first markers are seen, like before the others are stuck on
+    void AddFrame(BoardBundle& bundle, int markerCount)
+    {
+        // turned around to face the camera, then tilted
+        const cv::Vec3d tilt{rng.uniform(-0.8, 0.8), rng.uniform(-1.2, 1.2), rng.uniform(-0.5, 0.5)};
+        const cv::Vec3d rotation = RvecFromQuat(QuatFromRvec(tilt) * QuatFromRvec(cv::Vec3d(CV_PI, 0, 0)));
+        const RodrPose boardPose{cv::Vec3d(rng.uniform(-0.2, 0.2), rng.uniform(-0.2, 0.2), rng.uniform(0.6, 1.2)), RodriguesVec3d(rotation)};
+        const RigidTransform boardTransform = RigidTransform::FromPose(boardPose);
+        // calibration only knows the board pose up to its own error
+        const int index = bundle.AddFrame(RodrPose{boardPose.position + cv::Vec3d(rng.gaussian(0.002), rng.gaussian(0.002), rng.gaussian(0.005)),
+                                                   RodriguesVec3d(rotation + cv::Vec3d(rng.gaussian(0.01), rng.gaussian(0.01), rng.gaussian(0.01)))});
+        for (int marker = 0; marker < markerCount; ++marker)
+        {
+            // only markers facing the camera are seen
+            const cv::Vec3d normal = boardTransform.rotation * (RigidTransform::FromPose(markerPoses[marker]).rotation * cv::Vec3d(0, 0, 1));
+            if (normal[Z] > -0.3) continue;
+            std::array<cv::Point2f, NUM_CORNERS> corners;
+            for (int corner = 0; corner < NUM_CORNERS; ++corner)
+            {
+                const cv::Vec3d camPoint = boardTransform.Apply(ToVec3d(truth[marker][corner]));
+                corners[corner] = cv::Point2f(static_cast<float>(camPoint[X] / camPoint[Z] + rng.gaussian(0.3) / FOCAL_LENGTH),
+                                              static_cast<float>(camPoint[Y] / camPoint[Z] + rng.gaussian(0.3) / FOCAL_LENGTH));
+            }
+            if (index >= 0) bundle.AddObservation(index, ids[marker], corners);
+        }
+        // a background marker that is not part of the board is ignored
+        const std::array<cv::Point2f, NUM_CORNERS> background{cv::Point2f(0.1F, 0.1F), cv::Point2f(0.2F, 0.1F), cv::Point2f(0.2F, 0.2F), cv::Point2f(0.1F, 0.2F)};
+        if (index >= 0) bundle.AddObservation(index, 40, background);
+    }
+
+    /// every marker but the main one is refined closer to the truth
+    void CheckRefined(const BoardBundleResult& result) const
+    {
+        REQUIRE(result.markers.size() == ids.size());
+        CHECK(result.markers[0] == placed[0]);
+        for (int marker = 1; marker < static_cast<int>(ids.size()); ++marker)
+        {
+            CAPTURE(marker);
+            CHECK(result.markerErrors[marker] > 0);
+            CHECK(result.markerErrors[marker] < 0.6);
+            for (int corner = 0; corner < NUM_CORNERS; ++corner)
+            {
+                CAPTURE(corner);
+                CHECK(cv::norm(result.markers[marker][corner] - truth[marker][corner]) < 0.002);
+                CHECK(cv::norm(result.markers[marker][corner] - truth[marker][corner]) < cv::norm(placed[marker][corner] - truth[marker][corner]));
+            }
+        }
+    }
+};
+
+} // namespace
+
+TEST_CASE("BoardBundle refines markers placed with errors")
+{
+    SyntheticTracker synth;
+    BoardBundle bundle{synth.model};
+    for (int frame = 0; frame < 40; ++frame)
+    {
+        synth.AddFrame(bundle, static_cast<int>(synth.ids.size()));
+    }
+
+    const BoardBundleResult result = bundle.Adjust(synth.ids, synth.placed, SyntheticTracker::FOCAL_LENGTH);
+    CAPTURE(result.initialError);
+    CAPTURE(result.finalError);
+    CAPTURE(result.iterations);
+    CHECK(result.finalError < result.initialError);
+    CHECK(result.finalError < 0.6);
+    synth.CheckRefined(result);
+}
+
+TEST_CASE("BoardBundle keeps frames spread over the whole calibration")
+{
+    SyntheticTracker synth;
+    constexpr int maxFrames = 32;
+    BoardBundle bundle{synth.model, maxFrames};
+    // the last marker is only stuck on long after the bundle first filled up
+    for (int frame = 0; frame < 200; ++frame)
+    {
+        synth.AddFrame(bundle, frame < 100 ? 3 : 4);
+        CHECK(bundle.GetFrameCount() <= maxFrames);
+    }
+    CHECK(bundle.GetFrameCount() > maxFrames / 2);
+
+    const BoardBundleResult result = bundle.Adjust(synth.ids, synth.placed, SyntheticTracker::FOCAL_LENGTH);
+    CAPTURE(result.initialError);
+    CAPTURE(result.finalError);
+    CHECK(result.finalError < result.initialError);
+    synth.CheckRefined(result);
+}
+
+} // namespace math
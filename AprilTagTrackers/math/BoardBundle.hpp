@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CVTypes.hpp"
+#include "Helpers.hpp"
+#include "utils/Assert.hpp"
+
+#include <opencv2/core/types.hpp>
+
+#include <array>
+#include <span>
+#include <vector>
+
+namespace math
+{
+
+struct BoardBundleResult
+{
+    /// refined corners of each marker, in the order of the ids passed to Adjust
+    std::vector<MarkerCorners3f> markers;
+    /// root mean square reprojection error of each marker in pixels, 0 if the marker was not observed
+    std::vector<double> markerErrors;
+    /// root mean square reprojection error of every observation in pixels, before and after
+    double initialError = 0;
+    double finalError = 0;
+    int iterations = 0;
+};
+
+/// Observations of the markers of a tracker collected while calibrating it, to refine every marker together at the end.
+/// Calibration places each marker from the board pose of the markers placed before it, so errors build up around the tracker.
+/// Adjust refines the pose of every marker on the board and the board pose of every frame at once,
+/// with Levenberg-Marquardt. Each observation ties one frame to one marker, so the frames are eliminated
+/// from the normal equations with the Schur complement, leaving a small system over the markers.
+class BoardBundle
+{
+public:
+    /// frames kept by default, a few minutes of calibration at full rate, and any length after that at a lower rate
+    static constexpr int DEFAULT_MAX_FRAMES = 1000;
+
+    /// @param modelMarker corners of a marker in its own space, like TrackerUnit::CreateModelMarker,
+    ///   refined markers are this marker moved onto the board
+    /// @param maxFrames once this many frames are kept, every other one is dropped and frames are added at half the rate,
+    ///   so the frames kept stay spread over the whole calibration, and markers added late are observed too
+    explicit BoardBundle(MarkerCorners3f modelMarker, int maxFrames = DEFAULT_MAX_FRAMES)
+        : mModelMarker(std::move(modelMarker)), mMaxFrames(maxFrames)
+    {
+        ATT_ASSERT(maxFrames >= 2);
+    }
+
+    /// @param boardPose board to camera, as estimated in the frame
+    /// @return index of the frame, for AddObservation, or -1 if the frame is skipped to keep the frames spread out
+    int AddFrame(const RodrPose& boardPose);
+    /// @param corners detected corners of marker id in frame, undistorted to normalized camera coordinates
+    void AddObservation(int frame, int id, std::span<const cv::Point2f, NUM_CORNERS> corners);
+    int GetFrameCount() const { return static_cast<int>(mFramePoses.size()); }
+
+    /// @param ids markers of the board, the first one is held fixed and defines the space of the board
+    /// @param markers current corners of each marker, the start of the refinement
+    /// @param focalLength in pixels, only scales the reported errors
+    BoardBundleResult Adjust(const std::vector<int>& ids, const std::vector<MarkerCorners3f>& markers, double focalLength) const;
+
+private:
+    struct Observation
+    {
+        int frame = 0;
+        int id = 0;
+        std::array<cv::Point2d, NUM_CORNERS> corners{};
+    };
+
+    /// keep the frames at even indices, and their observations
+    void DropEveryOtherFrame();
+
+    MarkerCorners3f mModelMarker;
+    int mMaxFrames;
+    /// one in this many frames offered is kept
+    int mFrameStride = 1;
+    int mFramesOffered = 0;
+    std::vector<RodrPose> mFramePoses;
+    std::vector<Observation> mObservations;
+};
+
+} // namespace math
@@ -0,0 +1,926 @@
+#include "BoardPose.hpp"
+
+#include "CameraModel.hpp"
+#include "CVHelpers.hpp"
+#include "utils/AllocationCounter.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Cross.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <utility>
+
+namespace math
+{
+
+namespace
+{
+
+using Vec6d = cv::Vec<double, 6>;
+
+/// same limit as the iterative solvePnP
+constexpr int MAX_ITERATIONS = 20;
+constexpr double MIN_STEP = 1e-12;
+constexpr double INITIAL_DAMPING = 1e-3;
+/// corners closer to the camera plane than this are skipped, their projection is meaningless
+constexpr double MIN_DEPTH = 1e-6;
+/// markers with a larger root mean square reprojection error in pixels disagree with a pose
+constexpr double OUTLIER_MARKER_ERROR = 3;
+/// variance of detected corners in pixels, a lucky fit of few corners does not make the covariance vanish
+constexpr double MIN_CORNER_VARIANCE = 0.1 * 0.1;
+/// position deviation in meters at which tracking confidence is halved
+constexpr double HALF_CONFIDENCE_DEVIATION = 0.02;
+
+/// detected corners matched against the markers of a board
+struct Matches
+{
+    static constexpr int MAX_MASKED = 64;
+    static constexpr std::uint64_t ALL = ~std::uint64_t{0};
+
+    std::span<const int> ids;
+    std::span<const cv::Point2f> corners;
+    const BoardGeometry& board;
+    /// bit i includes the i-th matched marker, in detection order, markers after MAX_MASKED are always included
+    std::uint64_t included = ALL;
+
+    bool IsIncluded(int match) const { return match >= MAX_MASKED || ((included >> match) & 1U) != 0; }
+};
+
+/// call func(match, objectPoint, imagePoint) for every corner of included markers, match counts the matched markers in detection order
+/// @return number of included markers
+template <typename TFunc>
+int ForEachMatch(const Matches& matches, TFunc&& func)
+{
+    int match = 0;
+    int included = 0;
+    for (int det = 0; det < static_cast<int>(matches.ids.size()); ++det)
+    {
+        const int marker = matches.board.FindMarker(matches.ids[det]);
+        if (marker < 0) continue;
+        const int current = match++;
+        if (!matches.IsIncluded(current)) continue;
+        ++included;
+        const auto objectCorners = matches.board.GetCorners(marker);
+        for (int corner = 0; corner < NUM_CORNERS; ++corner)
+        {
+            const cv::Point2f& image = matches.corners[static_cast<std::size_t>(det) * NUM_CORNERS + corner];
+            func(current, objectCorners[corner], cv::Point2d(image.x, image.y));
+        }
+    }
+    return included;
+}
+
+/// detection index of the match-th matched marker
+int FindMatchedDetection(const Matches& matches, int match)
+{
+    for (int det = 0; det < static_cast<int>(matches.ids.size()); ++det)
+    {
+        if (matches.board.FindMarker(matches.ids[det]) < 0) continue;
+        if (match-- == 0) return det;
+    }
+    utils::Unreachable();
+}
+
+struct NormalEquations
+{
+    cv::Matx66d jtj{};
+    Vec6d jtr{};
+    double squaredError = 0;
+    int pointCount = 0;
+};
+
+/// residual of a projected corner, false if the corner is behind the camera
+bool Residual(const CameraModel& model, const cv::Matx33d& rotation, const cv::Vec3d& translation,
+              const cv::Point3d& object, const cv::Point2d& image, cv::Point2d& outResidual)
+{
+    const cv::Vec3d camPoint = rotation * cv::Vec3d(object.x, object.y, object.z) + translation;
+    if (camPoint[Z] < MIN_DEPTH) return false;
+    outResidual = model.ProjectNormalized(camPoint[X] / camPoint[Z], camPoint[Y] / camPoint[Z]) - image;
+    return true;
+}
+
+double SquaredError(const Matches& matches, const CameraModel& model, const cv::Matx33d& rotation, const cv::Vec3d& translation)
+{
+    double squaredError = 0;
+    ForEachMatch(matches, [&](int, const cv::Point3d& object, const cv::Point2d& image) {
+        cv::Point2d residual;
+        if (Residual(model, rotation, translation, object, image, residual)) squaredError += residual.dot(residual);
+    });
+    return squaredError;
+}
+
+/// Gauss-Newton normal equations for a small rotation in camera space applied after rotation, and a translation step
+NormalEquations Accumulate(const Matches& matches, const CameraModel& model, const cv::Matx33d& rotation, const cv::Vec3d& translation)
+{
+    NormalEquations result;
+    ForEachMatch(matches, [&](int, const cv::Point3d& object, const cv::Point2d& image) {
+        const cv::Vec3d rotated = rotation * cv::Vec3d(object.x, object.y, object.z);
+        const cv::Vec3d camPoint = rotated + translation;
+        if (camPoint[Z] < MIN_DEPTH) return;
+
+        const double invZ = 1.0 / camPoint[Z];
+        const double x = camPoint[X] * invZ;
+        const double y = camPoint[Y] * invZ;
+        cv::Matx22d distortJacobian;
+        const cv::Point2d residual = model.ProjectNormalized(x, y, distortJacobian) - image;
+
+        // pixel by camera point, through the perspective divide
+        const cv::Matx23d perspective{invZ, 0, -x * invZ,
+                                      0, invZ, -y * invZ};
+        const cv::Matx23d byPoint = distortJacobian * perspective;
+        // camera point by rotation step is -[rotated]x, by translation step is identity
+        const cv::Matx33d negSkew{0, rotated[Z], -rotated[Y],
+                                  -rotated[Z], 0, rotated[X],
+                                  rotated[Y], -rotated[X], 0};
+        const cv::Matx23d byRotation = byPoint * negSkew;
+
+        cv::Matx<double, 2, 6> jacobian;
+        for (int row = 0; row < 2; ++row)
+        {
+            for (int col = 0; col < 3; ++col)
+            {
+                jacobian(row, col) = byRotation(row, col);
+                jacobian(row, col + 3) = byPoint(row, col);
+            }
+        }
+        result.jtj += jacobian.t() * jacobian;
+        result.jtr += jacobian.t() * cv::Vec2d(residual.x, residual.y);
+        result.squaredError += residual.dot(residual);
+        ++result.pointCount;
+    });
+    return result;
+}
+
+/// Levenberg-Marquardt from rotation and translation
+/// @return normal equations at the solution
+NormalEquations Refine(const Matches& matches, const CameraModel& model, cv::Quatd& inOutRotation, cv::Vec3d& inOutTranslation)
+{
+    NormalEquations equations = Accumulate(matches, model, inOutRotation.toRotMat3x3(), inOutTranslation);
+    double damping = INITIAL_DAMPING;
+    for (int iteration = 0; iteration < MAX_ITERATIONS && equations.pointCount > 0; ++iteration)
+    {
+        cv::Matx66d damped = equations.jtj;
+        for (int i = 0; i < 6; ++i)
+        {
+            damped(i, i) += damping * std::max(equations.jtj(i, i), 1e-12);
+        }
+        const Vec6d step = damped.solve(-equations.jtr, cv::DECOMP_CHOLESKY);
+
+        const cv::Quatd nextRotation = (QuatFromRvec(cv::Vec3d(step[0], step[1], step[2])) * inOutRotation).normalize();
+        const cv::Vec3d nextTranslation = inOutTranslation + cv::Vec3d(step[3], step[4], step[5]);
+        const double nextError = SquaredError(matches, model, nextRotation.toRotMat3x3(), nextTranslation);
+        if (nextError < equations.squaredError)
+        {
+            inOutRotation = nextRotation;
+            inOutTranslation = nextTranslation;
+            equations = Accumulate(matches, model, inOutRotation.toRotMat3x3(), inOutTranslation);
+            damping = std::max(damping / 10, 1e-12);
+        }
+        else
+        {
+            damping *= 10;
+        }
+        if (cv::norm(step) < MIN_STEP) break;
+    }
+    return equations;
+}
+
+/// opencv initial estimate, exactly what cv::aruco::estimatePoseBoard does, allocates
+void SolvePnPOpenCV(const Matches& matches, cv::InputArray cameraMatrix, cv::InputArray distortionCoeffs,
+                    bool useGuess, cv::Vec3d& inOutRvec, cv::Vec3d& inOutTvec)
+{
+    std::vector<cv::Point3f> objectPoints;
+    std::vector<cv::Point2f> imagePoints;
+    ForEachMatch(matches, [&](int, const cv::Point3d& object, const cv::Point2d& image) {
+        objectPoints.emplace_back(object);
+        imagePoints.emplace_back(image);
+    });
+    cv::solvePnP(objectPoints, imagePoints, cameraMatrix, distortionCoeffs, inOutRvec, inOutTvec, useGuess);
+}
+
+/// call func(cameraMatrix, distortionCoeffs) with the model as opencv arrays
+template <typename TFunc>
+void WithOpenCVIntrinsics(const CameraModel& model, TFunc&& func)
+{
+    const cv::Matx33d cameraMatrix = model.GetCameraMatrix();
+    if (!model.isDistorted)
+    {
+        func(cameraMatrix, cv::noArray());
+        return;
+    }
+    const cv::Matx<double, 1, CameraModel::MAX_COEFFS> distortion{model.coeffs.data()};
+    func(cameraMatrix, distortion);
+}
+
+/// a marker of the board as the centered square of TrackerUnit::CreateModelMarker
+struct MarkerFrame
+{
+    /// marker space to board space
+    cv::Quatd rotation;
+    cv::Vec3d center;
+    double size = 0;
+};
+
+MarkerFrame GetMarkerFrame(std::span<const cv::Point3d, NUM_CORNERS> corners)
+{
+    const cv::Vec3d c0 = corners[0];
+    const cv::Vec3d c1 = corners[1];
+    const cv::Vec3d c2 = corners[2];
+    const cv::Vec3d c3 = corners[3];
+    // corners go top left, top right, bottom right, bottom left
+    const cv::Vec3d xAxis = cv::normalize((c1 - c0) + (c2 - c3));
+    const cv::Vec3d zAxis = cv::normalize(xAxis.cross((c0 - c3) + (c1 - c2)));
+    const cv::Vec3d yAxis = zAxis.cross(xAxis);
+    const cv::Matx33d rotation{xAxis[X], yAxis[X], zAxis[X],
+                               xAxis[Y], yAxis[Y], zAxis[Y],
+                               xAxis[Z], yAxis[Z], zAxis[Z]};
+
+    MarkerFrame frame;
+    frame.rotation = cv::Quatd::createFromRotMat(rotation);
+    frame.center = (c0 + c1 + c2 + c3) / 4;
+    frame.size = (cv::norm(c1 - c0) + cv::norm(c2 - c1) + cv::norm(c3 - c2) + cv::norm(c0 - c3)) / 4;
+    return frame;
+}
+
+double RotationAngle(const cv::Quatd& lhs, const cv::Quatd& rhs)
+{
+    return cv::norm(RvecFromQuat(lhs.conjugate() * rhs));
+}
+
+/// board poses from one marker
+struct MarkerHypotheses
+{
+    /// both solutions of the planar ambiguity, sorted by reprojection error
+    std::array<cv::Quatd, 2> rotations;
+    std::array<cv::Vec3d, 2> translations;
+    int count = 0;
+};
+
+/// pixel to the point on the z = 1 plane that projects onto it, inverts the distortion with a few Gauss-Newton steps
+cv::Point2d UnprojectNormalized(const CameraModel& model, const cv::Point2d& pixel)
+{
+    constexpr int undistortIterations = 10;
+    cv::Point2d normalized((pixel.x - model.cx) / model.fx, (pixel.y - model.cy) / model.fy);
+    for (int iteration = 0; iteration < undistortIterations && model.isDistorted; ++iteration)
+    {
+        cv::Matx22d jacobian;
+        const cv::Point2d residual = model.ProjectNormalized(normalized.x, normalized.y, jacobian) - pixel;
+        const cv::Vec2d step = jacobian.solve(cv::Vec2d(residual.x, residual.y), cv::DECOMP_LU);
+        normalized -= cv::Point2d(step[0], step[1]);
+    }
+    return normalized;
+}
+
+/// Both rotations of a plane that fit the homography at the origin of the plane to first order,
+/// from "Infinitesimal Plane-based Pose Estimation", Collins and Bartoli 2014, like SOLVEPNP_IPPE_SQUARE.
+/// @param jacobian of the homography at the origin
+/// @param origin image of the origin on the z = 1 plane
+/// @return false if the homography is degenerate
+bool IppeRotations(const cv::Matx22d& jacobian, const cv::Vec2d& origin, std::array<cv::Matx33d, 2>& outRotations)
+{
+    // rotates the z axis onto the line of sight to the origin
+    const double lateral = cv::norm(origin);
+    cv::Matx33d lineOfSight = cv::Matx33d::eye();
+    if (lateral > 1e-12)
+    {
+        const cv::Vec3d axis(-origin[1] / lateral, origin[0] / lateral, 0);
+        lineOfSight = cv::Quatd::createFromAngleAxis(std::atan(lateral), axis).toRotMat3x3();
+    }
+    const cv::Matx22d projected{lineOfSight(0, 0) - origin[0] * lineOfSight(2, 0), lineOfSight(0, 1) - origin[0] * lineOfSight(2, 1),
+                                lineOfSight(1, 0) - origin[1] * lineOfSight(2, 0), lineOfSight(1, 1) - origin[1] * lineOfSight(2, 1)};
+    if (std::abs(cv::determinant(projected)) < 1e-12 || std::abs(cv::determinant(jacobian)) < 1e-12) return false;
+    const cv::Matx22d a = projected.inv() * jacobian;
+
+    // largest singular value of a is the inverse depth, a scaled by it is the top left of the rotation in the line of sight
+    const double sumSquares = a(0, 0) * a(0, 0) + a(0, 1) * a(0, 1) + a(1, 0) * a(1, 0) + a(1, 1) * a(1, 1);
+    const double det = cv::determinant(a);
+    const double gamma = std::sqrt(0.5 * (sumSquares + std::sqrt(std::max(0.0, sumSquares * sumSquares - 4 * det * det))));
+    if (gamma < 1e-12) return false;
+    const cv::Matx22d r = a * (1 / gamma);
+
+    // the bottom row completes the columns to unit length, up to the sign that makes the two solutions
+    const double b0 = std::sqrt(std::max(0.0, 1 - r(0, 0) * r(0, 0) - r(1, 0) * r(1, 0)));
+    double b1 = std::sqrt(std::max(0.0, 1 - r(0, 1) * r(0, 1) - r(1, 1) * r(1, 1)));
+    if (r(0, 0) * r(0, 1) + r(1, 0) * r(1, 1) > 0) b1 = -b1;
+    for (int solution = 0; solution < 2; ++solution)
+    {
+        const double sign = solution == 0 ? 1 : -1;
+        const cv::Vec3d col0(r(0, 0), r(1, 0), sign * b0);
+        const cv::Vec3d col1(r(0, 1), r(1, 1), sign * b1);
+        const cv::Vec3d col2 = col0.cross(col1);
+        const cv::Matx33d inSight{col0[X], col1[X], col2[X],
+                                  col0[Y], col1[Y], col2[Y],
+                                  col0[Z], col1[Z], col2[Z]};
+        outRotations[solution] = lineOfSight * inSight;
+    }
+    return true;
+}
+
+/// least squares translation that moves the rotated plane points onto their lines of sight
+cv::Vec3d FitTranslation(std::span<const cv::Point3d, NUM_CORNERS> object, std::span<const cv::Point2d, NUM_CORNERS> normalized,
+                         const cv::Matx33d& rotation)
+{
+    cv::Matx33d ata{};
+    cv::Vec3d atb{};
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        const cv::Vec3d rotated = rotation * cv::Vec3d(object[corner].x, object[corner].y, object[corner].z);
+        for (const cv::Vec3d& row : {cv::Vec3d(1, 0, -normalized[corner].x), cv::Vec3d(0, 1, -normalized[corner].y)})
+        {
+            ata += row * row.t();
+            atb += row * -row.dot(rotated);
+        }
+    }
+    return ata.solve(atb, cv::DECOMP_CHOLESKY);
+}
+
+/// A single planar marker has two poses that fit about equally well, and iterating from a generic start picks either.
+/// Solve both in closed form with IPPE, on the stack, as this runs every frame a tracker shows a single marker.
+MarkerHypotheses SolveMarker(const Matches& matches, const CameraModel& model, int match)
+{
+    const int det = FindMatchedDetection(matches, match);
+    const MarkerFrame frame = GetMarkerFrame(matches.board.GetCorners(matches.board.FindMarker(matches.ids[det])));
+
+    const double half = frame.size / 2;
+    const std::array<cv::Point3d, NUM_CORNERS> square{
+        cv::Point3d(-half, half, 0), cv::Point3d(half, half, 0), cv::Point3d(half, -half, 0), cv::Point3d(-half, -half, 0)};
+    std::array<cv::Point2d, NUM_CORNERS> image;
+    std::array<cv::Point2d, NUM_CORNERS> normalized;
+    // homography of the square onto the z = 1 plane, with its bottom right element fixed to 1
+    cv::Matx<double, 2 * NUM_CORNERS, 8> system;
+    cv::Vec<double, 2 * NUM_CORNERS> rhs;
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        const cv::Point2f& detected = matches.corners[static_cast<std::size_t>(det) * NUM_CORNERS + corner];
+        image[corner] = cv::Point2d(detected.x, detected.y);
+        normalized[corner] = UnprojectNormalized(model, image[corner]);
+        const double x = square[corner].x;
+        const double y = square[corner].y;
+        const double u = normalized[corner].x;
+        const double v = normalized[corner].y;
+        const std::array<double, 8> uRow{x, y, 1, 0, 0, 0, -u * x, -u * y};
+        const std::array<double, 8> vRow{0, 0, 0, x, y, 1, -v * x, -v * y};
+        for (int col = 0; col < 8; ++col)
+        {
+            system(2 * corner, col) = uRow[col];
+            system(2 * corner + 1, col) = vRow[col];
+        }
+        rhs[2 * corner] = u;
+        rhs[2 * corner + 1] = v;
+    }
+    const cv::Vec<double, 8> h = system.solve(rhs, cv::DECOMP_LU);
+    // the square is centered, so the jacobian is taken at its center
+    const cv::Matx22d jacobian{h[0] - h[6] * h[2], h[1] - h[7] * h[2],
+                               h[3] - h[6] * h[5], h[4] - h[7] * h[5]};
+
+    MarkerHypotheses result;
+    std::array<cv::Matx33d, 2> rotations;
+    if (!IppeRotations(jacobian, cv::Vec2d(h[2], h[5]), rotations)) return result;
+
+    std::array<double, 2> errors{};
+    for (const cv::Matx33d& markerRotation : rotations)
+    {
+        const cv::Vec3d markerTranslation = FitTranslation(square, normalized, markerRotation);
+        double squaredError = 0;
+        bool isInFront = true;
+        for (int corner = 0; corner < NUM_CORNERS && isInFront; ++corner)
+        {
+            cv::Point2d residual;
+            isInFront = Residual(model, markerRotation, markerTranslation, square[corner], image[corner], residual);
+            squaredError += residual.dot(residual);
+        }
+        if (!isInFront) continue;
+
+        // marker to camera, then board to marker
+        const int index = result.count++;
+        result.rotations[index] = cv::Quatd::createFromRotMat(markerRotation) * frame.rotation.conjugate();
+        result.translations[index] = markerTranslation - result.rotations[index].toRotMat3x3() * frame.center;
+        errors[index] = squaredError;
+    }
+    if (result.count == 2 && errors[1] < errors[0])
+    {
+        std::swap(result.rotations[0], result.rotations[1]);
+        std::swap(result.translations[0], result.translations[1]);
+    }
+    return result;
+}
+
+/// solution closest to guessRotation, or with the lower reprojection error without a guess
+int PickHypothesis(const MarkerHypotheses& hypotheses, const cv::Quatd* guessRotation)
+{
+    if (guessRotation == nullptr || hypotheses.count < 2) return 0;
+    return RotationAngle(*guessRotation, hypotheses.rotations[1]) < RotationAngle(*guessRotation, hypotheses.rotations[0]) ? 1 : 0;
+}
+
+/// root mean square reprojection error of each matched marker
+void MarkerErrors(const Matches& matches, const CameraModel& model, const cv::Quatd& rotation, const cv::Vec3d& translation,
+                  std::array<double, Matches::MAX_MASKED>& outErrors)
+{
+    outErrors.fill(0);
+    const cv::Matx33d rotationMat = rotation.toRotMat3x3();
+    ForEachMatch(matches, [&](int match, const cv::Point3d& object, const cv::Point2d& image) {
+        if (match >= Matches::MAX_MASKED) return;
+        cv::Point2d residual;
+        // a corner behind the camera never fits
+        outErrors[match] += Residual(model, rotationMat, translation, object, image, residual)
+                                ? residual.dot(residual) / NUM_CORNERS
+                                : std::numeric_limits<double>::infinity();
+    });
+    for (double& error : outErrors)
+    {
+        error = std::sqrt(error);
+    }
+}
+
+/// markers that fit within OUTLIER_MARKER_ERROR
+std::uint64_t FindInliers(const std::array<double, Matches::MAX_MASKED>& errors, int markerCount)
+{
+    std::uint64_t inliers = 0;
+    for (int match = 0; match < std::min(markerCount, Matches::MAX_MASKED); ++match)
+    {
+        if (errors[match] <= OUTLIER_MARKER_ERROR) inliers |= std::uint64_t{1} << match;
+    }
+    return inliers;
+}
+
+int CountMarkers(std::uint64_t mask, int markerCount)
+{
+    return std::popcount(mask) + std::max(0, markerCount - Matches::MAX_MASKED);
+}
+
+/// Leaves out one marker per round, until the markers that are left agree on a pose.
+/// Each hypothesis of a round leaves one more marker out and refines the pose from the others, then counts the markers that fit it.
+/// Markers are tried worst fitting first, and a round stops at the first pose that all markers left agree with,
+/// which usually is the first hypothesis. Otherwise the round leaves out the marker whose hypothesis most markers fit,
+/// then the one fitting its own markers best, so several bad detections are left out one after the other.
+/// At least two markers are kept, so there are at most markerCount - 2 rounds.
+/// @return markers that agree with the best pose, which is returned in inOutRotation and inOutTranslation
+std::uint64_t RejectOutlierMarkers(const Matches& matches, const CameraModel& model, int markerCount,
+                                   cv::Quatd& inOutRotation, cv::Vec3d& inOutTranslation)
+{
+    std::array<double, Matches::MAX_MASKED> errors{};
+    MarkerErrors(matches, model, inOutRotation, inOutTranslation, errors);
+    std::uint64_t bestInliers = FindInliers(errors, markerCount);
+    int bestCount = CountMarkers(bestInliers, markerCount);
+    // early exit, every marker agrees with the pose from all markers
+    if (bestCount == markerCount) return bestInliers;
+
+    const int candidateCount = std::min(markerCount, Matches::MAX_MASKED);
+    const std::uint64_t candidateMask = candidateCount == Matches::MAX_MASKED ? Matches::ALL : (std::uint64_t{1} << candidateCount) - 1;
+    std::uint64_t remaining = Matches::ALL;
+    int remainingCount = markerCount;
+    cv::Quatd rotation = inOutRotation;
+    cv::Vec3d translation = inOutTranslation;
+    std::array<double, Matches::MAX_MASKED> hypothesisErrors{};
+    while (remainingCount > 2)
+    {
+        std::array<int, Matches::MAX_MASKED> candidates{};
+        int roundCandidates = 0;
+        for (int match = 0; match < candidateCount; ++match)
+        {
+            if ((remaining >> match) & 1U) candidates[roundCandidates++] = match;
+        }
+        std::sort(candidates.begin(), candidates.begin() + roundCandidates, [&](int lhs, int rhs) { return errors[lhs] > errors[rhs]; });
+
+        int roundLeftOut = -1;
+        int roundCount = -1;
+        double roundFitError = std::numeric_limits<double>::infinity();
+        std::uint64_t roundInliers = 0;
+        cv::Quatd roundRotation = rotation;
+        cv::Vec3d roundTranslation = translation;
+        std::array<double, Matches::MAX_MASKED> roundErrors{};
+        for (int i = 0; i < roundCandidates; ++i)
+        {
+            Matches others = matches;
+            others.included = remaining & ~(std::uint64_t{1} << candidates[i]);
+            cv::Quatd hypothesisRotation = rotation;
+            cv::Vec3d hypothesisTranslation = translation;
+            const double fitError = Refine(others, model, hypothesisRotation, hypothesisTranslation).squaredError;
+
+            MarkerErrors(matches, model, hypothesisRotation, hypothesisTranslation, hypothesisErrors);
+            const std::uint64_t inliers = FindInliers(hypothesisErrors, markerCount);
+            const int count = CountMarkers(inliers, markerCount);
+            if (count > roundCount || (count == roundCount && fitError < roundFitError))
+            {
+                roundLeftOut = candidates[i];
+                roundCount = count;
+                roundFitError = fitError;
+                roundInliers = inliers;
+                roundRotation = hypothesisRotation;
+                roundTranslation = hypothesisTranslation;
+                roundErrors = hypothesisErrors;
+            }
+            // every marker left fits
+            if ((others.included & candidateMask & ~inliers) == 0) break;
+        }
+        if (roundLeftOut < 0) break;
+
+        remaining &= ~(std::uint64_t{1} << roundLeftOut);
+        --remainingCount;
+        rotation = roundRotation;
+        translation = roundTranslation;
+        errors = roundErrors;
+        if (roundCount > bestCount)
+        {
+            bestInliers = roundInliers;
+            bestCount = roundCount;
+            inOutRotation = rotation;
+            inOutTranslation = translation;
+        }
+        if ((remaining & candidateMask & ~roundInliers) == 0) break;
+    }
+    return bestInliers;
+}
+
+} // namespace
+
+BoardGeometry::BoardGeometry(const std::vector<int>& ids, const std::vector<MarkerCorners3f>& corners)
+{
+    ATT_ASSERT(ids.size() == corners.size());
+    const auto maxId = std::max_element(ids.begin(), ids.end());
+    if (maxId == ids.end()) return;
+    mMarkerOfId.assign(static_cast<std::size_t>(std::max(*maxId, 0)) + 1, -1);
+    mCorners.reserve(ids.size() * NUM_CORNERS);
+    for (std::size_t marker = 0; marker < ids.size(); ++marker)
+    {
+        ATT_ASSERT(ids[marker] >= 0 && corners[marker].size() == NUM_CORNERS);
+        mMarkerOfId[ids[marker]] = static_cast<int>(marker);
+        for (const cv::Point3f& corner : corners[marker])
+        {
+            mCorners.emplace_back(corner);
+        }
+    }
+}
+
+BoardPoseEstimate EstimatePoseTracker(std::span<const int> ids,
+                                      std::span<const cv::Point2f> corners,
+                                      const BoardGeometry& board,
+                                      const cfg::CameraCalib& camera,
+                                      bool usePredictive,
+                                      const RodrPose& predictiveGuess)
+{
+    if (const std::optional<CameraModel> model = CameraModel::FromCalib(camera))
+    {
+        return EstimatePoseTracker(ids, corners, board, *model, usePredictive, predictiveGuess);
+    }
+
+    ATT_ASSERT(corners.size() == ids.size() * NUM_CORNERS);
+    const Matches matches{ids, corners, board};
+    BoardPoseEstimate result;
+    result.pose = predictiveGuess;
+    result.markerCount = ForEachMatch(matches, [](int, const cv::Point3d&, const cv::Point2d&) {});
+    if (result.markerCount == 0) return result;
+    SolvePnPOpenCV(matches, camera.cameraMatrix, camera.distortionCoeffs,
+                   usePredictive, result.pose.rotation.value, result.pose.position);
+    result.inlierCount = result.markerCount;
+    result.confidence = 1;
+    return result;
+}
+
+BoardPoseEstimate EstimatePoseTracker(std::span<const int> ids,
+                                      std::span<const cv::Point2f> corners,
+                                      const BoardGeometry& board,
+                                      const CameraModel& model,
+                                      bool usePredictive,
+                                      const RodrPose& predictiveGuess)
+{
+    ATT_ASSERT(corners.size() == ids.size() * NUM_CORNERS);
+    Matches matches{ids, corners, board};
+    BoardPoseEstimate result;
+    result.pose = predictiveGuess;
+    result.markerCount = ForEachMatch(matches, [](int, const cv::Point3d&, const cv::Point2d&) {});
+    if (result.markerCount == 0) return result;
+
+    cv::Quatd rotation = QuatFromRvec(result.pose.rotation.value);
+    cv::Vec3d translation = result.pose.position;
+    bool isInitialized = false;
+    if (result.markerCount == 1)
+    {
+        const cv::Quatd guessRotation = rotation;
+        const MarkerHypotheses hypotheses = SolveMarker(matches, model, 0);
+        if (hypotheses.count > 0)
+        {
+            const int picked = PickHypothesis(hypotheses, usePredictive ? &guessRotation : nullptr);
+            rotation = hypotheses.rotations[picked];
+            translation = hypotheses.translations[picked];
+            isInitialized = true;
+        }
+    }
+    else if (usePredictive)
+    {
+        // a guess with corners behind the camera can not be refined
+        isInitialized = Accumulate(matches, model, rotation.toRotMat3x3(), translation).pointCount == result.markerCount * NUM_CORNERS;
+    }
+    // start over from the opencv estimate
+    if (!isInitialized)
+    {
+        cv::Vec3d rvec = result.pose.rotation.value;
+        WithOpenCVIntrinsics(model, [&](cv::InputArray cameraMatrix, cv::InputArray distortionCoeffs) {
+            SolvePnPOpenCV(matches, cameraMatrix, distortionCoeffs, false, rvec, translation);
+        });
+        rotation = QuatFromRvec(rvec);
+    }
+
+    NormalEquations equations = Refine(matches, model, rotation, translation);
+    result.inlierCount = result.markerCount;
+    // with two markers there is no majority to tell which one is off
+    if (result.markerCount >= 3)
+    {
+        cv::Quatd robustRotation = rotation;
+        cv::Vec3d robustTranslation = translation;
+        const std::uint64_t inliers = RejectOutlierMarkers(matches, model, result.markerCount, robustRotation, robustTranslation);
+        const int inlierCount = CountMarkers(inliers, result.markerCount);
+        // one marker can not outvote the rest
+        if (inlierCount >= 2 && inlierCount < result.markerCount)
+        {
+            rotation = robustRotation;
+            translation = robustTranslation;
+            matches.included = inliers;
+            equations = Refine(matches, model, rotation, translation);
+            result.inlierCount = inlierCount;
+        }
+    }
+
+    result.pose = RodrPose(translation, RodriguesVec3d(RvecFromQuat(rotation)));
+    if (equations.pointCount > 0)
+    {
+        result.reprojectionError = std::sqrt(equations.squaredError / equations.pointCount);
+        const double variance = std::max(MIN_CORNER_VARIANCE, equations.squaredError / std::max(1, 2 * equations.pointCount - 6));
+        result.covariance = equations.jtj.inv(cv::DECOMP_CHOLESKY) * variance;
+    }
+    result.confidence = (static_cast<double>(result.inlierCount) / result.markerCount) *
+                        (OUTLIER_MARKER_ERROR / (OUTLIER_MARKER_ERROR + result.reprojectionError));
+    return result;
+}
+
+double GetTrackingConfidence(const BoardPoseEstimate& estimate, double positionScale)
+{
+    if (estimate.markerCount <= 0) return 0;
+    // translation block, an unsupported camera model leaves it zero and only the fit counts
+    const double positionVariance = estimate.covariance(3, 3) + estimate.covariance(4, 4) + estimate.covariance(5, 5);
+    const double deviation = std::sqrt(std::max(0.0, positionVariance)) * positionScale;
+    return estimate.confidence * (HALF_CONFIDENCE_DEVIATION / (HALF_CONFIDENCE_DEVIATION + deviation));
+}
+
+namespace
+{
+
+struct SyntheticBoard
+{
+    std::vector<int> ids{3, 7, 12};
+    std::vector<MarkerCorners3f> corners;
+    cfg::CameraCalib camera;
+    RodrPose truth{cv::Vec3d(0.05, -0.1, 1.2), RodriguesVec3d(cv::Vec3d(0.3, -0.5, 0.2))};
+    std::vector<int> detectedIds{12, 5, 3, 7};
+    std::vector<cv::Point2f> detectedCorners;
+
+    SyntheticBoard()
+    {
+        camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 620, 0, 321.5, 0, 615, 238.25, 0, 0, 1);
+        camera.distortionCoeffs = (cv::Mat_<double>(1, 5) << -0.1, 0.05, 0.001, -0.002, 0.01);
+        // a tracker with markers facing three directions
+        const float half = 0.03F;
+        corners.push_back({{-half, half, 0}, {half, half, 0}, {half, -half, 0}, {-half, -half, 0}});
+        corners.push_back({{0.05F, half, -0.02F}, {0.08F, half, -0.06F}, {0.08F, -half, -0.06F}, {0.05F, -half, -0.02F}});
+        corners.push_back({{-0.08F, half, -0.06F}, {-0.05F, half, -0.02F}, {-0.05F, -half, -0.02F}, {-0.08F, -half, -0.06F}});
+
+        cv::RNG rng{42};
+        for (const int id : detectedIds)
+        {
+            const auto marker = std::find(ids.begin(), ids.end(), id);
+            std::vector<cv::Point2f> projected(NUM_CORNERS, cv::Point2f(10, 10));
+            if (marker != ids.end())
+            {
+                cv::projectPoints(corners[marker - ids.begin()], truth.rotation.value, truth.position,
+                                  camera.cameraMatrix, camera.distortionCoeffs, projected);
+            }
+            for (const cv::Point2f& corner : projected)
+            {
+                detectedCorners.emplace_back(corner.x + static_cast<float>(rng.gaussian(0.3)), corner.y + static_cast<float>(rng.gaussian(0.3)));
+            }
+        }
+    }
+
+    RodrPose EstimateOpenCV(bool useGuess, RodrPose pose) const
+    {
+        std::vector<std::vector<cv::Point2f>> arucoCorners;
+        for (std::size_t i = 0; i < detectedIds.size(); ++i)
+        {
+            arucoCorners.emplace_back(detectedCorners.begin() + static_cast<std::ptrdiff_t>(i * NUM_CORNERS),
+                                      detectedCorners.begin() + static_cast<std::ptrdiff_t>((i + 1) * NUM_CORNERS));
+        }
+        const ArucoBoardSharedPtr board = cv::aruco::Board::create(corners, cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50), ids);
+        cv::aruco::estimatePoseBoard(arucoCorners, detectedIds, board, camera.cameraMatrix, camera.distortionCoeffs,
+                                     pose.rotation.value, pose.position, useGuess);
+        return pose;
+    }
+};
+
+double RotationDifference(const RodrPose& lhs, const RodrPose& rhs)
+{
+    const cv::Quatd diff = QuatFromRvec(lhs.rotation.value).conjugate() * QuatFromRvec(rhs.rotation.value);
+    return cv::norm(RvecFromQuat(diff));
+}
+
+} // namespace
+
+TEST_CASE("EstimatePoseTracker matches cv::aruco::estimatePoseBoard")
+{
+    const SyntheticBoard synth;
+    const BoardGeometry board{synth.ids, synth.corners};
+    CHECK(board.GetMarkerCount() == 3);
+    CHECK(board.FindMarker(5) == -1);
+    CHECK(board.FindMarker(12) == 2);
+
+    const BoardPoseEstimate cold = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera);
+    CHECK(cold.markerCount == 3);
+    const RodrPose expectedCold = synth.EstimateOpenCV(false, {});
+    CHECK(cv::norm(cold.pose.position - expectedCold.position) < 1e-5);
+    CHECK(RotationDifference(cold.pose, expectedCold) < 1e-5);
+    CHECK(cold.reprojectionError < 1);
+    for (int i = 0; i < 6; ++i)
+    {
+        CHECK(cold.covariance(i, i) > 0);
+    }
+
+    const RodrPose guess{synth.truth.position + cv::Vec3d(0.02, 0.01, -0.03), RodriguesVec3d(synth.truth.rotation.value + cv::Vec3d(0.05, -0.03, 0.02))};
+    const RodrPose expectedWarm = synth.EstimateOpenCV(true, guess);
+    BoardPoseEstimate warm = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera, true, guess);
+    CHECK(cv::norm(warm.pose.position - expectedWarm.position) < 1e-5);
+    CHECK(RotationDifference(warm.pose, expectedWarm) < 1e-5);
+
+    if (utils::IsCountingAllocations())
+    {
+        const std::uint64_t before = utils::GetThisThreadAllocationCount();
+        warm = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera, true, guess);
+        CHECK(utils::GetThisThreadAllocationCount() == before);
+    }
+
+    const std::vector<int> otherIds{1, 2};
+    const std::vector<cv::Point2f> otherCorners(otherIds.size() * NUM_CORNERS);
+    CHECK(EstimatePoseTracker(otherIds, otherCorners, board, synth.camera).markerCount == 0);
+}
+
+TEST_CASE("EstimatePoseTracker benchmark")
+{
+    const SyntheticBoard synth;
+    const BoardGeometry board{synth.ids, synth.corners};
+    const RodrPose guess{synth.truth.position + cv::Vec3d(0.002, 0.001, -0.003), RodriguesVec3d(synth.truth.rotation.value + cv::Vec3d(0.01, -0.005, 0.005))};
+    // enough solves that the clock resolution does not matter
+    constexpr int solves = 2000;
+    const auto microsPerSolve = [&](auto&& solve) {
+        solve(); // warm up, the first call may allocate
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < solves; ++i)
+        {
+            solve();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / solves;
+    };
+
+    // the previous estimator, with the board and corner lists built once, like the tracking loop kept them
+    std::vector<std::vector<cv::Point2f>> arucoCorners;
+    for (std::size_t i = 0; i < synth.detectedIds.size(); ++i)
+    {
+        arucoCorners.emplace_back(synth.detectedCorners.begin() + static_cast<std::ptrdiff_t>(i * NUM_CORNERS),
+                                  synth.detectedCorners.begin() + static_cast<std::ptrdiff_t>((i + 1) * NUM_CORNERS));
+    }
+    const ArucoBoardSharedPtr arucoBoard = cv::aruco::Board::create(synth.corners, cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50), synth.ids);
+    RodrPose openCVPose{};
+    const auto estimateOpenCV = [&](bool useGuess, const RodrPose& start) {
+        openCVPose = start;
+        cv::aruco::estimatePoseBoard(arucoCorners, synth.detectedIds, arucoBoard, synth.camera.cameraMatrix, synth.camera.distortionCoeffs,
+                                     openCVPose.rotation.value, openCVPose.position, useGuess);
+    };
+
+    BoardPoseEstimate estimate{};
+    const double openCVWarm = microsPerSolve([&] { estimateOpenCV(true, guess); });
+    const double solverWarm = microsPerSolve([&] { estimate = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera, true, guess); });
+    CHECK(cv::norm(estimate.pose.position - openCVPose.position) < 1e-5);
+    const double openCVCold = microsPerSolve([&] { estimateOpenCV(false, RodrPose{}); });
+    const double solverCold = microsPerSolve([&] { estimate = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera); });
+    CHECK(cv::norm(estimate.pose.position - openCVPose.position) < 1e-5);
+
+    MESSAGE("warm start: estimatePoseBoard ", openCVWarm, " us, EstimatePoseTracker ", solverWarm, " us, ", openCVWarm / solverWarm, "x");
+    MESSAGE("cold start: estimatePoseBoard ", openCVCold, " us, EstimatePoseTracker ", solverCold, " us, ", openCVCold / solverCold, "x");
+}
+
+TEST_CASE("EstimatePoseTracker rejects a displaced marker")
+{
+    SyntheticBoard synth;
+    const BoardGeometry board{synth.ids, synth.corners};
+    const BoardPoseEstimate clean = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera);
+    CHECK(clean.inlierCount == 3);
+
+    // detection of id 7, as if partially occluded
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        synth.detectedCorners[3 * NUM_CORNERS + corner] += cv::Point2f(12, -9);
+    }
+    const BoardPoseEstimate estimate = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera);
+    CHECK(estimate.markerCount == 3);
+    CHECK(estimate.inlierCount == 2);
+    CHECK(estimate.confidence < clean.confidence);
+    CHECK(estimate.reprojectionError < 1);
+    CHECK(cv::norm(estimate.pose.position - synth.truth.position) < 0.01);
+    CHECK(RotationDifference(estimate.pose, synth.truth) < 0.02);
+}
+
+TEST_CASE("EstimatePoseTracker rejects two displaced markers")
+{
+    SyntheticBoard synth;
+    // two more markers above and below the front one, so three markers are left to agree
+    const float half = 0.03F;
+    const std::vector<int> extraIds{20, 21};
+    synth.corners.push_back({{-half, 0.09F, -0.01F}, {half, 0.09F, -0.01F}, {half, 0.05F, 0}, {-half, 0.05F, 0}});
+    synth.corners.push_back({{-half, -0.05F, 0}, {half, -0.05F, 0}, {half, -0.09F, -0.01F}, {-half, -0.09F, -0.01F}});
+    cv::RNG rng{7};
+    for (std::size_t i = 0; i < extraIds.size(); ++i)
+    {
+        synth.ids.push_back(extraIds[i]);
+        synth.detectedIds.push_back(extraIds[i]);
+        std::vector<cv::Point2f> projected;
+        cv::projectPoints(synth.corners[3 + i], synth.truth.rotation.value, synth.truth.position,
+                          synth.camera.cameraMatrix, synth.camera.distortionCoeffs, projected);
+        for (const cv::Point2f& corner : projected)
+        {
+            synth.detectedCorners.emplace_back(corner.x + static_cast<float>(rng.gaussian(0.3)), corner.y + static_cast<float>(rng.gaussian(0.3)));
+        }
+    }
+    const BoardGeometry board{synth.ids, synth.corners};
+    const RodrPose guess{synth.truth.position + cv::Vec3d(0.02, 0.01, -0.03), RodriguesVec3d(synth.truth.rotation.value + cv::Vec3d(0.05, -0.03, 0.02))};
+
+    // detections of id 7 and id 20, a single leave-one-out hypothesis still contains one of them
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        synth.detectedCorners[3 * NUM_CORNERS + corner] += cv::Point2f(12, -9);
+        synth.detectedCorners[4 * NUM_CORNERS + corner] += cv::Point2f(-10, 14);
+    }
+    const BoardPoseEstimate estimate = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, board, synth.camera, true, guess);
+    CHECK(estimate.markerCount == 5);
+    CHECK(estimate.inlierCount == 3);
+    CHECK(estimate.reprojectionError < 1);
+    // three small markers at over a meter, the noise alone moves the depth by around a centimeter
+    CHECK(cv::norm(estimate.pose.position - synth.truth.position) < 0.02);
+    CHECK(RotationDifference(estimate.pose, synth.truth) < 0.02);
+}
+
+TEST_CASE("EstimatePoseTracker picks the single marker pose closest to the guess")
+{
+    const SyntheticBoard synth;
+    // only the side marker, offset and tilted from the board center
+    const BoardGeometry board{{7}, {synth.corners[1]}};
+    const std::vector<int> ids{7};
+    std::vector<cv::Point2f> corners;
+    cv::projectPoints(synth.corners[1], synth.truth.rotation.value, synth.truth.position,
+                      synth.camera.cameraMatrix, synth.camera.distortionCoeffs, corners);
+
+    const RodrPose guess{synth.truth.position + cv::Vec3d(0.01, 0, 0.02), RodriguesVec3d(synth.truth.rotation.value + cv::Vec3d(0.1, 0.05, 0))};
+    const BoardPoseEstimate estimate = EstimatePoseTracker(ids, corners, board, synth.camera, true, guess);
+    CHECK(estimate.markerCount == 1);
+    CHECK(cv::norm(estimate.pose.position - synth.truth.position) < 1e-4);
+    CHECK(RotationDifference(estimate.pose, synth.truth) < 1e-4);
+    CHECK(estimate.reprojectionError < 1e-3);
+
+    if (utils::IsCountingAllocations())
+    {
+        const std::uint64_t before = utils::GetThisThreadAllocationCount();
+        EstimatePoseTracker(ids, corners, board, synth.camera, true, guess);
+        CHECK(utils::GetThisThreadAllocationCount() == before);
+    }
+
+    // without a guess either solution fits the corners
+    const BoardPoseEstimate unguided = EstimatePoseTracker(ids, corners, board, synth.camera);
+    CHECK(unguided.markerCount == 1);
+    CHECK(unguided.reprojectionError < 1e-2);
+}
+
+TEST_CASE("GetTrackingConfidence trusts more markers and closer trackers")
+{
+    const SyntheticBoard synth;
+    const BoardPoseEstimate full = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, BoardGeometry{synth.ids, synth.corners}, synth.camera);
+    const BoardPoseEstimate single = EstimatePoseTracker(synth.detectedIds, synth.detectedCorners, BoardGeometry{{7}, {synth.corners[1]}}, synth.camera);
+    REQUIRE(full.markerCount == 3);
+    REQUIRE(single.markerCount == 1);
+
+    const double fullConfidence = GetTrackingConfidence(full, 1);
+    CAPTURE(fullConfidence);
+    CHECK(fullConfidence > 0);
+    CHECK(fullConfidence <= 1);
+    CHECK(GetTrackingConfidence(single, 1) < fullConfidence);
+    // the same deviation in units is ten times larger in meters
+    CHECK(GetTrackingConfidence(full, 10) < fullConfidence);
+    CHECK(GetTrackingConfidence(BoardPoseEstimate{}, 1) == 0);
+}
+
+} // namespace math
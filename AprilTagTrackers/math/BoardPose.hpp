@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CameraModel.hpp"
+#include "config/VideoStream.hpp"
+#include "CVTypes.hpp"
+#include "Helpers.hpp"
+
+#include <span>
+#include <vector>
+
+namespace math
+{
+
+/// Corners of the markers of a tracker, indexed by marker id, so detections are matched without a search.
+/// Rebuild whenever the markers of the tracker change.
+class BoardGeometry
+{
+public:
+    BoardGeometry() = default;
+    /// @param corners 4 corners per id, in the same order as detected corners
+    BoardGeometry(const std::vector<int>& ids, const std::vector<MarkerCorners3f>& corners);
+
+    /// index of the marker with id, or -1 if the board does not contain it
+    int FindMarker(int id) const
+    {
+        if (id < 0 || id >= static_cast<int>(mMarkerOfId.size())) return -1;
+        return mMarkerOfId[id];
+    }
+    std::span<const cv::Point3d, NUM_CORNERS> GetCorners(int marker) const
+    {
+        return std::span<const cv::Point3d, NUM_CORNERS>(mCorners.data() + static_cast<std::ptrdiff_t>(marker) * NUM_CORNERS, NUM_CORNERS);
+    }
+    int GetMarkerCount() const { return static_cast<int>(mCorners.size()) / NUM_CORNERS; }
+    bool Empty() const { return mCorners.empty(); }
+
+private:
+    std::vector<int> mMarkerOfId;
+    std::vector<cv::Point3d> mCorners;
+};
+
+struct BoardPoseEstimate
+{
+    /// board to camera
+    RodrPose pose{};
+    /// markers of the board found in the detections, 0 if the pose was not estimated
+    int markerCount = 0;
+    /// markers that agree with the pose, the others were left out of the estimate
+    int inlierCount = 0;
+    /// 0 to 1, fraction of inliers weighted by how well they fit
+    double confidence = 0;
+    /// root mean square reprojection error, in pixels
+    double reprojectionError = 0;
+    /// covariance of rotation then translation, scaled by the reprojection error, but at least by the corner detection noise.
+    /// Rotation is a small angle-axis rotation in camera space, applied after pose.rotation.
+    /// All zero if the camera model is not supported by CameraModel.
+    cv::Matx66d covariance{};
+};
+
+// This function receives the detected markers and returns the pose of a marker board composed by those markers.
+// Same result as cv::aruco::estimatePoseBoard, minimizing the reprojection error with Levenberg-Marquardt,
+// but accumulates the 6x6 normal equations directly from the matched corners, so a warm started estimate does not allocate.
+// Input markers that are not included in the board layout are ignored.
+// With three or more markers, markers that disagree with the pose the others agree on are left out, see inlierCount.
+/// @param ids detected marker ids
+/// @param corners 4 detected corners per id, like MarkerDetectionList::corners
+/// @param usePredictive start from predictiveGuess, instead of the opencv initial estimate
+BoardPoseEstimate EstimatePoseTracker(std::span<const int> ids,
+                                      std::span<const cv::Point2f> corners,
+                                      const BoardGeometry& board,
+                                      const cfg::CameraCalib& camera,
+                                      bool usePredictive = false,
+                                      const RodrPose& predictiveGuess = {});
+/// same as above, with a camera model already read from the calibration,
+/// like the pinhole model of UndistortionMap for corners that were undistorted
+BoardPoseEstimate EstimatePoseTracker(std::span<const int> ids,
+                                      std::span<const cv::Point2f> corners,
+                                      const BoardGeometry& board,
+                                      const CameraModel& model,
+                                      bool usePredictive = false,
+                                      const RodrPose& predictiveGuess = {});
+
+/// 0 to 1, how far a pose can be trusted, so the driver smooths poor poses more than good ones.
+/// The confidence of the estimate, lowered by the position deviation from the covariance,
+/// which grows with distance, grazing view angles and fewer visible markers.
+/// @param positionScale meters per unit of the estimated position
+double GetTrackingConfidence(const BoardPoseEstimate& estimate, double positionScale);
+
+} // namespace math
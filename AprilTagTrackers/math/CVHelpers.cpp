@@ -0,0 +1,118 @@
+#include "CVHelpers.hpp"
+
+#include "CameraModel.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <array>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+namespace math
+{
+
+namespace
+{
+
+cv::Point2d ProjectPointOpenCV(const cv::Point3d& point, const cfg::CameraCalib& camera)
+{
+    const std::array<cv::Point3d, 1> points{point};
+    std::array<cv::Point2d, 1> projected;
+    const cv::Vec3d zeroRVec{};
+    const cv::Vec3d zeroTVec{};
+    cv::projectPoints(points, zeroRVec, zeroTVec, camera.cameraMatrix, camera.distortionCoeffs, projected);
+    return projected[0];
+}
+
+} // namespace
+
+cv::Point2d ProjectPoint(const cv::Point3d& point, const cfg::CameraCalib& camera)
+{
+    if (const std::optional<CameraModel> model = CameraModel::FromCalib(camera)) return model->Project(point);
+    return ProjectPointOpenCV(point, camera);
+}
+
+double DownscaleForDetection(const cv::Mat& image, cv::Mat& outSmall, int maxWidth)
+{
+    if (image.cols <= maxWidth)
+    {
+        outSmall = image;
+        return 1;
+    }
+    const double scale = static_cast<double>(image.cols) / maxWidth;
+    // area averaging keeps thin edges of markers and squares that nearest or linear would skip over
+    cv::resize(image, outSmall, cv::Size(maxWidth, cvRound(image.rows / scale)), 0, 0, cv::INTER_AREA);
+    return static_cast<double>(image.cols) / outSmall.cols;
+}
+
+cv::Rect PaddedBoundingRect(std::span<const cv::Point2f> points, int margin, cv::Size2i imageSize)
+{
+    if (points.empty()) return {};
+    const cv::Rect bounds = cv::boundingRect(std::vector<cv::Point2f>(points.begin(), points.end()));
+    const cv::Rect padded{bounds.x - margin, bounds.y - margin, bounds.width + 2 * margin, bounds.height + 2 * margin};
+    return padded & cv::Rect(cv::Point(0, 0), imageSize);
+}
+
+cv::Quatd QuatFromRvec(const cv::Vec3d& rvec)
+{
+    const double angle = cv::norm(rvec);
+    if (angle < 1e-8) return cv::Quatd(1, rvec[0] / 2, rvec[1] / 2, rvec[2] / 2).normalize();
+    const double scale = std::sin(angle / 2) / angle;
+    return {std::cos(angle / 2), rvec[0] * scale, rvec[1] * scale, rvec[2] * scale};
+}
+
+cv::Vec3d RvecFromQuat(cv::Quatd quat)
+{
+    if (quat.w < 0) quat = -quat;
+    const cv::Vec3d axis{quat.x, quat.y, quat.z};
+    const double sinHalf = cv::norm(axis);
+    if (sinHalf < 1e-12) return axis * 2;
+    return axis * (2 * std::atan2(sinHalf, quat.w) / sinHalf);
+}
+
+TEST_CASE("ProjectPoint matches cv::projectPoints")
+{
+    cfg::CameraCalib camera;
+    camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 620, 0, 321.5, 0, 615, 238.25, 0, 0, 1);
+    const std::array<cv::Point3d, 4> points{
+        cv::Point3d(0, 0, 1), cv::Point3d(0.3, -0.2, 1.5), cv::Point3d(-0.8, 0.5, 2), cv::Point3d(0.1, 0.1, -3)};
+
+    const std::array<cv::Mat, 4> distortions{
+        cv::Mat(),
+        cv::Mat(cv::Mat_<double>(1, 5) << -0.1, 0.05, 0.001, -0.002, 0.01),
+        cv::Mat(cv::Mat_<double>(5, 1) << 0.2, -0.3, -0.001, 0.003, 0.1),
+        cv::Mat(cv::Mat_<double>(1, 12) << -0.1, 0.05, 0.001, -0.002, 0.01, 0.02, -0.01, 0.005, 0.001, -0.001, 0.002, -0.002)};
+
+    for (const cv::Mat& distortion : distortions)
+    {
+        camera.distortionCoeffs = distortion;
+        for (const cv::Point3d& point : points)
+        {
+            const cv::Point2d expected = ProjectPointOpenCV(point, camera);
+            const cv::Point2d actual = ProjectPoint(point, camera);
+            CHECK(cv::norm(expected - actual) < 1e-9);
+        }
+    }
+}
+
+TEST_CASE("DownscaleForDetection and PaddedBoundingRect")
+{
+    const cv::Mat large(1080, 1920, CV_8UC1, cv::Scalar(128));
+    cv::Mat small;
+    CHECK(DownscaleForDetection(large, small, 960) == 2);
+    CHECK(GetMatSize(small) == cv::Size2i(960, 540));
+    // an image no wider is shared, not copied
+    CHECK(DownscaleForDetection(small, small, 960) == 1);
+    CHECK(small.cols == 960);
+
+    const std::array<cv::Point2f, 3> points{cv::Point2f(100, 50), cv::Point2f(300.5F, 20), cv::Point2f(150, 400)};
+    CHECK(PaddedBoundingRect(points, 10, {1920, 1080}) == cv::Rect(90, 10, 221, 401));
+    // clipped to the image
+    CHECK(PaddedBoundingRect(points, 100, {350, 450}) == cv::Rect(0, 0, 350, 450));
+    CHECK(PaddedBoundingRect({}, 10, {1920, 1080}).empty());
+}
+
+} // namespace math
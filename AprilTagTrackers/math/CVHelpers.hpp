@@ -6,6 +6,7 @@
 #include "utils/Error.hpp"
 
 #include <array>
+#include <span>
 
 namespace math
 {
@@ -22,7 +23,8 @@ struct EstimatePoseSingleMarkersResult
 // The coordinates of the four corners of the marker in its own coordinate system are:
 // (-markerLength/2, markerLength/2, 0), (markerLength/2, markerLength/2, 0),
 // (markerLength/2, -markerLength/2, 0), (-markerLength/2, -markerLength/2, 0)
-inline void EstimatePoseSingleMarkers(const std::vector<MarkerCorners2f>& corners,
+/// corners are any opencv array of arrays, like vector<MarkerCorners2f> or MarkerDetectionList::GetCornerViews
+inline void EstimatePoseSingleMarkers(cv::InputArrayOfArrays corners,
                                       const double markerSize,
                                       const cfg::CameraCalib& camera,
                                       EstimatePoseSingleMarkersResult& result)
@@ -37,30 +39,24 @@ inline void EstimatePoseSingleMarkers(const std::vector<MarkerCorners2f>& corner
         result.rotations, result.positions);
 }
 
-// This function receives the detected markers and returns the pose of a marker board composed by those markers.
-// A Board of marker has a single world coordinate system which is defined by the board layout.
-// The returned transformation is the one that transforms points from the board coordinate system to the camera coordinate system.
-// Input markers that are not included in the board layout are ignored.
-// The function returns the number of markers from the input employed for the board pose estimation.
-// Note that returning a 0 means the pose has not been estimated.
-inline std::tuple<RodrPose, int> EstimatePoseTracker(const std::vector<MarkerCorners2f>& corners,
-                                                     const std::vector<int>& ids,
-                                                     const ArucoBoardSharedPtr& board,
-                                                     const cfg::CameraCalib& camera,
-                                                     const bool usePredictive = false,
-                                                     const RodrPose& predictiveGuess = {})
-{
-    RodrPose outPose = predictiveGuess;
-    const int estimated = cv::aruco::estimatePoseBoard(
-        corners, ids, board,
-        camera.cameraMatrix, camera.distortionCoeffs,
-        outPose.rotation.value, outPose.position,
-        usePredictive);
-    return {outPose, estimated};
-}
+/// Project a point in camera space to pixels, same as cv::projectPoints with zero rvec and tvec,
+/// but without its temporary matrices, so it does not allocate.
+/// Falls back to cv::projectPoints for a tilted sensor or coefficients that are not double.
+cv::Point2d ProjectPoint(const cv::Point3d& point, const cfg::CameraCalib& camera);
+
+/// exponential map, exact for small rotations, where cv::Quatd::createFromRvec rounds to identity
+cv::Quatd QuatFromRvec(const cv::Vec3d& rvec);
+/// rotation vector with an angle in [0, pi], like cv::Rodrigues
+cv::Vec3d RvecFromQuat(cv::Quatd quat);
 
 inline cv::Size2i GetMatSize(const cv::Mat& mat) { return {mat.cols, mat.rows}; }
 
+/// downscale an image for a quick detection, to at most maxWidth wide, shares the image if it is not wider
+/// @return factor from coordinates in the downscaled image to the original, 1 if it was not downscaled
+double DownscaleForDetection(const cv::Mat& image, cv::Mat& outSmall, int maxWidth);
+/// bounding rectangle of the points, grown by margin on every side and clipped to the image
+cv::Rect PaddedBoundingRect(std::span<const cv::Point2f> points, int margin, cv::Size2i imageSize);
+
 /// resize an image to a maximum width or height, while maintaining aspect ratio
 inline cv::Size2i ConstrainSize(const cv::Size2i& size, int maxSize)
 {
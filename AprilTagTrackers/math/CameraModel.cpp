@@ -0,0 +1,138 @@
+#include "CameraModel.hpp"
+
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+
+namespace math
+{
+
+namespace
+{
+
+constexpr int TILTED_COEFFS = 14;
+
+} // namespace
+
+std::optional<CameraModel> CameraModel::FromCalib(const cfg::CameraCalib& camera)
+{
+    const cv::Mat& cameraMatrix = camera.cameraMatrix;
+    const cv::Mat& distortion = camera.distortionCoeffs;
+    const int numCoeffs = distortion.empty() ? 0 : static_cast<int>(distortion.total());
+
+    if (cameraMatrix.rows != 3 || cameraMatrix.cols != 3 || cameraMatrix.type() != CV_64F) return std::nullopt;
+    if (numCoeffs > 0 && (distortion.type() != CV_64F || !distortion.isContinuous())) return std::nullopt;
+    if (numCoeffs > TILTED_COEFFS) return std::nullopt;
+
+    std::array<double, TILTED_COEFFS> k{};
+    if (numCoeffs > 0) std::copy_n(distortion.ptr<double>(), numCoeffs, k.begin());
+    if (k[12] != 0 || k[13] != 0) return std::nullopt;
+
+    CameraModel model;
+    model.fx = cameraMatrix.at<double>(0, 0);
+    model.fy = cameraMatrix.at<double>(1, 1);
+    model.cx = cameraMatrix.at<double>(0, 2);
+    model.cy = cameraMatrix.at<double>(1, 2);
+    std::copy_n(k.begin(), MAX_COEFFS, model.coeffs.begin());
+    model.isDistorted = std::any_of(model.coeffs.begin(), model.coeffs.end(), [](double coeff) { return coeff != 0; });
+    return model;
+}
+
+CameraModel CameraModel::FromCameraMatrix(const cv::Matx33d& cameraMatrix)
+{
+    CameraModel model;
+    model.fx = cameraMatrix(0, 0);
+    model.fy = cameraMatrix(1, 1);
+    model.cx = cameraMatrix(0, 2);
+    model.cy = cameraMatrix(1, 2);
+    return model;
+}
+
+cv::Point2d CameraModel::Project(const cv::Point3d& point) const
+{
+    const double invZ = (point.z != 0) ? 1.0 / point.z : 1.0;
+    return ProjectNormalized(point.x * invZ, point.y * invZ);
+}
+
+cv::Point2d CameraModel::ProjectNormalized(double x, double y) const
+{
+    if (!isDistorted) return {x * fx + cx, y * fy + cy};
+    const auto& k = coeffs;
+    const double r2 = x * x + y * y;
+    const double r4 = r2 * r2;
+    const double r6 = r4 * r2;
+    const double a1 = 2 * x * y;
+    const double a2 = r2 + 2 * x * x;
+    const double a3 = r2 + 2 * y * y;
+    const double radial = (1 + k[0] * r2 + k[1] * r4 + k[4] * r6) / (1 + k[5] * r2 + k[6] * r4 + k[7] * r6);
+    const double xd = x * radial + k[2] * a1 + k[3] * a2 + k[8] * r2 + k[9] * r4;
+    const double yd = y * radial + k[2] * a3 + k[3] * a1 + k[10] * r2 + k[11] * r4;
+    return {xd * fx + cx, yd * fy + cy};
+}
+
+cv::Point2d CameraModel::ProjectNormalized(double x, double y, cv::Matx22d& outJacobian) const
+{
+    if (!isDistorted)
+    {
+        outJacobian = cv::Matx22d(fx, 0, 0, fy);
+        return {x * fx + cx, y * fy + cy};
+    }
+    const auto& k = coeffs;
+    const double r2 = x * x + y * y;
+    const double r4 = r2 * r2;
+    const double r6 = r4 * r2;
+    const double num = 1 + k[0] * r2 + k[1] * r4 + k[4] * r6;
+    const double den = 1 + k[5] * r2 + k[6] * r4 + k[7] * r6;
+    const double radial = num / den;
+    // derivative of radial by r2
+    const double dNum = k[0] + 2 * k[1] * r2 + 3 * k[4] * r4;
+    const double dDen = k[5] + 2 * k[6] * r2 + 3 * k[7] * r4;
+    const double dRadial = (dNum * den - num * dDen) / (den * den);
+    // derivative of the thin prism terms by r2
+    const double dPrismX = k[8] + 2 * k[9] * r2;
+    const double dPrismY = k[10] + 2 * k[11] * r2;
+
+    const double xd = x * radial + k[2] * 2 * x * y + k[3] * (r2 + 2 * x * x) + k[8] * r2 + k[9] * r4;
+    const double yd = y * radial + k[2] * (r2 + 2 * y * y) + k[3] * 2 * x * y + k[10] * r2 + k[11] * r4;
+
+    const double dxdx = radial + x * dRadial * 2 * x + 2 * k[2] * y + 6 * k[3] * x + dPrismX * 2 * x;
+    const double dxdy = x * dRadial * 2 * y + 2 * k[2] * x + 2 * k[3] * y + dPrismX * 2 * y;
+    const double dydx = y * dRadial * 2 * x + 2 * k[2] * x + 2 * k[3] * y + dPrismY * 2 * x;
+    const double dydy = radial + y * dRadial * 2 * y + 6 * k[2] * y + 2 * k[3] * x + dPrismY * 2 * y;
+
+    outJacobian = cv::Matx22d(fx * dxdx, fx * dxdy,
+                              fy * dydx, fy * dydy);
+    return {xd * fx + cx, yd * fy + cy};
+}
+
+TEST_CASE("CameraModel jacobian matches finite differences")
+{
+    cfg::CameraCalib camera;
+    camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 620, 0, 321.5, 0, 615, 238.25, 0, 0, 1);
+    camera.distortionCoeffs = (cv::Mat_<double>(1, 12) << -0.1, 0.05, 0.001, -0.002, 0.01, 0.02, -0.01, 0.005, 0.001, -0.001, 0.002, -0.002);
+    const std::optional<CameraModel> model = CameraModel::FromCalib(camera);
+    REQUIRE(model.has_value());
+
+    constexpr double step = 1e-7;
+    for (const cv::Point2d point : {cv::Point2d(0, 0), cv::Point2d(0.2, -0.1), cv::Point2d(-0.4, 0.3)})
+    {
+        cv::Matx22d jacobian;
+        const cv::Point2d center = model->ProjectNormalized(point.x, point.y, jacobian);
+        CHECK(cv::norm(center - model->ProjectNormalized(point.x, point.y)) < 1e-12);
+
+        const cv::Point2d byX = (model->ProjectNormalized(point.x + step, point.y) - model->ProjectNormalized(point.x - step, point.y)) / (2 * step);
+        const cv::Point2d byY = (model->ProjectNormalized(point.x, point.y + step) - model->ProjectNormalized(point.x, point.y - step)) / (2 * step);
+        CHECK(std::abs(jacobian(0, 0) - byX.x) < 1e-4);
+        CHECK(std::abs(jacobian(1, 0) - byX.y) < 1e-4);
+        CHECK(std::abs(jacobian(0, 1) - byY.x) < 1e-4);
+        CHECK(std::abs(jacobian(1, 1) - byY.y) < 1e-4);
+    }
+
+    camera.distortionCoeffs = cv::Mat::zeros(1, 14, CV_64F);
+    camera.distortionCoeffs.at<double>(12) = 0.01;
+    CHECK_NOT(CameraModel::FromCalib(camera).has_value());
+}
+
+} // namespace math
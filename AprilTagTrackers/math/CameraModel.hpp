@@ -0,0 +1,44 @@
+#pragma once
+
+#include "config/VideoStream.hpp"
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+
+#include <array>
+#include <optional>
+
+namespace math
+{
+
+/// Pinhole camera with the opencv distortion model, read once from a CameraCalib,
+/// so points can be projected with plain arithmetic instead of cv::projectPoints.
+struct CameraModel
+{
+    /// k1 k2 p1 p2 k3 k4 k5 k6 s1 s2 s3 s4, the opencv model without the tilted sensor
+    static constexpr int MAX_COEFFS = 12;
+
+    /// nullopt if the calibration is not double precision, or uses the tilted sensor model
+    static std::optional<CameraModel> FromCalib(const cfg::CameraCalib& camera);
+    /// ideal pinhole camera without distortion
+    static CameraModel FromCameraMatrix(const cv::Matx33d& cameraMatrix);
+
+    cv::Matx33d GetCameraMatrix() const { return {fx, 0, cx, 0, fy, cy, 0, 0, 1}; }
+
+    /// point in camera space to pixels
+    cv::Point2d Project(const cv::Point3d& point) const;
+    /// point on the z = 1 plane to pixels
+    cv::Point2d ProjectNormalized(double x, double y) const;
+    /// @param outJacobian derivative of the pixel by x and y
+    cv::Point2d ProjectNormalized(double x, double y, cv::Matx22d& outJacobian) const;
+
+    double fx = 1;
+    double fy = 1;
+    double cx = 0;
+    double cy = 0;
+    std::array<double, MAX_COEFFS> coeffs{};
+    /// any of coeffs is not zero, otherwise projection skips the distortion
+    bool isDistorted = false;
+};
+
+} // namespace math
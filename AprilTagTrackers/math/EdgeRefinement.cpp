@@ -0,0 +1,339 @@
+#include "EdgeRefinement.hpp"
+
+#include "CVHelpers.hpp"
+#include "CVTypes.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace math
+{
+
+namespace
+{
+
+constexpr int SAMPLES_PER_EDGE = 8;
+/// part of each edge next to the corners that is not sampled, the corners themselves are rounded by blur
+constexpr float EDGE_MARGIN = 0.15F;
+/// samples across the search radius on both sides of an edge
+constexpr int PROFILE_LENGTH = 9;
+/// smallest change between profile samples that counts as an edge
+constexpr float MIN_CONTRAST = 6;
+constexpr float MIN_EDGE_LENGTH = 8;
+/// furthest a refined corner may be from the projected one, the search along the edges reaches about as far
+constexpr float MAX_CORNER_SHIFT = 1.5F;
+/// furthest a detected corner may be from the projected marker shifted onto the detection,
+/// further and the predicted rotation disagrees with the detection, so its edges would not be found where searched
+constexpr float MAX_SHAPE_DEVIATION = 3;
+/// corners closer to the camera plane than this are not projected
+constexpr double MIN_DEPTH = 1e-6;
+
+/// bilinear sample of an 8 bit image, false if outside
+bool Sample(const cv::Mat& gray, cv::Point2f point, float& outValue)
+{
+    const auto x0 = static_cast<int>(std::floor(point.x));
+    const auto y0 = static_cast<int>(std::floor(point.y));
+    if (x0 < 0 || y0 < 0 || x0 + 1 >= gray.cols || y0 + 1 >= gray.rows) return false;
+    const float tx = point.x - static_cast<float>(x0);
+    const float ty = point.y - static_cast<float>(y0);
+    const std::uint8_t* const top = gray.ptr<std::uint8_t>(y0) + x0;
+    const std::uint8_t* const bottom = gray.ptr<std::uint8_t>(y0 + 1) + x0;
+    const float upper = static_cast<float>(top[0]) + (static_cast<float>(top[1]) - static_cast<float>(top[0])) * tx;
+    const float lower = static_cast<float>(bottom[0]) + (static_cast<float>(bottom[1]) - static_cast<float>(bottom[0])) * tx;
+    outValue = upper + (lower - upper) * ty;
+    return true;
+}
+
+/// offset along normal from point to the strongest edge, within radius
+bool FindEdge(const cv::Mat& gray, cv::Point2f point, cv::Point2f normal, float radius, float& outOffset)
+{
+    const float step = radius * 2 / (PROFILE_LENGTH - 1);
+    std::array<float, PROFILE_LENGTH> profile{};
+    for (int i = 0; i < PROFILE_LENGTH; ++i)
+    {
+        const float offset = -radius + static_cast<float>(i) * step;
+        if (!Sample(gray, point + normal * offset, profile[i])) return false;
+    }
+
+    std::array<float, PROFILE_LENGTH> gradient{};
+    int best = 0;
+    for (int i = 1; i < PROFILE_LENGTH - 1; ++i)
+    {
+        gradient[i] = std::abs(profile[i + 1] - profile[i - 1]);
+        if (gradient[i] > gradient[best]) best = i;
+    }
+    if (gradient[best] < MIN_CONTRAST) return false;
+
+    // vertex of the parabola through the peak and its neighbours
+    float subStep = 0;
+    if (best > 1 && best < PROFILE_LENGTH - 2)
+    {
+        const float denom = gradient[best - 1] - 2 * gradient[best] + gradient[best + 1];
+        if (denom < 0) subStep = std::clamp(0.5F * (gradient[best - 1] - gradient[best + 1]) / denom, -0.5F, 0.5F);
+    }
+    outOffset = -radius + (static_cast<float>(best) + subStep) * step;
+    return true;
+}
+
+struct Line
+{
+    cv::Point2f point;
+    cv::Point2f direction;
+};
+
+/// total least squares line through the edge points found along the edge from start to end
+bool FitEdge(const cv::Mat& gray, cv::Point2f start, cv::Point2f end, Line& outLine)
+{
+    const cv::Point2f delta = end - start;
+    const auto length = static_cast<float>(cv::norm(delta));
+    if (length < MIN_EDGE_LENGTH) return false;
+    const cv::Point2f direction = delta / length;
+    const cv::Point2f normal{-direction.y, direction.x};
+    // the black border of a marker is a few pixels wide when small, the search must not reach its inner edge
+    const float radius = std::clamp(length / 16, 0.75F, 2.0F);
+
+    std::array<cv::Point2f, SAMPLES_PER_EDGE> points;
+    int count = 0;
+    cv::Point2f centroid{};
+    for (int i = 0; i < SAMPLES_PER_EDGE; ++i)
+    {
+        const float along = EDGE_MARGIN + (1 - 2 * EDGE_MARGIN) * (static_cast<float>(i) + 0.5F) / SAMPLES_PER_EDGE;
+        const cv::Point2f point = start + delta * along;
+        float offset = 0;
+        if (!FindEdge(gray, point, normal, radius, offset)) continue;
+        points[count] = point + normal * offset;
+        centroid += points[count];
+        ++count;
+    }
+    if (count < SAMPLES_PER_EDGE / 2) return false;
+    centroid /= static_cast<float>(count);
+
+    float sxx = 0;
+    float sxy = 0;
+    float syy = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const cv::Point2f diff = points[i] - centroid;
+        sxx += diff.x * diff.x;
+        sxy += diff.x * diff.y;
+        syy += diff.y * diff.y;
+    }
+    const float angle = 0.5F * std::atan2(2 * sxy, sxx - syy);
+    outLine = {centroid, {std::cos(angle), std::sin(angle)}};
+    return true;
+}
+
+bool Intersect(const Line& lhs, const Line& rhs, cv::Point2f& outPoint)
+{
+    const float det = lhs.direction.x * rhs.direction.y - lhs.direction.y * rhs.direction.x;
+    if (std::abs(det) < 1e-3F) return false;
+    const cv::Point2f diff = rhs.point - lhs.point;
+    const float along = (diff.x * rhs.direction.y - diff.y * rhs.direction.x) / det;
+    outPoint = lhs.point + lhs.direction * along;
+    return true;
+}
+
+/// corners of marker projected at the predicted pose, then shifted onto the detected corners
+/// @return false if a corner is behind the camera, or the detection does not have the projected shape
+bool ProjectMarker(const CameraModel& camera, const cv::Matx33d& rotation, const cv::Vec3d& translation,
+                   std::span<const cv::Point3d, NUM_CORNERS> object, std::span<const cv::Point2f, NUM_CORNERS> detected,
+                   std::array<cv::Point2f, NUM_CORNERS>& outProjected)
+{
+    cv::Point2f shift{};
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        const cv::Vec3d camPoint = rotation * cv::Vec3d(object[i].x, object[i].y, object[i].z) + translation;
+        if (camPoint[Z] < MIN_DEPTH) return false;
+        const cv::Point2d pixel = camera.Project(cv::Point3d(camPoint[X], camPoint[Y], camPoint[Z]));
+        outProjected[i] = cv::Point2f(static_cast<float>(pixel.x), static_cast<float>(pixel.y));
+        shift += detected[i] - outProjected[i];
+    }
+    shift /= static_cast<float>(NUM_CORNERS);
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        outProjected[i] += shift;
+        if (cv::norm(detected[i] - outProjected[i]) > MAX_SHAPE_DEVIATION) return false;
+    }
+    return true;
+}
+
+/// fit the edges along the projected quad, and intersect them
+bool RefineMarker(const cv::Mat& gray, const std::array<cv::Point2f, NUM_CORNERS>& projected, std::span<cv::Point2f, NUM_CORNERS> corners)
+{
+    std::array<Line, NUM_CORNERS> edges;
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        if (!FitEdge(gray, projected[i], projected[(i + 1) % NUM_CORNERS], edges[i])) return false;
+    }
+    std::array<cv::Point2f, NUM_CORNERS> refined;
+    for (int i = 0; i < NUM_CORNERS; ++i)
+    {
+        // corner i joins the edge ending at it and the edge starting at it
+        if (!Intersect(edges[(i + NUM_CORNERS - 1) % NUM_CORNERS], edges[i], refined[i])) return false;
+        if (cv::norm(refined[i] - projected[i]) > MAX_CORNER_SHIFT) return false;
+    }
+    std::copy(refined.begin(), refined.end(), corners.begin());
+    return true;
+}
+
+} // namespace
+
+int RefineMarkerCorners(const cv::Mat& gray, const CameraModel& camera, const BoardGeometry& board, const RodrPose& predicted,
+                        std::span<const int> ids, std::span<cv::Point2f> corners, int& inOutBudget)
+{
+    ATT_ASSERT(gray.type() == CV_8UC1);
+    ATT_ASSERT(corners.size() == ids.size() * NUM_CORNERS);
+    const cv::Matx33d rotation = QuatFromRvec(predicted.rotation.value).toRotMat3x3();
+    int refined = 0;
+    for (std::size_t det = 0; det < ids.size() && inOutBudget > 0; ++det)
+    {
+        const int marker = board.FindMarker(ids[det]);
+        if (marker < 0) continue;
+        --inOutBudget;
+        const std::span<cv::Point2f, NUM_CORNERS> markerCorners = corners.subspan(det * NUM_CORNERS).first<NUM_CORNERS>();
+        std::array<cv::Point2f, NUM_CORNERS> projected;
+        if (!ProjectMarker(camera, rotation, predicted.position, board.GetCorners(marker), markerCorners, projected)) continue;
+        if (RefineMarker(gray, projected, markerCorners)) ++refined;
+    }
+    return refined;
+}
+
+namespace
+{
+
+/// tracker with a marker facing the camera and one to each side, far enough that the markers are around 23 pixels wide
+struct RenderedTracker
+{
+    std::vector<int> ids{3, 7, 12};
+    std::vector<MarkerCorners3f> markers;
+    cfg::CameraCalib camera;
+    RodrPose truth{cv::Vec3d(0.05, -0.1, 1.6), RodriguesVec3d(cv::Vec3d(0.3, 0, 0.1))};
+    std::vector<cv::Point2f> truthCorners;
+    cv::Mat gray;
+
+    RenderedTracker()
+    {
+        camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 620, 0, 321.5, 0, 615, 238.25, 0, 0, 1);
+        camera.distortionCoeffs = (cv::Mat_<double>(1, 5) << -0.1, 0.05, 0.001, -0.002, 0.01);
+        const float half = 0.03F;
+        markers.push_back({{-half, half, 0}, {half, half, 0}, {half, -half, 0}, {-half, -half, 0}});
+        markers.push_back({{0.05F, half, -0.02F}, {0.08F, half, -0.06F}, {0.08F, -half, -0.06F}, {0.05F, -half, -0.02F}});
+        markers.push_back({{-0.08F, half, -0.06F}, {-0.05F, half, -0.02F}, {-0.05F, -half, -0.02F}, {-0.08F, -half, -0.06F}});
+
+        // dark quads drawn supersampled and blurred like a camera would,
+        // antialiased polygons of opencv come out around half a pixel larger than their corners
+        constexpr int supersampling = 8;
+        constexpr int shift = 8;
+        cv::Mat large(480 * supersampling, 640 * supersampling, CV_8UC1, cv::Scalar(220));
+        for (const MarkerCorners3f& marker : markers)
+        {
+            std::vector<cv::Point2f> projected;
+            cv::projectPoints(marker, truth.rotation.value, truth.position, camera.cameraMatrix, camera.distortionCoeffs, projected);
+            std::array<cv::Point, NUM_CORNERS> fixedPoint;
+            for (int i = 0; i < NUM_CORNERS; ++i)
+            {
+                truthCorners.push_back(projected[i]);
+                // pixel centers of the large image average onto the pixel centers of the small one
+                const cv::Point2f center = (projected[i] + cv::Point2f(0.5F, 0.5F)) * supersampling - cv::Point2f(0.5F, 0.5F);
+                fixedPoint[i] = cv::Point(cvRound(center.x * (1 << shift)), cvRound(center.y * (1 << shift)));
+            }
+            cv::fillConvexPoly(large, fixedPoint.data(), NUM_CORNERS, cv::Scalar(30), cv::LINE_8, shift);
+        }
+        cv::resize(large, gray, cv::Size(640, 480), 0, 0, cv::INTER_AREA);
+        cv::GaussianBlur(gray, gray, cv::Size(5, 5), 0.8);
+    }
+};
+
+double RotationDifference(const RodrPose& lhs, const RodrPose& rhs)
+{
+    const cv::Quatd diff = QuatFromRvec(lhs.rotation.value).conjugate() * QuatFromRvec(rhs.rotation.value);
+    return cv::norm(RvecFromQuat(diff));
+}
+
+} // namespace
+
+TEST_CASE("RefineMarkerCorners improves the pose of a small tracker")
+{
+    const RenderedTracker tracker;
+    const BoardGeometry board{tracker.ids, tracker.markers};
+    const std::optional<CameraModel> model = CameraModel::FromCalib(tracker.camera);
+    REQUIRE(model.has_value());
+    // off by about as much as the prediction of one frame
+    const RodrPose predicted{tracker.truth.position + cv::Vec3d(0.005, 0.003, -0.01),
+                             RodriguesVec3d(tracker.truth.rotation.value + cv::Vec3d(0.02, -0.01, 0.01))};
+
+    // the gain is compared over many detections, a single one may be lucky either way
+    constexpr int draws = 40;
+    constexpr int markerCount = 3;
+    cv::RNG rng{11};
+    int refinedCount = 0;
+    double detectedPositionError = 0;
+    double refinedPositionError = 0;
+    double detectedRotationError = 0;
+    double refinedRotationError = 0;
+    for (int draw = 0; draw < draws; ++draw)
+    {
+        // apriltag corners of markers this small are off by around half a pixel
+        std::vector<cv::Point2f> detected = tracker.truthCorners;
+        for (cv::Point2f& corner : detected)
+        {
+            corner += cv::Point2f(static_cast<float>(rng.gaussian(0.6)), static_cast<float>(rng.gaussian(0.6)));
+        }
+        std::vector<cv::Point2f> refined = detected;
+        int budget = MAX_REFINED_MARKERS;
+        refinedCount += RefineMarkerCorners(tracker.gray, *model, board, predicted, tracker.ids, refined, budget);
+        CHECK(budget == MAX_REFINED_MARKERS - markerCount);
+
+        const BoardPoseEstimate fromDetected = EstimatePoseTracker(tracker.ids, detected, board, tracker.camera, true, predicted);
+        const BoardPoseEstimate fromRefined = EstimatePoseTracker(tracker.ids, refined, board, tracker.camera, true, predicted);
+        detectedPositionError += cv::norm(fromDetected.pose.position - tracker.truth.position);
+        refinedPositionError += cv::norm(fromRefined.pose.position - tracker.truth.position);
+        detectedRotationError += RotationDifference(fromDetected.pose, tracker.truth);
+        refinedRotationError += RotationDifference(fromRefined.pose, tracker.truth);
+    }
+
+    MESSAGE("mean position error ", detectedPositionError / draws * 1000, " mm detected, ", refinedPositionError / draws * 1000, " mm refined");
+    MESSAGE("mean rotation error ", detectedRotationError / draws, " rad detected, ", refinedRotationError / draws, " rad refined");
+    // a marker is only left as detected where the search along an edge found nothing it could trust
+    CHECK(refinedCount > draws * markerCount * 8 / 10);
+    CHECK(refinedPositionError < 0.85 * detectedPositionError);
+    CHECK(refinedRotationError < 0.5 * detectedRotationError);
+}
+
+TEST_CASE("RefineMarkerCorners leaves markers as detected")
+{
+    const RenderedTracker tracker;
+    const BoardGeometry board{tracker.ids, tracker.markers};
+    const std::optional<CameraModel> model = CameraModel::FromCalib(tracker.camera);
+    REQUIRE(model.has_value());
+
+    // a prediction rolled too far, the projected markers do not have the detected shape
+    const RodrPose rolled{tracker.truth.position, RodriguesVec3d(tracker.truth.rotation.value + cv::Vec3d(0, 0, 0.3))};
+    std::vector<cv::Point2f> corners = tracker.truthCorners;
+    int budget = MAX_REFINED_MARKERS;
+    CHECK(RefineMarkerCorners(tracker.gray, *model, board, rolled, tracker.ids, corners, budget) == 0);
+    CHECK(corners == tracker.truthCorners);
+
+    // a flat image has no edges
+    const cv::Mat flat(tracker.gray.size(), CV_8UC1, cv::Scalar(128));
+    CHECK(RefineMarkerCorners(flat, *model, board, tracker.truth, tracker.ids, corners, budget) == 0);
+    CHECK(corners == tracker.truthCorners);
+
+    // markers that are not on the board do not use up the budget, the others stop when it is used up
+    const BoardGeometry single{std::vector<int>{7}, std::vector<MarkerCorners3f>{tracker.markers[1]}};
+    budget = 1;
+    CHECK(RefineMarkerCorners(tracker.gray, *model, single, tracker.truth, tracker.ids, corners, budget) == 1);
+    CHECK(budget == 0);
+    CHECK(RefineMarkerCorners(tracker.gray, *model, board, tracker.truth, tracker.ids, corners, budget) == 0);
+}
+
+} // namespace math
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "BoardPose.hpp"
+#include "CameraModel.hpp"
+#include "Helpers.hpp"
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/types.hpp>
+
+#include <span>
+
+namespace math
+{
+
+/// markers tried per frame at most, each costs the same, so refinement takes a bounded time per frame
+constexpr inline int MAX_REFINED_MARKERS = 32;
+
+/// Moves detected marker corners onto the edges of the markers of a board, projected at the pose predicted before detection.
+/// Each projected marker is shifted onto its detection, which takes out the lag of the prediction,
+/// then the strongest gradient is searched along the normals of its projected edges to sub-pixel precision,
+/// and the corners are the intersections of the fitted edges.
+/// Cheaper than another quad fit, and most precise where apriltag is not, on small and distant markers.
+/// A marker is left as detected if its projection does not have the shape of the detection, an edge is not found,
+/// or a corner would move further than the search along the edges reaches.
+/// @param gray 8 bit single channel image the markers were detected in
+/// @param camera projects into gray, with its distortion
+/// @param predicted board to camera, in the units of board
+/// @param ids detected marker ids, markers not on board are skipped
+/// @param corners 4 corners per id in clockwise order, like MarkerDetectionList::corners, refined in place
+/// @param inOutBudget markers that may still be tried this frame, reduced by the markers tried, so boards share one budget
+/// @return markers refined
+int RefineMarkerCorners(const cv::Mat& gray, const CameraModel& camera, const BoardGeometry& board, const RodrPose& predicted,
+                        std::span<const int> ids, std::span<cv::Point2f> corners, int& inOutBudget);
+
+} // namespace math
@@ -0,0 +1,100 @@
+#include "MotionFilter.hpp"
+
+#include "CVHelpers.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Test.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace math
+{
+
+namespace
+{
+
+double SecondsBetween(MotionFilter::TimePoint from, MotionFilter::TimePoint to)
+{
+    return duration_cast<utils::FSeconds>(to - from).count();
+}
+
+} // namespace
+
+void MotionFilter::Update(const Pose& estimate, TimePoint time)
+{
+    const cv::Vec3d position = ToVec(estimate.position);
+    const double dt = SecondsBetween(mTime, time);
+    if (!mIsValid || dt <= 0 || dt > MAX_GAP)
+    {
+        mIsValid = true;
+        mTime = time;
+        mPosition = position;
+        mVelocity = {};
+        mRotation = estimate.rotation;
+        mAngularVelocity = {};
+        return;
+    }
+
+    const cv::Vec3d predictedPosition = mPosition + mVelocity * dt;
+    const cv::Vec3d positionResidual = position - predictedPosition;
+    mPosition = predictedPosition + positionResidual * ALPHA;
+    mVelocity += positionResidual * (BETA / dt);
+
+    const cv::Quatd predictedRotation = QuatFromRvec(mAngularVelocity * dt) * mRotation;
+    // shortest rotation from the prediction to the estimate
+    const cv::Vec3d rotationResidual = RvecFromQuat(estimate.rotation * predictedRotation.conjugate());
+    mRotation = (QuatFromRvec(rotationResidual * ALPHA) * predictedRotation).normalize();
+    mAngularVelocity += rotationResidual * (BETA / dt);
+
+    mTime = time;
+}
+
+bool MotionFilter::CanPredict(TimePoint time) const
+{
+    return mIsValid && SecondsBetween(mTime, time) <= MAX_GAP;
+}
+
+Pose MotionFilter::Predict(TimePoint time) const
+{
+    ATT_ASSERT(mIsValid);
+    const double dt = std::clamp(SecondsBetween(mTime, time), 0.0, MAX_EXTRAPOLATION);
+    const cv::Vec3d position = mPosition + mVelocity * dt;
+    return {cv::Point3d(position), (QuatFromRvec(mAngularVelocity * dt) * mRotation).normalize()};
+}
+
+TEST_CASE("MotionFilter follows a constant motion")
+{
+    const MotionFilter::TimePoint start{};
+    const auto timeAt = [&](double seconds) {
+        return start + duration_cast<utils::NanoS>(utils::FSeconds(seconds));
+    };
+    const cv::Vec3d velocity{0.4, -0.2, 0.6};
+    const cv::Vec3d angularVelocity{0.5, 1.5, -1};
+    const cv::Quatd initialRotation = QuatFromRvec(cv::Vec3d(0.3, -0.2, 0.1));
+    const auto truthAt = [&](double seconds) {
+        return Pose(cv::Point3d(cv::Vec3d(0.1, 0.2, 1.5) + velocity * seconds), QuatFromRvec(angularVelocity * seconds) * initialRotation);
+    };
+
+    MotionFilter filter;
+    CHECK_NOT(filter.CanPredict(start));
+    constexpr double frameTime = 1.0 / 60;
+    for (int frame = 0; frame < 60; ++frame)
+    {
+        filter.Update(truthAt(frame * frameTime), timeAt(frame * frameTime));
+    }
+
+    const double next = 60 * frameTime;
+    REQUIRE(filter.CanPredict(timeAt(next)));
+    const Pose predicted = filter.Predict(timeAt(next));
+    const Pose truth = truthAt(next);
+    CHECK(cv::norm(predicted.position - truth.position) < 1e-4);
+    CHECK(cv::norm(RvecFromQuat(predicted.rotation * truth.rotation.conjugate())) < 1e-3);
+
+    // a long gap restarts at the next estimate, without the old velocity
+    CHECK_NOT(filter.CanPredict(timeAt(next + 1)));
+    filter.Update(truthAt(next + 1), timeAt(next + 1));
+    const Pose restarted = filter.Predict(timeAt(next + 1 + frameTime));
+    CHECK(cv::norm(restarted.position - truthAt(next + 1).position) < 1e-9);
+}
+
+} // namespace math
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Helpers.hpp"
+#include "utils/SteadyTimer.hpp"
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/quaternion.hpp>
+
+namespace math
+{
+
+/// Constant velocity alpha-beta filter of the pose of a tracker, updated with each estimate,
+/// so the pose at the next frame is predicted locally, instead of asking the driver.
+/// Angular velocity is a rotation vector per second in the space of the pose, applied before its rotation.
+class MotionFilter
+{
+public:
+    using TimePoint = utils::SteadyTimer::TimePoint;
+
+    /// seconds without an estimate after which the motion before says nothing about the motion after, and the filter restarts
+    static constexpr double MAX_GAP = 0.25;
+    /// seconds past the last estimate a prediction extrapolates at most
+    static constexpr double MAX_EXTRAPOLATION = 0.1;
+
+    void Reset() { mIsValid = false; }
+    void Update(const Pose& estimate, TimePoint time);
+    /// false until the first estimate, and once the last estimate is older than MAX_GAP
+    bool CanPredict(TimePoint time) const;
+    /// pose at time, only valid if CanPredict
+    Pose Predict(TimePoint time) const;
+
+private:
+    /// critically damped for a gain of 0.6, follows a new motion in a few frames while halving the noise of the estimates
+    static constexpr double ALPHA = 0.6;
+    static constexpr double BETA = ALPHA * ALPHA / (2 - ALPHA);
+
+    bool mIsValid = false;
+    TimePoint mTime{};
+    cv::Vec3d mPosition{};
+    cv::Vec3d mVelocity{};
+    cv::Quatd mRotation{1, 0, 0, 0};
+    cv::Vec3d mAngularVelocity{};
+};
+
+} // namespace math
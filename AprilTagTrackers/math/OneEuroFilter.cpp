@@ -0,0 +1,138 @@
+#include "OneEuroFilter.hpp"
+
+#include "CVHelpers.hpp"
+#include "CVTypes.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <cmath>
+
+namespace math
+{
+
+namespace
+{
+
+/// weight of a new sample in an exponential low-pass filter with cutoff in Hz
+double SmoothingFactor(double cutoff, double dt)
+{
+    const double timeConstant = 1 / (2 * CV_PI * cutoff);
+    return 1 / (1 + timeConstant / dt);
+}
+
+} // namespace
+
+Pose OneEuroFilter::Filter(const Pose& pose, TimePoint time, const Settings& settings)
+{
+    const cv::Vec3d position = ToVec(pose.position);
+    const double dt = duration_cast<utils::FSeconds>(time - mTime).count();
+    if (!mIsValid || dt <= 0 || dt > MAX_GAP)
+    {
+        mIsValid = true;
+        mTime = time;
+        mPosition = position;
+        mVelocity = {};
+        mRotation = pose.rotation;
+        mAngularVelocity = {};
+        return pose;
+    }
+    mTime = time;
+
+    // velocities are filtered per axis before taking their length, so noise cancels out instead of reading as speed
+    const double velocityAlpha = SmoothingFactor(VELOCITY_CUTOFF, dt);
+    mVelocity += ((position - mPosition) / dt - mVelocity) * velocityAlpha;
+    const double speed = cv::norm(mVelocity);
+    const double lateralAlpha = SmoothingFactor(settings.minCutoff + settings.speedCoeff * speed, dt);
+    const double depthAlpha = SmoothingFactor(settings.depthMinCutoff + settings.speedCoeff * speed, dt);
+    mPosition[X] += (position[X] - mPosition[X]) * lateralAlpha;
+    mPosition[Y] += (position[Y] - mPosition[Y]) * lateralAlpha;
+    mPosition[Z] += (position[Z] - mPosition[Z]) * depthAlpha;
+
+    const cv::Vec3d rotationDelta = RvecFromQuat(pose.rotation * mRotation.conjugate());
+    mAngularVelocity += (rotationDelta / dt - mAngularVelocity) * velocityAlpha;
+    const double rotationAlpha = SmoothingFactor(settings.minCutoff + settings.speedCoeff * cv::norm(mAngularVelocity), dt);
+    mRotation = (QuatFromRvec(rotationDelta * rotationAlpha) * mRotation).normalize();
+
+    return {cv::Point3d(mPosition), mRotation};
+}
+
+namespace
+{
+
+struct ReplayResult
+{
+    /// root mean square error while still, in meters
+    double lateralJitter = 0;
+    double depthJitter = 0;
+    /// mean delay behind a steady motion, in seconds
+    double lag = 0;
+};
+
+/// replay a still tracker that starts moving at 1 m/s, with lateral and depth noise like a camera 2 m away
+ReplayResult Replay(const OneEuroFilter::Settings& settings)
+{
+    constexpr double frameTime = 1.0 / 60;
+    constexpr double moveStart = 3;
+    constexpr double speed = 1;
+    constexpr double lateralNoise = 0.002;
+    constexpr double depthNoise = 0.006;
+
+    cv::RNG rng{3};
+    OneEuroFilter filter;
+    ReplayResult result;
+    int stillCount = 0;
+    int movingCount = 0;
+    for (int frame = 0; frame < 240; ++frame)
+    {
+        const double time = frame * frameTime;
+        const cv::Point3d truth{(time > moveStart) ? (time - moveStart) * speed : 0, 0, 2};
+        const cv::Point3d measured = truth + cv::Point3d(rng.gaussian(lateralNoise), rng.gaussian(lateralNoise), rng.gaussian(depthNoise));
+        const auto timestamp = OneEuroFilter::TimePoint{} + duration_cast<utils::NanoS>(utils::FSeconds(time));
+        const Pose filtered = filter.Filter(Pose(measured, cv::Quatd(1, 0, 0, 0)), timestamp, settings);
+
+        const cv::Point3d error = filtered.position - truth;
+        if (time >= 1 && time < moveStart)
+        {
+            result.lateralJitter += (error.x * error.x + error.y * error.y) / 2;
+            result.depthJitter += error.z * error.z;
+            ++stillCount;
+        }
+        else if (time >= moveStart + 0.5)
+        {
+            result.lag -= error.x / speed;
+            ++movingCount;
+        }
+    }
+    result.lateralJitter = std::sqrt(result.lateralJitter / stillCount);
+    result.depthJitter = std::sqrt(result.depthJitter / stillCount);
+    result.lag /= movingCount;
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("OneEuroFilter latency and jitter on a replayed motion")
+{
+    const OneEuroFilter::Settings adaptive{};
+    OneEuroFilter::Settings fixed = adaptive;
+    fixed.speedCoeff = 0;
+
+    const ReplayResult adaptiveResult = Replay(adaptive);
+    const ReplayResult fixedResult = Replay(fixed);
+    MESSAGE("adaptive: lateral jitter ", adaptiveResult.lateralJitter * 1000, " mm, depth jitter ",
+            adaptiveResult.depthJitter * 1000, " mm, lag ", adaptiveResult.lag * 1000, " ms");
+    MESSAGE("fixed:    lateral jitter ", fixedResult.lateralJitter * 1000, " mm, depth jitter ",
+            fixedResult.depthJitter * 1000, " mm, lag ", fixedResult.lag * 1000, " ms");
+
+    // still poses are at least twice as steady as the estimates
+    CHECK(adaptiveResult.lateralJitter < 0.001);
+    CHECK(adaptiveResult.depthJitter < 0.003);
+    // depth is filtered harder than the lateral axes, relative to its noise
+    CHECK(adaptiveResult.depthJitter / 0.006 < adaptiveResult.lateralJitter / 0.002);
+    // adapting to speed lags far less than a fixed cutoff, at almost the same jitter
+    CHECK(adaptiveResult.lag < 0.1);
+    CHECK(adaptiveResult.lag < fixedResult.lag / 2);
+}
+
+} // namespace math
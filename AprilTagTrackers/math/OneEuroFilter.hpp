@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Helpers.hpp"
+#include "utils/SteadyTimer.hpp"
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/quaternion.hpp>
+
+namespace math
+{
+
+/// One Euro filter of the pose of a tracker in camera space, a low-pass filter whose cutoff rises with speed,
+/// so a still tracker does not jitter and a moving one does not lag. See https://gery.casiez.net/1euro/
+/// Depth is filtered with its own cutoff, since a camera estimates it far less precisely than the other axes.
+class OneEuroFilter
+{
+public:
+    using TimePoint = utils::SteadyTimer::TimePoint;
+
+    struct Settings
+    {
+        /// cutoff in Hz of x and y and of rotation, while still
+        double minCutoff = 1;
+        /// cutoff in Hz of z, while still
+        double depthMinCutoff = 0.5;
+        /// cutoff increase in Hz per m/s of speed, and per rad/s for rotation
+        double speedCoeff = 2;
+    };
+
+    /// seconds without a pose after which the filter restarts, instead of smoothing towards a stale pose
+    static constexpr double MAX_GAP = 0.25;
+
+    void Reset() { mIsValid = false; }
+    /// filter the pose at time, the first pose after a reset or a gap is returned unchanged
+    Pose Filter(const Pose& pose, TimePoint time, const Settings& settings);
+
+private:
+    /// cutoff in Hz of the velocities the cutoffs adapt to
+    static constexpr double VELOCITY_CUTOFF = 1;
+
+    bool mIsValid = false;
+    TimePoint mTime{};
+    cv::Vec3d mPosition{};
+    cv::Vec3d mVelocity{};
+    cv::Quatd mRotation{1, 0, 0, 0};
+    /// rotation vector per second, in camera space
+    cv::Vec3d mAngularVelocity{};
+};
+
+} // namespace math
@@ -0,0 +1,179 @@
+#include "StreamingMedian.hpp"
+
+#include "Helpers.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace math
+{
+
+namespace
+{
+
+/// desired positions move by these fractions of each new value, for the median
+constexpr std::array<double, 5> DESIRED_STEP{0, 0.25, 0.5, 0.75, 1};
+
+} // namespace
+
+void StreamingMedian::Add(double value)
+{
+    if (mCount < NUM_POINTS)
+    {
+        // keep the first values sorted, they are the initial heights
+        const auto end = mHeights.begin() + mCount;
+        const auto position = std::upper_bound(mHeights.begin(), end, value);
+        std::copy_backward(position, end, end + 1);
+        *position = value;
+        ++mCount;
+        return;
+    }
+    ++mCount;
+
+    // cell of the new value, stretching the extremes to include it
+    int cell = 0;
+    if (value < mHeights[0])
+    {
+        mHeights[0] = value;
+    }
+    else if (value >= mHeights[NUM_POINTS - 1])
+    {
+        mHeights[NUM_POINTS - 1] = value;
+        cell = NUM_POINTS - 2;
+    }
+    else
+    {
+        while (value >= mHeights[cell + 1]) ++cell;
+    }
+    for (int i = cell + 1; i < NUM_POINTS; ++i)
+    {
+        ++mPositions[i];
+    }
+    for (int i = 0; i < NUM_POINTS; ++i)
+    {
+        mDesired[i] += DESIRED_STEP[i];
+    }
+
+    // move the middle points towards their desired positions, at most one rank per value
+    for (int i = 1; i < NUM_POINTS - 1; ++i)
+    {
+        const double offset = mDesired[i] - mPositions[i];
+        const bool moveUp = offset >= 1 && mPositions[i + 1] - mPositions[i] > 1;
+        const bool moveDown = offset <= -1 && mPositions[i - 1] - mPositions[i] < -1;
+        if (!moveUp && !moveDown) continue;
+        const int step = moveUp ? 1 : -1;
+
+        const double below = mPositions[i] - mPositions[i - 1];
+        const double above = mPositions[i + 1] - mPositions[i];
+        // piecewise parabolic prediction of the height at the new position
+        const double parabolic = mHeights[i] + step / (below + above) *
+                                                   ((below + step) * (mHeights[i + 1] - mHeights[i]) / above +
+                                                    (above - step) * (mHeights[i] - mHeights[i - 1]) / below);
+        if (mHeights[i - 1] < parabolic && parabolic < mHeights[i + 1])
+        {
+            mHeights[i] = parabolic;
+        }
+        else
+        {
+            // linear, if the parabola would leave the neighbouring heights out of order
+            mHeights[i] += step * (mHeights[i + step] - mHeights[i]) / (mPositions[i + step] - mPositions[i]);
+        }
+        mPositions[i] += step;
+    }
+}
+
+double StreamingMedian::Get() const
+{
+    if (mCount == 0) return 0;
+    if (mCount < NUM_POINTS) return mHeights[mCount / 2];
+    return mHeights[NUM_POINTS / 2];
+}
+
+void MarkerMedian::Add(const MarkerCorners3f& corners)
+{
+    ATT_ASSERT(corners.size() == NUM_CORNERS);
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        mCoords[corner * DIMENSIONS + X].Add(corners[corner].x);
+        mCoords[corner * DIMENSIONS + Y].Add(corners[corner].y);
+        mCoords[corner * DIMENSIONS + Z].Add(corners[corner].z);
+    }
+}
+
+MarkerCorners3f MarkerMedian::Get() const
+{
+    MarkerCorners3f corners(NUM_CORNERS);
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        corners[corner] = cv::Point3f(static_cast<float>(mCoords[corner * DIMENSIONS + X].Get()),
+                                      static_cast<float>(mCoords[corner * DIMENSIONS + Y].Get()),
+                                      static_cast<float>(mCoords[corner * DIMENSIONS + Z].Get()));
+    }
+    return corners;
+}
+
+TEST_CASE("StreamingMedian")
+{
+    StreamingMedian median;
+    CHECK(median.Get() == 0);
+    for (const double value : {5.0, 1.0, 4.0})
+    {
+        median.Add(value);
+    }
+    // exact while there are too few values to estimate
+    CHECK(median.GetCount() == 3);
+    CHECK(median.Get() == 4);
+
+    // noisy values with a few far outliers, like marker corners while calibrating
+    cv::RNG rng{11};
+    std::vector<double> values;
+    StreamingMedian noisy;
+    for (int i = 0; i < 200; ++i)
+    {
+        const double value = (i % 10 == 0) ? rng.uniform(5.0, 50.0) : 2 + rng.gaussian(0.1);
+        values.push_back(value);
+        noisy.Add(value);
+    }
+    std::nth_element(values.begin(), values.begin() + 100, values.end());
+    CAPTURE(values[100]);
+    CAPTURE(noisy.Get());
+    // within half the deviation of the values
+    CHECK(std::abs(noisy.Get() - values[100]) < 0.05);
+}
+
+TEST_CASE("MarkerMedian matches FindMedianMarker")
+{
+    const MarkerCorners3f truth{{-0.02F, 0.02F, 0}, {0.02F, 0.02F, 0.01F}, {0.02F, -0.02F, 0.01F}, {-0.02F, -0.02F, 0}};
+    cv::RNG rng{5};
+    std::vector<MarkerCorners3f> observations;
+    MarkerMedian median;
+    for (int i = 0; i < 50; ++i)
+    {
+        MarkerCorners3f corners = truth;
+        for (cv::Point3f& corner : corners)
+        {
+            const float noise = (i % 8 == 0) ? 0.05F : 0.001F;
+            corner += cv::Point3f(static_cast<float>(rng.gaussian(noise)), static_cast<float>(rng.gaussian(noise)), static_cast<float>(rng.gaussian(noise)));
+        }
+        observations.push_back(corners);
+        median.Add(corners);
+    }
+    CHECK(median.GetCount() == 50);
+
+    MarkerCorners3f expected;
+    FindMedianMarker(observations, expected);
+    const MarkerCorners3f actual = median.Get();
+    REQUIRE(actual.size() == NUM_CORNERS);
+    for (int corner = 0; corner < NUM_CORNERS; ++corner)
+    {
+        CAPTURE(corner);
+        CHECK(cv::norm(actual[corner] - expected[corner]) < 0.002);
+    }
+}
+
+} // namespace math
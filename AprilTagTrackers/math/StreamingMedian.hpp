@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CVTypes.hpp"
+
+#include <array>
+
+namespace math
+{
+
+/// Running estimate of the median of a stream of values, in constant memory and time per value,
+/// with the P-square algorithm of Jain and Chlamtac. Exact for the first 5 values.
+class StreamingMedian
+{
+public:
+    void Add(double value);
+    /// values added so far
+    int GetCount() const { return mCount; }
+    /// 0 if no value was added
+    double Get() const;
+
+private:
+    static constexpr int NUM_POINTS = 5;
+
+    /// heights of the points, the middle one estimates the median
+    std::array<double, NUM_POINTS> mHeights{};
+    /// positions of the points, 0 based ranks of their heights among the values added
+    std::array<int, NUM_POINTS> mPositions{0, 1, 2, 3, 4};
+    /// where the points should be, for the minimum, quartiles, median and maximum
+    std::array<double, NUM_POINTS> mDesired{0, 1, 2, 3, 4};
+    int mCount = 0;
+};
+
+/// per coordinate median of the corners of many observations of a marker, like FindMedianMarker,
+/// without keeping the observations
+class MarkerMedian
+{
+public:
+    void Add(const MarkerCorners3f& corners);
+    int GetCount() const { return mCoords[0].GetCount(); }
+    MarkerCorners3f Get() const;
+
+private:
+    static constexpr int DIMENSIONS = 3;
+
+    /// x, y, z of each corner
+    std::array<StreamingMedian, NUM_CORNERS * DIMENSIONS> mCoords{};
+};
+
+} // namespace math
@@ -0,0 +1,131 @@
+#include "UndistortionMap.hpp"
+
+#include "utils/Assert.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace math
+{
+
+namespace
+{
+
+/// iterations of cv::undistortPoints when sampling the grid, the default of 5 is too few for wide lenses
+const cv::TermCriteria SAMPLE_CRITERIA{cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 100, 1e-12};
+
+bool IsSameMat(const cv::Mat& lhs, const cv::Mat& rhs)
+{
+    if (lhs.size() != rhs.size() || lhs.type() != rhs.type()) return false;
+    if (lhs.empty()) return true;
+    if (lhs.isContinuous() && rhs.isContinuous())
+    {
+        return std::memcmp(lhs.data, rhs.data, lhs.total() * lhs.elemSize()) == 0;
+    }
+    return cv::norm(lhs, rhs, cv::NORM_INF) == 0;
+}
+
+} // namespace
+
+bool UndistortionMap::IsSameCalib(const cfg::CameraCalib& camera, cv::Size2i imageSize) const
+{
+    return imageSize == mImageSize &&
+           IsSameMat(camera.cameraMatrix, mCameraMatrix) &&
+           IsSameMat(camera.distortionCoeffs, mDistortionCoeffs);
+}
+
+bool UndistortionMap::Update(const cfg::CameraCalib& camera, cv::Size2i imageSize)
+{
+    if (IsSameCalib(camera, imageSize)) return false;
+    mCameraMatrix = camera.cameraMatrix.clone();
+    mDistortionCoeffs = camera.distortionCoeffs.clone();
+    mImageSize = imageSize;
+    mGrid.clear();
+    if (camera.cameraMatrix.empty() || imageSize.area() <= 0) return false;
+
+    cv::Mat cameraMatrix;
+    camera.cameraMatrix.convertTo(cameraMatrix, CV_64F);
+    mPinhole = CameraModel::FromCameraMatrix(cv::Matx33d(cameraMatrix.ptr<double>()));
+
+    mGridCols = (imageSize.width + GRID_STEP - 1) / GRID_STEP + 1;
+    mGridRows = (imageSize.height + GRID_STEP - 1) / GRID_STEP + 1;
+    std::vector<cv::Point2f> samples;
+    samples.reserve(static_cast<std::size_t>(mGridCols) * mGridRows);
+    for (int row = 0; row < mGridRows; ++row)
+    {
+        for (int col = 0; col < mGridCols; ++col)
+        {
+            samples.emplace_back(static_cast<float>(col * GRID_STEP), static_cast<float>(row * GRID_STEP));
+        }
+    }
+    cv::undistortPoints(samples, mGrid, camera.cameraMatrix, camera.distortionCoeffs, cv::noArray(), cameraMatrix, SAMPLE_CRITERIA);
+    return true;
+}
+
+cv::Point2f UndistortionMap::Undistort(const cv::Point2f& point) const
+{
+    constexpr float invStep = 1.0F / GRID_STEP;
+    const float gridX = point.x * invStep;
+    const float gridY = point.y * invStep;
+    const int col = std::clamp(static_cast<int>(std::floor(gridX)), 0, mGridCols - 2);
+    const int row = std::clamp(static_cast<int>(std::floor(gridY)), 0, mGridRows - 2);
+    const float tx = gridX - static_cast<float>(col);
+    const float ty = gridY - static_cast<float>(row);
+
+    const cv::Point2f* const top = mGrid.data() + static_cast<std::ptrdiff_t>(row) * mGridCols + col;
+    const cv::Point2f* const bottom = top + mGridCols;
+    const cv::Point2f upper = top[0] + (top[1] - top[0]) * tx;
+    const cv::Point2f lower = bottom[0] + (bottom[1] - bottom[0]) * tx;
+    return upper + (lower - upper) * ty;
+}
+
+void UndistortionMap::Undistort(std::span<const cv::Point2f> points, std::vector<cv::Point2f>& outPoints) const
+{
+    ATT_ASSERT(IsValid());
+    outPoints.resize(points.size());
+    std::transform(points.begin(), points.end(), outPoints.begin(), [this](const cv::Point2f& point) { return Undistort(point); });
+}
+
+TEST_CASE("UndistortionMap matches cv::undistortPoints")
+{
+    cfg::CameraCalib camera;
+    camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 620, 0, 321.5, 0, 615, 238.25, 0, 0, 1);
+    camera.distortionCoeffs = (cv::Mat_<double>(1, 5) << -0.35, 0.15, 0.001, -0.002, -0.03);
+    const cv::Size2i imageSize{640, 480};
+
+    UndistortionMap map;
+    CHECK_NOT(map.IsValid());
+    CHECK(map.Update(camera, imageSize));
+    CHECK_NOT(map.Update(camera, imageSize));
+    REQUIRE(map.IsValid());
+
+    cv::RNG rng{7};
+    std::vector<cv::Point2f> points;
+    for (int i = 0; i < 200; ++i)
+    {
+        points.emplace_back(rng.uniform(0.0F, 640.0F), rng.uniform(0.0F, 480.0F));
+    }
+    std::vector<cv::Point2f> expected;
+    cv::undistortPoints(points, expected, camera.cameraMatrix, camera.distortionCoeffs, cv::noArray(), camera.cameraMatrix, SAMPLE_CRITERIA);
+    std::vector<cv::Point2f> actual;
+    map.Undistort(points, actual);
+    REQUIRE(actual.size() == expected.size());
+    double maxError = 0;
+    for (std::size_t i = 0; i < actual.size(); ++i)
+    {
+        maxError = std::max(maxError, cv::norm(actual[i] - expected[i]));
+    }
+    CAPTURE(maxError);
+    CHECK(maxError < 0.1);
+
+    // a changed calibration is noticed and rebuilt
+    camera.distortionCoeffs.at<double>(0) = -0.2;
+    CHECK(map.Update(camera, imageSize));
+    CHECK_NOT(map.Update(camera, imageSize));
+}
+
+} // namespace math
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "CameraModel.hpp"
+#include "config/VideoStream.hpp"
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/types.hpp>
+
+#include <span>
+#include <vector>
+
+namespace math
+{
+
+/// Grid of undistorted positions over the image, sampled once from the calibration,
+/// so detected corners are undistorted by bilinear interpolation instead of iterating cv::undistortPoints.
+/// Undistorted corners are pixels of an ideal pinhole camera with the same camera matrix, see GetPinholeModel.
+class UndistortionMap
+{
+public:
+    /// pixels between grid samples, the interpolation error stays far below detection noise
+    static constexpr int GRID_STEP = 8;
+
+    /// rebuild the grid if the calibration or image size changed since the last call
+    /// @return true if the grid was rebuilt
+    bool Update(const cfg::CameraCalib& camera, cv::Size2i imageSize);
+
+    bool IsValid() const { return !mGrid.empty(); }
+    const CameraModel& GetPinholeModel() const { return mPinhole; }
+
+    /// distorted image pixel to pinhole pixel, points outside the image are extrapolated from the border cells
+    cv::Point2f Undistort(const cv::Point2f& point) const;
+    /// undistort every point in one pass, outPoints is resized to match
+    void Undistort(std::span<const cv::Point2f> points, std::vector<cv::Point2f>& outPoints) const;
+
+private:
+    bool IsSameCalib(const cfg::CameraCalib& camera, cv::Size2i imageSize) const;
+
+    /// copies of the calibration the grid was built from, to notice changes
+    cv::Mat mCameraMatrix;
+    cv::Mat mDistortionCoeffs;
+    cv::Size2i mImageSize;
+
+    CameraModel mPinhole;
+    int mGridCols = 0;
+    int mGridRows = 0;
+    std::vector<cv::Point2f> mGrid;
+};
+
+} // namespace math
@@ -0,0 +1,269 @@
+#include "ViewScorer.hpp"
+
+#include "utils/Assert.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+namespace math
+{
+
+namespace
+{
+
+/// points needed to estimate the pose of a planar board
+constexpr int MIN_POSE_POINTS = 4;
+/// columns of the jacobian of cv::projectPoints before the intrinsics, rotation then translation
+constexpr int POSE_PARAMS = 6;
+
+const cv::Scalar COLOR_MISSING{0, 0, 160};
+const cv::Scalar COLOR_COVERED{0, 200, 0};
+
+double LogDeterminant(const IntrinsicsInformation& information)
+{
+    cv::Matx<double, NUM_INTRINSICS, 1> eigenvalues;
+    cv::eigen(information, eigenvalues);
+    double sum = 0;
+    for (int i = 0; i < NUM_INTRINSICS; ++i)
+    {
+        sum += std::log(std::max(eigenvalues(i), 1e-300));
+    }
+    return sum;
+}
+
+int GetTiltBin(const cv::Vec3d& rvec)
+{
+    cv::Matx33d rotation;
+    cv::Rodrigues(rvec, rotation);
+    // normal of the board in camera space, towards the camera
+    cv::Vec3d normal{rotation(0, 2), rotation(1, 2), rotation(2, 2)};
+    if (normal[2] > 0) normal = -normal;
+
+    const double tilt = std::acos(std::clamp(-normal[2], -1.0, 1.0)) * 180 / std::numbers::pi;
+    const auto& edges = ViewScorer::TILT_EDGES;
+    const int ring = std::min(static_cast<int>(std::upper_bound(edges.begin(), edges.end(), tilt) - edges.begin()),
+                              static_cast<int>(edges.size()) - 1);
+    if (ring == 0) return 0;
+    const double direction = (std::atan2(normal[1], normal[0]) + std::numbers::pi) / (2 * std::numbers::pi);
+    const int directionBin = std::min(static_cast<int>(direction * ViewScorer::TILT_DIRECTIONS), ViewScorer::TILT_DIRECTIONS - 1);
+    return 1 + (ring - 1) * ViewScorer::TILT_DIRECTIONS + directionBin;
+}
+
+} // namespace
+
+void ViewScorer::SetCamera(cv::Size imageSize, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs)
+{
+    mImageSize = imageSize;
+    if (cameraMatrix.empty())
+    {
+        // about a 55 degree field of view, a pose from a poor guess still tells the tilt and covers the right cells
+        const double focal = imageSize.width;
+        mCameraMatrix = cv::Matx33d(focal, 0, imageSize.width / 2.0, 0, focal, imageSize.height / 2.0, 0, 0, 1);
+    }
+    else
+    {
+        cv::Mat converted;
+        cameraMatrix.convertTo(converted, CV_64F);
+        mCameraMatrix = cv::Matx33d(converted.ptr<double>());
+    }
+    mDistCoeffs = {};
+    if (!distCoeffs.empty())
+    {
+        cv::Mat coeffs;
+        distCoeffs.reshape(1, 1).convertTo(coeffs, CV_64F);
+        for (int i = 0; i < std::min(coeffs.cols, mDistCoeffs.cols); ++i)
+        {
+            mDistCoeffs(i) = coeffs.at<double>(i);
+        }
+    }
+}
+
+ViewScore ViewScorer::Score(std::span<const cv::Point3f> objectPoints, std::span<const cv::Point2f> imagePoints) const
+{
+    ATT_ASSERT(objectPoints.size() == imagePoints.size());
+    ATT_ASSERT(mImageSize.area() > 0, "camera not set");
+    ViewScore score;
+    for (const cv::Point2f& point : imagePoints)
+    {
+        const int col = std::clamp(static_cast<int>(point.x * VIEW_GRID_COLS / static_cast<float>(mImageSize.width)), 0, VIEW_GRID_COLS - 1);
+        const int row = std::clamp(static_cast<int>(point.y * VIEW_GRID_ROWS / static_cast<float>(mImageSize.height)), 0, VIEW_GRID_ROWS - 1);
+        score.cells.set(static_cast<std::size_t>(row) * VIEW_GRID_COLS + col);
+    }
+    if (static_cast<int>(objectPoints.size()) < MIN_POSE_POINTS) return score;
+
+    const std::vector<cv::Point3f> object(objectPoints.begin(), objectPoints.end());
+    const std::vector<cv::Point2f> image(imagePoints.begin(), imagePoints.end());
+    cv::Vec3d rvec, tvec;
+    std::vector<cv::Point2f> projected;
+    cv::Mat jacobian;
+    try
+    {
+        if (!cv::solvePnP(object, image, mCameraMatrix, mDistCoeffs, rvec, tvec) || tvec[2] <= 0) return score;
+        cv::projectPoints(object, rvec, tvec, mCameraMatrix, mDistCoeffs, projected, jacobian);
+    }
+    catch (const cv::Exception&)
+    {
+        // corners in a line or otherwise degenerate, the view still covers its cells
+        return score;
+    }
+    score.tiltBin = GetTiltBin(rvec);
+    ATT_ASSERT(jacobian.cols == POSE_PARAMS + NUM_INTRINSICS);
+    const cv::Mat normal = jacobian.t() * jacobian;
+
+    // the pose of each view is solved along with the intrinsics, what the view knows about the intrinsics
+    // is what is left once the pose is accounted for, the schur complement of the pose
+    const cv::Matx<double, POSE_PARAMS, POSE_PARAMS> pose = normal(cv::Rect(0, 0, POSE_PARAMS, POSE_PARAMS));
+    const cv::Matx<double, POSE_PARAMS, NUM_INTRINSICS> cross = normal(cv::Rect(POSE_PARAMS, 0, NUM_INTRINSICS, POSE_PARAMS));
+    const IntrinsicsInformation intrinsics = normal(cv::Rect(POSE_PARAMS, POSE_PARAMS, NUM_INTRINSICS, NUM_INTRINSICS));
+    score.information = intrinsics - cross.t() * pose.solve(cross, cv::DECOMP_SVD);
+    return score;
+}
+
+void ViewScorer::Clear()
+{
+    mInformation = {};
+    mCellViews = {};
+    mTiltViews = {};
+}
+
+void ViewScorer::Add(const ViewScore& score)
+{
+    mInformation += score.information;
+    for (int cell = 0; cell < VIEW_GRID_CELLS; ++cell)
+    {
+        if (score.cells.test(cell)) ++mCellViews[cell];
+    }
+    if (score.tiltBin >= 0) ++mTiltViews[score.tiltBin];
+}
+
+double ViewScorer::GetInformationGain(const ViewScore& score) const
+{
+    const IntrinsicsInformation current = GetPrior() + mInformation;
+    return LogDeterminant(current + score.information) - LogDeterminant(current);
+}
+
+int ViewScorer::GetNewCoverage(const ViewScore& score) const
+{
+    int count = 0;
+    for (int cell = 0; cell < VIEW_GRID_CELLS; ++cell)
+    {
+        if (score.cells.test(cell) && mCellViews[cell] < TARGET_CELL_VIEWS) ++count;
+    }
+    if (score.tiltBin >= 0 && mTiltViews[score.tiltBin] < TARGET_TILT_VIEWS) ++count;
+    return count;
+}
+
+bool ViewScorer::IsComplete() const
+{
+    return std::all_of(mCellViews.begin(), mCellViews.end(), [](int views) { return views >= TARGET_CELL_VIEWS; }) &&
+           std::all_of(mTiltViews.begin(), mTiltViews.end(), [](int views) { return views >= TARGET_TILT_VIEWS; });
+}
+
+void ViewScorer::DrawMissing(cv::Mat& image) const
+{
+    for (int row = 0; row < VIEW_GRID_ROWS; ++row)
+    {
+        for (int col = 0; col < VIEW_GRID_COLS; ++col)
+        {
+            if (mCellViews[static_cast<std::size_t>(row) * VIEW_GRID_COLS + col] >= TARGET_CELL_VIEWS) continue;
+            const cv::Point topLeft{col * image.cols / VIEW_GRID_COLS, row * image.rows / VIEW_GRID_ROWS};
+            const cv::Point bottomRight{(col + 1) * image.cols / VIEW_GRID_COLS, (row + 1) * image.rows / VIEW_GRID_ROWS};
+            cv::Mat cell = image(cv::Rect(topLeft, bottomRight));
+            cell.convertTo(cell, -1, 0.6);
+            cell += COLOR_MISSING * 0.4;
+        }
+    }
+
+    // rings of tilt, a sector for each direction the board normal can point
+    constexpr int frontalRadius = 14;
+    constexpr int ringWidth = 20;
+    const cv::Point center{image.cols - frontalRadius - 2 * ringWidth - 10, frontalRadius + 2 * ringWidth + 10};
+    const auto binColor = [&](int bin) { return mTiltViews[bin] >= TARGET_TILT_VIEWS ? COLOR_COVERED : COLOR_MISSING; };
+    cv::circle(image, center, frontalRadius, binColor(0), cv::FILLED);
+    constexpr double sector = 360.0 / TILT_DIRECTIONS;
+    for (int ring = 1; ring < static_cast<int>(TILT_EDGES.size()); ++ring)
+    {
+        const int radius = frontalRadius + ringWidth * ring - ringWidth / 2;
+        for (int direction = 0; direction < TILT_DIRECTIONS; ++direction)
+        {
+            // bins start at -180 degrees, like atan2
+            const double start = -180 + sector * direction;
+            cv::ellipse(image, center, cv::Size(radius, radius), 0, start + 2, start + sector - 2,
+                        binColor(1 + (ring - 1) * TILT_DIRECTIONS + direction), ringWidth - 4);
+        }
+    }
+}
+
+IntrinsicsInformation ViewScorer::GetPrior() const
+{
+    // a focal length and principal point anywhere within the image, distortion coefficients within 1
+    const double width = std::max(mImageSize.width, 1);
+    IntrinsicsInformation prior = IntrinsicsInformation::eye();
+    prior(0, 0) = prior(1, 1) = 1 / (width * width);
+    prior(2, 2) = prior(3, 3) = 4 / (width * width);
+    return prior;
+}
+
+TEST_CASE("ViewScorer skips views that add nothing")
+{
+    const cv::Size imageSize{640, 480};
+    const cv::Mat cameraMatrix = (cv::Mat_<double>(3, 3) << 600, 0, 320, 0, 600, 240, 0, 0, 1);
+    ViewScorer scorer;
+    scorer.SetCamera(imageSize, cameraMatrix, cv::Mat());
+
+    // a 7x6 grid of corners 3 cm apart, centered on the board origin
+    std::vector<cv::Point3f> board;
+    for (int row = 0; row < 6; ++row)
+    {
+        for (int col = 0; col < 7; ++col)
+        {
+            board.emplace_back(0.03F * (static_cast<float>(col) - 3), 0.03F * (static_cast<float>(row) - 2.5F), 0.0F);
+        }
+    }
+    const auto view = [&](cv::Vec3d rotation, cv::Vec3d position) {
+        std::vector<cv::Point2f> image;
+        cv::projectPoints(board, rotation, position, cameraMatrix, cv::noArray(), image);
+        return scorer.Score(board, image);
+    };
+
+    const ViewScore frontal = view({0, 0, 0}, {0, 0, 0.6});
+    CHECK(frontal.tiltBin == 0);
+    CHECK(frontal.cells.count() > 0);
+    CHECK(scorer.IsUseful(frontal));
+    scorer.Add(frontal);
+
+    // the same view again covers nothing new
+    CHECK(scorer.GetNewCoverage(frontal) == 0);
+    CHECK_NOT(scorer.IsUseful(frontal));
+
+    // tilted about 26 degrees in another part of the image, pins down the focal length a frontal view can not
+    const ViewScore tilted = view({0, 0.45, 0}, {-0.15, 0.05, 0.6});
+    CHECK(tilted.tiltBin >= 1);
+    CHECK(tilted.tiltBin <= ViewScorer::TILT_DIRECTIONS);
+    CHECK(scorer.GetNewCoverage(tilted) > 0);
+    const double gain = scorer.GetInformationGain(tilted);
+    CAPTURE(gain);
+    CHECK(scorer.IsUseful(tilted));
+    scorer.Add(tilted);
+    CHECK_NOT(scorer.IsComplete());
+
+    // too few corners to know the pose of the board
+    const std::span<const cv::Point3f> few{board.data(), 3};
+    const std::vector<cv::Point2f> fewImage{{100, 100}, {120, 100}, {140, 100}};
+    const ViewScore unknown = scorer.Score(few, fewImage);
+    CHECK(unknown.tiltBin == -1);
+    CHECK_NOT(scorer.IsUseful(unknown));
+
+    cv::Mat preview(imageSize, CV_8UC3, cv::Scalar::all(255));
+    scorer.DrawMissing(preview);
+    CHECK(preview.at<cv::Vec3b>(5, 5) != cv::Vec3b(255, 255, 255));
+}
+
+} // namespace math
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+
+#include <array>
+#include <bitset>
+#include <span>
+
+namespace math
+{
+
+/// fx, fy, cx, cy and the 5 distortion coefficients, the intrinsics a calibration solves for
+constexpr inline int NUM_INTRINSICS = 9;
+using IntrinsicsInformation = cv::Matx<double, NUM_INTRINSICS, NUM_INTRINSICS>;
+
+/// the image is split into a grid of cells, a view covers the cells its corners are in
+constexpr inline int VIEW_GRID_COLS = 8;
+constexpr inline int VIEW_GRID_ROWS = 6;
+constexpr inline int VIEW_GRID_CELLS = VIEW_GRID_COLS * VIEW_GRID_ROWS;
+
+/// what a view of a planar calibration board would add to a calibration
+struct ViewScore
+{
+    /// cells of the image grid the board corners fall in
+    std::bitset<VIEW_GRID_CELLS> cells;
+    /// bin of the tilt of the board towards the camera, -1 if its pose was not estimated
+    int tiltBin = -1;
+    /// Fisher information of the intrinsics, with the pose of the board marginalized out,
+    /// for corners detected with an error of 1 pixel. Zero if the pose was not estimated
+    IntrinsicsInformation information{};
+};
+
+/// Decides which views of a calibration board are worth adding by how much they add, rather than by a timer.
+/// A view is useful if it covers a cell of the image or a tilt of the board that few views cover yet,
+/// and shrinks the uncertainty of the intrinsics, so views that repeat the calibration are skipped.
+class ViewScorer
+{
+public:
+    /// directions the board is tilted in, in each ring of tilt angles
+    static constexpr int TILT_DIRECTIONS = 8;
+    /// degrees, under the first the board faces the camera, the rings are between
+    static constexpr std::array<double, 3> TILT_EDGES{15, 35, 90};
+    static constexpr int NUM_TILT_BINS = 1 + TILT_DIRECTIONS * (static_cast<int>(TILT_EDGES.size()) - 1);
+    /// views a cell or tilt bin needs before it counts as covered
+    static constexpr int TARGET_CELL_VIEWS = 1;
+    static constexpr int TARGET_TILT_VIEWS = 1;
+    /// log of the factor the volume of the intrinsics uncertainty must shrink by, for a view to be useful
+    static constexpr double MIN_INFORMATION_GAIN = 0.3;
+
+    /// intrinsics the poses of views are estimated with, empty to guess them from the image size.
+    /// Scores of views added before are not updated, score and add them again
+    void SetCamera(cv::Size imageSize, const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs);
+    cv::Size GetImageSize() const { return mImageSize; }
+    /// @param objectPoints corners on the board, z = 0
+    /// @param imagePoints the same corners detected in the image
+    ViewScore Score(std::span<const cv::Point3f> objectPoints, std::span<const cv::Point2f> imagePoints) const;
+
+    void Clear();
+    void Add(const ViewScore& score);
+    /// increase of the log determinant of the information the views added so far have about the intrinsics
+    double GetInformationGain(const ViewScore& score) const;
+    /// cells and tilt bins of the view that are not covered yet
+    int GetNewCoverage(const ViewScore& score) const;
+    bool IsUseful(const ViewScore& score) const
+    {
+        return GetNewCoverage(score) > 0 && GetInformationGain(score) >= MIN_INFORMATION_GAIN;
+    }
+    /// every cell and tilt bin is covered
+    bool IsComplete() const;
+
+    /// shade the cells not covered yet, and draw a dial of the tilts in the top right corner,
+    /// so the user knows where to hold the board next
+    void DrawMissing(cv::Mat& image) const;
+
+private:
+    /// loose prior of the intrinsics, so the information of the first views has a determinant
+    IntrinsicsInformation GetPrior() const;
+
+    cv::Size mImageSize{};
+    cv::Matx33d mCameraMatrix{};
+    /// always 5 coefficients, the jacobian of cv::projectPoints has a column per coefficient
+    cv::Matx<double, 1, 5> mDistCoeffs{};
+    IntrinsicsInformation mInformation{};
+    std::array<int, VIEW_GRID_CELLS> mCellViews{};
+    std::array<int, NUM_TILT_BINS> mTiltViews{};
+};
+
+} // namespace math
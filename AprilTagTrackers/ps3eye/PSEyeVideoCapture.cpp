@@ -297,7 +297,7 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
 public:
     PSEYECaptureCAM_PS3EYE(int _index)
     : m_index(-1), m_width(-1), m_height(-1), m_widthStep(-1),
-    m_size(-1), m_MatBayer(0, 0, CV_8UC1)
+    m_size(-1), m_MatFrame(0, 0, CV_8UC3)
     {
         //CoInitialize(NULL);
         open(_index);
@@ -333,6 +333,10 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
         case CV_CAP_PROP_SHARPNESS:
             // [0, 63] -> [0, 255]
             return (double)(eye->getSharpness())*256.0 / 64.0;
+        case CV_CAP_PROP_CONVERT_RGB:
+            return eye->getOutputFormat() == ps3eye::PS3EYECam::EOutputFormat::Gray ? 0 : 1;
+        case PSEYE_CAP_PROP_CONVERSION_THREADS:
+            return (double)(eye->getConversionThreadCount());
         }
         return 0;
     }
@@ -389,6 +393,20 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
             // [0, 255] -> [0, 63] [0]
             val = (int)(value * 64.0 / 256.0);
             eye->setSharpness((int)round(value));
+			break;
+        case CV_CAP_PROP_CONVERT_RGB:
+            // 0 -> grayscale converted directly from bayer, skips the color conversion
+            eye->setOutputFormat(value != 0 ? ps3eye::PS3EYECam::EOutputFormat::BGR : ps3eye::PS3EYECam::EOutputFormat::Gray);
+			break;
+        case PSEYE_CAP_PROP_CONVERSION_THREADS:
+            // [1, ...] [1], the worker threads are created when the stream starts
+            // restarting drops frames, so only when the count changes
+			val = (int)round(value) < 1 ? 1 : (int)round(value);
+			if (val == eye->getConversionThreadCount()) break;
+			eye->stop();
+			eye->setConversionThreadCount(val);
+			eye->start();
+			break;
         }
 
         refreshDimensions();
@@ -403,9 +421,18 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
 
     bool retrieveFrame(int outputType, cv::OutputArray outArray)
     {
-        eye->getFrame(m_MatBayer.data);
-
-        cv::cvtColor(m_MatBayer, outArray, cv::COLOR_BayerGB2BGR);
+        // the driver converts from bayer, directly into the output when possible
+        outArray.create(m_MatFrame.size(), m_MatFrame.type());
+        cv::Mat outMat = outArray.getMat();
+        if (outMat.isContinuous())
+        {
+            eye->getFrame(outMat.data);
+        }
+        else
+        {
+            eye->getFrame(m_MatFrame.data);
+            m_MatFrame.copyTo(outMat);
+        }
         return true;
     }
 
@@ -447,7 +474,7 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
 
             eye = devices[_index];
 
-            if (eye && eye->init(640, 480, 15, ps3eye::PS3EYECam::EOutputFormat::Bayer))
+            if (eye && eye->init(640, 480, 15, ps3eye::PS3EYECam::EOutputFormat::BGR))
             {
                 // Change any default settings here
 
@@ -476,15 +503,15 @@ class PSEYECaptureCAM_PS3EYE : public cv::IVideoCapture
     void refreshDimensions()
     {
         m_width = eye->getWidth();
-        m_widthStep = eye->getRowBytes(); // just width * 1 byte per pixel.
+        m_widthStep = eye->getRowBytes(); // width * bytes per pixel of the output format.
         m_height = eye->getHeight();
         m_size = m_widthStep * m_height;
-        m_MatBayer.create(cv::Size(m_width, m_height), CV_8UC1);
+        m_MatFrame.create(cv::Size(m_width, m_height), eye->getOutputBytesPerPixel() == 1 ? CV_8UC1 : CV_8UC3);
     }
 
     int m_index, m_width, m_height, m_widthStep;
     size_t m_size;
-    cv::Mat m_MatBayer;
+    cv::Mat m_MatFrame;
     ps3eye::PS3EYECam::PS3EYERef eye;
 };
 
@@ -19,6 +19,13 @@ limitations under the License.
 
 #include <opencv2/videoio.hpp>
 
+// MODIFIED: PS3EYEDriver specific properties for PSEyeVideoCapture::set() and get()
+enum
+{
+    PSEYE_CAP_PROP_CONVERSION_THREADS = 2301 // threads converting frames from bayer, including the capture thread
+};
+// MODIFIED
+
 /// Video capture class that prioritizes PS3 Eye devices.
 /**
 Device opening priority:
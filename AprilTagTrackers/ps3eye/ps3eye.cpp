@@ -61,13 +61,29 @@ The code is based on the Linux driver for the PSEye, which can be found here:
 #endif
 // MODIFIED
 
+// MODIFIED: include tests before the debug() macro is defined
+#include "utils/Test.hpp"
+// MODIFIED
+
 #include "ps3eye.h"
 
+#include <cassert>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 
+// MODIFIED: vectorized Bayer conversion, SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PS3EYE_DEBAYER_SSE2
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#define PS3EYE_DEBAYER_NEON
+	#include <arm_neon.h>
+#endif
+// MODIFIED
+
 #if defined WIN32 || defined _WIN32 || defined WINCE
 	#include <windows.h>
 	#include <algorithm>
@@ -488,21 +504,522 @@ int USBMgr::listDevices( std::vector<PS3EYECam::PS3EYERef>& list )
 
 static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr);
 
+// MODIFIED: row based Bayer conversion
+//
+// PSMove output is in the following Bayer format (GRBG):
+//
+// G R G R G R   <- even rows ("red rows")
+// B G B G B G   <- odd rows ("blue rows")
+//
+// Every interior pixel is interpolated from its 3x3 neighbourhood, using the sums
+//   c = center, h = left + right, v = up + down, d = the 4 diagonals
+// The edges are copied from their inner neighbours, same as FrameQueue::Debayer.
+// Rows are independent, so any range of interior rows can be converted on its own.
+
+// Luma weights (77R + 150G + 29B) / 256, reduced to fit 16 bit lanes: (76R + 152G + 28B) / 256
+// Per Bayer site the interpolated colours are folded into weights for c, h, v and d.
+struct BayerLumaWeights
+{
+	uint16_t c, h, v, d;
+};
+static const BayerLumaWeights LUMA_RED_SITE			= { 76, 38, 38, 7 };	// R = c, G = (h + v) / 4, B = d / 4
+static const BayerLumaWeights LUMA_BLUE_SITE		= { 28, 38, 38, 19 };	// B = c, G = (h + v) / 4, R = d / 4
+static const BayerLumaWeights LUMA_GREEN_RED_ROW	= { 152, 38, 14, 0 };	// G = c, R = h / 2, B = v / 2
+static const BayerLumaWeights LUMA_GREEN_BLUE_ROW	= { 152, 14, 38, 0 };	// G = c, B = h / 2, R = v / 2
+
+static inline uint8_t BayerLumaPixel(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, bool red_row)
+{
+	const bool odd_x = (x & 1) != 0;
+	const BayerLumaWeights& w = red_row ? (odd_x ? LUMA_RED_SITE : LUMA_GREEN_RED_ROW) : (odd_x ? LUMA_GREEN_BLUE_ROW : LUMA_BLUE_SITE);
+	const int h = mid[x - 1] + mid[x + 1];
+	const int v = up[x] + down[x];
+	const int d = up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1];
+	return (uint8_t)((w.c * mid[x] + w.h * h + w.v * v + w.d * d + 128) >> 8);
+}
+
+// Same rounding as FrameQueue::Debayer
+static inline void BayerColorPixel(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, bool red_row, uint8_t* dest, bool inBGR)
+{
+	const bool odd_x = (x & 1) != 0;
+	const int h = mid[x - 1] + mid[x + 1];
+	const int v = up[x] + down[x];
+	const int d = up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1];
+	int r, g, b;
+	if (red_row == odd_x)
+	{
+		// red or blue site
+		const int center = mid[x];
+		const int diag = (d + 2) >> 2;
+		g = (h + v + 2) >> 2;
+		r = red_row ? center : diag;
+		b = red_row ? diag : center;
+	}
+	else
+	{
+		// green site
+		g = mid[x];
+		r = red_row ? (h + 1) >> 1 : (v + 1) >> 1;
+		b = red_row ? (v + 1) >> 1 : (h + 1) >> 1;
+	}
+	dest[0] = (uint8_t)(inBGR ? b : r);
+	dest[1] = (uint8_t)g;
+	dest[2] = (uint8_t)(inBGR ? r : b);
+}
+
+#if defined(PS3EYE_DEBAYER_SSE2)
+
+// Neighbourhood sums of 16 pixels starting at mid[0], widened to 16 bit: [0] = pixels 0-7, [1] = pixels 8-15
+struct BayerSums16
+{
+	__m128i c[2], h[2], v[2], d[2];
+};
+
+static inline void LoadBayerSums(const uint8_t* up, const uint8_t* mid, const uint8_t* down, BayerSums16& sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i u0 = _mm_loadu_si128((const __m128i*)(up - 1));
+	const __m128i u1 = _mm_loadu_si128((const __m128i*)(up));
+	const __m128i u2 = _mm_loadu_si128((const __m128i*)(up + 1));
+	const __m128i m0 = _mm_loadu_si128((const __m128i*)(mid - 1));
+	const __m128i m1 = _mm_loadu_si128((const __m128i*)(mid));
+	const __m128i m2 = _mm_loadu_si128((const __m128i*)(mid + 1));
+	const __m128i d0 = _mm_loadu_si128((const __m128i*)(down - 1));
+	const __m128i d1 = _mm_loadu_si128((const __m128i*)(down));
+	const __m128i d2 = _mm_loadu_si128((const __m128i*)(down + 1));
+
+	sums.c[0] = _mm_unpacklo_epi8(m1, zero);
+	sums.c[1] = _mm_unpackhi_epi8(m1, zero);
+	sums.h[0] = _mm_add_epi16(_mm_unpacklo_epi8(m0, zero), _mm_unpacklo_epi8(m2, zero));
+	sums.h[1] = _mm_add_epi16(_mm_unpackhi_epi8(m0, zero), _mm_unpackhi_epi8(m2, zero));
+	sums.v[0] = _mm_add_epi16(_mm_unpacklo_epi8(u1, zero), _mm_unpacklo_epi8(d1, zero));
+	sums.v[1] = _mm_add_epi16(_mm_unpackhi_epi8(u1, zero), _mm_unpackhi_epi8(d1, zero));
+	sums.d[0] = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(u0, zero), _mm_unpacklo_epi8(u2, zero)),
+							  _mm_add_epi16(_mm_unpacklo_epi8(d0, zero), _mm_unpacklo_epi8(d2, zero)));
+	sums.d[1] = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(u0, zero), _mm_unpackhi_epi8(u2, zero)),
+							  _mm_add_epi16(_mm_unpackhi_epi8(d0, zero), _mm_unpackhi_epi8(d2, zero)));
+}
+
+// mask ? a : b
+static inline __m128i Select16(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Store 16 pixels of 3 planes as 48 interleaved bytes
+static inline void StoreInterleaved3(uint8_t* dest, __m128i a, __m128i b, __m128i c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ab_lo = _mm_unpacklo_epi8(a, b);
+	const __m128i ab_hi = _mm_unpackhi_epi8(a, b);
+	const __m128i c_lo = _mm_unpacklo_epi8(c, zero);
+	const __m128i c_hi = _mm_unpackhi_epi8(c, zero);
+	// 4 pixels per register as a b c 0
+	__m128i px[4] = {
+		_mm_unpacklo_epi16(ab_lo, c_lo),
+		_mm_unpackhi_epi16(ab_lo, c_lo),
+		_mm_unpacklo_epi16(ab_hi, c_hi),
+		_mm_unpackhi_epi16(ab_hi, c_hi) };
+
+	// squeeze out the padding bytes, first within each 64 bit half, then between the halves
+	const __m128i first_pixel = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+	const __m128i second_pixel = _mm_set_epi32(0x0000ffff, (int)0xff000000, 0x0000ffff, (int)0xff000000);
+	const __m128i low_half = _mm_set_epi32(0, 0, 0x0000ffff, -1);
+	const __m128i high_half = _mm_set_epi32(0, -1, (int)0xffff0000, 0);
+	for (int i = 0; i < 4; ++i)
+	{
+		const __m128i pairs = _mm_or_si128(_mm_and_si128(px[i], first_pixel), _mm_and_si128(_mm_srli_epi64(px[i], 8), second_pixel));
+		px[i] = _mm_or_si128(_mm_and_si128(pairs, low_half), _mm_and_si128(_mm_srli_si128(pairs, 2), high_half));
+	}
+
+	// 12 valid bytes per register, the top 4 bytes are zero
+	_mm_storeu_si128((__m128i*)(dest), _mm_or_si128(px[0], _mm_slli_si128(px[1], 12)));
+	_mm_storeu_si128((__m128i*)(dest + 16), _mm_or_si128(_mm_srli_si128(px[1], 4), _mm_slli_si128(px[2], 8)));
+	_mm_storeu_si128((__m128i*)(dest + 32), _mm_or_si128(_mm_srli_si128(px[2], 8), _mm_slli_si128(px[3], 4)));
+}
+
+// Convert pixels [x, x + 16) for as long as the loads stay inside the row, x must be odd. Returns the first unconverted x.
+static int BayerColorRowSIMD(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, int frame_width, bool red_row, uint8_t* dest_row, bool inBGR)
+{
+	// even lanes hold odd x
+	const __m128i even_lanes = _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i two = _mm_set1_epi16(2);
+	// red rows: even lanes are red sites, odd lanes green. blue rows: even lanes are green, odd lanes blue sites.
+	const __m128i color_site = red_row ? even_lanes : _mm_xor_si128(even_lanes, _mm_set1_epi16(-1));
+
+	BayerSums16 sums;
+	for (; x + 16 <= frame_width - 1; x += 16)
+	{
+		LoadBayerSums(up + x, mid + x, down + x, sums);
+
+		__m128i r[2], g[2], b[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			const __m128i half_h = _mm_srli_epi16(_mm_add_epi16(sums.h[i], one), 1);
+			const __m128i half_v = _mm_srli_epi16(_mm_add_epi16(sums.v[i], one), 1);
+			const __m128i cross = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sums.h[i], sums.v[i]), two), 2);
+			const __m128i diag = _mm_srli_epi16(_mm_add_epi16(sums.d[i], two), 2);
+
+			g[i] = Select16(color_site, cross, sums.c[i]);
+			if (red_row)
+			{
+				r[i] = Select16(color_site, sums.c[i], half_h);
+				b[i] = Select16(color_site, diag, half_v);
+			}
+			else
+			{
+				r[i] = Select16(color_site, diag, half_v);
+				b[i] = Select16(color_site, sums.c[i], half_h);
+			}
+		}
+
+		const __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+		const __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+		const __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+		if (inBGR)
+			StoreInterleaved3(dest_row + x * 3, b8, g8, r8);
+		else
+			StoreInterleaved3(dest_row + x * 3, r8, g8, b8);
+	}
+	return x;
+}
+
+static inline __m128i LumaWeights(const BayerLumaWeights& even_lane, const BayerLumaWeights& odd_lane, uint16_t BayerLumaWeights::*weight)
+{
+	return _mm_set_epi16(odd_lane.*weight, even_lane.*weight, odd_lane.*weight, even_lane.*weight,
+						 odd_lane.*weight, even_lane.*weight, odd_lane.*weight, even_lane.*weight);
+}
+
+static int BayerLumaRowSIMD(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, int frame_width, bool red_row, uint8_t* dest_row)
+{
+	// even lanes hold odd x
+	const BayerLumaWeights& even_lane = red_row ? LUMA_RED_SITE : LUMA_GREEN_BLUE_ROW;
+	const BayerLumaWeights& odd_lane = red_row ? LUMA_GREEN_RED_ROW : LUMA_BLUE_SITE;
+	const __m128i wc = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::c);
+	const __m128i wh = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::h);
+	const __m128i wv = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::v);
+	const __m128i wd = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::d);
+	const __m128i round = _mm_set1_epi16(128);
+
+	BayerSums16 sums;
+	for (; x + 16 <= frame_width - 1; x += 16)
+	{
+		LoadBayerSums(up + x, mid + x, down + x, sums);
+
+		__m128i luma[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			// at most 65280 + 128, fits unsigned 16 bit
+			__m128i sum = _mm_add_epi16(_mm_mullo_epi16(sums.c[i], wc), _mm_mullo_epi16(sums.h[i], wh));
+			sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(sums.v[i], wv), _mm_mullo_epi16(sums.d[i], wd)));
+			luma[i] = _mm_srli_epi16(_mm_add_epi16(sum, round), 8);
+		}
+		_mm_storeu_si128((__m128i*)(dest_row + x), _mm_packus_epi16(luma[0], luma[1]));
+	}
+	return x;
+}
+
+#elif defined(PS3EYE_DEBAYER_NEON)
+
+struct BayerSums16
+{
+	uint16x8_t c[2], h[2], v[2], d[2];
+};
+
+static inline void LoadBayerSums(const uint8_t* up, const uint8_t* mid, const uint8_t* down, BayerSums16& sums)
+{
+	const uint8x16_t u0 = vld1q_u8(up - 1);
+	const uint8x16_t u1 = vld1q_u8(up);
+	const uint8x16_t u2 = vld1q_u8(up + 1);
+	const uint8x16_t m0 = vld1q_u8(mid - 1);
+	const uint8x16_t m1 = vld1q_u8(mid);
+	const uint8x16_t m2 = vld1q_u8(mid + 1);
+	const uint8x16_t d0 = vld1q_u8(down - 1);
+	const uint8x16_t d1 = vld1q_u8(down);
+	const uint8x16_t d2 = vld1q_u8(down + 1);
+
+	sums.c[0] = vmovl_u8(vget_low_u8(m1));
+	sums.c[1] = vmovl_u8(vget_high_u8(m1));
+	sums.h[0] = vaddl_u8(vget_low_u8(m0), vget_low_u8(m2));
+	sums.h[1] = vaddl_u8(vget_high_u8(m0), vget_high_u8(m2));
+	sums.v[0] = vaddl_u8(vget_low_u8(u1), vget_low_u8(d1));
+	sums.v[1] = vaddl_u8(vget_high_u8(u1), vget_high_u8(d1));
+	sums.d[0] = vaddq_u16(vaddl_u8(vget_low_u8(u0), vget_low_u8(u2)), vaddl_u8(vget_low_u8(d0), vget_low_u8(d2)));
+	sums.d[1] = vaddq_u16(vaddl_u8(vget_high_u8(u0), vget_high_u8(u2)), vaddl_u8(vget_high_u8(d0), vget_high_u8(d2)));
+}
+
+static int BayerColorRowSIMD(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, int frame_width, bool red_row, uint8_t* dest_row, bool inBGR)
+{
+	// even lanes hold odd x
+	static const uint16_t even_lanes_init[8] = { 0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff, 0 };
+	const uint16x8_t even_lanes = vld1q_u16(even_lanes_init);
+	const uint16x8_t color_site = red_row ? even_lanes : vmvnq_u16(even_lanes);
+
+	BayerSums16 sums;
+	for (; x + 16 <= frame_width - 1; x += 16)
+	{
+		LoadBayerSums(up + x, mid + x, down + x, sums);
+
+		uint16x8_t r[2], g[2], b[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			// rounding shifts, (a + 2^(n-1)) >> n
+			const uint16x8_t half_h = vrshrq_n_u16(sums.h[i], 1);
+			const uint16x8_t half_v = vrshrq_n_u16(sums.v[i], 1);
+			const uint16x8_t cross = vrshrq_n_u16(vaddq_u16(sums.h[i], sums.v[i]), 2);
+			const uint16x8_t diag = vrshrq_n_u16(sums.d[i], 2);
+
+			g[i] = vbslq_u16(color_site, cross, sums.c[i]);
+			if (red_row)
+			{
+				r[i] = vbslq_u16(color_site, sums.c[i], half_h);
+				b[i] = vbslq_u16(color_site, diag, half_v);
+			}
+			else
+			{
+				r[i] = vbslq_u16(color_site, diag, half_v);
+				b[i] = vbslq_u16(color_site, sums.c[i], half_h);
+			}
+		}
+
+		const uint8x16_t r8 = vcombine_u8(vmovn_u16(r[0]), vmovn_u16(r[1]));
+		const uint8x16_t g8 = vcombine_u8(vmovn_u16(g[0]), vmovn_u16(g[1]));
+		const uint8x16_t b8 = vcombine_u8(vmovn_u16(b[0]), vmovn_u16(b[1]));
+		uint8x16x3_t pixels;
+		pixels.val[0] = inBGR ? b8 : r8;
+		pixels.val[1] = g8;
+		pixels.val[2] = inBGR ? r8 : b8;
+		vst3q_u8(dest_row + x * 3, pixels);
+	}
+	return x;
+}
+
+static inline uint16x8_t LumaWeights(const BayerLumaWeights& even_lane, const BayerLumaWeights& odd_lane, uint16_t BayerLumaWeights::*weight)
+{
+	const uint16_t lanes[8] = { even_lane.*weight, odd_lane.*weight, even_lane.*weight, odd_lane.*weight,
+								even_lane.*weight, odd_lane.*weight, even_lane.*weight, odd_lane.*weight };
+	return vld1q_u16(lanes);
+}
+
+static int BayerLumaRowSIMD(const uint8_t* up, const uint8_t* mid, const uint8_t* down, int x, int frame_width, bool red_row, uint8_t* dest_row)
+{
+	// even lanes hold odd x
+	const BayerLumaWeights& even_lane = red_row ? LUMA_RED_SITE : LUMA_GREEN_BLUE_ROW;
+	const BayerLumaWeights& odd_lane = red_row ? LUMA_GREEN_RED_ROW : LUMA_BLUE_SITE;
+	const uint16x8_t wc = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::c);
+	const uint16x8_t wh = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::h);
+	const uint16x8_t wv = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::v);
+	const uint16x8_t wd = LumaWeights(even_lane, odd_lane, &BayerLumaWeights::d);
+
+	BayerSums16 sums;
+	for (; x + 16 <= frame_width - 1; x += 16)
+	{
+		LoadBayerSums(up + x, mid + x, down + x, sums);
+
+		uint8x8_t luma[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			// at most 65280, fits unsigned 16 bit
+			uint16x8_t sum = vmulq_u16(sums.c[i], wc);
+			sum = vmlaq_u16(sum, sums.h[i], wh);
+			sum = vmlaq_u16(sum, sums.v[i], wv);
+			sum = vmlaq_u16(sum, sums.d[i], wd);
+			luma[i] = vmovn_u16(vrshrq_n_u16(sum, 8));
+		}
+		vst1q_u8(dest_row + x, vcombine_u8(luma[0], luma[1]));
+	}
+	return x;
+}
+
+#endif
+
+// Convert interior rows [y_begin, y_end) to BGR or RGB, including the first and last pixel of each row
+static void BayerColorRows(int frame_width, int y_begin, int y_end, const uint8_t* inBayer, uint8_t* outBuffer, bool inBGR)
+{
+	for (int y = y_begin; y < y_end; ++y)
+	{
+		const uint8_t* mid = inBayer + y * frame_width;
+		uint8_t* dest_row = outBuffer + y * frame_width * 3;
+		const bool red_row = (y & 1) == 0;
+
+		int x = 1;
+#if defined(PS3EYE_DEBAYER_SSE2) || defined(PS3EYE_DEBAYER_NEON)
+		x = BayerColorRowSIMD(mid - frame_width, mid, mid + frame_width, x, frame_width, red_row, dest_row, inBGR);
+#endif
+		for (; x < frame_width - 1; ++x)
+			BayerColorPixel(mid - frame_width, mid, mid + frame_width, x, red_row, dest_row + x * 3, inBGR);
+
+		memcpy(dest_row, dest_row + 3, 3);
+		memcpy(dest_row + (frame_width - 1) * 3, dest_row + (frame_width - 2) * 3, 3);
+	}
+}
+
+// Convert interior rows [y_begin, y_end) to luma, including the first and last pixel of each row
+static void BayerLumaRows(int frame_width, int y_begin, int y_end, const uint8_t* inBayer, uint8_t* outBuffer)
+{
+	for (int y = y_begin; y < y_end; ++y)
+	{
+		const uint8_t* mid = inBayer + y * frame_width;
+		uint8_t* dest_row = outBuffer + y * frame_width;
+		const bool red_row = (y & 1) == 0;
+
+		int x = 1;
+#if defined(PS3EYE_DEBAYER_SSE2) || defined(PS3EYE_DEBAYER_NEON)
+		x = BayerLumaRowSIMD(mid - frame_width, mid, mid + frame_width, x, frame_width, red_row, dest_row);
+#endif
+		for (; x < frame_width - 1; ++x)
+			dest_row[x] = BayerLumaPixel(mid - frame_width, mid, mid + frame_width, x, red_row);
+
+		dest_row[0] = dest_row[1];
+		dest_row[frame_width - 1] = dest_row[frame_width - 2];
+	}
+}
+
+// Copy the first and last row from their inner neighbours, once all interior rows are converted
+static void BayerFillEdgeRows(int frame_width, int frame_height, uint8_t* outBuffer, int num_output_channels)
+{
+	const int dest_stride = frame_width * num_output_channels;
+	memcpy(outBuffer, outBuffer + dest_stride, dest_stride);
+	memcpy(outBuffer + (frame_height - 1) * dest_stride, outBuffer + (frame_height - 2) * dest_stride, dest_stride);
+}
+// MODIFIED
+
+// MODIFIED: band parallel Bayer conversion
+// Splits the interior rows of a frame into horizontal bands, one per thread.
+// Every output row only reads its own input rows, so the seams between bands need no overlap,
+// only the edge rows have to wait until every band is done.
+static void BayerConvertBand(int band, int num_bands, int frame_width, int frame_height, const uint8_t* inBayer, uint8_t* outBuffer, PS3EYECam::EOutputFormat outputFormat)
+{
+	const int interior_rows = frame_height - 2;
+	const int y_begin = 1 + interior_rows * band / num_bands;
+	const int y_end = 1 + interior_rows * (band + 1) / num_bands;
+
+	if (outputFormat == PS3EYECam::EOutputFormat::Gray)
+		BayerLumaRows(frame_width, y_begin, y_end, inBayer, outBuffer);
+	else
+		BayerColorRows(frame_width, y_begin, y_end, inBayer, outBuffer, outputFormat == PS3EYECam::EOutputFormat::BGR);
+}
+
+// Band conversion on threads of its own, with the calling thread converting the first band
+class BayerBandWorkers
+{
+public:
+	BayerBandWorkers(int num_threads) :
+		frame_width		(0),
+		frame_height	(0),
+		source			(NULL),
+		dest			(NULL),
+		output_format	(PS3EYECam::EOutputFormat::Bayer),
+		generation		(0),
+		pending			(0),
+		stopping		(false)
+	{
+		for (int band = 1; band < num_threads; ++band)
+			threads.emplace_back(&BayerBandWorkers::WorkerLoop, this, band);
+	}
+
+	~BayerBandWorkers()
+	{
+		stopping.store(true, std::memory_order_relaxed);
+		generation.fetch_add(1, std::memory_order_release);
+		generation.notify_all();
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	int GetBandCount() const
+	{
+		return (int)threads.size() + 1;
+	}
+
+	void Convert(int width, int height, const uint8_t* inBayer, uint8_t* outBuffer, PS3EYECam::EOutputFormat outputFormat)
+	{
+		frame_width = width;
+		frame_height = height;
+		source = inBayer;
+		dest = outBuffer;
+		output_format = outputFormat;
+
+		// release: the frame description above is visible to workers once they see the new generation
+		pending.store((int)threads.size(), std::memory_order_relaxed);
+		generation.fetch_add(1, std::memory_order_release);
+		generation.notify_all();
+
+		ConvertBand(0);
+
+		int remaining = pending.load(std::memory_order_acquire);
+		for (int spin = 0; remaining != 0 && spin < MAX_WAIT_SPINS; ++spin)
+		{
+			std::this_thread::yield();
+			remaining = pending.load(std::memory_order_acquire);
+		}
+		while (remaining != 0)
+		{
+			pending.wait(remaining, std::memory_order_acquire);
+			remaining = pending.load(std::memory_order_acquire);
+		}
+
+		BayerFillEdgeRows(frame_width, frame_height, dest, output_format == PS3EYECam::EOutputFormat::Gray ? 1 : 3);
+	}
+
+private:
+	static const int MAX_WAIT_SPINS = 64;
+
+	void ConvertBand(int band)
+	{
+		BayerConvertBand(band, GetBandCount(), frame_width, frame_height, source, dest, output_format);
+	}
+
+	void WorkerLoop(int band)
+	{
+		uint32_t seen_generation = 0;
+		for (;;)
+		{
+			generation.wait(seen_generation, std::memory_order_acquire);
+			seen_generation = generation.load(std::memory_order_acquire);
+			if (stopping.load(std::memory_order_relaxed))
+				return;
+
+			ConvertBand(band);
+
+			// acq_rel: the converted rows are visible to the calling thread once it sees pending reach 0
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				pending.notify_one();
+		}
+	}
+
+	int							frame_width;
+	int							frame_height;
+	const uint8_t*				source;
+	uint8_t*					dest;
+	PS3EYECam::EOutputFormat	output_format;
+	std::vector<std::thread>	threads;
+	std::atomic<uint32_t>		generation;
+	std::atomic<int>			pending;
+	std::atomic<bool>			stopping;
+};
+// MODIFIED
+
 class FrameQueue
 {
 public:
-	FrameQueue(uint32_t frame_size) :
+	FrameQueue(uint32_t frame_size, int conversion_threads = 1, const PS3EYECam::ParallelFor& parallel_for = PS3EYECam::ParallelFor()) :
 		frame_size			(frame_size),
 		num_frames			(2),
 		frame_buffer		((uint8_t*)malloc(frame_size * num_frames)),
-		head				(0),
-		tail				(0),
-		available			(0)
+		write_index			(0),
+		read_index			(0),
+		conversion_bands	(conversion_threads),
+		parallel_for		(conversion_threads > 1 ? parallel_for : PS3EYECam::ParallelFor()),
+		band_workers		(conversion_threads > 1 && !parallel_for ? new BayerBandWorkers(conversion_threads) : NULL)
 	{
+		// The indices wrap around at 2^32, so the slot mapping (index % num_frames) only stays continuous for power of two sizes
+		assert((num_frames & (num_frames - 1)) == 0);
 	}
 
 	~FrameQueue()
 	{
+		delete band_workers;
 		free(frame_buffer);
 	}
 
@@ -511,11 +1028,15 @@ class FrameQueue
 		return frame_buffer;
 	}
 
+	// Single producer / single consumer ring without locks:
+	// - write_index is only modified by the producer (libusb transfer callback thread)
+	// - read_index is only modified by the consumer (capture thread)
+	// Frames in [read_index, write_index) are complete and owned by the consumer, the slot at write_index is owned by the producer.
 	uint8_t* Enqueue()
 	{
-		uint8_t* new_frame = NULL;
-
-		std::lock_guard<std::mutex> lock(mutex);
+		const uint32_t write = write_index.load(std::memory_order_relaxed);
+		// acquire: the consumer must have finished reading a slot before we can hand it back to the producer
+		const uint32_t read = read_index.load(std::memory_order_acquire);
 
 		// Unlike traditional producer/consumer, we don't block the producer if the buffer is full (ie. the consumer is not reading data fast enough).
 		// Instead, if the buffer is full, we simply return the current frame pointer, causing the producer to overwrite the previous frame.
@@ -523,48 +1044,79 @@ class FrameQueue
 		//
 		// Note that because the the producer is writing directly to the ring buffer, we can only ever be a maximum of num_frames-1 ahead of the consumer,
 		// otherwise the producer could overwrite the frame the consumer is currently reading (in case of a slow consumer)
-		if (available >= num_frames - 1)
+		if (write - read >= num_frames - 1)
 		{
-			return frame_buffer + head * frame_size;
+			return frame_buffer + (write % num_frames) * frame_size;
 		}
 
 		// Note: we don't need to copy any data to the buffer since the USB packets are directly written to the frame buffer.
-		// We just need to update head and available count to signal to the consumer that a new frame is available
-		head = (head + 1) % num_frames;
-		available++;
+		// We just need to advance the write index to signal to the consumer that a new frame is available.
+		// release: the frame data written by the producer is visible to the consumer once it sees the new index
+		write_index.store(write + 1, std::memory_order_release);
 
-		// Determine the next frame pointer that the producer should write to
-		new_frame = frame_buffer + head * frame_size;
+		// Wake the consumer if it went to sleep waiting on an empty queue, cheap when nobody is waiting
+		write_index.notify_one();
 
-		// Signal consumer that data became available
-		empty_condition.notify_one();
-
-		return new_frame;
+		// Determine the next frame pointer that the producer should write to
+		return frame_buffer + ((write + 1) % num_frames) * frame_size;
 	}
 
 	void Dequeue(uint8_t* new_frame, int frame_width, int frame_height, PS3EYECam::EOutputFormat outputFormat)
 	{
-		std::unique_lock<std::mutex> lock(mutex);
+		const uint32_t read = read_index.load(std::memory_order_relaxed);
 
-		// If there is no data in the buffer, wait until data becomes available
-		empty_condition.wait(lock, [this] () { return available != 0; });
+		// If there is no data in the buffer, wait until data becomes available.
+		// A frame arrives every 5-66ms, so spin only briefly before falling back to a futex wait, which will only be entered when the queue is empty.
+		uint32_t write = write_index.load(std::memory_order_acquire);
+		for (int spin = 0; write == read && spin < MAX_EMPTY_SPINS; ++spin)
+		{
+			std::this_thread::yield();
+			write = write_index.load(std::memory_order_acquire);
+		}
+		while (write == read)
+		{
+			write_index.wait(read, std::memory_order_acquire);
+			write = write_index.load(std::memory_order_acquire);
+		}
 
-		// Copy from internal buffer
-		uint8_t* source = frame_buffer + frame_size * tail;
+		// Copy from internal buffer, the producer won't touch this slot until read_index is advanced
+		const uint8_t* source = frame_buffer + frame_size * (read % num_frames);
 
 		if (outputFormat == PS3EYECam::EOutputFormat::Bayer)
 		{
 			memcpy(new_frame, source, frame_size);
 		}
+		else if (parallel_for)
+		{
+			const int num_bands = conversion_bands;
+			parallel_for(num_bands, [&](int band) {
+				BayerConvertBand(band, num_bands, frame_width, frame_height, source, new_frame, outputFormat);
+			});
+			BayerFillEdgeRows(frame_width, frame_height, new_frame, outputFormat == PS3EYECam::EOutputFormat::Gray ? 1 : 3);
+		}
+		else if (band_workers != NULL)
+		{
+			band_workers->Convert(frame_width, frame_height, source, new_frame, outputFormat);
+		}
 		else if (outputFormat == PS3EYECam::EOutputFormat::BGR ||
 				 outputFormat == PS3EYECam::EOutputFormat::RGB)
 		{
-			Debayer(frame_width, frame_height, source, new_frame, outputFormat == PS3EYECam::EOutputFormat::BGR);
+			const bool inBGR = outputFormat == PS3EYECam::EOutputFormat::BGR;
+#if defined(PS3EYE_DEBAYER_SSE2) || defined(PS3EYE_DEBAYER_NEON)
+			BayerColorRows(frame_width, 1, frame_height - 1, source, new_frame, inBGR);
+			BayerFillEdgeRows(frame_width, frame_height, new_frame, 3);
+#else
+			Debayer(frame_width, frame_height, source, new_frame, inBGR);
+#endif
+		}
+		else if (outputFormat == PS3EYECam::EOutputFormat::Gray)
+		{
+			BayerLumaRows(frame_width, 1, frame_height - 1, source, new_frame);
+			BayerFillEdgeRows(frame_width, frame_height, new_frame, 1);
 		}
 
-		// Update tail and available count
-		tail = (tail + 1) % num_frames;
-		available--;
+		// Release the slot back to the producer
+		read_index.store(read + 1, std::memory_order_release);
 	}
 
 	void Debayer(int frame_width, int frame_height, const uint8_t* inBayer, uint8_t* outBuffer, bool inBGR)
@@ -671,16 +1223,17 @@ class FrameQueue
 	}
 
 private:
+	static const int		MAX_EMPTY_SPINS = 64;
+
 	uint32_t				frame_size;
 	uint32_t				num_frames;
 
 	uint8_t*				frame_buffer;
-	uint32_t				head;
-	uint32_t				tail;
-	uint32_t				available;
-
-	std::mutex				mutex;
-	std::condition_variable	empty_condition;
+	std::atomic<uint32_t>	write_index;
+	std::atomic<uint32_t>	read_index;
+	int						conversion_bands;
+	PS3EYECam::ParallelFor	parallel_for;
+	BayerBandWorkers*		band_workers;
 };
 
 // URBDesc
@@ -707,11 +1260,11 @@ class URBDesc
 		close_transfers();
 	}
 
-	bool start_transfers(libusb_device_handle *handle, uint32_t curr_frame_size)
+	bool start_transfers(libusb_device_handle *handle, uint32_t curr_frame_size, int conversion_threads, const PS3EYECam::ParallelFor& parallel_for)
 	{
 		// Initialize the frame queue
         frame_size = curr_frame_size;
-		frame_queue = new FrameQueue(frame_size);
+		frame_queue = new FrameQueue(frame_size, conversion_threads, parallel_for);
 
 		// Initialize the current frame pointer to the start of the buffer; it will be updated as frames are completed and pushed onto the frame queue
 		cur_frame_start = frame_queue->GetFrameBufferStart();
@@ -940,9 +1493,325 @@ static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr)
     }
 }
 
+#ifdef ATT_TESTING
+
+// MODIFIED: fake USB frame source for testing the frame queue without a camera
+// Produces the same bulk transfers as the camera: 2048 byte payloads, each prefixed with a 12 byte UVC header,
+// with the EOF flag set on the last payload of a frame.
+class FakeUSBFrameSource
+{
+public:
+	static const uint32_t UVC_HEADER_SIZE = 12;
+	static const uint32_t PAYLOAD_SIZE = 2048;
+	static const uint32_t PAYLOAD_DATA_SIZE = PAYLOAD_SIZE - UVC_HEADER_SIZE;
+
+	FakeUSBFrameSource(uint32_t frame_size) :
+		frame_size	(frame_size),
+		pts			(0),
+		fid			(0)
+	{
+		const uint32_t num_payloads = (frame_size + PAYLOAD_DATA_SIZE - 1) / PAYLOAD_DATA_SIZE;
+		transfer.resize(frame_size + num_payloads * UVC_HEADER_SIZE);
+	}
+
+	// The first 4 bytes of a frame hold the frame number, every other byte is the low byte of the frame number
+	static uint8_t FramePixel(uint32_t frame_number, uint32_t offset)
+	{
+		return (uint8_t)(offset < 4 ? frame_number >> (offset * 8) : frame_number);
+	}
+	static uint32_t FrameNumber(const uint8_t* frame)
+	{
+		return frame[0] | (frame[1] << 8) | (frame[2] << 16) | ((uint32_t)frame[3] << 24);
+	}
+
+	std::vector<uint8_t>& MakeFrame(uint32_t frame_number)
+	{
+		// a new frame starts when the PTS or FID changes, PTS must never be 0
+		++pts;
+		fid ^= 1;
+
+		uint8_t* data = transfer.data();
+		uint32_t offset = 0;
+		while (offset < frame_size)
+		{
+			const uint32_t len = (std::min)(frame_size - offset, PAYLOAD_DATA_SIZE);
+			const bool is_last = offset + len == frame_size;
+
+			memset(data, 0, UVC_HEADER_SIZE);
+			data[0] = UVC_HEADER_SIZE;
+			data[1] = UVC_STREAM_PTS | fid | (is_last ? UVC_STREAM_EOF : 0);
+			data[2] = (uint8_t)pts;
+			data[3] = (uint8_t)(pts >> 8);
+			data[4] = (uint8_t)(pts >> 16);
+			data[5] = (uint8_t)(pts >> 24);
+			for (uint32_t i = 0; i < len; ++i)
+				data[UVC_HEADER_SIZE + i] = FramePixel(frame_number, offset + i);
+
+			data += UVC_HEADER_SIZE + len;
+			offset += len;
+		}
+		return transfer;
+	}
+
+private:
+	uint32_t				frame_size;
+	uint32_t				pts;
+	uint8_t					fid;
+	std::vector<uint8_t>	transfer;
+};
+
+struct FakeCameraStats
+{
+	uint32_t	frames_received;
+	uint32_t	frames_dropped;
+	uint32_t	frames_torn;
+	uint32_t	frames_out_of_order;
+	double		seconds;
+};
+
+// Feed a frame queue from a producer thread acting as the libusb transfer thread.
+// With fps = 0 the producer runs as fast as it can, otherwise it is paced like the real camera.
+static FakeCameraStats RunFakeCamera(int width, int height, int fps, uint32_t frames_to_receive)
+{
+	const uint32_t frame_size = width * height;
+	FrameQueue queue(frame_size);
+	URBDesc urb;
+	urb.frame_size = frame_size;
+	urb.frame_queue = &queue;
+	urb.cur_frame_start = queue.GetFrameBufferStart();
+
+	std::atomic_bool done(false);
+	std::thread producer([&]() {
+		FakeUSBFrameSource source(frame_size);
+		auto next_frame_time = std::chrono::steady_clock::now();
+		for (uint32_t frame_number = 1; !done; ++frame_number)
+		{
+			std::vector<uint8_t>& transfer = source.MakeFrame(frame_number);
+			if (fps > 0)
+			{
+				next_frame_time += std::chrono::nanoseconds(1000000000 / fps);
+				std::this_thread::sleep_until(next_frame_time);
+			}
+			urb.pkt_scan(transfer.data(), (int)transfer.size());
+		}
+	});
+
+	FakeCameraStats stats = {};
+	std::vector<uint8_t> bayer(frame_size);
+	uint32_t last_frame_number = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (; stats.frames_received < frames_to_receive; ++stats.frames_received)
+	{
+		queue.Dequeue(bayer.data(), width, height, PS3EYECam::EOutputFormat::Bayer);
+
+		const uint32_t frame_number = FakeUSBFrameSource::FrameNumber(bayer.data());
+		for (uint32_t i = 4; i < frame_size; ++i)
+		{
+			if (bayer[i] != FakeUSBFrameSource::FramePixel(frame_number, i))
+			{
+				++stats.frames_torn;
+				break;
+			}
+		}
+		if (frame_number <= last_frame_number)
+			++stats.frames_out_of_order;
+		else
+			stats.frames_dropped += frame_number - last_frame_number - 1;
+		last_frame_number = frame_number;
+	}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	done = true;
+	producer.join();
+	urb.frame_queue = NULL; // not owned by urb
+	return stats;
+}
+
+TEST_CASE("FrameQueue stress")
+{
+	// unpaced producer, overwrites the newest frame whenever the consumer falls behind
+	const FakeCameraStats stats = RunFakeCamera(320, 240, 0, 2000);
+	CHECK(stats.frames_received == 2000);
+	CHECK(stats.frames_torn == 0);
+	CHECK(stats.frames_out_of_order == 0);
+}
+
+TEST_CASE("FrameQueue benchmark")
+{
+	struct Mode { int width, height, fps; };
+	const Mode modes[] = { { 320, 240, 187 }, { 640, 480, 75 } };
+	for (const Mode& mode : modes)
+	{
+		const FakeCameraStats stats = RunFakeCamera(mode.width, mode.height, mode.fps, mode.fps);
+		CHECK(stats.frames_torn == 0);
+		CHECK(stats.frames_out_of_order == 0);
+		DOCTEST_MESSAGE(mode.width, "x", mode.height, "@", mode.fps, ": ", stats.frames_received, " frames in ", stats.seconds,
+						" s, dropped ", stats.frames_dropped);
+	}
+}
+// MODIFIED
+
+// MODIFIED: Bayer conversion tests
+static std::vector<uint8_t> RandomBayerFrame(int width, int height, uint32_t seed)
+{
+	std::vector<uint8_t> bayer(width * height);
+	for (uint8_t& pixel : bayer)
+	{
+		seed = seed * 1664525 + 1013904223;
+		pixel = (uint8_t)(seed >> 24);
+	}
+	return bayer;
+}
+
+static void BayerLumaReference(int width, int height, const uint8_t* bayer, uint8_t* gray)
+{
+	for (int y = 1; y < height - 1; ++y)
+	{
+		const uint8_t* mid = bayer + y * width;
+		for (int x = 1; x < width - 1; ++x)
+			gray[y * width + x] = BayerLumaPixel(mid - width, mid, mid + width, x, (y & 1) == 0);
+		gray[y * width] = gray[y * width + 1];
+		gray[y * width + width - 1] = gray[y * width + width - 2];
+	}
+	BayerFillEdgeRows(width, height, gray, 1);
+}
+
+TEST_CASE("Bayer conversion matches scalar debayer")
+{
+	struct Size { int width, height; };
+	const Size sizes[] = { { 320, 240 }, { 640, 480 }, { 36, 6 } };
+	for (const Size& size : sizes)
+	{
+		const uint32_t frame_size = size.width * size.height;
+		const std::vector<uint8_t> bayer = RandomBayerFrame(size.width, size.height, frame_size);
+		FrameQueue queue(frame_size);
+
+		for (const bool inBGR : { true, false })
+		{
+			std::vector<uint8_t> expected(frame_size * 3), actual(frame_size * 3);
+			queue.Debayer(size.width, size.height, bayer.data(), expected.data(), inBGR);
+			BayerColorRows(size.width, 1, size.height - 1, bayer.data(), actual.data(), inBGR);
+			BayerFillEdgeRows(size.width, size.height, actual.data(), 3);
+			CHECK(expected == actual);
+		}
+
+		std::vector<uint8_t> expected(frame_size), actual(frame_size);
+		BayerLumaReference(size.width, size.height, bayer.data(), expected.data());
+		BayerLumaRows(size.width, 1, size.height - 1, bayer.data(), actual.data());
+		BayerFillEdgeRows(size.width, size.height, actual.data(), 1);
+		CHECK(expected == actual);
+	}
+}
+
+TEST_CASE("Band parallel Bayer conversion matches single thread")
+{
+	struct Size { int width, height; };
+	// includes frames with fewer interior rows than bands
+	const Size sizes[] = { { 640, 480 }, { 320, 241 }, { 36, 4 } };
+	const PS3EYECam::EOutputFormat formats[] = { PS3EYECam::EOutputFormat::BGR, PS3EYECam::EOutputFormat::RGB, PS3EYECam::EOutputFormat::Gray };
+	for (const Size& size : sizes)
+	{
+		const uint32_t frame_size = size.width * size.height;
+		const std::vector<uint8_t> bayer = RandomBayerFrame(size.width, size.height, frame_size);
+		for (const PS3EYECam::EOutputFormat format : formats)
+		{
+			const int channels = format == PS3EYECam::EOutputFormat::Gray ? 1 : 3;
+			std::vector<uint8_t> expected(frame_size * channels);
+			if (channels == 1)
+				BayerLumaRows(size.width, 1, size.height - 1, bayer.data(), expected.data());
+			else
+				BayerColorRows(size.width, 1, size.height - 1, bayer.data(), expected.data(), format == PS3EYECam::EOutputFormat::BGR);
+			BayerFillEdgeRows(size.width, size.height, expected.data(), channels);
+
+			for (const int num_threads : { 2, 3, 4 })
+			{
+				BayerBandWorkers workers(num_threads);
+				// run several frames to catch stale rows from a previous conversion
+				for (int frame = 0; frame < 3; ++frame)
+				{
+					std::vector<uint8_t> actual(frame_size * channels, 0);
+					workers.Convert(size.width, size.height, bayer.data(), actual.data(), format);
+					CHECK(expected == actual);
+				}
+
+				// an external parallel for may run the bands in any order
+				std::vector<uint8_t> actual(frame_size * channels, 0);
+				for (int band = num_threads - 1; band >= 0; --band)
+					BayerConvertBand(band, num_threads, size.width, size.height, bayer.data(), actual.data(), format);
+				BayerFillEdgeRows(size.width, size.height, actual.data(), channels);
+				CHECK(expected == actual);
+			}
+		}
+	}
+}
+
+TEST_CASE("Bayer to gray keeps uniform brightness")
+{
+	const int width = 64, height = 8;
+	for (const uint8_t value : { 0, 100, 255 })
+	{
+		const std::vector<uint8_t> bayer(width * height, value);
+		std::vector<uint8_t> gray(width * height);
+		BayerLumaRows(width, 1, height - 1, bayer.data(), gray.data());
+		BayerFillEdgeRows(width, height, gray.data(), 1);
+		CHECK(gray == std::vector<uint8_t>(width * height, value));
+	}
+}
+
+TEST_CASE("Bayer conversion benchmark")
+{
+	struct Mode { int width, height, fps; };
+	const Mode modes[] = { { 320, 240, 187 }, { 640, 480, 75 } };
+	for (const Mode& mode : modes)
+	{
+		const uint32_t frame_size = mode.width * mode.height;
+		const std::vector<uint8_t> bayer = RandomBayerFrame(mode.width, mode.height, 1);
+		std::vector<uint8_t> output(frame_size * 3);
+		FrameQueue queue(frame_size);
+
+		// one second worth of frames per output path
+		const auto time_per_frame = [&](auto&& convert) {
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < mode.fps; ++i)
+				convert();
+			return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / mode.fps;
+		};
+		const double scalar_us = time_per_frame([&]() {
+			queue.Debayer(mode.width, mode.height, bayer.data(), output.data(), true);
+		});
+		const double bgr_us = time_per_frame([&]() {
+			BayerColorRows(mode.width, 1, mode.height - 1, bayer.data(), output.data(), true);
+			BayerFillEdgeRows(mode.width, mode.height, output.data(), 3);
+		});
+		const double gray_us = time_per_frame([&]() {
+			BayerLumaRows(mode.width, 1, mode.height - 1, bayer.data(), output.data());
+			BayerFillEdgeRows(mode.width, mode.height, output.data(), 1);
+		});
+		DOCTEST_MESSAGE(mode.width, "x", mode.height, "@", mode.fps, ": scalar BGR ", scalar_us, " us, BGR ", bgr_us,
+						" us, gray ", gray_us, " us per frame");
+
+		for (const int num_threads : { 2, 4 })
+		{
+			BayerBandWorkers workers(num_threads);
+			const double banded_bgr_us = time_per_frame([&]() {
+				workers.Convert(mode.width, mode.height, bayer.data(), output.data(), PS3EYECam::EOutputFormat::BGR);
+			});
+			const double banded_gray_us = time_per_frame([&]() {
+				workers.Convert(mode.width, mode.height, bayer.data(), output.data(), PS3EYECam::EOutputFormat::Gray);
+			});
+			DOCTEST_MESSAGE(mode.width, "x", mode.height, " with ", num_threads, " threads: BGR ", banded_bgr_us,
+							" us, gray ", banded_gray_us, " us per frame");
+		}
+	}
+}
+// MODIFIED
+
+#endif
+
 // PS3EYECam
 
 bool PS3EYECam::devicesEnumerated = false;
+PS3EYECam::ParallelFor PS3EYECam::conversion_parallel_for;
 std::vector<PS3EYECam::PS3EYERef> PS3EYECam::devices;
 
 const std::vector<PS3EYECam::PS3EYERef>& PS3EYECam::getDevices( bool forceRefresh )
@@ -979,6 +1848,7 @@ PS3EYECam::PS3EYECam(libusb_device *device)
 	handle_ = NULL;
 
 	is_streaming = false;
+	conversion_threads = 1;
 
 	device_ = device;
 	mgrPtr = USBMgr::instance();
@@ -1097,7 +1967,7 @@ void PS3EYECam::start()
 	ov534_reg_write(0xe0, 0x00); // start stream
 
 	// init and start urb
-	urb->start_transfers(handle_, frame_width*frame_height);
+	urb->start_transfers(handle_, frame_width*frame_height, conversion_threads, conversion_parallel_for);
     is_streaming = true;
 }
 
@@ -1168,6 +2038,8 @@ uint32_t PS3EYECam::getOutputBytesPerPixel() const
 		return 3;
 	else if (frame_output_format == EOutputFormat::RGB)
 		return 3;
+	else if (frame_output_format == EOutputFormat::Gray)
+		return 1;
 
 	return 0;
 }
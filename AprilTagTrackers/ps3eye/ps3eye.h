@@ -52,6 +52,7 @@ The code is based on the Linux driver for the PSEye, which can be found here:
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <vector>
 
 #include <memory>
@@ -91,10 +92,15 @@ class PS3EYECam
 	{
 		Bayer,					// Output in Bayer. Destination buffer must be width * height bytes
 		BGR,					// Output in BGR. Destination buffer must be width * height * 3 bytes
-		RGB						// Output in RGB. Destination buffer must be width * height * 3 bytes
+		RGB,					// Output in RGB. Destination buffer must be width * height * 3 bytes
+		Gray					// Output luma interpolated directly from Bayer. Destination buffer must be width * height bytes
 	};
 
 	typedef std::shared_ptr<PS3EYECam> PS3EYERef;
+	// MODIFIED: Bayer conversion bands can run on the application's thread pool
+	// Runs task(index) for every index in [0, count), returning once all have finished
+	typedef std::function<void(int count, const std::function<void(int index)>& task)> ParallelFor;
+	// MODIFIED
 
 	static const uint16_t VENDOR_ID;
 	static const uint16_t PRODUCT_ID;
@@ -252,6 +258,15 @@ class PS3EYECam
 		frame_rate = ov534_set_frame_rate(val, true);
 		return true;
 	}
+	// Threads converting from Bayer in getFrame, including the calling thread, or bands when a conversion ParallelFor is set. Takes effect on the next start()
+	int getConversionThreadCount() const { return conversion_threads; }
+	void setConversionThreadCount(int count) { conversion_threads = count < 1 ? 1 : count; }
+	// Used by every camera to run its conversion bands, instead of starting conversion threads of its own.
+	// Set before any camera is started, takes effect on the next start()
+	static void setConversionParallelFor(ParallelFor parallelFor) { conversion_parallel_for = std::move(parallelFor); }
+	EOutputFormat getOutputFormat() const { return frame_output_format; }
+	// Only affects how getFrame converts the raw Bayer data, so can be changed while streaming
+	void setOutputFormat(EOutputFormat outputFormat) { frame_output_format = outputFormat; }
 	uint32_t getRowBytes() const { return frame_width * getOutputBytesPerPixel(); }
 	uint32_t getOutputBytesPerPixel() const;
 
@@ -295,12 +310,14 @@ class PS3EYECam
 	std::shared_ptr<class USBMgr> mgrPtr;
 
 	static bool devicesEnumerated;
+	static ParallelFor conversion_parallel_for;
     static std::vector<PS3EYERef> devices;
 
 	uint32_t frame_width;
 	uint32_t frame_height;
 	uint16_t frame_rate;
 	EOutputFormat frame_output_format;
+	int conversion_threads;
 
 	//usb stuff
 	libusb_device *device_;
@@ -0,0 +1,118 @@
+#include "Config.hpp"
+#include "GUI.hpp"
+#include "Localization.hpp"
+#include "Tracker.hpp"
+#include "tracker/SessionReplay.hpp"
+#include "utils/Env.hpp"
+#include "utils/Log.hpp"
+
+#include <opencv2/core/utils/logger.hpp>
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replays a session recorded with recordSession through the main loop, with the driver replaced by the recording,
+// and reports how far the poses drifted from the recorded ones, how long the frames took,
+// and how much the one euro filter would lag and jitter on them at settings around its defaults.
+// Usage: replay <session.attrec> [--out frames.csv] [--max-position-error mm] [--max-frame-time ms]
+// Exits with 1 if the session could not be replayed, and with 2 if the 95th percentile exceeds a given maximum,
+// so a change to detection or estimation can be checked against recordings before it is merged.
+
+namespace
+{
+
+constexpr int EXIT_REPLAY_FAILED = 1;
+constexpr int EXIT_GATE_FAILED = 2;
+/// percentile of the position errors and frame times the maximums are checked against
+constexpr double GATE_PERCENTILE = 0.95;
+
+struct Options
+{
+    std::string sessionPath;
+    std::string framesCsvPath;
+    /// millimeters and milliseconds, not checked if negative
+    double maxPositionError = -1;
+    double maxFrameTime = -1;
+};
+
+bool ParseDouble(std::string_view text, double& out)
+{
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return !text.empty() && ec == std::errc() && end == text.data() + text.size();
+}
+
+bool ParseOptions(int argc, char** argv, Options& out)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue)
+        {
+            out.framesCsvPath = argv[++i];
+        }
+        else if (arg == "--max-position-error" && hasValue)
+        {
+            if (!ParseDouble(argv[++i], out.maxPositionError)) return false;
+        }
+        else if (arg == "--max-frame-time" && hasValue)
+        {
+            if (!ParseDouble(argv[++i], out.maxFrameTime)) return false;
+        }
+        else if (out.sessionPath.empty() && !arg.starts_with("--"))
+        {
+            out.sessionPath = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !out.sessionPath.empty();
+}
+
+/// @return false if the percentile of values exceeds max
+bool CheckGate(std::string_view name, const std::vector<double>& values, double max)
+{
+    if (max < 0) return true;
+    const double value = tracker::ReplayMetrics::Percentile(values, GATE_PERCENTILE);
+    if (value <= max) return true;
+    ATT_LOG_ERROR(name, " p95 ", value, " exceeds ", max);
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    utils::RegisterThisThreadName("Main");
+    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_WARNING);
+
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        ATT_LOG_ERROR("usage: replay <session.attrec> [--out frames.csv] [--max-position-error mm] [--max-frame-time ms]");
+        return EXIT_REPLAY_FAILED;
+    }
+
+    // settings from the usual config files, the camera, tracker and playspace calibration come from the recording
+    UserConfig userConfig;
+    ArucoConfig arucoConfig;
+    Localization lc;
+    userConfig.Load();
+    arucoConfig.Load();
+    lc.LoadLang(userConfig.langCode);
+
+    Tracker tracker(userConfig, userConfig.calib, arucoConfig, lc);
+    GUI gui(&tracker, lc, userConfig);
+
+    tracker::ReplayMetrics metrics;
+    if (!tracker.ReplaySession(options.sessionPath, options.framesCsvPath, metrics)) return EXIT_REPLAY_FAILED;
+
+    // both are checked, so every failed gate is logged
+    const bool positionPassed = CheckGate("position error mm", metrics.GetPositionErrors(), options.maxPositionError);
+    const bool frameTimePassed = CheckGate("frame time ms", metrics.GetFrameTimes(), options.maxFrameTime);
+    return positionPassed && frameTimePassed ? 0 : EXIT_GATE_FAILED;
+}
@@ -0,0 +1,492 @@
+#include "CharucoCalibrator.hpp"
+
+#include "math/CVHelpers.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Log.hpp"
+#include "utils/TaskScheduler.hpp"
+#include "utils/Test.hpp"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace tracker
+{
+
+namespace
+{
+
+std::vector<cv::Point3f> GetObjectPoints(const cv::aruco::CharucoBoard& board, const std::vector<int>& ids)
+{
+    std::vector<cv::Point3f> objectPoints;
+    objectPoints.reserve(ids.size());
+    for (const int id : ids)
+    {
+        objectPoints.push_back(board.chessboardCorners[id]);
+    }
+    return objectPoints;
+}
+
+} // namespace
+
+CharucoCalibrator::CharucoCalibrator()
+    : mDictionary(cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50)),
+      mParams(cv::aruco::DetectorParameters::create()),
+      mBoard(cv::aruco::CharucoBoard::create(8, 7, 0.04F, 0.02F, mDictionary))
+{
+    // set our detectors marker border bits to 1 since thats what charuco uses
+    mParams->markerBorderBits = 1;
+}
+
+CharucoCalibrator::~CharucoCalibrator()
+{
+    if (mSolveDone.valid()) mSolveDone.wait();
+}
+
+void CharucoCalibrator::DetectMarkers(const cv::Mat& gray, CharucoMarkers& outMarkers) const
+{
+    cv::Mat small;
+    const double scale = math::DownscaleForDetection(gray, small, DETECT_MAX_WIDTH);
+    cv::aruco::detectMarkers(small, mDictionary, outMarkers.corners, outMarkers.ids, mParams, outMarkers.rejected);
+    if (scale == 1) return;
+    // pixel centers line up, not pixel corners
+    const auto toFull = [&](cv::Point2f& point) {
+        point = (point + cv::Point2f(0.5F, 0.5F)) * static_cast<float>(scale) - cv::Point2f(0.5F, 0.5F);
+    };
+    for (auto& corners : outMarkers.corners)
+    {
+        std::for_each(corners.begin(), corners.end(), toFull);
+    }
+    for (auto& corners : outMarkers.rejected)
+    {
+        std::for_each(corners.begin(), corners.end(), toFull);
+    }
+}
+
+bool CharucoCalibrator::FindView(const cv::Mat& gray, CharucoMarkers& markers, CharucoView& outView) const
+{
+    // refining needs the board pose from markers already found, now that every frame is tried skip the empty ones
+    if (markers.ids.empty()) return false;
+
+    std::vector<cv::Point2f> markerCorners;
+    double markerSize = 0;
+    for (const auto& corners : markers.corners)
+    {
+        markerCorners.insert(markerCorners.end(), corners.begin(), corners.end());
+        markerSize = std::max(markerSize, cv::norm(corners[2] - corners[0]));
+    }
+    const cv::Rect roi = math::PaddedBoundingRect(markerCorners, static_cast<int>(markerSize * VIEW_ROI_MARGIN), math::GetMatSize(gray));
+    const cv::Point2f offset(static_cast<float>(roi.x), static_cast<float>(roi.y));
+    const auto shift = [](std::vector<std::vector<cv::Point2f>>& allCorners, cv::Point2f by) {
+        for (auto& corners : allCorners)
+        {
+            for (cv::Point2f& corner : corners)
+            {
+                corner += by;
+            }
+        }
+    };
+    // rejected candidates cut off by the region can not be read
+    const cv::Rect2f roiBounds(cv::Point2f(0, 0), cv::Size2f(roi.size()));
+    std::erase_if(markers.rejected, [&](const std::vector<cv::Point2f>& corners) {
+        return std::any_of(corners.begin(), corners.end(), [&](const cv::Point2f& corner) { return !roiBounds.contains(corner - offset); });
+    });
+
+    const cv::Mat grayRoi = gray(roi);
+    shift(markers.corners, -offset);
+    shift(markers.rejected, -offset);
+    cv::aruco::refineDetectedMarkers(grayRoi, mBoard, markers.corners, markers.ids, markers.rejected);
+    // using data from aruco detection we refine the search of chessboard corners for higher accuracy
+    if (!markers.ids.empty())
+    {
+        cv::aruco::interpolateCornersCharuco(markers.corners, markers.ids, grayRoi, mBoard, outView.corners, outView.ids);
+    }
+    else
+    {
+        outView.corners.clear();
+        outView.ids.clear();
+    }
+    shift(markers.corners, offset);
+    shift(markers.rejected, offset);
+    for (cv::Point2f& corner : outView.corners)
+    {
+        corner += offset;
+    }
+    return static_cast<int>(outView.ids.size()) >= MIN_VIEW_CORNERS;
+}
+
+math::ViewScore CharucoCalibrator::ScoreView(const CharucoView& view, cv::Size imageSize)
+{
+    if (imageSize != mScorer.GetImageSize()) mScorer.SetCamera(imageSize, mCalib.cameraMatrix, mCalib.distortionCoeffs);
+    return mScorer.Score(GetObjectPoints(*mBoard, view.ids), view.corners);
+}
+
+void CharucoCalibrator::AddView(CharucoView view, const math::ViewScore& score)
+{
+    mViews.push_back(KeptView{std::move(view), score, -1, mNextSerial++});
+    if (GetViewCount() > MAX_VIEWS)
+    {
+        DropLeastCoverage();
+        RebuildScorer();
+    }
+    else
+    {
+        mScorer.Add(score);
+    }
+    mViewsChanged = true;
+    PublishViews();
+}
+
+bool CharucoCalibrator::RemoveWorstView()
+{
+    // only views with an error are compared, they come first
+    const auto solvedEnd = std::find_if(mViews.begin(), mViews.end(), [](const KeptView& kept) { return kept.error < 0; });
+    if (solvedEnd - mViews.begin() <= MIN_KEPT_VIEWS) return false;
+    const auto worst = std::max_element(mViews.begin(), solvedEnd,
+                                        [](const KeptView& lhs, const KeptView& rhs) { return lhs.error < rhs.error; });
+    if (worst->error <= MAX_VIEW_ERROR) return false;
+
+    mViews.erase(worst);
+    RebuildScorer();
+    mViewsChanged = true;
+    PublishViews();
+    return true;
+}
+
+bool CharucoCalibrator::Update(cv::Size imageSize)
+{
+    bool updated = false;
+    if (mSolveDone.valid())
+    {
+        if (mSolveDone.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+        updated = FinishSolve();
+    }
+    if (mViewsChanged) StartSolve(imageSize);
+    return updated;
+}
+
+bool CharucoCalibrator::Calibrate(cv::Size imageSize)
+{
+    bool updated = false;
+    if (mSolveDone.valid()) updated = FinishSolve();
+    if (!mViewsChanged || !StartSolve(imageSize)) return updated;
+    return FinishSolve();
+}
+
+bool CharucoCalibrator::StartSolve(cv::Size imageSize)
+{
+    ATT_ASSERT(!mSolveDone.valid());
+    if (GetViewCount() < MIN_CALIB_VIEWS) return false;
+    mViewsChanged = false;
+
+    mSolve.corners.clear();
+    mSolve.ids.clear();
+    mSolve.serials.clear();
+    for (const KeptView& kept : mViews)
+    {
+        mSolve.corners.push_back(kept.view.corners);
+        mSolve.ids.push_back(kept.view.ids);
+        mSolve.serials.push_back(kept.serial);
+    }
+    mSolve.imageSize = imageSize;
+    mSolve.flags = cv::CALIB_USE_LU;
+    if (IsCalibrated())
+    {
+        // one view more or less barely moves the intrinsics, so the solver starts next to the result
+        mSolve.cameraMatrix = mCalib.cameraMatrix.clone();
+        mSolve.distortionCoeffs = mCalib.distortionCoeffs.clone();
+        mSolve.flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+    }
+    else
+    {
+        mSolve.cameraMatrix.release();
+        mSolve.distortionCoeffs.release();
+    }
+    // published with the result, so the solver writes a new one
+    mSolve.stdDeviationsIntrinsics.release();
+    mSolve.solved = false;
+
+    mSolveDone = utils::TaskScheduler::Get().Async([this] { RunSolve(); });
+    return true;
+}
+
+void CharucoCalibrator::RunSolve()
+{
+    cv::Mat rvecs, tvecs, stdDeviationsExtrinsics;
+    try
+    {
+        mSolve.error = cv::aruco::calibrateCameraCharuco(mSolve.corners, mSolve.ids, mBoard, mSolve.imageSize,
+                                                         mSolve.cameraMatrix, mSolve.distortionCoeffs, rvecs, tvecs,
+                                                         mSolve.stdDeviationsIntrinsics, stdDeviationsExtrinsics, mSolve.perViewErrors,
+                                                         mSolve.flags);
+        mSolve.solved = true;
+    }
+    catch (const cv::Exception& e)
+    {
+        ATT_LOG_ERROR(e.what());
+        return;
+    }
+
+    // the poses behind the scores were estimated with the previous intrinsics, the new ones tell the tilts better
+    math::ViewScorer scorer;
+    scorer.SetCamera(mSolve.imageSize, mSolve.cameraMatrix, mSolve.distortionCoeffs);
+    mSolve.scores.clear();
+    for (std::size_t index = 0; index < mSolve.corners.size(); ++index)
+    {
+        mSolve.scores.push_back(scorer.Score(GetObjectPoints(*mBoard, mSolve.ids[index]), mSolve.corners[index]));
+    }
+}
+
+bool CharucoCalibrator::FinishSolve()
+{
+    mSolveDone.get();
+    if (!mSolve.solved) return false;
+
+    mCalib.cameraMatrix = mSolve.cameraMatrix;
+    mCalib.distortionCoeffs = mSolve.distortionCoeffs;
+    mCalib.stdDeviationsIntrinsics = mSolve.stdDeviationsIntrinsics;
+    mReprojectionError = mSolve.error;
+    mScorer.SetCamera(mSolve.imageSize, mCalib.cameraMatrix, mCalib.distortionCoeffs);
+    // views removed while solving are gone, views added while solving keep waiting for the next solve
+    for (std::size_t index = 0; index < mSolve.serials.size(); ++index)
+    {
+        const auto kept = std::find_if(mViews.begin(), mViews.end(),
+                                       [&](const KeptView& view) { return view.serial == mSolve.serials[index]; });
+        if (kept == mViews.end()) continue;
+        if (index < mSolve.perViewErrors.size()) kept->error = mSolve.perViewErrors[index];
+        if (index < mSolve.scores.size()) kept->score = mSolve.scores[index];
+    }
+    RebuildScorer();
+    PublishViews();
+    return true;
+}
+
+void CharucoCalibrator::DropLeastCoverage()
+{
+    std::array<int, math::VIEW_GRID_CELLS> viewsInCell{};
+    for (const KeptView& kept : mViews)
+    {
+        for (std::size_t cell = 0; cell < viewsInCell.size(); ++cell)
+        {
+            if (kept.score.cells.test(cell)) ++viewsInCell[cell];
+        }
+    }
+    // a cell is worth less the more views cover it, a view is worth the sum of its cells
+    const auto coverage = [&](const KeptView& kept) {
+        double sum = 0;
+        for (std::size_t cell = 0; cell < viewsInCell.size(); ++cell)
+        {
+            if (kept.score.cells.test(cell)) sum += 1.0 / viewsInCell[cell];
+        }
+        return sum;
+    };
+    const auto least = std::min_element(mViews.begin(), mViews.end(),
+                                        [&](const KeptView& lhs, const KeptView& rhs) { return coverage(lhs) < coverage(rhs); });
+    mViews.erase(least);
+}
+
+void CharucoCalibrator::RebuildScorer()
+{
+    mScorer.Clear();
+    for (const KeptView& kept : mViews)
+    {
+        mScorer.Add(kept.score);
+    }
+}
+
+void CharucoCalibrator::PublishViews()
+{
+    mCalib.allCharucoCorners.clear();
+    mCalib.allCharucoIds.clear();
+    mCalib.perViewErrors.clear();
+    for (const KeptView& kept : mViews)
+    {
+        mCalib.allCharucoCorners.push_back(kept.view.corners);
+        mCalib.allCharucoIds.push_back(kept.view.ids);
+    }
+    for (const KeptView& kept : mViews)
+    {
+        if (kept.error < 0) break;
+        mCalib.perViewErrors.push_back(kept.error);
+    }
+}
+
+namespace
+{
+
+/// the board CharucoCalibrator detects
+cv::Ptr<cv::aruco::CharucoBoard> CreateTestBoard()
+{
+    return cv::aruco::CharucoBoard::create(8, 7, 0.04F, 0.02F, cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50));
+}
+
+/// chessboard corners of the board seen by an ideal 640x480 camera with a focal length of 600 px, tilted by rotation
+CharucoView ProjectView(const cv::Ptr<cv::aruco::CharucoBoard>& board, cv::Vec3d rotation, double distance)
+{
+    const cv::Matx33d cameraMatrix{600, 0, 320, 0, 600, 240, 0, 0, 1};
+    // the board center in front of the camera
+    const cv::Vec3d position{-0.16, -0.14, distance};
+    CharucoView view;
+    cv::projectPoints(board->chessboardCorners, rotation, position, cameraMatrix, cv::noArray(), view.corners);
+    for (int id = 0; id < static_cast<int>(view.corners.size()); ++id)
+    {
+        view.ids.push_back(id);
+    }
+    return view;
+}
+
+} // namespace
+
+TEST_CASE("CharucoCalibrator finds the views of a drawn board")
+{
+    const CharucoCalibrator calibrator;
+    const auto board = CreateTestBoard();
+    cv::Mat boardImage;
+    board->draw(cv::Size(640, 560), boardImage, 40, 1);
+
+    // seen from an angle, like the camera would
+    const std::array<cv::Point2f, 4> source{cv::Point2f(0, 0), cv::Point2f(640, 0), cv::Point2f(640, 560), cv::Point2f(0, 560)};
+    const std::array<cv::Point2f, 4> target{cv::Point2f(110, 60), cv::Point2f(700, 120), cv::Point2f(660, 650), cv::Point2f(140, 580)};
+    cv::Mat gray;
+    cv::warpPerspective(boardImage, gray, cv::getPerspectiveTransform(source.data(), target.data()), cv::Size(800, 720),
+                        cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(255));
+
+    CharucoMarkers markers;
+    CharucoView view;
+    calibrator.DetectMarkers(gray, markers);
+    CHECK(markers.ids.size() == 28);
+    REQUIRE(calibrator.FindView(gray, markers, view));
+    // every inner corner of the 8x7 board
+    CHECK(view.ids.size() == 42);
+
+    // a 1080p camera, detected downscaled then refined at full resolution, finds the same corners
+    cv::Mat large;
+    cv::resize(gray, large, cv::Size(), 2.4, 2.4, cv::INTER_LINEAR);
+    CharucoView largeView;
+    calibrator.DetectMarkers(large, markers);
+    CHECK(markers.ids.size() == 28);
+    REQUIRE(calibrator.FindView(large, markers, largeView));
+    REQUIRE(largeView.ids == view.ids);
+    double maxOffset = 0;
+    double meanOffset = 0;
+    for (std::size_t corner = 0; corner < view.corners.size(); ++corner)
+    {
+        const cv::Point2f scaled = (view.corners[corner] + cv::Point2f(0.5F, 0.5F)) * 2.4F - cv::Point2f(0.5F, 0.5F);
+        const double offset = cv::norm(largeView.corners[corner] - scaled);
+        maxOffset = std::max(maxOffset, offset);
+        meanOffset += offset / static_cast<double>(view.corners.size());
+    }
+    CAPTURE(maxOffset);
+    CAPTURE(meanOffset);
+    // mapping the downscaled corners with the wrong pixel center alone would shift every corner by 0.7 px
+    CHECK(maxOffset < 0.5);
+    CHECK(meanOffset < 0.25);
+
+    // a blank image has no board to add
+    const cv::Mat blank(720, 800, CV_8UC1, cv::Scalar(255));
+    calibrator.DetectMarkers(blank, markers);
+    CHECK_NOT(calibrator.FindView(blank, markers, view));
+}
+
+TEST_CASE("CharucoCalibrator solves on a worker")
+{
+    CharucoCalibrator calibrator;
+    const auto board = CreateTestBoard();
+    const cv::Size imageSize{640, 480};
+    const std::array<cv::Vec3d, 6> rotations{
+        cv::Vec3d(0.4, 0, 0), cv::Vec3d(-0.4, 0, 0), cv::Vec3d(0, 0.4, 0),
+        cv::Vec3d(0, -0.4, 0), cv::Vec3d(0.3, 0.3, 0.2), cv::Vec3d(-0.3, 0.3, -0.2)};
+    const auto addView = [&](CharucoView view) {
+        const math::ViewScore score = calibrator.ScoreView(view, imageSize);
+        calibrator.AddView(std::move(view), score);
+    };
+    for (int i = 0; i < 3; ++i)
+    {
+        addView(ProjectView(board, rotations[i], 0.8));
+    }
+
+    // starts the solve, then picks it up once finished
+    CHECK_NOT(calibrator.Update(imageSize));
+    bool updated = false;
+    for (int wait = 0; wait < 1000 && !updated; ++wait)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        updated = calibrator.Update(imageSize);
+    }
+    REQUIRE(updated);
+    REQUIRE(calibrator.IsCalibrated());
+    CHECK(calibrator.GetCalib().perViewErrors.size() == 3);
+
+    // warm started from the first result, views added in the meantime have no error yet
+    for (int i = 3; i < static_cast<int>(rotations.size()); ++i)
+    {
+        addView(ProjectView(board, rotations[i], 0.7));
+    }
+    CHECK(calibrator.GetCalib().perViewErrors.size() == 3);
+    REQUIRE(calibrator.Calibrate(imageSize));
+    CHECK(calibrator.GetCalib().perViewErrors.size() == rotations.size());
+    const cv::Mat& cameraMatrix = calibrator.GetCalib().cameraMatrix;
+    const double focalX = cameraMatrix.at<double>(0, 0);
+    const double focalY = cameraMatrix.at<double>(1, 1);
+    CAPTURE(focalX);
+    CAPTURE(focalY);
+    CHECK(std::abs(focalX - 600) < 1);
+    CHECK(std::abs(focalY - 600) < 1);
+    CHECK(calibrator.GetReprojectionError() < 0.01);
+}
+
+TEST_CASE("CharucoCalibrator keeps the views that cover the image")
+{
+    CharucoCalibrator calibrator;
+    const cv::Size imageSize{800, 600};
+    // a view in each block of 2x2 cells covers the whole image between them,
+    // the first chessboard square of the board, corners 0 and 1 on the first row, 7 and 8 on the second
+    constexpr std::array<int, 4> squareIds{0, 1, 7, 8};
+    const auto blockView = [&](int blockCol, int blockRow) {
+        CharucoView view;
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            const float x = (static_cast<float>(blockCol * 2 + corner % 2) + 0.5F) * 100;
+            const float y = (static_cast<float>(blockRow * 2 + corner / 2) + 0.5F) * 100;
+            view.corners.emplace_back(x, y);
+            view.ids.push_back(squareIds[corner]);
+        }
+        return view;
+    };
+    const auto addView = [&](CharucoView view) {
+        const math::ViewScore score = calibrator.ScoreView(view, imageSize);
+        calibrator.AddView(std::move(view), score);
+    };
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 4; ++col)
+        {
+            addView(blockView(col, row));
+        }
+    }
+    // every cell is covered, but the board was only seen facing the camera
+    CHECK_NOT(calibrator.IsCoverageComplete());
+    // the same corner of the image again covers nothing new
+    CHECK_NOT(calibrator.IsUseful(calibrator.ScoreView(blockView(0, 0), imageSize)));
+    // many more views of it, added anyway
+    for (int i = 0; i < CharucoCalibrator::MAX_VIEWS; ++i)
+    {
+        addView(blockView(0, 0));
+    }
+    CHECK(calibrator.GetViewCount() == CharucoCalibrator::MAX_VIEWS);
+
+    // every block is still covered
+    std::array<bool, 12> covered{};
+    for (const auto& corners : calibrator.GetCalib().allCharucoCorners)
+    {
+        covered[static_cast<int>(corners[0].y / 200) * 4 + static_cast<int>(corners[0].x / 200)] = true;
+    }
+    CHECK(std::all_of(covered.begin(), covered.end(), [](bool cell) { return cell; }));
+}
+
+} // namespace tracker
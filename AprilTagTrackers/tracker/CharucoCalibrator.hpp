@@ -0,0 +1,157 @@
+#pragma once
+
+#include "config/VideoStream.hpp"
+#include "math/ViewScorer.hpp"
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+
+#include <future>
+#include <vector>
+
+namespace tracker
+{
+
+/// aruco markers of the charuco board found in an image
+struct CharucoMarkers
+{
+    std::vector<int> ids;
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<std::vector<cv::Point2f>> rejected;
+};
+
+/// chessboard corners of the charuco board found in an image, one calibration view
+struct CharucoView
+{
+    std::vector<cv::Point2f> corners;
+    std::vector<int> ids;
+};
+
+/// Camera intrinsics from views of the charuco board, the same steps for a live camera and for recorded frames.
+/// Detection is const and may run on many images at once, adding views and calibrating may not.
+/// Views are added when they cover a part of the image or a tilt of the board not seen yet, only the views that
+/// cover the image best are kept, and the camera is solved on a worker, warm started from the previous intrinsics,
+/// so capture continues while it solves.
+class CharucoCalibrator
+{
+public:
+    /// views with fewer chessboard corners found are not added
+    static constexpr int MIN_VIEW_CORNERS = 16;
+    /// views needed before the first calibration
+    static constexpr int MIN_CALIB_VIEWS = 3;
+    /// views kept regardless of their error, so a poor start is not thrown away entirely
+    static constexpr int MIN_KEPT_VIEWS = 10;
+    /// reprojection error of a view, in pixels, over which it is removed as a misdetection
+    static constexpr double MAX_VIEW_ERROR = 1;
+    /// markers are detected on the frame downscaled to this width, so the preview keeps up on 1080p cameras
+    static constexpr int DETECT_MAX_WIDTH = 960;
+    /// the chessboard corners are refined at full resolution around the markers found,
+    /// grown by this many marker sizes to reach corners and markers at the edge of the board
+    static constexpr double VIEW_ROI_MARGIN = 1.5;
+    /// views kept at most, beyond that the view adding the least coverage is dropped,
+    /// so the time to solve stops growing once the image is covered
+    static constexpr int MAX_VIEWS = 40;
+
+    CharucoCalibrator();
+    ~CharucoCalibrator();
+    CharucoCalibrator(const CharucoCalibrator&) = delete;
+    CharucoCalibrator& operator=(const CharucoCalibrator&) = delete;
+
+    /// detect the aruco markers of the board in a grayscale image, cheap enough for every frame.
+    /// Detected on a downscaled copy, the corners are in the full image but only as precise as the copy
+    void DetectMarkers(const cv::Mat& gray, CharucoMarkers& outMarkers) const;
+    /// refine the markers against the board and interpolate its chessboard corners,
+    /// at full resolution but only within the region of the image around the markers
+    /// @return if enough corners were found to add the view
+    bool FindView(const cv::Mat& gray, CharucoMarkers& markers, CharucoView& outView) const;
+
+    /// score a view against the latest intrinsics, or a guess from the image size until calibrated
+    math::ViewScore ScoreView(const CharucoView& view, cv::Size imageSize);
+    /// if the view covers something the kept views do not, and would tighten the intrinsics
+    bool IsUseful(const math::ViewScore& score) const { return mScorer.IsUseful(score); }
+    /// add a view without calibrating, drops the view adding the least coverage once there are more than MAX_VIEWS
+    void AddView(CharucoView view, const math::ViewScore& score);
+    /// remove the view with the highest error over MAX_VIEW_ERROR, without calibrating
+    /// @return if a view was removed
+    bool RemoveWorstView();
+
+    /// Pick up a calibration finished on a worker, and start the next if views changed since the last one started.
+    /// Call every frame, it does not wait for the worker.
+    /// @return if the calibration was updated
+    bool Update(cv::Size imageSize);
+    /// calibrate with every view kept, if they changed since the last calibration started,
+    /// once there are at least MIN_CALIB_VIEWS. Waits for the result
+    /// @return if the calibration was updated
+    bool Calibrate(cv::Size imageSize);
+
+    int GetViewCount() const { return static_cast<int>(mViews.size()); }
+    bool IsCalibrated() const { return !mCalib.cameraMatrix.empty(); }
+    /// intrinsics along with the views and their errors, empty until calibrated.
+    /// Views added since the last calibration are last, and have no error yet
+    const cfg::CameraCalib& GetCalib() const { return mCalib; }
+    /// root mean square reprojection error of the last calibration, in pixels
+    double GetReprojectionError() const { return mReprojectionError; }
+    /// every cell of the image and tilt of the board is covered by a kept view
+    bool IsCoverageComplete() const { return mScorer.IsComplete(); }
+    /// shade what the kept views do not cover yet, to guide the user
+    void DrawCoverage(cv::Mat& image) const { mScorer.DrawMissing(image); }
+
+private:
+    struct KeptView
+    {
+        CharucoView view;
+        math::ViewScore score;
+        /// reprojection error in the last calibration that included the view, negative until then
+        double error = -1;
+        int serial = 0;
+    };
+
+    /// snapshot of the views, solved on a worker, which owns it until mSolveDone is ready
+    struct Solve
+    {
+        std::vector<std::vector<cv::Point2f>> corners;
+        std::vector<std::vector<int>> ids;
+        std::vector<int> serials;
+        cv::Size imageSize;
+        /// the previous intrinsics when warm started
+        cv::Mat cameraMatrix;
+        cv::Mat distortionCoeffs;
+        int flags = cv::CALIB_USE_LU;
+
+        cv::Mat stdDeviationsIntrinsics;
+        std::vector<double> perViewErrors;
+        /// the views scored again with the new intrinsics
+        std::vector<math::ViewScore> scores;
+        double error = 0;
+        bool solved = false;
+    };
+
+    bool StartSolve(cv::Size imageSize);
+    void RunSolve();
+    /// wait for the worker and apply its result
+    bool FinishSolve();
+    void DropLeastCoverage();
+    /// count the scores of the kept views again, after views were removed or rescored
+    void RebuildScorer();
+    /// copy the views and their errors to mCalib
+    void PublishViews();
+
+    cv::Ptr<cv::aruco::Dictionary> mDictionary;
+    cv::Ptr<cv::aruco::DetectorParameters> mParams;
+    cv::Ptr<cv::aruco::CharucoBoard> mBoard;
+
+    std::vector<KeptView> mViews;
+    math::ViewScorer mScorer;
+    int mNextSerial = 0;
+    /// views were added or removed since the last calibration started
+    bool mViewsChanged = false;
+    Solve mSolve{};
+    std::future<void> mSolveDone{};
+
+    cfg::CameraCalib mCalib{};
+    double mReprojectionError = 0;
+};
+
+} // namespace tracker
@@ -0,0 +1,118 @@
+#include "MainLoopRunner.hpp"
+
+#include "Config.hpp"
+#include "Localization.hpp"
+#include "SessionReplay.hpp"
+#include "utils/Test.hpp"
+
+#include <apriltag/apriltag.h>
+#include <apriltag/tagStandard41h12.h>
+#include <opencv2/imgproc.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace tracker
+{
+
+namespace
+{
+
+class StubTrackerControl final : public ITrackerControl
+{
+public:
+    void StartCamera() final {}
+    void StartCameraCalib() final {}
+    void StartTrackerCalib() final {}
+    void StartConnection() final {}
+    void Start() final {}
+    void Stop() final {}
+    void UpdateConfig() final {}
+};
+
+/// draw marker id of the standard family centered in image, scaled up so every bit is cellSize pixels
+void DrawStandardMarker(int id, cv::Mat& image, int cellSize)
+{
+    apriltag_family* const family = tagStandard41h12_create();
+    image_u8_t* const marker = apriltag_to_image(family, id);
+    const cv::Mat markerRef{marker->height, marker->width, CV_8UC1, marker->buf, static_cast<size_t>(marker->stride)};
+    cv::Mat scaled;
+    cv::resize(markerRef, scaled, cv::Size(), cellSize, cellSize, cv::INTER_NEAREST);
+    scaled.copyTo(image(cv::Rect((image.cols - scaled.cols) / 2, (image.rows - scaled.rows) / 2, scaled.cols, scaled.rows)));
+    image_u8_destroy(marker);
+    tagStandard41h12_destroy(family);
+}
+
+} // namespace
+
+TEST_CASE("MainLoopRunner does not allocate per frame outside of apriltag")
+{
+    if (!utils::IsCountingAllocations()) return;
+    // opencv allocates images through malloc, if only operator new is counted the check would miss them
+#ifdef ATT_OS_LINUX
+    REQUIRE_M(utils::IsCountingEveryMalloc(), "malloc is not counted, the allocations of opencv would be missed");
+#else
+    if (!utils::IsCountingEveryMalloc()) MESSAGE("malloc is not counted, only allocations of operator new are checked");
+#endif
+
+    constexpr int cellSize = 10;
+    constexpr double markerSize = 0.05;
+    constexpr int warmupFrames = 10;
+    // longer than the driver query interval, so frames that ask the driver and frames that predict are both checked
+    constexpr int checkedFrames = 40;
+
+    UserConfig config;
+    config.trackerNum = 1;
+    config.markerLibrary = APRILTAG_STANDARD;
+    config.trackers.Resize(1);
+    config.calib.cameras[0]->cameraMatrix = (cv::Mat_<double>(3, 3) << 600, 0, 320, 0, 600, 240, 0, 0, 1);
+    config.calib.cameras[0]->distortionCoeffs = cv::Mat::zeros(1, 5, CV_64F);
+    Localization lc;
+    StubTrackerControl control;
+    GUI gui(&control, lc, config);
+    MockOpenVRClient vrClient;
+    vrClient.Init();
+
+    std::vector<TrackerUnit> units(1);
+    units[0].SetMarkers({0}, {TrackerUnit::CreateModelMarker(markerSize)});
+
+    PlayspaceCalib playspace;
+    auto replayClient = std::make_unique<ReplayDriverClient>(1);
+    ReplayDriverClient& driverClient = *replayClient;
+    VRDriver driver(config.trackers, std::move(replayClient));
+    MainLoopRunner runner(&config, &config.calib, &playspace, &driver);
+
+    cv::Mat image{480, 640, CV_8UC1, cv::Scalar(255)};
+    DrawStandardMarker(0, image, cellSize);
+    // the driver sees the tracker in front of the camera, so the search window starts around it
+    RecordedFrame recorded;
+    recorded.trackers.resize(1);
+    recorded.trackers[0].flags = RecordedTracker::DRIVER_ASKED | RecordedTracker::VISIBLE_TO_DRIVER;
+    recorded.trackers[0].driverPose = RodrPose(cv::Vec3d(0, 0, 0.6), math::RodriguesVec3d(cv::Vec3d(0, 0, 0)));
+
+    AwaitedFrame cameraFrame;
+    CapturedFrame captured;
+    const utils::SteadyTimer::TimePoint start = utils::SteadyTimer::Now();
+    for (int frame = 0; frame < warmupFrames + checkedFrames; ++frame)
+    {
+        // shares the pixels, so handing over a frame does not allocate either
+        captured.image = image;
+        captured.timestamp = start + frame * utils::MilliS(16);
+        driverClient.BeginFrame(recorded, playspace);
+        cameraFrame.Set(captured);
+        runner.Update(&cameraFrame, &gui, &units, &vrClient, &control);
+        if (frame < warmupFrames) continue;
+
+        CAPTURE(frame);
+        CHECK(units[0].WasVisibleLastFrame());
+        CHECK(driverClient.GetSentPose(0).has_value());
+        for (int stage = 0; stage < MainLoopRunner::NUM_STAGES; ++stage)
+        {
+            if (stage == MainLoopRunner::STAGE_APRILTAG) continue;
+            CAPTURE(MainLoopRunner::STAGE_NAMES[stage]);
+            CHECK(runner.GetAllocationAudit().GetLastFrameCount(stage) == 0);
+        }
+    }
+}
+
+} // namespace tracker
@@ -5,9 +5,21 @@
 #include "OpenVRClient.hpp"
 #include "PlayspaceCalib.hpp"
 #include "RefPtr.hpp"
+#include "SessionRecorder.hpp"
 #include "TrackerUnit.hpp"
 #include "VideoCapture.hpp"
 #include "VRDriver.hpp"
+#include "math/BoardPose.hpp"
+#include "math/EdgeRefinement.hpp"
+#include "math/UndistortionMap.hpp"
+#include "utils/AllocationCounter.hpp"
+#include "utils/TaskScheduler.hpp"
+
+#include <array>
+#include <charconv>
+#include <memory>
+#include <optional>
+#include <string_view>
 
 namespace tracker
 {
@@ -16,8 +28,19 @@ class MainLoopRunner
 {
     static constexpr int DRAW_IMG_SIZE = 480; // TODO: make configurable (preview image scaler)
     static inline const cv::Scalar COLOR_MASK{255, 0, 0}; /// red
+    /// frames between driver queries while every tracker is predicted locally, so poses from other cameras are still picked up
+    static constexpr int DRIVER_QUERY_INTERVAL = 30;
 
 public:
+    static constexpr int NUM_STAGES = 5;
+    static constexpr std::array<std::string_view, NUM_STAGES> STAGE_NAMES{"capture", "prediction", "apriltag", "detection", "estimation"};
+    static constexpr int STAGE_CAPTURE = 0;
+    static constexpr int STAGE_PREDICTION = 1;
+    /// apriltag allocates internally, its own stage keeps that out of the counts of the others
+    static constexpr int STAGE_APRILTAG = 2;
+    static constexpr int STAGE_DETECTION = 3;
+    static constexpr int STAGE_ESTIMATION = 4;
+
     explicit MainLoopRunner(RefPtr<UserConfig> config,
                             RefPtr<const CalibrationConfig> calibConfig,
                             RefPtr<PlayspaceCalib> playspace,
@@ -25,7 +48,8 @@ class MainLoopRunner
         : mConfig(config),
           camCalib(calibConfig->cameras[0]),
           videoStream(mConfig->videoStreams[0]),
-          april(AprilTagWrapper::ConvertFamily(mConfig->markerLibrary), videoStream->quadDecimate, mConfig->apriltagThreadCount),
+          april(AprilTagPool::Get().Acquire(AprilTagWrapper::ConvertFamily(mConfig->markerLibrary), videoStream->quadDecimate,
+                                            AprilTagWrapper::MarkerIdCount(mConfig->trackerNum, mConfig->markersPerTracker))),
           trackerNum(mConfig->trackerNum),
           mPlayspace(playspace),
           mVRDriver(vrDriver)
@@ -33,7 +57,14 @@ class MainLoopRunner
         mPlayspace->Set(mConfig->manualCalib.GetAsReal());
         // calculate position of camera from calibration data and send its position to steamvr
         mVRDriver->UpdateStation(mPlayspace->GetStationPoseOVR());
+        if (mConfig->recordSession)
+        {
+            mRecorder = std::make_unique<SessionRecorder>(SessionRecorder::GetDefaultPath(), *camCalib, MakeRecordedCalib(*calibConfig),
+                                                          mConfig->recordRegionsOnly);
+        }
     }
+    MainLoopRunner(const MainLoopRunner&) = delete;
+    MainLoopRunner& operator=(const MainLoopRunner&) = delete;
 
     void Update(RefPtr<AwaitedFrame> cameraFrame,
                 RefPtr<GUI> gui,
@@ -41,12 +72,22 @@ class MainLoopRunner
                 RefPtr<IVRClient> vrClient,
                 RefPtr<const ITrackerControl> trackerCtrl)
     {
+        BeginStages();
         cameraFrame->Get(frame);
+        const bool previewIsVisible = gui->IsPreviewVisible();
         // shallow copy, gray will be cloned from image and used for detection,
         // so drawing can happen on color image without clone.
-        drawImg = frame.image;
+        // grayscale cameras only need a color image when it will be shown.
+        if (previewIsVisible && frame.image.channels() == 1)
+        {
+            AprilTagWrapper::ConvertDrawImage(frame.image, drawImg);
+        }
+        else
+        {
+            drawImg = frame.image;
+        }
         AprilTagWrapper::ConvertGrayscale(frame.image, grayAprilImg);
-        const bool previewIsVisible = gui->IsPreviewVisible();
+        EndStage(STAGE_CAPTURE);
 
         const auto stampBeforeDetect = utils::SteadyTimer::Now();
         detectionTimer.Restart(stampBeforeDetect);
@@ -75,32 +116,51 @@ class MainLoopRunner
         bool atleastOneTrackerVisible = false;
 
         const double frameTimeBeforeDetect = duration_cast<utils::FSeconds>(stampBeforeDetect - frame.timestamp).count();
+        // each driver query is a blocking round trip, skip it while the motion of a tracker predicts it well enough.
+        // calibration compares against the driver, so it always asks.
+        const bool refreshFromDriver = ++framesSinceDriverQuery >= DRIVER_QUERY_INTERVAL;
+        if (refreshFromDriver) framesSinceDriverQuery = 0;
+        const bool alwaysAskDriver = !mConfig->localPrediction || refreshFromDriver ||
+                                     trackerCtrl->multicamAutocalib || trackerCtrl->manualRecalibrate;
+        // drawn with the preview on a worker, drawing allocates
+        mPreviewMarks.resize(trackerNum);
+        mPreviewCircularWindow = circularWindow;
+        mPreviewSearchRadius = searchRadius;
         for (int i = 0; i < trackerNum; i++)
         {
             auto& unit = (*trackerUnits)[i];
-            auto [pose, isValid] = mVRDriver->GetTracker(i, -frameTimeBeforeDetect - videoStream->latency);
-
-            if(isValid)
-                pose = mPlayspace->InvTransformFromOVR(pose);
-
-            std::array<cv::Point2d, 2> projected;
+            PreviewMarks& marks = mPreviewMarks[i];
+            Pose pose = Pose::Ident();
+            bool isValid = false;
+            bool isFromDriver = false;
+            if (!alwaysAskDriver && unit.GetMotion().CanPredict(frame.timestamp))
+            {
+                pose = unit.GetMotion().Predict(frame.timestamp);
+                isValid = true;
+            }
+            else
             {
-                const cv::Vec3d unusedRVec{}; // used to perform change of basis
-                const cv::Vec3d unusedTVec{};
-                const std::array<cv::Point3d, 2> points{pose.position, unit.GetEstimatedPose().position};
-                cv::projectPoints(points, unusedRVec, unusedTVec, camCalib->cameraMatrix, camCalib->distortionCoeffs, projected);
+                const VRDriver::GetTrackerResult driverResult = mVRDriver->GetTracker(i, -frameTimeBeforeDetect - videoStream->latency);
+                pose = driverResult.pose;
+                isValid = driverResult.isValid;
+                isFromDriver = true;
+                if (isValid) pose = mPlayspace->InvTransformFromOVR(pose);
             }
-            const auto& [driverCenter, previousCenter] = projected;
 
-            // project point from position of tracker in camera 3d space to 2d camera pixel space, and draw a dot there
-            if (previewIsVisible) cv::circle(drawImg, driverCenter, 5, cv::Scalar(0, 0, 255), 2, 8, 0);
+            const cv::Point2d driverCenter = math::ProjectPoint(pose.position, *camCalib);
+            const cv::Point2d previousCenter = math::ProjectPoint(cv::Point3d(unit.GetEstimatedPose().position), *camCalib);
+
+            marks.driverCenter = driverCenter;
+            marks.pose = pose;
+            marks.isValid = isValid;
+            marks.isMasked = false;
 
-            unit.SetWasVisibleToDriverLastFrame(isValid);
+            // a local prediction is only a guess for this frame, the driver pose and its depth are kept for when it is asked
+            unit.SetWasDriverAskedLastFrame(isFromDriver);
+            unit.SetWasVisibleToDriverLastFrame(isFromDriver && isValid);
             cv::Point2d maskCenter;
             if (isValid) // if the pose from steamvr was valid, save the predicted position and rotation
             {
-                if (previewIsVisible) cv::drawFrameAxes(drawImg, camCalib->cameraMatrix, camCalib->distortionCoeffs, pose.rotation.toRotVec(), math::ToVec(pose.position), 0.10F);
-
                 if (!unit.WasVisibleLastFrame()) // if tracker was found in previous frame, we use that position for masking. If not, we use position from driver for masking.
                 {
                     maskCenter = driverCenter;
@@ -110,7 +170,8 @@ class MainLoopRunner
                     maskCenter = previousCenter;
                 }
                 unit.SetWasVisibleLastFrame(true);
-                unit.SetPoseFromDriver(RodrPose(pose));
+                unit.SetPredictedPose(RodrPose(pose));
+                if (isFromDriver) unit.SetPoseFromDriver(RodrPose(pose));
             }
             else
             {
@@ -123,17 +184,15 @@ class MainLoopRunner
             if (maskCenter.inside(cv::Rect2d(0, 0, frame.image.cols, frame.image.rows)))
             {
                 atleastOneTrackerVisible = true;
+                marks.maskCenter = maskCenter;
+                marks.isMasked = true;
                 if (circularWindow) // if circular window is set mask a circle around the predicted tracker point
                 {
                     cv::circle(maskSearchImg, maskCenter, searchRadius, cv::Scalar(255), -1, 8, 0);
-                    if (previewIsVisible) cv::circle(drawImg, maskCenter, searchRadius, COLOR_MASK, 2, 8, 0);
                 }
                 else // if not, mask a vertical strip top to bottom. This happens every 20 frames if a tracker is lost.
                 {
-                    const int maskX = static_cast<int>(maskCenter.x);
-                    const cv::Rect2i maskRect{cv::Point(maskX - searchRadius, 0), cv::Point2i(maskX + searchRadius, frame.image.rows)};
-                    cv::rectangle(maskSearchImg, maskRect, cv::Scalar(255), -1);
-                    if (previewIsVisible) cv::rectangle(drawImg, maskRect, COLOR_MASK, 3);
+                    cv::rectangle(maskSearchImg, GetMaskStrip(maskCenter, searchRadius), cv::Scalar(255), -1);
                 }
             }
             else
@@ -142,138 +201,309 @@ class MainLoopRunner
             }
         }
 
-        // using copyTo with masking creates the image where everything but the locations where trackers are predicted to be is black
+        // masking creates the image where everything but the locations where trackers are predicted to be is black,
+        // written to its own buffer, so grayAprilImg is not aliased and the next frame converts into fresh pixels
+        const cv::Mat* detectImg = &grayAprilImg;
         if (atleastOneTrackerVisible)
         {
-            grayAprilImg.copyTo(tempGrayMaskedImg, maskSearchImg);
-            grayAprilImg = tempGrayMaskedImg;
+            cv::bitwise_and(grayAprilImg, maskSearchImg, tempGrayMaskedImg);
+            detectImg = &tempGrayMaskedImg;
         }
 
         mCalibrator.Update(vrClient, mVRDriver, gui, mPlayspace, trackerCtrl->lockHeightCalib, trackerCtrl->manualRecalibrate);
-
-        april.DetectMarkers(grayAprilImg, dets);
+        EndStage(STAGE_PREDICTION);
+
+        april->DetectMarkers(*detectImg, dets);
+        EndStage(STAGE_APRILTAG);
+        // cheap when the calibration did not change, then every corner is undistorted in one pass
+        if (mUndistortion.Update(*camCalib, GetMatSize(frame.image))) mDistortedModel = math::CameraModel::FromCalib(*camCalib);
+        if (mConfig->refineCorners && mUndistortion.IsValid() && mDistortedModel) RefineCorners(*trackerUnits);
+        if (mUndistortion.IsValid()) mUndistortion.Undistort(dets.corners, undistortedCorners);
+        EndStage(STAGE_DETECTION);
         // frame time is how much time passed since frame was acquired.
-        const double frameTimeAfterDetect = duration_cast<utils::FSeconds>(utils::SteadyTimer::Now() - frame.timestamp).count();
+        const auto stampAfterDetect = utils::SteadyTimer::Now();
+        const double frameTimeAfterDetect = duration_cast<utils::FSeconds>(stampAfterDetect - frame.timestamp).count();
+        // trackers only touch their own unit while estimating, so each runs as its own task.
+        // preview only reads the detections, so it is drawn as one more task, which runs on a worker unless it is the only one
+        const EstimationContext context{*trackerUnits, trackerCtrl->manualRecalibrate, gui, frameTimeAfterDetect};
+        const int trackerCount = static_cast<int>(trackerUnits->size());
+        utils::TaskScheduler::Get().ParallelFor(trackerCount + (previewIsVisible ? 1 : 0), [this, &context](int index) {
+            if (index < static_cast<int>(context.units.size()))
+            {
+                EstimateTracker(context.units[index], context.manualRecalibrate);
+            }
+            else
+            {
+                DrawPreview(context.gui, context.frameTimeAfterDetect);
+            }
+        });
+
+        if (mRecorder) BeginRecordTrackers(*trackerUnits);
+        // gathered in order, the driver and the calibrator are not thread safe
         for (int index = 0; index < trackerUnits->size(); ++index)
         {
             auto& unit = (*trackerUnits)[index];
-            // estimate the pose of current board
-            const RodrPose scaledPoseFromDriver{unit.GetPoseFromDriver().position / mPlayspace->GetScale(), unit.GetPoseFromDriver().rotation};
-            // on rare occasions, detection crashes. Should be very rare and indicate something wrong with camera or tracker calibration
-            auto [estimatedPose, numEstimated] = math::EstimatePoseTracker(
-                dets.corners, dets.ids, unit.GetArucoBoard(), *camCalib,
-                unit.WasVisibleLastFrame() && mConfig->usePredictive,
-                scaledPoseFromDriver);
-            estimatedPose.position *= mPlayspace->GetScale(); // unscale returned estimation;
-            unit.SetEstimatedPose(estimatedPose);
-
-            ATT_ASSERT(!std::isnan(estimatedPose.position[X]));
-
-            if (numEstimated <= 0)
+            if (!unit.WasVisibleLastFrame()) continue;
+
+            if (trackerCtrl->multicamAutocalib && unit.WasVisibleToDriverLastFrame())
             {
-                unit.SetWasVisibleLastFrame(false);
-                continue;
+                tracker::PlayspaceCalibrator::UpdateMulticam(gui, mPlayspace, unit);
+                continue; // skip sending to driver
             }
-            unit.SetWasVisibleLastFrame(true);
 
-            if (mConfig->depthSmoothing > 0 && unit.WasVisibleToDriverLastFrame() && !trackerCtrl->manualRecalibrate)
+            Pose pose{unit.GetEstimatedPose()};
+            if (mConfig->filterMinCutoff > 0)
             {
-                // depth estimation is noisy, so try to smooth it more, especialy if using multiple cameras
-                // if position is close to the position predicted by the driver, take the depth of the driver.
-                // if error is big, take the calculated depth
-                // error threshold is defined in the params as depth smoothing
-                RodrPose pose = unit.GetEstimatedPose();
+                const math::OneEuroFilter::Settings filterSettings{mConfig->filterMinCutoff, mConfig->filterDepthCutoff, mConfig->filterSpeedCoeff};
+                pose = unit.GetSmoothing().Filter(pose, frame.timestamp, filterSettings);
+            }
+            // transform boards position based on our calibration data
+            Pose poseToSend = mPlayspace->TransformToOVR(pose);
 
-                const double distDriver = Length(unit.GetPoseFromDriver().position);
-                const double distPredict = Length(pose.position);
+            // send all the values
+            mVRDriver->UpdateTracker(index, poseToSend, -frameTimeAfterDetect - videoStream->latency,
+                                     GetSmoothing(unit.GetConfidence()), unit.GetConfidence());
+            if (mRecorder)
+            {
+                mRecordedTrackers[index].sentPose = poseToSend;
+                mRecordedTrackers[index].flags |= RecordedTracker::SENT;
+            }
+        }
+        // only a copy into the recorder ring, compressed and written on its own thread
+        if (mRecorder) mRecorder->Record(grayAprilImg, frame.timestamp, stampAfterDetect, dets, mRecordedTrackers);
 
-                const cv::Vec3d normPredict = pose.position / distPredict;
+        EndStage(STAGE_ESTIMATION);
+        mAudit.EndFrame();
+    }
 
-                double dist = std::abs(distPredict - distDriver);
-                dist = (dist / static_cast<double>(mConfig->depthSmoothing)) + 0.1;
-                dist = std::clamp(dist, 0.0, 1.0);
+    /// time each stage of the last Update took, the preview is drawn during estimation
+    const std::array<utils::NanoS, NUM_STAGES>& GetStageTimes() const { return mStageTimes; }
+    /// allocations of the tracking thread per stage, only counted if utils::IsCountingAllocations
+    const utils::AllocationAudit<NUM_STAGES>& GetAllocationAudit() const { return mAudit; }
 
-                const double distFinal = (dist * distPredict) + (1 - dist) * distDriver;
+private:
+    struct EstimationContext
+    {
+        std::vector<TrackerUnit>& units;
+        bool manualRecalibrate;
+        RefPtr<GUI> gui;
+        double frameTimeAfterDetect;
+    };
+
+    /// the tracker calibration units are set up from, and the playspace, so a replay estimates against the same
+    RecordedCalib MakeRecordedCalib(const CalibrationConfig& calibConfig) const
+    {
+        RecordedCalib calib;
+        calib.trackers.resize(calibConfig.trackers.GetSize());
+        for (Index i = 0; i < calibConfig.trackers.GetSize(); ++i)
+        {
+            calib.trackers[i].ids = calibConfig.trackers[i]->ids;
+            calib.trackers[i].corners = calibConfig.trackers[i]->corners;
+        }
+        calib.recenterMarkers = mConfig->trackerCalibCenters;
+        calib.playspace = mConfig->manualCalib.GetAsReal();
+        return calib;
+    }
 
-                pose.position = normPredict * distFinal;
-                unit.SetEstimatedPose(pose);
-            }
+    /// move the detected corners of trackers seen last frame onto the edges of their markers, projected at the predicted pose.
+    /// Trackers share one budget of markers, so a frame with many markers is not slowed down.
+    void RefineCorners(const std::vector<TrackerUnit>& units)
+    {
+        int budget = math::MAX_REFINED_MARKERS;
+        for (const TrackerUnit& unit : units)
+        {
+            if (!unit.WasVisibleLastFrame()) continue;
+            const RodrPose scaledPredictedPose{unit.GetPredictedPose().position / mPlayspace->GetScale(), unit.GetPredictedPose().rotation};
+            math::RefineMarkerCorners(grayAprilImg, *mDistortedModel, unit.GetBoardGeometry(), scaledPredictedPose, dets.ids, dets.corners, budget);
+        }
+    }
 
-            {
-                const cv::Point3d position = unit.GetEstimatedPose().position;
+    /// estimate the pose of one tracker and reject implausible ones, marking the unit as not visible.
+    /// Only reads shared state, so trackers are estimated in parallel.
+    void EstimateTracker(TrackerUnit& unit, bool manualRecalibrate) const
+    {
+        // estimate the pose of current board
+        const RodrPose scaledPredictedPose{unit.GetPredictedPose().position / mPlayspace->GetScale(), unit.GetPredictedPose().rotation};
+        // on rare occasions, detection crashes. Should be very rare and indicate something wrong with camera or tracker calibration
+        const bool usePredictive = unit.WasVisibleLastFrame() && mConfig->usePredictive;
+        math::BoardPoseEstimate estimate = mUndistortion.IsValid()
+                                               ? math::EstimatePoseTracker(dets.ids, undistortedCorners, unit.GetBoardGeometry(),
+                                                                           mUndistortion.GetPinholeModel(), usePredictive, scaledPredictedPose)
+                                               : math::EstimatePoseTracker(dets.ids, dets.corners, unit.GetBoardGeometry(),
+                                                                           *camCalib, usePredictive, scaledPredictedPose);
+        estimate.pose.position *= mPlayspace->GetScale(); // unscale returned estimation;
+        unit.SetEstimatedPose(estimate.pose);
+        unit.SetConfidence(math::GetTrackingConfidence(estimate, mPlayspace->GetScale()));
+
+        ATT_ASSERT(!std::isnan(estimate.pose.position[X]));
+
+        if (estimate.markerCount <= 0)
+        {
+            unit.SetWasVisibleLastFrame(false);
+            return;
+        }
+        unit.SetWasVisibleLastFrame(true);
 
-                // Reject detected positions that are behind the camera
-                if (position.z < 0)
-                {
-                    unit.SetWasVisibleLastFrame(false);
-                    continue;
-                }
+        // only against a pose the driver answered with this frame, smoothing toward the local prediction
+        // would feed the motion filter its own extrapolation
+        if (mConfig->depthSmoothing > 0 && unit.WasVisibleToDriverLastFrame() && !manualRecalibrate)
+        {
+            // depth estimation is noisy, so try to smooth it more, especialy if using multiple cameras
+            // if position is close to the position predicted by the driver, take the depth of the driver.
+            // if error is big, take the calculated depth
+            // error threshold is defined in the params as depth smoothing
+            RodrPose pose = unit.GetEstimatedPose();
+
+            const double distDriver = Length(unit.GetPoseFromDriver().position);
+            const double distPredict = Length(pose.position);
+
+            const cv::Vec3d normPredict = pose.position / distPredict;
+
+            double dist = std::abs(distPredict - distDriver);
+            dist = (dist / static_cast<double>(mConfig->depthSmoothing)) + 0.1;
+            dist = std::clamp(dist, 0.0, 1.0);
+
+            const double distFinal = (dist * distPredict) + (1 - dist) * distDriver;
+
+            pose.position = normPredict * distFinal;
+            unit.SetEstimatedPose(pose);
+        }
+
+        {
+            const cv::Point3d position = unit.GetEstimatedPose().position;
+
+            // Reject detected positions that are behind the camera
+            if (position.z < 0)
+            {
+                unit.SetWasVisibleLastFrame(false);
+                return;
+            }
 
-                // Figure out the camera aspect ratio, XZ and YZ ratio limits
-                const double aspectRatio = GetMatSize(frame.image).aspectRatio();
-                const double xzRatioLimit = 0.5 * static_cast<double>(frame.image.cols) / camCalib->cameraMatrix.at<double>(0, 0);
-                const double yzRatioLimit = 0.5 * static_cast<double>(frame.image.rows) / camCalib->cameraMatrix.at<double>(1, 1);
+            // Figure out the camera aspect ratio, XZ and YZ ratio limits
+            const double aspectRatio = GetMatSize(frame.image).aspectRatio();
+            const double xzRatioLimit = 0.5 * static_cast<double>(frame.image.cols) / camCalib->cameraMatrix.at<double>(0, 0);
+            const double yzRatioLimit = 0.5 * static_cast<double>(frame.image.rows) / camCalib->cameraMatrix.at<double>(1, 1);
 
-                // Figure out whether X or Y dimension is most likely to go outside the camera field of view
-                if (std::abs(position.x / position.y) > aspectRatio)
+            // Figure out whether X or Y dimension is most likely to go outside the camera field of view
+            if (std::abs(position.x / position.y) > aspectRatio)
+            {
+                // Reject detections when XZ coordinate ratio goes out of camera FOV
+                if (std::abs(position.x / position.z) > xzRatioLimit)
                 {
-                    // Reject detections when XZ coordinate ratio goes out of camera FOV
-                    if (std::abs(position.x / position.z) > xzRatioLimit)
-                    {
-                        unit.SetWasVisibleLastFrame(false);
-                        continue;
-                    }
+                    unit.SetWasVisibleLastFrame(false);
+                    return;
                 }
-                else
+            }
+            else
+            {
+                // Reject detections when YZ coordinate ratio goes out of camera FOV
+                if (std::abs(position.y / position.z) > yzRatioLimit)
                 {
-                    // Reject detections when YZ coordinate ratio goes out of camera FOV
-                    if (std::abs(position.y / position.z) > yzRatioLimit)
-                    {
-                        unit.SetWasVisibleLastFrame(false);
-                        continue;
-                    }
+                    unit.SetWasVisibleLastFrame(false);
+                    return;
                 }
             }
+        }
 
-            if (trackerCtrl->multicamAutocalib && unit.WasVisibleToDriverLastFrame())
-            {
-                tracker::PlayspaceCalibrator::UpdateMulticam(gui, mPlayspace, unit);
-                continue; // skip sending to driver
-            }
+        unit.GetMotion().Update(Pose(unit.GetEstimatedPose()), frame.timestamp);
+    }
 
-            // transform boards position based on our calibration data
-            Pose poseToSend = mPlayspace->TransformToOVR(Pose(unit.GetEstimatedPose()));
+    /// smoothing window sent to the driver, confident poses need less of it, but never less than the camera latency
+    double GetSmoothing(double confidence) const
+    {
+        const double factor = mConfig->smoothingFactor;
+        if (!mConfig->adaptiveSmoothing) return factor;
+        constexpr double minScale = 0.5;
+        const double scale = minScale + (1 - minScale) * (1 - std::clamp(confidence, 0.0, 1.0));
+        return std::max(factor * scale, std::min(factor, videoStream->latency));
+    }
 
-            // send all the values
-            mVRDriver->UpdateTracker(index, poseToSend, -frameTimeAfterDetect - videoStream->latency, mConfig->smoothingFactor);
+    void BeginStages()
+    {
+        mAudit.BeginFrame();
+        mStageStart = utils::SteadyTimer::Now();
+    }
+    void EndStage(int stage)
+    {
+        mAudit.EndStage(stage);
+        const auto now = utils::SteadyTimer::Now();
+        mStageTimes[stage] = duration_cast<utils::NanoS>(now - mStageStart);
+        mStageStart = now;
+    }
+
+    /// state of every tracker after estimation, the poses sent are added while sending
+    void BeginRecordTrackers(const std::vector<TrackerUnit>& units)
+    {
+        mRecordedTrackers.resize(units.size());
+        for (int index = 0; index < static_cast<int>(units.size()); ++index)
+        {
+            const TrackerUnit& unit = units[index];
+            RecordedTracker& record = mRecordedTrackers[index];
+            record.flags = 0;
+            if (unit.WasVisibleLastFrame()) record.flags |= RecordedTracker::VISIBLE;
+            if (unit.WasVisibleToDriverLastFrame()) record.flags |= RecordedTracker::VISIBLE_TO_DRIVER;
+            if (unit.WasDriverAskedLastFrame()) record.flags |= RecordedTracker::DRIVER_ASKED;
+            record.confidence = unit.GetConfidence();
+            record.driverPose = unit.GetPoseFromDriver();
+            record.estimatedPose = unit.GetEstimatedPose();
+            record.sentPose = Pose::Ident();
         }
+    }
 
-        if (gui->IsPreviewVisible())
+    /// vertical strip top to bottom around center
+    cv::Rect2i GetMaskStrip(const cv::Point2d& center, int searchRadius) const
+    {
+        const int maskX = static_cast<int>(center.x);
+        return {cv::Point(maskX - searchRadius, 0), cv::Point2i(maskX + searchRadius, frame.image.rows)};
+    }
+
+    void DrawPreview(RefPtr<GUI> gui, double frameTimeAfterDetect)
+    {
+        for (const PreviewMarks& marks : mPreviewMarks)
         {
-            // draw and display the detections
-            if (!dets.ids.empty()) cv::aruco::drawDetectedMarkers(drawImg, dets.corners, dets.ids);
-            const cv::Size2i drawSize = ConstrainSize(GetMatSize(frame.image), DRAW_IMG_SIZE);
-            cv::resize(drawImg, outImg, drawSize);
-            cv::putText(outImg, std::to_string(frameTimeAfterDetect).substr(0, 5), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
-            if (false) // TODO: tracker->showTimeProfile (is this even needed?)
+            // project point from position of tracker in camera 3d space to 2d camera pixel space, and draw a dot there
+            cv::circle(drawImg, marks.driverCenter, 5, cv::Scalar(0, 0, 255), 2, 8, 0);
+            if (marks.isValid) cv::drawFrameAxes(drawImg, camCalib->cameraMatrix, camCalib->distortionCoeffs, marks.pose.rotation.toRotVec(), math::ToVec(marks.pose.position), 0.10F);
+            if (!marks.isMasked) continue;
+            if (mPreviewCircularWindow)
             {
-                april.DrawTimeProfile(outImg, cv::Point(10, 60));
+                cv::circle(drawImg, marks.maskCenter, mPreviewSearchRadius, COLOR_MASK, 2, 8, 0);
             }
-            gui->UpdatePreview(outImg);
+            else
+            {
+                cv::rectangle(drawImg, GetMaskStrip(marks.maskCenter, mPreviewSearchRadius), COLOR_MASK, 3);
+            }
+        }
+        // draw and display the detections
+        if (!dets.Empty()) cv::aruco::drawDetectedMarkers(drawImg, dets.GetCornerViews(), dets.ids);
+        const cv::Size2i drawSize = ConstrainSize(GetMatSize(frame.image), DRAW_IMG_SIZE);
+        cv::resize(drawImg, outImg, drawSize);
+        // short enough to stay in the small string buffer
+        std::array<char, 16> frameTimeText{};
+        std::to_chars(frameTimeText.data(), frameTimeText.data() + frameTimeText.size() - 1, frameTimeAfterDetect, std::chars_format::fixed, 3);
+        cv::putText(outImg, frameTimeText.data(), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
+        if (false) // TODO: tracker->showTimeProfile (is this even needed?)
+        {
+            april->DrawTimeProfile(outImg, cv::Point(10, 60));
         }
-        // time of marker detection
+        gui->UpdatePreview(outImg);
     }
 
-private:
     RefPtr<UserConfig> mConfig;
     RefPtr<const cfg::CameraCalib> camCalib;
     RefPtr<const cfg::VideoStream> videoStream;
-    AprilTagWrapper april;
+    AprilTagPool::Lease april;
     Index trackerNum;
     RefPtr<PlayspaceCalib> mPlayspace;
     RefPtr<VRDriver> mVRDriver;
 
     MarkerDetectionList dets{};
+    /// rebuilt when the camera calibration changes
+    math::UndistortionMap mUndistortion{};
+    /// camera of camCalib with its distortion, rebuilt with mUndistortion
+    std::optional<math::CameraModel> mDistortedModel{};
+    /// dets.corners in the pinhole model of mUndistortion
+    std::vector<cv::Point2f> undistortedCorners{};
 
     tracker::CapturedFrame frame{};
     cv::Mat drawImg{};
@@ -283,10 +513,33 @@ class MainLoopRunner
     cv::Mat tempGrayMaskedImg{};
 
     int framesSinceLastSeen = 0;
+    int framesSinceDriverQuery = 0;
     static constexpr int framesToCheckAll = 20;
     PlayspaceCalibrator mCalibrator{};
 
     utils::SteadyTimer detectionTimer{};
+
+    /// what the prediction of a tracker looked like, for the preview
+    struct PreviewMarks
+    {
+        cv::Point2d driverCenter{};
+        Pose pose = Pose::Ident();
+        bool isValid = false;
+        cv::Point2d maskCenter{};
+        bool isMasked = false;
+    };
+    std::vector<PreviewMarks> mPreviewMarks{};
+    bool mPreviewCircularWindow = true;
+    int mPreviewSearchRadius = 0;
+
+    /// only while recordSession is set
+    std::unique_ptr<SessionRecorder> mRecorder{};
+    std::vector<RecordedTracker> mRecordedTrackers{};
+
+    /// the preview runs on a worker, so only allocations of the tracking thread are counted
+    utils::AllocationAudit<NUM_STAGES> mAudit{"main loop", STAGE_NAMES};
+    utils::SteadyTimer::TimePoint mStageStart{};
+    std::array<utils::NanoS, NUM_STAGES> mStageTimes{};
 };
 
 } // namespace tracker
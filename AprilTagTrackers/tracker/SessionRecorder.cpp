@@ -0,0 +1,614 @@
+#include "SessionRecorder.hpp"
+
+#include "math/CVHelpers.hpp"
+#include "utils/Env.hpp"
+#include "utils/Error.hpp"
+#include "utils/Log.hpp"
+#include "utils/Test.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <type_traits>
+
+namespace tracker
+{
+
+namespace
+{
+
+// values are written in the byte order of the machine, recordings are read back where they were made
+constexpr std::array<char, 8> MAGIC{'A', 'T', 'T', 'S', 'E', 'S', 'S', '\0'};
+/// 2 added RecordedTracker::DRIVER_ASKED, the driver pose of version 1 could be a local prediction.
+/// 3 added CHUNK_CALIB, earlier versions could only be replayed against the calibration of the machine replaying them
+constexpr std::uint32_t FORMAT_VERSION = 3;
+constexpr std::uint32_t CHUNK_CAMERA = 1;
+constexpr std::uint32_t CHUNK_FRAME = 2;
+constexpr std::uint32_t CHUNK_CALIB = 3;
+/// larger chunks are taken as a corrupt length rather than allocated
+constexpr std::uint32_t MAX_CHUNK_SIZE = 256U * 1024 * 1024;
+
+class ByteWriter
+{
+public:
+    explicit ByteWriter(std::vector<std::uint8_t>& out) : mOut(out) { mOut.clear(); }
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    void Put(T value)
+    {
+        PutBytes(&value, sizeof(T));
+    }
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    void PutArray(std::span<const T> values)
+    {
+        Put(static_cast<std::uint32_t>(values.size()));
+        PutBytes(values.data(), values.size_bytes());
+    }
+    void PutBytes(const void* data, std::size_t size)
+    {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        mOut.insert(mOut.end(), bytes, bytes + size);
+    }
+    void PutVec3(const cv::Vec3d& vec)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            Put(vec[i]);
+        }
+    }
+
+private:
+    std::vector<std::uint8_t>& mOut;
+};
+
+class ByteReader
+{
+public:
+    explicit ByteReader(std::span<const std::uint8_t> in) : mIn(in) {}
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    T Get()
+    {
+        T value{};
+        GetBytes(&value, sizeof(T));
+        return value;
+    }
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    void GetArray(std::vector<T>& outValues)
+    {
+        outValues.resize(Get<std::uint32_t>());
+        GetBytes(outValues.data(), outValues.size() * sizeof(T));
+    }
+    void GetBytes(void* outData, std::size_t size)
+    {
+        if (size > mIn.size() - mOffset) throw utils::Error("session recording chunk is shorter than its contents");
+        std::copy_n(mIn.begin() + static_cast<std::ptrdiff_t>(mOffset), size, static_cast<std::uint8_t*>(outData));
+        mOffset += size;
+    }
+    cv::Vec3d GetVec3()
+    {
+        cv::Vec3d vec;
+        for (int i = 0; i < 3; ++i)
+        {
+            vec[i] = Get<double>();
+        }
+        return vec;
+    }
+
+private:
+    std::span<const std::uint8_t> mIn;
+    std::size_t mOffset = 0;
+};
+
+void PutMat(ByteWriter& writer, const cv::Mat& mat)
+{
+    cv::Mat values;
+    if (!mat.empty()) mat.convertTo(values, CV_64F);
+    writer.Put(static_cast<std::int32_t>(values.rows));
+    writer.Put(static_cast<std::int32_t>(values.cols));
+    for (int row = 0; row < values.rows; ++row)
+    {
+        writer.PutBytes(values.ptr<double>(row), values.cols * sizeof(double));
+    }
+}
+
+cv::Mat GetMat(ByteReader& reader)
+{
+    const int rows = reader.Get<std::int32_t>();
+    const int cols = reader.Get<std::int32_t>();
+    if (rows <= 0 || cols <= 0) return {};
+    cv::Mat values(rows, cols, CV_64F);
+    reader.GetBytes(values.data, values.total() * sizeof(double));
+    return values;
+}
+
+void SerializeCalib(const RecordedCalib& calib, std::vector<std::uint8_t>& outPayload)
+{
+    ByteWriter writer(outPayload);
+    writer.Put(static_cast<std::uint32_t>(calib.trackers.size()));
+    for (const RecordedBoard& board : calib.trackers)
+    {
+        writer.PutArray(std::span<const int>(board.ids));
+        writer.Put(static_cast<std::uint32_t>(board.corners.size()));
+        for (const std::vector<cv::Point3f>& marker : board.corners)
+        {
+            writer.Put(static_cast<std::uint32_t>(marker.size()));
+            for (const cv::Point3f& corner : marker)
+            {
+                writer.Put(corner.x);
+                writer.Put(corner.y);
+                writer.Put(corner.z);
+            }
+        }
+    }
+    writer.Put(static_cast<std::uint8_t>(calib.recenterMarkers));
+    writer.PutVec3(calib.playspace.posOffset);
+    writer.PutVec3(calib.playspace.angleOffset);
+    writer.Put(calib.playspace.scale);
+}
+
+void DeserializeCalib(std::span<const std::uint8_t> payload, RecordedCalib& outCalib)
+{
+    ByteReader reader(payload);
+    outCalib.trackers.resize(reader.Get<std::uint32_t>());
+    for (RecordedBoard& board : outCalib.trackers)
+    {
+        reader.GetArray(board.ids);
+        board.corners.resize(reader.Get<std::uint32_t>());
+        for (std::vector<cv::Point3f>& marker : board.corners)
+        {
+            marker.resize(reader.Get<std::uint32_t>());
+            for (cv::Point3f& corner : marker)
+            {
+                corner.x = reader.Get<float>();
+                corner.y = reader.Get<float>();
+                corner.z = reader.Get<float>();
+            }
+        }
+    }
+    outCalib.recenterMarkers = reader.Get<std::uint8_t>() != 0;
+    outCalib.playspace.posOffset = reader.GetVec3();
+    outCalib.playspace.angleOffset = reader.GetVec3();
+    outCalib.playspace.scale = reader.Get<double>();
+}
+
+void SerializeFrame(const RecordedFrame& frame, std::vector<std::uint8_t>& outPayload)
+{
+    ByteWriter writer(outPayload);
+    writer.Put(frame.index);
+    writer.Put(frame.captureTime);
+    writer.Put(frame.detectTime);
+    writer.Put(frame.sendTime);
+    writer.Put(static_cast<std::int32_t>(frame.imageSize.width));
+    writer.Put(static_cast<std::int32_t>(frame.imageSize.height));
+
+    writer.Put(static_cast<std::uint32_t>(frame.regions.size()));
+    for (std::size_t index = 0; index < frame.regions.size(); ++index)
+    {
+        const cv::Rect& region = frame.regions[index];
+        const cv::Mat& crop = frame.crops[index];
+        ATT_ASSERT(crop.type() == CV_8UC1 && crop.rows == region.height && crop.cols == region.width);
+        writer.Put(static_cast<std::int32_t>(region.x));
+        writer.Put(static_cast<std::int32_t>(region.y));
+        writer.Put(static_cast<std::int32_t>(region.width));
+        writer.Put(static_cast<std::int32_t>(region.height));
+        for (int row = 0; row < crop.rows; ++row)
+        {
+            writer.PutBytes(crop.ptr(row), crop.cols);
+        }
+    }
+
+    writer.PutArray(std::span<const int>(frame.ids));
+    writer.Put(static_cast<std::uint32_t>(frame.corners.size()));
+    for (const cv::Point2f& corner : frame.corners)
+    {
+        writer.Put(corner.x);
+        writer.Put(corner.y);
+    }
+
+    writer.Put(static_cast<std::uint32_t>(frame.trackers.size()));
+    for (const RecordedTracker& tracker : frame.trackers)
+    {
+        writer.Put(tracker.flags);
+        writer.Put(tracker.confidence);
+        writer.PutVec3(tracker.driverPose.position);
+        writer.PutVec3(tracker.driverPose.rotation.value);
+        writer.PutVec3(tracker.estimatedPose.position);
+        writer.PutVec3(tracker.estimatedPose.rotation.value);
+        writer.PutVec3(ToVec(tracker.sentPose.position));
+        for (int i = 0; i < 4; ++i)
+        {
+            writer.Put(tracker.sentPose.rotation[i]);
+        }
+    }
+}
+
+void DeserializeFrame(std::span<const std::uint8_t> payload, RecordedFrame& outFrame)
+{
+    ByteReader reader(payload);
+    outFrame.index = reader.Get<std::int64_t>();
+    outFrame.captureTime = reader.Get<std::int64_t>();
+    outFrame.detectTime = reader.Get<std::int64_t>();
+    outFrame.sendTime = reader.Get<std::int64_t>();
+    outFrame.imageSize.width = reader.Get<std::int32_t>();
+    outFrame.imageSize.height = reader.Get<std::int32_t>();
+
+    const std::uint32_t regionCount = reader.Get<std::uint32_t>();
+    outFrame.regions.resize(regionCount);
+    outFrame.crops.resize(regionCount);
+    for (std::uint32_t index = 0; index < regionCount; ++index)
+    {
+        cv::Rect& region = outFrame.regions[index];
+        region.x = reader.Get<std::int32_t>();
+        region.y = reader.Get<std::int32_t>();
+        region.width = reader.Get<std::int32_t>();
+        region.height = reader.Get<std::int32_t>();
+        if (region.width <= 0 || region.height <= 0 || (region & cv::Rect(cv::Point(0, 0), outFrame.imageSize)) != region)
+        {
+            throw utils::Error("session recording region is outside its frame");
+        }
+        cv::Mat& crop = outFrame.crops[index];
+        crop.create(region.size(), CV_8UC1);
+        reader.GetBytes(crop.data, crop.total());
+    }
+
+    reader.GetArray(outFrame.ids);
+    outFrame.corners.resize(reader.Get<std::uint32_t>());
+    for (cv::Point2f& corner : outFrame.corners)
+    {
+        corner.x = reader.Get<float>();
+        corner.y = reader.Get<float>();
+    }
+
+    outFrame.trackers.resize(reader.Get<std::uint32_t>());
+    for (RecordedTracker& tracker : outFrame.trackers)
+    {
+        tracker.flags = reader.Get<std::uint8_t>();
+        tracker.confidence = reader.Get<double>();
+        tracker.driverPose.position = reader.GetVec3();
+        tracker.driverPose.rotation = math::RodriguesVec3d(reader.GetVec3());
+        tracker.estimatedPose.position = reader.GetVec3();
+        tracker.estimatedPose.rotation = math::RodriguesVec3d(reader.GetVec3());
+        const cv::Vec3d position = reader.GetVec3();
+        cv::Quatd rotation;
+        for (int i = 0; i < 4; ++i)
+        {
+            rotation[i] = reader.Get<double>();
+        }
+        tracker.sentPose = Pose(cv::Point3d(position), rotation);
+    }
+}
+
+} // namespace
+
+void RecordedFrame::DrawImage(cv::Mat& outGray) const
+{
+    outGray.create(imageSize, CV_8UC1);
+    outGray = cv::Scalar(0);
+    for (std::size_t index = 0; index < regions.size(); ++index)
+    {
+        cv::Mat target = outGray(regions[index]);
+        crops[index].copyTo(target);
+    }
+}
+
+SessionRecorder::SessionRecorder(const std::filesystem::path& path, const cfg::CameraCalib& camera, const RecordedCalib& calib, bool regionsOnly)
+    : mRegionsOnly(regionsOnly)
+{
+    std::error_code error;
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), error);
+    mFile.open(path, std::ios::binary | std::ios::trunc);
+    if (!mFile.is_open())
+    {
+        ATT_LOG_ERROR("unable to open session recording ", path.string());
+        return;
+    }
+    mFile.write(MAGIC.data(), MAGIC.size());
+    mFile.write(reinterpret_cast<const char*>(&FORMAT_VERSION), sizeof(FORMAT_VERSION));
+
+    ByteWriter writer(mPayload);
+    PutMat(writer, camera.cameraMatrix);
+    PutMat(writer, camera.distortionCoeffs);
+    WriteChunk(CHUNK_CAMERA, mPayload);
+    SerializeCalib(calib, mPayload);
+    WriteChunk(CHUNK_CALIB, mPayload);
+
+    mWriter = std::thread(&SessionRecorder::RunWriter, this);
+    ATT_LOG_INFO("recording session to ", path.string());
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    {
+        const std::lock_guard lock(mMutex);
+        mStopping = true;
+    }
+    mFilledCond.notify_one();
+    if (mWriter.joinable()) mWriter.join();
+    if (IsOpen()) ATT_LOG_INFO("session recording ended, ", mRecordedFrames, " frames recorded, ", mDroppedFrames, " dropped");
+}
+
+bool SessionRecorder::Record(const cv::Mat& gray, utils::SteadyTimer::TimePoint captureTime, utils::SteadyTimer::TimePoint detectTime,
+                             const MarkerDetectionList& dets, std::span<const RecordedTracker> trackers)
+{
+    ATT_ASSERT(gray.type() == CV_8UC1);
+    const auto sendTime = utils::SteadyTimer::Now();
+    const std::int64_t index = mNextIndex++;
+    if (!IsOpen()) return false;
+    {
+        const std::lock_guard lock(mMutex);
+        if (mFilled - mWritten >= RING_SLOTS)
+        {
+            ++mDroppedFrames;
+            return false;
+        }
+    }
+    // only this thread moves mFilled, the writer does not touch the slot until it does
+    RecordedFrame& slot = mSlots[mFilled % RING_SLOTS];
+
+    const auto sinceStart = [this](utils::SteadyTimer::TimePoint time) {
+        return duration_cast<utils::NanoS>(time - mStart).count();
+    };
+    slot.index = index;
+    slot.captureTime = sinceStart(captureTime);
+    slot.detectTime = sinceStart(detectTime);
+    slot.sendTime = sinceStart(sendTime);
+    slot.imageSize = GetMatSize(gray);
+
+    slot.regions.clear();
+    if (!mRegionsOnly)
+    {
+        slot.regions.emplace_back(cv::Point(0, 0), slot.imageSize);
+    }
+    else
+    {
+        for (int marker = 0; marker < dets.Size(); ++marker)
+        {
+            const auto corners = dets.GetCorners(marker);
+            const double markerSize = cv::norm(corners[2] - corners[0]);
+            cv::Rect region = math::PaddedBoundingRect(corners, static_cast<int>(markerSize * REGION_MARGIN), slot.imageSize);
+            if (region.empty()) continue;
+            // overlapping regions are merged, so no pixel is stored twice
+            for (auto other = slot.regions.begin(); other != slot.regions.end();)
+            {
+                if ((region & *other).empty())
+                {
+                    ++other;
+                    continue;
+                }
+                region |= *other;
+                slot.regions.erase(other);
+                other = slot.regions.begin();
+            }
+            slot.regions.push_back(region);
+        }
+    }
+    slot.crops.resize(slot.regions.size());
+    for (std::size_t region = 0; region < slot.regions.size(); ++region)
+    {
+        gray(slot.regions[region]).copyTo(slot.crops[region]);
+    }
+
+    slot.ids.assign(dets.ids.begin(), dets.ids.end());
+    slot.corners.assign(dets.corners.begin(), dets.corners.end());
+    slot.trackers.assign(trackers.begin(), trackers.end());
+
+    {
+        const std::lock_guard lock(mMutex);
+        ++mFilled;
+    }
+    mFilledCond.notify_one();
+    ++mRecordedFrames;
+    return true;
+}
+
+std::filesystem::path SessionRecorder::GetDefaultPath()
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    return utils::GetRecordingsDir() / ("session_" + std::to_string(seconds.count()) + ".attrec");
+}
+
+void SessionRecorder::RunWriter()
+{
+    utils::RegisterThisThreadName("Session Recorder");
+    std::unique_lock lock(mMutex);
+    while (true)
+    {
+        mFilledCond.wait(lock, [this] { return mStopping || mWritten < mFilled; });
+        // every filled slot is written before stopping
+        if (mWritten == mFilled) return;
+        const RecordedFrame& frame = mSlots[mWritten % RING_SLOTS];
+        lock.unlock();
+        SerializeFrame(frame, mPayload);
+        WriteChunk(CHUNK_FRAME, mPayload);
+        lock.lock();
+        ++mWritten;
+    }
+}
+
+void SessionRecorder::WriteChunk(std::uint32_t type, const std::vector<std::uint8_t>& payload)
+{
+    uLongf compressedSize = compressBound(static_cast<uLong>(payload.size()));
+    mCompressed.resize(compressedSize);
+    if (compress2(mCompressed.data(), &compressedSize, payload.data(), static_cast<uLong>(payload.size()), COMPRESSION_LEVEL) != Z_OK)
+    {
+        ATT_LOG_ERROR("unable to compress session recording chunk");
+        return;
+    }
+    const std::array<std::uint32_t, 3> header{type, static_cast<std::uint32_t>(payload.size()), static_cast<std::uint32_t>(compressedSize)};
+    mFile.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+    mFile.write(reinterpret_cast<const char*>(mCompressed.data()), static_cast<std::streamsize>(compressedSize));
+    // a crash loses at most the chunks still in the ring
+    mFile.flush();
+}
+
+SessionReader::SessionReader(const std::filesystem::path& path)
+    : mFile(path, std::ios::binary)
+{
+    std::array<char, MAGIC.size()> magic{};
+    std::uint32_t version = 0;
+    mFile.read(magic.data(), magic.size());
+    mFile.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!mFile || magic != MAGIC) throw utils::MakeError("not a session recording: ", path.string());
+    if (version != FORMAT_VERSION) throw utils::MakeError("unsupported session recording version ", version, ": ", path.string());
+
+    std::uint32_t type = 0;
+    if (!ReadChunk(type) || type != CHUNK_CAMERA) throw utils::MakeError("session recording has no camera: ", path.string());
+    ByteReader reader(mPayload);
+    mCamera.cameraMatrix = GetMat(reader);
+    mCamera.distortionCoeffs = GetMat(reader);
+
+    if (!ReadChunk(type) || type != CHUNK_CALIB) throw utils::MakeError("session recording has no tracker calibration: ", path.string());
+    DeserializeCalib(mPayload, mCalib);
+}
+
+bool SessionReader::ReadFrame(RecordedFrame& outFrame)
+{
+    std::uint32_t type = 0;
+    while (ReadChunk(type))
+    {
+        // chunks this reader does not know are skipped
+        if (type != CHUNK_FRAME) continue;
+        DeserializeFrame(mPayload, outFrame);
+        return true;
+    }
+    return false;
+}
+
+bool SessionReader::ReadChunk(std::uint32_t& outType)
+{
+    std::array<std::uint32_t, 3> header{};
+    mFile.read(reinterpret_cast<char*>(header.data()), sizeof(header));
+    if (!mFile) return false;
+    const auto [type, size, compressedSize] = header;
+    if (size > MAX_CHUNK_SIZE || compressedSize > compressBound(MAX_CHUNK_SIZE))
+    {
+        ATT_LOG_ERROR("session recording chunk is corrupt");
+        return false;
+    }
+    mCompressed.resize(compressedSize);
+    mFile.read(reinterpret_cast<char*>(mCompressed.data()), compressedSize);
+    if (!mFile) return false;
+    mPayload.resize(size);
+    uLongf payloadSize = size;
+    if (uncompress(mPayload.data(), &payloadSize, mCompressed.data(), compressedSize) != Z_OK || payloadSize != size)
+    {
+        ATT_LOG_ERROR("session recording chunk is corrupt");
+        return false;
+    }
+    outType = type;
+    return true;
+}
+
+TEST_CASE("SessionRecorder writes frames a SessionReader reads back")
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "att_session_recorder_test.attrec";
+    cfg::CameraCalib camera;
+    camera.cameraMatrix = (cv::Mat_<double>(3, 3) << 600, 0, 320, 0, 610, 240, 0, 0, 1);
+    camera.distortionCoeffs = (cv::Mat_<double>(1, 5) << 0.1, -0.2, 0.001, 0.002, 0.05);
+
+    cv::Mat gray(120, 160, CV_8UC1);
+    cv::randu(gray, 0, 256);
+    MarkerDetectionList dets;
+    dets.ids = {3, 7};
+    dets.corners = {{10, 10}, {30, 10}, {30, 30}, {10, 30}, {100, 60}, {120, 60}, {120, 80}, {100, 80}};
+    RecordedTracker tracker;
+    tracker.flags = RecordedTracker::VISIBLE | RecordedTracker::SENT | RecordedTracker::DRIVER_ASKED;
+    tracker.confidence = 0.75;
+    tracker.estimatedPose = RodrPose(cv::Vec3d(0.1, -0.2, 1.5), math::RodriguesVec3d(cv::Vec3d(0.3, 0.1, -0.2)));
+    tracker.sentPose = Pose(cv::Point3d(1, 2, 3), cv::Quatd(0.5, 0.5, 0.5, 0.5));
+    const std::array<RecordedTracker, 1> trackers{tracker};
+    RecordedCalib calib;
+    calib.trackers.resize(2);
+    calib.trackers[0].ids = {3, 7};
+    calib.trackers[0].corners = {{{-1, 1, 0}, {1, 1, 0}, {1, -1, 0}, {-1, -1, 0}}, {{1, 1, 0}, {2, 1, -1}, {2, -1, -1}, {1, -1, 0}}};
+    calib.recenterMarkers = true;
+    calib.playspace = {cv::Vec3d(0.1, 1, 1.5), cv::Vec3d(3, 0.2, 0), 1.05};
+
+    const auto start = utils::SteadyTimer::Now();
+    {
+        SessionRecorder recorder(path, camera, calib, false);
+        REQUIRE(recorder.IsOpen());
+        for (int frame = 0; frame < 3; ++frame)
+        {
+            CHECK(recorder.Record(gray, start, start + std::chrono::milliseconds(5), dets, trackers));
+        }
+    }
+
+    {
+        SessionReader reader(path);
+        CHECK(cv::norm(reader.GetCamera().cameraMatrix, camera.cameraMatrix, cv::NORM_INF) == 0);
+        CHECK(cv::norm(reader.GetCamera().distortionCoeffs, camera.distortionCoeffs, cv::NORM_INF) == 0);
+        REQUIRE(reader.GetCalib().trackers.size() == 2);
+        CHECK(reader.GetCalib().trackers[0].ids == calib.trackers[0].ids);
+        CHECK(reader.GetCalib().trackers[0].corners == calib.trackers[0].corners);
+        CHECK(reader.GetCalib().trackers[1].ids.empty());
+        CHECK(reader.GetCalib().trackers[1].corners.empty());
+        CHECK(reader.GetCalib().recenterMarkers);
+        CHECK(reader.GetCalib().playspace.posOffset == calib.playspace.posOffset);
+        CHECK(reader.GetCalib().playspace.angleOffset == calib.playspace.angleOffset);
+        CHECK(reader.GetCalib().playspace.scale == calib.playspace.scale);
+        RecordedFrame frame;
+        for (int index = 0; index < 3; ++index)
+        {
+            REQUIRE(reader.ReadFrame(frame));
+            CHECK(frame.index == index);
+            CHECK(frame.detectTime - frame.captureTime == 5'000'000);
+            CHECK(frame.sendTime >= frame.captureTime);
+            cv::Mat image;
+            frame.DrawImage(image);
+            CHECK(cv::norm(image, gray, cv::NORM_INF) == 0);
+            CHECK(frame.ids == dets.ids);
+            CHECK(frame.corners == dets.corners);
+            REQUIRE(frame.trackers.size() == 1);
+            CHECK(frame.trackers[0].flags == tracker.flags);
+            CHECK(frame.trackers[0].confidence == tracker.confidence);
+            CHECK(frame.trackers[0].estimatedPose.position == tracker.estimatedPose.position);
+            CHECK(frame.trackers[0].estimatedPose.rotation.value == tracker.estimatedPose.rotation.value);
+            CHECK(frame.trackers[0].sentPose.rotation == tracker.sentPose.rotation);
+        }
+        CHECK_NOT(reader.ReadFrame(frame));
+    }
+
+    // only the pixels around markers, nothing when there are none
+    {
+        SessionRecorder recorder(path, camera, calib, true);
+        CHECK(recorder.Record(gray, start, start, dets, trackers));
+        CHECK(recorder.Record(gray, start, start, MarkerDetectionList{}, trackers));
+    }
+    {
+        SessionReader reader(path);
+        RecordedFrame frame;
+        REQUIRE(reader.ReadFrame(frame));
+        CHECK(frame.regions.size() == 2);
+        cv::Mat image;
+        frame.DrawImage(image);
+        for (const cv::Rect& region : frame.regions)
+        {
+            CHECK(cv::norm(image(region), gray(region), cv::NORM_INF) == 0);
+        }
+        CHECK(image.at<std::uint8_t>(100, 10) == 0);
+        REQUIRE(reader.ReadFrame(frame));
+        CHECK(frame.regions.empty());
+        CHECK_NOT(reader.ReadFrame(frame));
+    }
+
+    // a recording cut off mid chunk reads up to the last whole chunk
+    const auto fullSize = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, fullSize - 10);
+    {
+        SessionReader reader(path);
+        RecordedFrame frame;
+        CHECK(reader.ReadFrame(frame));
+        CHECK_NOT(reader.ReadFrame(frame));
+    }
+    std::filesystem::remove(path);
+}
+
+} // namespace tracker
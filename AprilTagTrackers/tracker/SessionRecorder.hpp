@@ -0,0 +1,168 @@
+#pragma once
+
+#include "AprilTagWrapper.hpp"
+#include "config/ManualCalib.hpp"
+#include "config/VideoStream.hpp"
+#include "Helpers.hpp"
+#include "utils/SteadyTimer.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace tracker
+{
+
+/// one tracker in one recorded frame
+struct RecordedTracker
+{
+    static constexpr std::uint8_t VISIBLE = 1;
+    /// the driver was asked and answered with driverPose this frame
+    static constexpr std::uint8_t VISIBLE_TO_DRIVER = 2;
+    /// sentPose was sent to the driver this frame
+    static constexpr std::uint8_t SENT = 4;
+    /// the driver was asked this frame, otherwise the pose was predicted locally
+    static constexpr std::uint8_t DRIVER_ASKED = 8;
+
+    std::uint8_t flags = 0;
+    double confidence = 0;
+    /// last pose the driver answered with, in camera space, never a local prediction
+    RodrPose driverPose{};
+    /// pose estimated from the markers, in camera space
+    RodrPose estimatedPose{};
+    /// pose sent to the driver, in steamvr space
+    Pose sentPose = Pose::Ident();
+};
+
+/// markers of one tracker, like cfg::TrackerUnitCalib
+struct RecordedBoard
+{
+    std::vector<int> ids;
+    std::vector<std::vector<cv::Point3f>> corners;
+};
+
+/// calibration the poses of a recording were estimated with, besides the camera,
+/// so a replay does not depend on the calibration of the machine replaying it
+struct RecordedCalib
+{
+    std::vector<RecordedBoard> trackers;
+    /// config trackerCalibCenters, the markers of each tracker are centered on the tracker
+    bool recenterMarkers = false;
+    /// sets the scale the markers were estimated at, and the steamvr space of sent poses
+    cfg::ManualCalib::Real playspace{};
+};
+
+/// everything the tracker saw and did in one frame
+struct RecordedFrame
+{
+    std::int64_t index = 0;
+    /// nanoseconds since the recording started, when the camera captured the frame,
+    /// when its markers were detected, and when its poses were sent
+    std::int64_t captureTime = 0;
+    std::int64_t detectTime = 0;
+    std::int64_t sendTime = 0;
+    cv::Size imageSize{};
+    /// regions of the grayscale frame kept, the whole frame unless only the regions around markers are recorded
+    std::vector<cv::Rect> regions;
+    /// grayscale pixels of each region
+    std::vector<cv::Mat> crops;
+    std::vector<int> ids;
+    /// 4 corners per marker, like MarkerDetectionList
+    std::vector<cv::Point2f> corners;
+    std::vector<RecordedTracker> trackers;
+
+    /// paste the recorded regions onto a black frame
+    void DrawImage(cv::Mat& outGray) const;
+};
+
+/// Writes what the tracker saw while tracking to a file, for debugging it afterwards.
+/// The tracking thread only copies a frame into a ring of preallocated slots, a writer thread compresses and writes it.
+/// The file is a header followed by chunks, each compressed on its own, a file cut off by a crash reads up to its last chunk.
+/// If the writer falls behind the ring fills up and frames are dropped, tracking never waits for the disk.
+class SessionRecorder
+{
+public:
+    /// frames the tracking thread may be ahead of the writer
+    static constexpr int RING_SLOTS = 8;
+    /// zlib level, fast is enough for grayscale frames, the writer has to keep up with the camera
+    static constexpr int COMPRESSION_LEVEL = 1;
+    /// kept around each marker when only regions are recorded, in marker sizes
+    static constexpr double REGION_MARGIN = 0.5;
+
+    /// @param regionsOnly keep only the pixels around detected markers, a fraction of the size of whole frames
+    SessionRecorder(const std::filesystem::path& path, const cfg::CameraCalib& camera, const RecordedCalib& calib, bool regionsOnly);
+    /// writes every frame still in the ring
+    ~SessionRecorder();
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool IsOpen() const { return mFile.is_open(); }
+    int GetRecordedFrames() const { return mRecordedFrames; }
+    int GetDroppedFrames() const { return mDroppedFrames; }
+
+    /// copy one frame into the ring, whole frames do not allocate once every slot has grown to the frame size
+    /// @return false if the writer fell behind and the frame was dropped
+    bool Record(const cv::Mat& gray, utils::SteadyTimer::TimePoint captureTime, utils::SteadyTimer::TimePoint detectTime,
+                const MarkerDetectionList& dets, std::span<const RecordedTracker> trackers);
+
+    /// default path of a new recording, named after the time it started
+    static std::filesystem::path GetDefaultPath();
+
+private:
+    void RunWriter();
+    void WriteChunk(std::uint32_t type, const std::vector<std::uint8_t>& payload);
+
+    std::ofstream mFile;
+    bool mRegionsOnly;
+    utils::SteadyTimer::TimePoint mStart = utils::SteadyTimer::Now();
+    std::int64_t mNextIndex = 0;
+    int mRecordedFrames = 0;
+    int mDroppedFrames = 0;
+
+    std::array<RecordedFrame, RING_SLOTS> mSlots{};
+    /// slots written by the writer, and filled by the tracking thread, slot n is mSlots[n % RING_SLOTS]
+    std::int64_t mWritten = 0;
+    std::int64_t mFilled = 0;
+    bool mStopping = false;
+    std::mutex mMutex;
+    std::condition_variable mFilledCond;
+    std::thread mWriter;
+
+    /// owned by the writer thread
+    std::vector<std::uint8_t> mPayload;
+    std::vector<std::uint8_t> mCompressed;
+};
+
+/// Reads a recording of SessionRecorder frame by frame.
+class SessionReader
+{
+public:
+    /// throws utils::Error if the file is not a recording
+    explicit SessionReader(const std::filesystem::path& path);
+
+    /// camera calibration the session was recorded with
+    const cfg::CameraCalib& GetCamera() const { return mCamera; }
+    /// tracker and playspace calibration the session was recorded with
+    const RecordedCalib& GetCalib() const { return mCalib; }
+    /// @return false once every frame was read, or at a chunk cut off when the recording ended unexpectedly
+    bool ReadFrame(RecordedFrame& outFrame);
+
+private:
+    bool ReadChunk(std::uint32_t& outType);
+
+    std::ifstream mFile;
+    cfg::CameraCalib mCamera{};
+    RecordedCalib mCalib{};
+    std::vector<std::uint8_t> mPayload;
+    std::vector<std::uint8_t> mCompressed;
+};
+
+} // namespace tracker
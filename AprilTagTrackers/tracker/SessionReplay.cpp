@@ -0,0 +1,454 @@
+#include "SessionReplay.hpp"
+
+#include "math/CVHelpers.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Env.hpp"
+#include "utils/Log.hpp"
+#include "utils/Test.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <sstream>
+
+namespace tracker
+{
+
+namespace
+{
+
+/// shortest text that parses back to the same value, so replayed poses are not rounded like the driver protocol does
+void AppendNumber(std::string& out, double value)
+{
+    std::array<char, 32> buffer{};
+    const auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    ATT_ASSERT(ec == std::errc());
+    out += ' ';
+    out.append(buffer.data(), end);
+}
+
+/// pop the next space separated token from the front of rest
+std::string_view NextToken(std::string_view& rest)
+{
+    const auto begin = std::min(rest.find_first_not_of(' '), rest.size());
+    const auto end = std::min(rest.find(' ', begin), rest.size());
+    const std::string_view token = rest.substr(begin, end - begin);
+    rest.remove_prefix(end);
+    return token;
+}
+
+template <typename T>
+bool ParseNumber(std::string_view& rest, T& out)
+{
+    const std::string_view token = NextToken(rest);
+    const auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+    return !token.empty() && ec == std::errc() && end == token.data() + token.size();
+}
+
+/// frames on each side of an estimate that its reference is the mean of
+constexpr int REFERENCE_HALF_WINDOW = 5;
+/// m/s, slower is still, for jitter, faster is moving, for lag, in between is neither
+constexpr double STILL_SPEED = 0.1;
+constexpr double MOVING_SPEED = 0.5;
+
+/// cutoffs around the defaults, depth cutoff half of the lateral one like the defaults
+constexpr std::array<math::OneEuroFilter::Settings, 12> FILTER_SETTINGS{{
+    {0.5, 0.25, 0},
+    {0.5, 0.25, 1},
+    {0.5, 0.25, 2},
+    {0.5, 0.25, 4},
+    {1, 0.5, 0},
+    {1, 0.5, 1},
+    {1, 0.5, 2},
+    {1, 0.5, 4},
+    {2, 1, 0},
+    {2, 1, 1},
+    {2, 1, 2},
+    {2, 1, 4},
+}};
+
+} // namespace
+
+ReplayDriverClient::ReplayDriverClient(int trackerCount)
+    : mDriverPoses(trackerCount), mSentPoses(trackerCount), mHasRecordedReply(trackerCount, false)
+{
+    constexpr size_t responseCapacity = 256;
+    mResponse.reserve(responseCapacity);
+}
+
+void ReplayDriverClient::BeginFrame(const RecordedFrame& frame, const PlayspaceCalib& playspace)
+{
+    ATT_ASSERT(frame.trackers.size() == mDriverPoses.size(), "recorded frame has a different number of trackers");
+    for (size_t i = 0; i < mDriverPoses.size(); ++i)
+    {
+        const RecordedTracker& tracker = frame.trackers[i];
+        mSentPoses[i].reset();
+        mHasRecordedReply[i] = (tracker.flags & RecordedTracker::DRIVER_ASKED) != 0;
+        if (!mHasRecordedReply[i]) continue;
+        mDriverPoses[i].reset();
+        if (tracker.flags & RecordedTracker::VISIBLE_TO_DRIVER)
+        {
+            mDriverPoses[i] = playspace.TransformToOVR(Pose(tracker.driverPose));
+        }
+    }
+}
+
+std::string_view ReplayDriverClient::SendRecv(const std::string& message)
+{
+    std::string_view rest = message;
+    const std::string_view name = NextToken(rest);
+    const int trackerCount = static_cast<int>(mDriverPoses.size());
+    mResponse.clear();
+
+    if (name == "numtrackers")
+    {
+        mResponse += " numtrackers ";
+        mResponse += std::to_string(trackerCount);
+        mResponse += ' ';
+        mResponse += utils::GetBridgeDriverVersion().ToString();
+    }
+    else if (name == "addtracker" || name == "addstation")
+    {
+        mResponse = " added";
+    }
+    else if (name == "updatestation")
+    {
+        mResponse = " updated";
+    }
+    else if (name == "settings")
+    {
+        mResponse = " changed";
+    }
+    else if (name == "gettrackerpose")
+    {
+        int id = -1;
+        if (!ParseNumber(rest, id) || id < 0 || id >= trackerCount) return mResponse = " idinvalid";
+        const Pose pose = mDriverPoses[id].value_or(Pose::Ident());
+        mResponse += " trackerpose ";
+        mResponse += std::to_string(id);
+        AppendNumber(mResponse, pose.position.x);
+        AppendNumber(mResponse, pose.position.y);
+        AppendNumber(mResponse, pose.position.z);
+        AppendNumber(mResponse, pose.rotation.w);
+        AppendNumber(mResponse, pose.rotation.x);
+        AppendNumber(mResponse, pose.rotation.y);
+        AppendNumber(mResponse, pose.rotation.z);
+        mResponse += mDriverPoses[id] ? " 0" : " -1";
+    }
+    else if (name == "updatepose")
+    {
+        int id = -1;
+        Pose pose = Pose::Ident();
+        if (!ParseNumber(rest, id) || id < 0 || id >= trackerCount) return mResponse = " idinvalid";
+        if (!ParseNumber(rest, pose.position.x) || !ParseNumber(rest, pose.position.y) || !ParseNumber(rest, pose.position.z) ||
+            !ParseNumber(rest, pose.rotation.w) || !ParseNumber(rest, pose.rotation.x) || !ParseNumber(rest, pose.rotation.y) ||
+            !ParseNumber(rest, pose.rotation.z))
+        {
+            return mResponse = " invalid";
+        }
+        mSentPoses[id] = pose;
+        mResponse = " updated";
+    }
+    else
+    {
+        mResponse = " invalid";
+    }
+    return mResponse;
+}
+
+void ReplayMetrics::AddPoseError(const RodrPose& replayed, const RodrPose& recorded)
+{
+    mPositionErrors.push_back(PositionError(replayed.position, recorded.position));
+    mRotationErrors.push_back(RotationError(math::QuatFromRvec(replayed.rotation.value), math::QuatFromRvec(recorded.rotation.value)));
+}
+
+void ReplayMetrics::AddFrameTimes(std::span<const utils::NanoS> stageTimes)
+{
+    using Millis = std::chrono::duration<double, std::milli>;
+    mStageTimes.resize(stageTimes.size());
+    Millis total{0};
+    for (size_t stage = 0; stage < stageTimes.size(); ++stage)
+    {
+        const Millis time = stageTimes[stage];
+        mStageTimes[stage].push_back(time.count());
+        total += time;
+    }
+    mFrameTimes.push_back(total.count());
+}
+
+void ReplayMetrics::AddEstimate(int tracker, utils::SteadyTimer::TimePoint time, const Pose& pose)
+{
+    if (tracker >= static_cast<int>(mEstimates.size())) mEstimates.resize(tracker + 1);
+    mEstimates[tracker].push_back({time, pose});
+}
+
+std::vector<ReplayMetrics::FilterReport> ReplayMetrics::ReportFilters(std::span<const math::OneEuroFilter::Settings> settings) const
+{
+    const auto seconds = [](utils::SteadyTimer::TimePoint from, utils::SteadyTimer::TimePoint to)
+    { return duration_cast<utils::FSeconds>(to - from).count(); };
+    const auto windowMean = [](auto&& positionAt, int center)
+    {
+        cv::Vec3d sum{};
+        for (int i = center - REFERENCE_HALF_WINDOW; i <= center + REFERENCE_HALF_WINDOW; ++i) sum += positionAt(i);
+        return sum / (2 * REFERENCE_HALF_WINDOW + 1);
+    };
+
+    std::vector<FilterReport> reports;
+    std::vector<cv::Vec3d> filtered;
+    for (const math::OneEuroFilter::Settings& setting : settings)
+    {
+        FilterReport& report = reports.emplace_back();
+        report.settings = setting;
+        double lagAlongVelocity = 0;
+        double squaredSpeed = 0;
+        for (const std::vector<Estimate>& estimates : mEstimates)
+        {
+            math::OneEuroFilter filter;
+            filtered.clear();
+            for (const Estimate& estimate : estimates)
+            {
+                filtered.push_back(math::ToVec(filter.Filter(estimate.pose, estimate.time, setting).position));
+            }
+            const auto estimatedAt = [&](int i) { return math::ToVec(estimates[i].pose.position); };
+            const auto filteredAt = [&](int i) { return filtered[i]; };
+
+            const auto count = static_cast<int>(estimates.size());
+            // first estimate after the last gap, where the filter restarted
+            int segmentStart = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                if (i > 0 && seconds(estimates[i - 1].time, estimates[i].time) > math::OneEuroFilter::MAX_GAP) segmentStart = i;
+                if (i - segmentStart < REFERENCE_HALF_WINDOW || i + REFERENCE_HALF_WINDOW >= count) continue;
+                // the window must not reach over the next gap either
+                bool hasGap = false;
+                for (int next = i + 1; next <= i + REFERENCE_HALF_WINDOW; ++next)
+                {
+                    hasGap = hasGap || seconds(estimates[next - 1].time, estimates[next].time) > math::OneEuroFilter::MAX_GAP;
+                }
+                if (hasGap) continue;
+
+                // velocity between the means of both halves of the window
+                cv::Vec3d before{};
+                cv::Vec3d after{};
+                for (int offset = 1; offset <= REFERENCE_HALF_WINDOW; ++offset)
+                {
+                    before += estimatedAt(i - offset);
+                    after += estimatedAt(i + offset);
+                }
+                const double meanSeconds = seconds(estimates[i - REFERENCE_HALF_WINDOW].time, estimates[i + REFERENCE_HALF_WINDOW].time) *
+                                           (REFERENCE_HALF_WINDOW + 1) / (2 * REFERENCE_HALF_WINDOW);
+                const cv::Vec3d velocity = (after - before) / REFERENCE_HALF_WINDOW / meanSeconds;
+                const double speed = cv::norm(velocity);
+
+                if (speed < STILL_SPEED)
+                {
+                    // the estimates are too noisy to tell jitter from, so the filtered poses are compared with their own mean
+                    const cv::Vec3d error = filtered[i] - windowMean(filteredAt, i);
+                    report.lateralJitter += (error[X] * error[X] + error[Y] * error[Y]) / 2;
+                    report.depthJitter += error[Z] * error[Z];
+                    ++report.stillFrames;
+                }
+                else if (speed > MOVING_SPEED)
+                {
+                    // lag seconds behind, the filtered pose is lag * velocity behind the estimates, which the mean does not lag in a steady motion
+                    lagAlongVelocity += (windowMean(estimatedAt, i) - filtered[i]).dot(velocity);
+                    squaredSpeed += speed * speed;
+                    ++report.movingFrames;
+                }
+            }
+        }
+        constexpr double thousand = 1000;
+        if (report.stillFrames > 0)
+        {
+            report.lateralJitter = std::sqrt(report.lateralJitter / report.stillFrames) * thousand;
+            report.depthJitter = std::sqrt(report.depthJitter / report.stillFrames) * thousand;
+        }
+        if (squaredSpeed > 0) report.lag = lagAlongVelocity / squaredSpeed * thousand;
+    }
+    return reports;
+}
+
+void ReplayMetrics::Log(std::span<const std::string_view> stageNames, double recordedSeconds, double replaySeconds) const
+{
+    const auto formatPercentiles = [](const std::vector<double>& values)
+    {
+        std::ostringstream out;
+        out.precision(3);
+        out << std::fixed << "p50 " << Percentile(values, 0.5) << " p95 " << Percentile(values, 0.95)
+            << " p99 " << Percentile(values, 0.99) << " max " << Percentile(values, 1);
+        return out.str();
+    };
+
+    ATT_LOG_INFO("replayed ", mFrameTimes.size(), " frames in ", replaySeconds, "s, recorded in ", recordedSeconds, "s, ",
+                 replaySeconds > 0 ? recordedSeconds / replaySeconds : 0, "x real time");
+    ATT_LOG_INFO("position error mm: ", formatPercentiles(mPositionErrors), " over ", mPositionErrors.size(), " poses, ",
+                 mPredictedPoses, " predicted poses left out");
+    ATT_LOG_INFO("rotation error deg: ", formatPercentiles(mRotationErrors));
+    ATT_LOG_INFO("visibility mismatches: ", mVisibilityMismatches);
+    ATT_LOG_INFO("frame ms: ", formatPercentiles(mFrameTimes));
+    for (size_t stage = 0; stage < mStageTimes.size() && stage < stageNames.size(); ++stage)
+    {
+        ATT_LOG_INFO(stageNames[stage], " ms: ", formatPercentiles(mStageTimes[stage]));
+    }
+
+    if (mEstimates.empty()) return;
+    const std::vector<FilterReport> reports = ReportFilters(FILTER_SETTINGS);
+    ATT_LOG_INFO("one euro filter over ", reports.front().stillFrames, " still and ", reports.front().movingFrames, " moving frames:");
+    const math::OneEuroFilter::Settings defaults{};
+    for (const FilterReport& report : reports)
+    {
+        const bool isDefault = report.settings.minCutoff == defaults.minCutoff && report.settings.depthMinCutoff == defaults.depthMinCutoff &&
+                               report.settings.speedCoeff == defaults.speedCoeff;
+        std::ostringstream out;
+        out.precision(2);
+        out << std::fixed << "min cutoff " << report.settings.minCutoff << " Hz, depth " << report.settings.depthMinCutoff
+            << " Hz, speed coeff " << report.settings.speedCoeff << (isDefault ? " (default)" : "") << ": lateral jitter "
+            << report.lateralJitter << " mm, depth jitter " << report.depthJitter << " mm, lag " << report.lag << " ms";
+        ATT_LOG_INFO(out.str());
+    }
+}
+
+double ReplayMetrics::Percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty()) return 0;
+    const double rank = std::ceil(fraction * static_cast<double>(values.size()));
+    const auto index = static_cast<std::ptrdiff_t>(std::clamp(rank - 1, 0.0, static_cast<double>(values.size() - 1)));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+double ReplayMetrics::PositionError(const cv::Vec3d& lhs, const cv::Vec3d& rhs)
+{
+    constexpr double millimeters = 1000;
+    return cv::norm(lhs - rhs) * millimeters;
+}
+
+double ReplayMetrics::RotationError(const cv::Quatd& lhs, const cv::Quatd& rhs)
+{
+    // q and -q are the same rotation
+    const double dot = std::abs(lhs.w * rhs.w + lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z);
+    return 2 * std::acos(std::min(dot, 1.0)) * 180 / std::numbers::pi;
+}
+
+TEST_CASE("ReplayMetrics")
+{
+    CHECK(ReplayMetrics::Percentile({}, 0.5) == 0);
+    CHECK(ReplayMetrics::Percentile({5, 1, 4, 2, 3}, 0.5) == 3);
+    CHECK(ReplayMetrics::Percentile({5, 1, 4, 2, 3}, 0.95) == 5);
+    CHECK(ReplayMetrics::Percentile({5, 1, 4, 2, 3}, 0) == 1);
+    CHECK(ReplayMetrics::Percentile({5, 1, 4, 2, 3}, 1) == 5);
+
+    CHECK(std::abs(ReplayMetrics::PositionError(cv::Vec3d(0, 0, 1), cv::Vec3d(0, 0.003, 1.004)) - 5) < 1e-9);
+    const cv::Quatd ident(1, 0, 0, 0);
+    CHECK(ReplayMetrics::RotationError(ident, ident) == 0);
+    CHECK(std::abs(ReplayMetrics::RotationError(ident, cv::Quatd::createFromYRot(std::numbers::pi / 2)) - 90) < 1e-9);
+    CHECK(std::abs(ReplayMetrics::RotationError(ident, -cv::Quatd::createFromYRot(0.1)) - 0.1 * 180 / std::numbers::pi) < 1e-9);
+}
+
+TEST_CASE("ReplayMetrics reports the lag and jitter of the one euro filter")
+{
+    ReplayMetrics metrics;
+    constexpr double frameTime = 1.0 / 60;
+    constexpr double moveStart = 3;
+    cv::RNG rng{5};
+    for (int frame = 0; frame < 360; ++frame)
+    {
+        // a dropped frame is not a gap
+        if (frame == 100) continue;
+        // still, then moving sideways at 1 m/s, with lateral and depth noise like a camera 2 m away
+        const double time = frame * frameTime;
+        const cv::Point3d estimated{(time > moveStart ? time - moveStart : 0) + rng.gaussian(0.002), rng.gaussian(0.002), 2 + rng.gaussian(0.006)};
+        const auto timestamp = utils::SteadyTimer::TimePoint{} + duration_cast<utils::NanoS>(utils::FSeconds(time));
+        metrics.AddEstimate(0, timestamp, Pose(estimated, cv::Quatd(1, 0, 0, 0)));
+    }
+
+    const std::array<math::OneEuroFilter::Settings, 4> settings{{{1, 0.5, 0}, {0.5, 0.25, 2}, {1, 0.5, 2}, {4, 2, 2}}};
+    const std::vector<ReplayMetrics::FilterReport> reports = metrics.ReportFilters(settings);
+    REQUIRE(reports.size() == settings.size());
+    for (const ReplayMetrics::FilterReport& report : reports)
+    {
+        CAPTURE(report.settings.minCutoff);
+        CAPTURE(report.settings.speedCoeff);
+        CHECK(report.stillFrames > 150);
+        CHECK(report.movingFrames > 150);
+        CHECK(report.lag > 0);
+    }
+    // adapting to speed lags far less than a fixed cutoff
+    CHECK(reports[2].lag < reports[0].lag / 2);
+    // a higher cutoff is less steady, and lags less
+    CHECK(reports[1].lateralJitter < reports[2].lateralJitter);
+    CHECK(reports[2].lateralJitter < reports[3].lateralJitter);
+    CHECK(reports[1].depthJitter < reports[2].depthJitter);
+    CHECK(reports[2].depthJitter < reports[3].depthJitter);
+    CHECK(reports[3].lag < reports[2].lag);
+    CHECK(reports[2].lag < reports[1].lag);
+}
+
+TEST_CASE("ReplayDriverClient answers with the recorded frame")
+{
+    ReplayDriverClient client(2);
+    PlayspaceCalib playspace;
+    playspace.Set(cv::Vec3d(0.5, 0, -1), cv::Vec3d(0, 0.3, 0), 1);
+
+    RecordedFrame frame;
+    frame.trackers.resize(2);
+    frame.trackers[0].flags = RecordedTracker::VISIBLE_TO_DRIVER | RecordedTracker::DRIVER_ASKED;
+    frame.trackers[1].flags = RecordedTracker::DRIVER_ASKED;
+    frame.trackers[0].driverPose = RodrPose(cv::Vec3d(0.1, -0.2, 1.5), math::RodriguesVec3d(cv::Vec3d(0.3, 0.1, -0.2)));
+    client.BeginFrame(frame, playspace);
+
+    std::string_view rest = client.SendRecv(" numtrackers");
+    CHECK(NextToken(rest) == "numtrackers");
+    CHECK(NextToken(rest) == "2");
+    CHECK(NextToken(rest) == utils::GetBridgeDriverVersion().ToString());
+    CHECK(client.SendRecv(" addtracker ApriltagTracker0 TrackerRole_Waist") == " added");
+    CHECK(client.SendRecv(" settings 120 0.5 0.5") == " changed");
+    CHECK(client.SendRecv(" gettrackerpose 2 0") == " idinvalid");
+
+    const Pose expected = playspace.TransformToOVR(Pose(frame.trackers[0].driverPose));
+    rest = client.SendRecv(" gettrackerpose 0 -0.03");
+    int id = -1;
+    Pose pose = Pose::Ident();
+    int status = -1;
+    CHECK(NextToken(rest) == "trackerpose");
+    REQUIRE(ParseNumber(rest, id));
+    REQUIRE((ParseNumber(rest, pose.position.x) && ParseNumber(rest, pose.position.y) && ParseNumber(rest, pose.position.z)));
+    REQUIRE((ParseNumber(rest, pose.rotation.w) && ParseNumber(rest, pose.rotation.x) && ParseNumber(rest, pose.rotation.y) && ParseNumber(rest, pose.rotation.z)));
+    REQUIRE(ParseNumber(rest, status));
+    CHECK(id == 0);
+    CHECK(pose.position == expected.position);
+    CHECK(pose.rotation == expected.rotation);
+    CHECK(status == 0);
+
+    rest = client.SendRecv(" gettrackerpose 1 0");
+    CHECK(NextToken(rest) == "trackerpose");
+    CHECK(rest.ends_with(" -1"));
+
+    CHECK_NOT(client.GetSentPose(1).has_value());
+    CHECK(client.SendRecv(" updatepose 1 0.500000 1.000000 -2.000000 1.000000 0.000000 0.000000 0.000000 -0.010000 0.500000 1.000000") == " updated");
+    REQUIRE(client.GetSentPose(1).has_value());
+    CHECK(client.GetSentPose(1)->position == cv::Point3d(0.5, 1, -2));
+
+    client.BeginFrame(frame, playspace);
+    CHECK_NOT(client.GetSentPose(1).has_value());
+    CHECK(client.HasRecordedReply(0));
+
+    // predicted in the recording, the last reply is repeated, but not taken as the driver's
+    RecordedFrame predicted;
+    predicted.trackers.resize(2);
+    predicted.trackers[0].flags = RecordedTracker::VISIBLE;
+    predicted.trackers[0].driverPose = RodrPose(cv::Vec3d(9, 9, 9), math::RodriguesVec3d(cv::Vec3d(0, 0, 0)));
+    client.BeginFrame(predicted, playspace);
+    CHECK_NOT(client.HasRecordedReply(0));
+    rest = client.SendRecv(" gettrackerpose 0 0");
+    CHECK(NextToken(rest) == "trackerpose");
+    REQUIRE(ParseNumber(rest, id));
+    REQUIRE((ParseNumber(rest, pose.position.x) && ParseNumber(rest, pose.position.y) && ParseNumber(rest, pose.position.z)));
+    CHECK(pose.position == expected.position);
+    CHECK(rest.ends_with(" 0"));
+}
+
+} // namespace tracker
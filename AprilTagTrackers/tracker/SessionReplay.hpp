@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Helpers.hpp"
+#include "IPC/IPC.hpp"
+#include "PlayspaceCalib.hpp"
+#include "SessionRecorder.hpp"
+#include "math/OneEuroFilter.hpp"
+#include "utils/SteadyTimer.hpp"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tracker
+{
+
+/// Stands in for the driver while a recorded session is replayed, like MockOpenVRClient does for steamvr.
+/// Pose queries are answered with the driver poses recorded for the current frame,
+/// and the poses the tracker sends are kept to compare against the recording.
+/// Where the recording predicted a tracker locally, there is no reply for the frame, so the last recorded one is repeated.
+class ReplayDriverClient final : public IPC::IClient
+{
+public:
+    explicit ReplayDriverClient(int trackerCount);
+
+    /// answer with the driver poses of frame, which were recorded in camera space, from now on
+    void BeginFrame(const RecordedFrame& frame, const PlayspaceCalib& playspace);
+    /// pose sent for tracker id since BeginFrame
+    const std::optional<Pose>& GetSentPose(int id) const { return mSentPoses[id]; }
+    /// the recording asked the driver for tracker id this frame, so its reply is the one the driver gave
+    bool HasRecordedReply(int id) const { return mHasRecordedReply[id]; }
+
+    std::string_view SendRecv(const std::string& message) final;
+
+private:
+    /// last recorded reply per tracker, kept over frames without one
+    std::vector<std::optional<Pose>> mDriverPoses;
+    std::vector<std::optional<Pose>> mSentPoses;
+    std::vector<bool> mHasRecordedReply;
+    std::string mResponse;
+};
+
+/// Accuracy of a replay against the recording it replays, and how long its frames took.
+class ReplayMetrics
+{
+public:
+    /// one tracker in one frame, estimated in both the recording and the replay
+    void AddPoseError(const RodrPose& replayed, const RodrPose& recorded);
+    /// one tracker in one frame, visible in only one of the recording and the replay
+    void AddVisibilityMismatch() { ++mVisibilityMismatches; }
+    /// one tracker in one frame predicted locally by the recording or the replay, its error is left out of the percentiles,
+    /// as the guess it started from was the app's own extrapolation and not the driver
+    void AddPredictedPose() { ++mPredictedPoses; }
+    void AddFrameTimes(std::span<const utils::NanoS> stageTimes);
+    /// one tracker in one frame, visible in the replay, its estimate before smoothing in camera space
+    void AddEstimate(int tracker, utils::SteadyTimer::TimePoint time, const Pose& pose);
+
+    /// millimeters
+    const std::vector<double>& GetPositionErrors() const { return mPositionErrors; }
+    /// degrees
+    const std::vector<double>& GetRotationErrors() const { return mRotationErrors; }
+    /// milliseconds, every stage of a frame
+    const std::vector<double>& GetFrameTimes() const { return mFrameTimes; }
+    int GetVisibilityMismatches() const { return mVisibilityMismatches; }
+    int GetPredictedPoses() const { return mPredictedPoses; }
+
+    /// How the one euro filter would have smoothed the estimates of the replay, to choose its settings on real recordings.
+    /// There is no ground truth, so poses are compared with their centered mean over a few frames,
+    /// which does not lag in a steady motion.
+    struct FilterReport
+    {
+        math::OneEuroFilter::Settings settings;
+        /// root mean square distance of the filtered poses from their centered mean while still, in millimeters
+        double lateralJitter = 0;
+        double depthJitter = 0;
+        /// delay behind the centered mean of the estimates while moving, in milliseconds, least squares over every moving frame
+        double lag = 0;
+        int stillFrames = 0;
+        int movingFrames = 0;
+    };
+    /// filter the estimates of every tracker with each of settings, a tracker restarts its filter after a gap like the main loop does
+    std::vector<FilterReport> ReportFilters(std::span<const math::OneEuroFilter::Settings> settings) const;
+
+    /// @param recordedSeconds duration of the recording, to tell how much faster than real time it replayed
+    void Log(std::span<const std::string_view> stageNames, double recordedSeconds, double replaySeconds) const;
+
+    /// nearest rank percentile, 0 without values
+    /// @param fraction 0.5 for the median
+    static double Percentile(std::vector<double> values, double fraction);
+    /// millimeters and degrees
+    static double PositionError(const cv::Vec3d& lhs, const cv::Vec3d& rhs);
+    static double RotationError(const cv::Quatd& lhs, const cv::Quatd& rhs);
+
+private:
+    std::vector<double> mPositionErrors;
+    std::vector<double> mRotationErrors;
+    int mVisibilityMismatches = 0;
+    int mPredictedPoses = 0;
+    std::vector<double> mFrameTimes;
+    /// milliseconds, a list per stage
+    std::vector<std::vector<double>> mStageTimes;
+    struct Estimate
+    {
+        utils::SteadyTimer::TimePoint time;
+        Pose pose;
+    };
+    /// a list per tracker
+    std::vector<std::vector<Estimate>> mEstimates;
+};
+
+} // namespace tracker
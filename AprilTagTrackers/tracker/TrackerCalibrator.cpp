@@ -0,0 +1,138 @@
+#include "TrackerCalibrator.hpp"
+
+#include "math/BoardPose.hpp"
+#include "utils/Assert.hpp"
+#include "utils/Log.hpp"
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/calib3d.hpp>
+
+namespace tracker
+{
+
+TrackerCalibrator::TrackerCalibrator(const UserConfig& config, const cfg::CameraCalib& camera)
+    : mCamera(camera),
+      mTrackerNum(config.trackerNum),
+      mMarkersPerTracker(config.markersPerTracker),
+      mMarkerSize(config.markerSize * 0.01), // centimeters to meters
+      mMaxDistance(config.trackerCalibDistance),
+      mModelMarker(TrackerUnit::CreateModelMarker(mMarkerSize)),
+      mBundles(static_cast<std::size_t>(mTrackerNum), math::BoardBundle(mModelMarker)),
+      mObservedCorners(math::NUM_CORNERS)
+{
+    // add main marker for every tracker
+    for (int i = 0; i < mTrackerNum; i++)
+    {
+        TrackerUnit unit;
+        // TODO: dynamically pick the main marker, based on the first seen? need some gui to help as multiple marker tend to get detected in the background while calibrating.
+        // might be helpful to draw the id of the marker on each detected, and then some gui to select which detected marker is the main, and which should be added to this one.
+        // it should be easy to detect if two markers are moving together, and separate from one not moving in the background
+        const int id = i * mMarkersPerTracker;
+        unit.AddMarker(id, mModelMarker);
+        mTrackerUnits.push_back(std::move(unit));
+    }
+}
+
+void TrackerCalibrator::Update(const MarkerDetectionList& dets, const cv::Mat& drawImage)
+{
+    const bool draw = !drawImage.empty();
+    // draw all markers blue. We will overwrite this with other colors for markers that are part of any of the trackers that we use
+    if (draw) cv::aruco::drawDetectedMarkers(drawImage, dets.GetCornerViews(), dets.ids, COLOR_MARKER_DETECTED);
+
+    math::EstimatePoseSingleMarkers(dets.GetCornerViews(), mMarkerSize, mCamera, mMarkerPoses);
+    mNormalizedCorners.clear();
+    if (!dets.Empty()) cv::undistortPoints(dets.corners, mNormalizedCorners, mCamera.cameraMatrix, mCamera.distortionCoeffs);
+    ATT_ASSERT(mMarkerPoses.positions.size() == dets.ids.size());
+    ATT_ASSERT(mMarkerPoses.rotations.size() == dets.ids.size());
+
+    // TODO: stop using hardcoded tracker roles
+    /// 0 = waist, 1 = left foot, 2 = right foot
+    for (int trackerIndex = 0; trackerIndex < mTrackerNum; ++trackerIndex)
+    {
+        auto& unit = mTrackerUnits[trackerIndex];
+        // on weird images or calibrations, throws exception. This should usually only happen on bad camera calibrations, or in very rare cases
+        const math::BoardPoseEstimate boardEstimate = math::EstimatePoseTracker(dets.ids, dets.corners, unit.GetBoardGeometry(), mCamera);
+        const RodrPose& boardPose = boardEstimate.pose;
+        if (boardEstimate.markerCount == 0) continue; // no existing markers in this tracker were detected, can't add new ones to it
+
+        if (draw) cv::drawFrameAxes(drawImage, mCamera.cameraMatrix, mCamera.distortionCoeffs, boardPose.rotation.value, boardPose.position, 0.1F);
+
+        // the bundle keeps a bounded number of frames spread over the whole calibration, skipped frames are -1
+        auto& bundle = mBundles[trackerIndex];
+        const int bundleFrame = bundle.AddFrame(boardPose);
+
+        for (Index detIndex = 0; detIndex < static_cast<Index>(dets.ids.size()); ++detIndex)
+        {
+            const int detId = dets.ids[detIndex];
+            const auto detCorners = dets.GetCorners(detIndex);
+            const RodrPose detMarkerPose{mMarkerPoses.positions[detIndex], math::RodriguesVec3d(mMarkerPoses.rotations[detIndex])};
+
+            // if marker is part of current tracker (usualy, 0 is 0-44, 1 is 45-89 etc), if not, continue to next detection
+            if (detId < (trackerIndex * mMarkersPerTracker) || detId >= ((trackerIndex + 1) * mMarkersPerTracker))
+            {
+                continue;
+            }
+
+            // markers too far to be added are too imprecise to refine the others with
+            if (bundleFrame >= 0 && Length(detMarkerPose.position) <= mMaxDistance)
+            {
+                const std::span<const cv::Point2f> normalized{mNormalizedCorners};
+                bundle.AddObservation(bundleFrame, detId, normalized.subspan(static_cast<std::size_t>(detIndex) * math::NUM_CORNERS).first<math::NUM_CORNERS>());
+            }
+
+            // the main markers are already added above
+            if (unit.HasMarkerId(detId)) // already added to a tracker, draw it green and continue to next detection
+            {
+                if (draw) DrawMarker(drawImage, detCorners, COLOR_MARKER_ADDED);
+                continue;
+            }
+            ATT_ASSERT(detId % mMarkersPerTracker != 0, "main marker already added");
+
+            // if marker is too far away from camera, paint it purple, as adding it could have too much error
+            if (Length(detMarkerPose.position) > mMaxDistance)
+            {
+                if (draw) DrawMarker(drawImage, detCorners, COLOR_MARKER_FAR);
+                continue;
+            }
+
+            if (draw) DrawMarker(drawImage, detCorners, COLOR_MARKER_ADDING);
+
+            // every marker seen this frame is observed, each median only depends on its own observations
+            auto& median = mMarkerMedians[detId]; // add or get
+            TransformMarkerSpace(mModelMarker, boardPose, detMarkerPose, mObservedCorners);
+            median.Add(mObservedCorners);
+
+            if (median.GetCount() >= NUM_OBSERVATIONS_TO_ADD)
+            {
+                unit.AddMarker(detId, median.Get());
+                mMarkerMedians.erase(detId);
+            }
+        }
+    }
+}
+
+std::vector<TrackerUnit> TrackerCalibrator::Finish()
+{
+    const double focalLength = mCamera.cameraMatrix.at<double>(0, 0);
+    for (int trackerIndex = 0; trackerIndex < mTrackerNum; ++trackerIndex)
+    {
+        auto& unit = mTrackerUnits[trackerIndex];
+        const math::BoardBundleResult refined = mBundles[trackerIndex].Adjust(unit.GetIds(), unit.GetMarkers(), focalLength);
+        ATT_LOG_INFO("tracker ", trackerIndex, " markers refined over ", mBundles[trackerIndex].GetFrameCount(), " frames in ",
+                     refined.iterations, " iterations, reprojection error ", refined.initialError, " -> ", refined.finalError, " px");
+        for (Index marker = 0; marker < static_cast<Index>(refined.markerErrors.size()); ++marker)
+        {
+            // the main marker defines the board, any other without an error was never observed close enough to refine
+            if (marker > 0 && refined.markerErrors[marker] == 0)
+            {
+                ATT_LOG_INFO("  marker ", unit.GetIds()[marker], ": not refined, no observations within trackerCalibDistance");
+                continue;
+            }
+            ATT_LOG_INFO("  marker ", unit.GetIds()[marker], ": ", refined.markerErrors[marker], " px");
+        }
+        unit.SetMarkers(unit.GetIds(), refined.markers);
+    }
+    return std::move(mTrackerUnits);
+}
+
+} // namespace tracker
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "AprilTagWrapper.hpp"
+#include "Config.hpp"
+#include "math/BoardBundle.hpp"
+#include "math/CVHelpers.hpp"
+#include "math/StreamingMedian.hpp"
+#include "TrackerUnit.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+namespace tracker
+{
+
+/// Builds the marker layout of every tracker from frames of them being rotated in front of the camera,
+/// the same steps for a live camera and for recorded frames. Frames must be added in the order they were captured,
+/// markers are only added relative to markers already added.
+class TrackerCalibrator
+{
+    static inline const cv::Scalar COLOR_MARKER_DETECTED{0, 0, 255}; /// blue
+    static inline const cv::Scalar COLOR_MARKER_ADDING{255, 0, 255}; /// yellow
+    static inline const cv::Scalar COLOR_MARKER_ADDED{0, 255, 0}; /// green
+    static inline const cv::Scalar COLOR_MARKER_FAR{255, 0, 255}; /// purple
+
+    /// observations of a marker before its median is added to the tracker
+    static constexpr int NUM_OBSERVATIONS_TO_ADD = 50;
+
+public:
+    /// camera is expected to exceed lifetime of this instance
+    TrackerCalibrator(const UserConfig& config, const cfg::CameraCalib& camera);
+
+    /// add the markers detected in a frame
+    /// @param drawImage the frame in color to draw the markers and tracker axes on, or empty to not draw
+    void Update(const MarkerDetectionList& dets, const cv::Mat& drawImage);
+    /// refine the markers of every tracker over all frames added, and take the trackers
+    std::vector<TrackerUnit> Finish();
+
+private:
+    const cfg::CameraCalib& mCamera;
+    int mTrackerNum;
+    int mMarkersPerTracker;
+    /// meters
+    double mMarkerSize;
+    /// markers further from the camera are not added, they would add too much error
+    double mMaxDistance;
+
+    MarkerCorners3f mModelMarker;
+    std::vector<TrackerUnit> mTrackerUnits;
+    /// maps marker id to the running median of its corners
+    std::unordered_map<int, math::MarkerMedian> mMarkerMedians;
+    std::vector<math::BoardBundle> mBundles;
+
+    math::EstimatePoseSingleMarkersResult mMarkerPoses;
+    MarkerCorners3f mObservedCorners;
+    /// detected corners undistorted to normalized camera coordinates, for the bundles
+    std::vector<cv::Point2f> mNormalizedCorners;
+};
+
+} // namespace tracker
@@ -2,8 +2,11 @@
 
 #include "config/TrackerUnit.hpp"
 #include "Helpers.hpp"
+#include "math/BoardPose.hpp"
 #include "math/CVHelpers.hpp"
 #include "math/CVTypes.hpp"
+#include "math/MotionFilter.hpp"
+#include "math/OneEuroFilter.hpp"
 #include "utils/Error.hpp"
 #include "utils/Types.hpp"
 
@@ -66,6 +69,7 @@ class TrackerUnit
     void RecenterMarkers()
     {
         RecenterCornersList(mArucoBoard->objPoints);
+        UpdateBoardGeometry();
     }
 
     void SetMarkers(IdsList ids, MarkersList cornersList)
@@ -73,12 +77,14 @@ class TrackerUnit
         EnsureMarkers(ids, cornersList);
         mArucoBoard->ids = std::move(ids);
         mArucoBoard->objPoints = std::move(cornersList);
+        UpdateBoardGeometry();
     }
     void AddMarker(int id, MarkerCorners3f corners)
     {
         EnsureCorners(corners);
         mArucoBoard->ids.push_back(id);
         mArucoBoard->objPoints.push_back(std::move(corners));
+        UpdateBoardGeometry();
     }
 
     void SetRole(cfg::TrackerRole role) { mRole = role; }
@@ -97,35 +103,64 @@ class TrackerUnit
     }
 
     void SetWasVisibleLastFrame(bool isFound) { mIsFound = isFound; }
+    /// only true if the driver was asked for the pose this frame and had it, false when it was predicted locally
     void SetWasVisibleToDriverLastFrame(bool isFound) { mIsDriverFound = isFound; }
     bool WasVisibleLastFrame() const { return mIsFound; }
     bool WasVisibleToDriverLastFrame() const { return mIsDriverFound; }
+    /// the driver was asked for the pose this frame, instead of predicting it locally
+    void SetWasDriverAskedLastFrame(bool isAsked) { mIsDriverAsked = isAsked; }
+    bool WasDriverAskedLastFrame() const { return mIsDriverAsked; }
 
     void SetMaskCenter(const cv::Point2d& center) { mMaskCenter = center; }
     const cv::Point2d& GetMaskCenter() const { return mMaskCenter; }
 
     void SetEstimatedPose(const RodrPose& pose) { mPose = pose; }
     const RodrPose& GetEstimatedPose() const { return mPose; }
+    /// 0 to 1, see math::GetTrackingConfidence
+    void SetConfidence(double confidence) { mConfidence = confidence; }
+    double GetConfidence() const { return mConfidence; }
+    /// last pose the driver answered with, not updated on frames that were predicted locally
     void SetPoseFromDriver(const RodrPose& pose) { mDriverPose = pose; }
     const RodrPose& GetPoseFromDriver() const { return mDriverPose; }
+    /// pose expected before detection, from the driver or predicted by GetMotion, a guess for the estimate
+    void SetPredictedPose(const RodrPose& pose) { mPredictedPose = pose; }
+    const RodrPose& GetPredictedPose() const { return mPredictedPose; }
+    /// predicts the estimated pose locally, in the same space
+    math::MotionFilter& GetMotion() { return mMotion; }
+    const math::MotionFilter& GetMotion() const { return mMotion; }
+    /// smooths the poses sent to the driver
+    math::OneEuroFilter& GetSmoothing() { return mSmoothing; }
 
     const ArucoBoardSharedPtr& GetArucoBoard() const { return mArucoBoard; }
+    /// markers laid out for math::EstimatePoseTracker
+    const math::BoardGeometry& GetBoardGeometry() const { return mBoardGeometry; }
     const MarkersList& GetMarkers() const { return mArucoBoard->objPoints; }
     const IdsList& GetIds() const { return mArucoBoard->ids; }
 
 private:
+    void UpdateBoardGeometry()
+    {
+        mBoardGeometry = math::BoardGeometry(mArucoBoard->ids, mArucoBoard->objPoints);
+    }
+
     /// stores ids and corners of markers
     ArucoBoardSharedPtr mArucoBoard = cv::aruco::Board::create(
         MarkersList{},
         cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50),
         IdsList{});
+    math::BoardGeometry mBoardGeometry{};
 
     RodrPose mPose{};
+    double mConfidence = 0;
     cv::Point2d mMaskCenter{};
     bool mIsFound = false;
 
     RodrPose mDriverPose{};
+    RodrPose mPredictedPose{};
+    math::MotionFilter mMotion{};
+    math::OneEuroFilter mSmoothing{};
     bool mIsDriverFound = false;
+    bool mIsDriverAsked = false;
 
     cfg::TrackerRole mRole = cfg::TrackerRole::Disabled;
 };
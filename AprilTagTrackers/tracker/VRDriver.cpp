@@ -1,42 +1,80 @@
 #include "VRDriver.hpp"
 
 #include "SemVer.h"
+#include "utils/AllocationCounter.hpp"
+#include "utils/Assert.hpp"
 #include "utils/Env.hpp"
 #include "utils/Error.hpp"
 #include "utils/Test.hpp"
 
-#include <sstream>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <concepts>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
-inline std::ostream& operator<<(std::ostream& os, const Pose& pose)
+namespace
 {
-    return os << pose.position.x << ' '
-              << pose.position.y << ' '
-              << pose.position.z << ' '
-              << pose.rotation.w << ' '
-              << pose.rotation.x << ' '
-              << pose.rotation.y << ' '
-              << pose.rotation.z;
-}
 
-inline std::istream& operator>>(std::istream& is, Pose& pose)
+void AppendArg(std::string& outCommand, std::string_view value)
 {
-    return is >> pose.position.x >> pose.position.y >> pose.position.z >>
-           pose.rotation.w >> pose.rotation.x >> pose.rotation.y >> pose.rotation.z;
+    outCommand += value;
 }
-
-namespace
+template <std::integral T>
+void AppendArg(std::string& outCommand, T value)
 {
+    std::array<char, 24> buffer{};
+    const auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    ATT_ASSERT(ec == std::errc());
+    outCommand.append(buffer.data(), end);
+}
+/// fixed with 6 decimals, same as printf %f
+template <std::floating_point T>
+void AppendArg(std::string& outCommand, T value)
+{
+    // large enough for any double in fixed notation
+    std::array<char, 384> buffer{};
+    constexpr int precision = 6;
+    const auto [end, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, std::chars_format::fixed, precision);
+    ATT_ASSERT(ec == std::errc());
+    outCommand.append(buffer.data(), end);
+}
+/// x y z qw qx qy qz
+void AppendArg(std::string& outCommand, const Pose& pose)
+{
+    AppendArg(outCommand, pose.position.x);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.position.y);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.position.z);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.rotation.w);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.rotation.x);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.rotation.y);
+    outCommand += ' ';
+    AppendArg(outCommand, pose.rotation.z);
+}
 
+/// overwrites outCommand, reusing its capacity
+template <typename... TArgs>
+void WriteCommand(std::string& outCommand, std::string_view name, const TArgs&... args)
+{
+    outCommand.clear();
+    outCommand += ' ';
+    outCommand += name;
+    ((outCommand += ' ', AppendArg(outCommand, args)), ...);
+}
 template <typename... TArgs>
 std::string BuildCommand(std::string_view name, const TArgs&... args)
 {
-    std::ostringstream ss;
-    ss << ' ' << name
-       << std::fixed << std::setprecision(6);
-    ((ss << ' ' << args), ...);
-    return ss.str();
+    std::string command;
+    WriteCommand(command, name, args...);
+    return command;
 }
 TEST_CASE("BuildCommand")
 {
@@ -50,15 +88,50 @@ TEST_CASE("BuildCommand")
           " foo 0.100000 0.200000 0.300000 1.000000 0.000000 0.000000 0.000000");
 }
 
+/// pop the next space separated token from the front of rest
+std::string_view NextToken(std::string_view& rest)
+{
+    const auto begin = std::min(rest.find_first_not_of(' '), rest.size());
+    const auto end = std::min(rest.find(' ', begin), rest.size());
+    const std::string_view token = rest.substr(begin, end - begin);
+    rest.remove_prefix(end);
+    return token;
+}
+
+/// like istream extraction, out is left unchanged and false is returned on failure
+template <typename T>
+    requires std::is_arithmetic_v<T>
+bool ReadArg(std::string_view& rest, T& out)
+{
+    const std::string_view token = NextToken(rest);
+    T value{};
+    const auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (token.empty() || ec != std::errc() || end != token.data() + token.size()) return false;
+    out = value;
+    return true;
+}
+bool ReadArg(std::string_view& rest, std::string& out)
+{
+    const std::string_view token = NextToken(rest);
+    if (token.empty()) return false;
+    out.assign(token);
+    return true;
+}
+bool ReadArg(std::string_view& rest, Pose& out)
+{
+    return ReadArg(rest, out.position.x) && ReadArg(rest, out.position.y) && ReadArg(rest, out.position.z) &&
+           ReadArg(rest, out.rotation.w) && ReadArg(rest, out.rotation.x) && ReadArg(rest, out.rotation.y) && ReadArg(rest, out.rotation.z);
+}
+
 template <typename... TArgs>
 void VerifyAndParseResponse(std::string_view buffer, std::string_view expectName, TArgs&... outArgs)
 {
-    std::istringstream ss{std::string(buffer)};
-    std::string name;
-    ss >> name;
+    std::string_view rest = buffer;
+    const std::string_view name = NextToken(rest);
     if (name.empty()) throw utils::MakeError("no response from driver");
     if (name != expectName) throw utils::MakeError("command response indicated failure: ", buffer);
-    ((ss >> outArgs), ...);
+    // stops at the first argument that fails to parse
+    (ReadArg(rest, outArgs) && ...);
 }
 TEST_CASE("VerifyAndParseResponse")
 {
@@ -67,6 +140,50 @@ TEST_CASE("VerifyAndParseResponse")
     int outId = -1;
     DOCTEST_CHECK_NOTHROW(VerifyAndParseResponse(" foo 12", "foo", outId));
     CHECK(outId == 12);
+
+    Pose pose = Pose::Ident();
+    int status = -1;
+    VerifyAndParseResponse(" trackerpose 2 0.5 -1.25 3 1 0 0 0 0", "trackerpose", outId, pose, status);
+    CHECK(outId == 2);
+    CHECK(pose.position == cv::Point3d(0.5, -1.25, 3));
+    CHECK(pose.rotation.w == 1);
+    CHECK(status == 0);
+
+    std::string version;
+    VerifyAndParseResponse(" numtrackers 3 0.6.0", "numtrackers", outId, version);
+    CHECK(outId == 3);
+    CHECK(version == "0.6.0");
+
+    // parsing stops at an invalid argument
+    outId = -1;
+    status = -1;
+    VerifyAndParseResponse(" trackerpose x 1", "trackerpose", outId, status);
+    CHECK(outId == -1);
+    CHECK(status == -1);
+}
+
+TEST_CASE("driver commands do not allocate once warmed up")
+{
+    if (!utils::IsCountingAllocations()) return;
+
+    std::string command;
+    int outId = -1;
+    Pose outPose = Pose::Ident();
+    int outStatus = -1;
+    const Pose pose{cv::Point3d(-1.5, 2.25, 1000.125), cv::Quatd(0.5, 0.5, 0.5, 0.5)};
+    constexpr std::string_view response = " trackerpose 1 0.1 0.2 0.3 1 0 0 0 0";
+
+    WriteCommand(command, "updatepose", 1, pose, -0.0123, 0.5, 0.75);
+    const std::uint64_t before = utils::GetThisThreadAllocationCount();
+    for (int frame = 0; frame < 10; ++frame)
+    {
+        WriteCommand(command, "updatepose", frame, pose, -0.0123, 0.5, 0.75);
+        WriteCommand(command, "gettrackerpose", frame, -0.03);
+        VerifyAndParseResponse(response, "trackerpose", outId, outPose, outStatus);
+    }
+    const std::uint64_t after = utils::GetThisThreadAllocationCount();
+    CHECK(after == before);
+    CHECK(outId == 1);
 }
 
 } // namespace
@@ -75,8 +192,13 @@ namespace tracker
 {
 
 VRDriver::VRDriver(const cfg::List<cfg::TrackerUnit>& trackers)
-    : mBridge(IPC::CreateDriverClient())
+    : VRDriver(trackers, IPC::CreateDriverClient()) {}
+
+VRDriver::VRDriver(const cfg::List<cfg::TrackerUnit>& trackers, std::unique_ptr<IPC::IClient> bridge)
+    : mBridge(std::move(bridge))
 {
+    constexpr size_t commandCapacity = 256;
+    mCommand.reserve(commandCapacity);
     // Only add trackers (and station) if they were not already added
     // also checks driver version, ensures can connect
     if (CmdGetTrackerCount() != trackers.GetSize())
@@ -92,31 +214,32 @@ VRDriver::VRDriver(const cfg::List<cfg::TrackerUnit>& trackers)
     }
 }
 
-void VRDriver::UpdateTracker(int id, Pose pose, double frameTime, double smoothing)
+void VRDriver::UpdateTracker(int id, Pose pose, double frameTime, double smoothing, double confidence)
 {
-    const std::string cmd = BuildCommand("updatepose", id, pose, frameTime, smoothing);
-    const std::string_view res = mBridge->SendRecv(cmd);
+    WriteCommand(mCommand, "updatepose", id, pose, frameTime, smoothing, confidence);
+    const std::string_view res = mBridge->SendRecv(mCommand);
     VerifyAndParseResponse(res, "updated");
 }
 
 void VRDriver::CmdUpdateStation(int id, Pose pose)
 {
-    const std::string cmd = BuildCommand("updatestation", id, pose);
-    const std::string_view res = mBridge->SendRecv(cmd);
+    WriteCommand(mCommand, "updatestation", id, pose);
+    const std::string_view res = mBridge->SendRecv(mCommand);
     VerifyAndParseResponse(res, "updated");
 }
 
 void VRDriver::SetSmoothing(double factor, double additional)
 {
     constexpr int saved = 120;
-    const std::string cmd = BuildCommand("settings", saved, factor, additional);
-    const std::string_view res = mBridge->SendRecv(cmd);
+    WriteCommand(mCommand, "settings", saved, factor, additional);
+    const std::string_view res = mBridge->SendRecv(mCommand);
     VerifyAndParseResponse(res, "changed");
 }
 
 int VRDriver::CmdGetTrackerCount()
 {
-    const std::string_view res = mBridge->SendRecv(BuildCommand("numtrackers"));
+    WriteCommand(mCommand, "numtrackers");
+    const std::string_view res = mBridge->SendRecv(mCommand);
     int count = -1;
     std::string versionStr;
     VerifyAndParseResponse(res, "numtrackers", count, versionStr);
@@ -133,21 +256,22 @@ int VRDriver::CmdGetTrackerCount()
 
 void VRDriver::CmdAddTracker(std::string_view name, std::string_view role)
 {
-    const std::string cmd = BuildCommand("addtracker", name, role);
-    const std::string_view res = mBridge->SendRecv(cmd);
+    WriteCommand(mCommand, "addtracker", name, role);
+    const std::string_view res = mBridge->SendRecv(mCommand);
     VerifyAndParseResponse(res, "added");
 }
 
 void VRDriver::CmdAddStation()
 {
-    const std::string_view res = mBridge->SendRecv(BuildCommand("addstation"));
+    WriteCommand(mCommand, "addstation");
+    const std::string_view res = mBridge->SendRecv(mCommand);
     VerifyAndParseResponse(res, "added");
 }
 
 VRDriver::GetTrackerResult VRDriver::GetTracker(int id, double timeOffset)
 {
-    const std::string cmd = BuildCommand("gettrackerpose", id, timeOffset);
-    const std::string_view res = mBridge->SendRecv(cmd);
+    WriteCommand(mCommand, "gettrackerpose", id, timeOffset);
+    const std::string_view res = mBridge->SendRecv(mCommand);
     int outId = -1;
     Pose outPose = Pose::Ident();
     int outStatus = -1;
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 
 namespace tracker
@@ -17,12 +18,15 @@ class VRDriver
 {
 public:
     explicit VRDriver(const cfg::List<cfg::TrackerUnit>& trackers);
+    /// talk to something other than the driver, like a replay of a recorded session
+    VRDriver(const cfg::List<cfg::TrackerUnit>& trackers, std::unique_ptr<IPC::IClient> bridge);
 
     void UpdateStation(Pose pose) { CmdUpdateStation(0, pose); }
 
     // pose = x y z qw qx qy qz
-    // 'updatepose' id pose time smoothing -> 'updated'
-    void UpdateTracker(int id, Pose pose, double frameTime, double smoothing);
+    // 'updatepose' id pose time smoothing confidence -> 'updated'
+    // confidence 0 to 1, drivers that do not read it ignore the trailing argument
+    void UpdateTracker(int id, Pose pose, double frameTime, double smoothing, double confidence);
     // 'settings' saved factor additional -> 'changed'
     void SetSmoothing(double factor, double additional);
 
@@ -54,6 +58,8 @@ class VRDriver
     void CmdAddStation();
 
     std::unique_ptr<IPC::IClient> mBridge;
+    /// reused by every command, so sending does not allocate
+    std::string mCommand;
 };
 
 } // namespace tracker
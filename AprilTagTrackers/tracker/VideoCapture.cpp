@@ -3,11 +3,14 @@
 #include "utils/Assert.hpp"
 #include "utils/Log.hpp"
 #include "utils/SteadyTimer.hpp"
+#include "utils/TaskScheduler.hpp"
 #include "utils/Test.hpp"
 
+#include <ps3eye/ps3eye.h>
 #include <ps3eye/PSEyeVideoCapture.h>
 
 #include <charconv>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <sstream>
@@ -111,6 +114,10 @@ bool VideoCapture::TryOpenCapture()
     if (api == CAP_PS3EYE)
     {
         if (!hwIndex) return false;
+        // convert frames on the shared workers, rather than threads owned by the camera
+        ps3eye::PS3EYECam::setConversionParallelFor([](int count, const std::function<void(int)>& task) {
+            utils::TaskScheduler::Get().ParallelFor(count, task);
+        });
         mCapture = std::make_unique<PSEyeVideoCapture>(*hwIndex);
         return mCapture->isOpened();
     }
@@ -152,6 +159,11 @@ void VideoCapture::SetCaptureOptions()
         mCapture->set(cv::CAP_PROP_FPS, mCameraInfo->fps);
     }
     if (mCameraInfo->openDirectShowSettings) mCapture->set(cv::CAP_PROP_SETTINGS, 1);
+    if (mCameraInfo->api == CAP_PS3EYE)
+    {
+        mCapture->set(cv::CAP_PROP_CONVERT_RGB, mCameraInfo->grayscale ? 0 : 1);
+        mCapture->set(PSEYE_CAP_PROP_CONVERSION_THREADS, mCameraInfo->conversionThreads);
+    }
     if (mCameraInfo->extraSettings.enabled)
     {
         mCapture->set(cv::CAP_PROP_AUTOFOCUS, 0);
@@ -0,0 +1,225 @@
+#include "AllocationCounter.hpp"
+
+#include "utils/Log.hpp"
+#include "utils/Test.hpp"
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef ATT_COUNT_ALLOCATIONS
+
+#    if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#        define ATT_DETAIL_SANITIZED_ALLOCATOR 1
+#    elif defined(__has_feature)
+#        if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#            define ATT_DETAIL_SANITIZED_ALLOCATOR 1
+#        endif
+#    endif
+
+// glibc allows malloc to be replaced by the executable, which also catches every allocation made by C libraries.
+// Sanitizers replace malloc themselves, but call hooks on every allocation of their allocator, malloc and operator new alike.
+// Without either, fall back to operator new.
+#    if defined(ATT_OS_LINUX) && !defined(ATT_DETAIL_SANITIZED_ALLOCATOR)
+#        define ATT_DETAIL_COUNT_MALLOC 1
+#    elif defined(ATT_DETAIL_SANITIZED_ALLOCATOR) && !defined(ATT_COMP_MSVC)
+#        define ATT_DETAIL_COUNT_SANITIZER_HOOKS 1
+#    endif
+
+namespace
+{
+/// zero initialized, so reading it never allocates, even from within malloc
+thread_local std::uint64_t tAllocationCount = 0;
+} // namespace
+
+#    ifdef ATT_DETAIL_COUNT_MALLOC
+
+#        include <cerrno>
+
+extern "C"
+{
+    void* __libc_malloc(std::size_t size);
+    void* __libc_calloc(std::size_t count, std::size_t size);
+    void* __libc_realloc(void* ptr, std::size_t size);
+    void* __libc_memalign(std::size_t alignment, std::size_t size);
+
+    // NOLINTBEGIN: replacing the C allocator requires its exact names and signatures
+    void* malloc(std::size_t size)
+    {
+        ++tAllocationCount;
+        return __libc_malloc(size);
+    }
+    void* calloc(std::size_t count, std::size_t size)
+    {
+        ++tAllocationCount;
+        return __libc_calloc(count, size);
+    }
+    void* realloc(void* ptr, std::size_t size)
+    {
+        if (size != 0) ++tAllocationCount;
+        return __libc_realloc(ptr, size);
+    }
+    void* memalign(std::size_t alignment, std::size_t size)
+    {
+        ++tAllocationCount;
+        return __libc_memalign(alignment, size);
+    }
+    void* aligned_alloc(std::size_t alignment, std::size_t size)
+    {
+        ++tAllocationCount;
+        return __libc_memalign(alignment, size);
+    }
+    int posix_memalign(void** outPtr, std::size_t alignment, std::size_t size)
+    {
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+        ++tAllocationCount;
+        void* const ptr = __libc_memalign(alignment, size);
+        if (ptr == nullptr) return ENOMEM;
+        *outPtr = ptr;
+        return 0;
+    }
+    // NOLINTEND
+}
+
+#    elif defined(ATT_DETAIL_COUNT_SANITIZER_HOOKS)
+
+// from sanitizer/allocator_interface.h, which not every compiler installs
+extern "C" int __sanitizer_install_malloc_and_free_hooks( // NOLINT: name of the sanitizer runtime
+    void (*mallocHook)(const volatile void* ptr, std::size_t size),
+    void (*freeHook)(const volatile void* ptr));
+
+namespace
+{
+void CountSanitizerMalloc(const volatile void* /*ptr*/, std::size_t /*size*/)
+{
+    ++tAllocationCount;
+}
+void IgnoreSanitizerFree(const volatile void* /*ptr*/) {}
+
+/// installed before main, so allocations of static initializers that run earlier are not counted
+const bool gSanitizerHooksInstalled = __sanitizer_install_malloc_and_free_hooks(&CountSanitizerMalloc, &IgnoreSanitizerFree) != 0;
+} // namespace
+
+#    else
+
+void* operator new(std::size_t size)
+{
+    ++tAllocationCount;
+    if (void* const ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++tAllocationCount;
+    return std::malloc(size == 0 ? 1 : size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+#    endif
+
+#endif
+
+namespace utils
+{
+
+std::uint64_t GetThisThreadAllocationCount() noexcept
+{
+#ifdef ATT_COUNT_ALLOCATIONS
+    // compilers assume malloc leaves other memory alone, so without volatile a read from before a malloc could be reused
+    return const_cast<const volatile std::uint64_t&>(tAllocationCount);
+#else
+    return 0;
+#endif
+}
+
+bool IsCountingEveryMalloc() noexcept
+{
+#if defined(ATT_DETAIL_COUNT_MALLOC)
+    return true;
+#elif defined(ATT_DETAIL_COUNT_SANITIZER_HOOKS)
+    return gSanitizerHooksInstalled;
+#else
+    return false;
+#endif
+}
+
+namespace detail
+{
+
+void LogAllocationAudit(std::string_view name, const std::string_view* stageNames, const std::uint64_t* stageTotals, int stageCount, int frames)
+{
+    std::ostringstream ss;
+    std::uint64_t total = 0;
+    for (int i = 0; i < stageCount; ++i)
+    {
+        ss << "\n    " << stageNames[i] << " = " << (static_cast<double>(stageTotals[i]) / frames);
+        total += stageTotals[i];
+    }
+    ATT_LOG_INFO(name, " allocations per frame = ", (static_cast<double>(total) / frames), ss.str());
+}
+
+} // namespace detail
+
+TEST_CASE("GetThisThreadAllocationCount")
+{
+    if (!IsCountingAllocations()) return;
+
+    volatile std::size_t sink = 0; // keeps the allocations from being optimized away
+    const std::uint64_t before = GetThisThreadAllocationCount();
+    {
+        const auto value = std::make_unique<int>(1);
+        const std::vector<int> values(100);
+        sink = values.size() + static_cast<std::size_t>(*value);
+    }
+    const std::uint64_t after = GetThisThreadAllocationCount();
+    CHECK(after - before == 2);
+
+    if (IsCountingEveryMalloc())
+    {
+        // opencv and apriltag allocate through malloc
+        const std::uint64_t beforeMalloc = GetThisThreadAllocationCount();
+        void* volatile ptr = std::malloc(16);
+        std::free(ptr);
+        CHECK(GetThisThreadAllocationCount() - beforeMalloc == 1);
+    }
+
+    AllocationAudit<2> audit{"test", {"first", "second"}};
+    std::vector<int> reused;
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        audit.BeginFrame();
+        reused.assign(10, frame); // only the first frame allocates
+        audit.EndStage(0);
+        audit.EndStage(1);
+        audit.EndFrame();
+    }
+    CHECK(audit.GetLastFrameCount() == 0);
+}
+
+} // namespace utils
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace utils
+{
+
+/// built with ATT_COUNT_ALLOCATIONS, heap allocations are counted per thread
+constexpr bool IsCountingAllocations()
+{
+#ifdef ATT_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// heap allocations made by the calling thread since it started, always 0 unless IsCountingAllocations.
+/// See IsCountingEveryMalloc for which allocations are seen.
+std::uint64_t GetThisThreadAllocationCount() noexcept;
+/// every malloc is counted, including those of opencv and apriltag, on linux also with address and thread sanitizers.
+/// false if only operator new is counted, as on other platforms, or if nothing is counted.
+bool IsCountingEveryMalloc() noexcept;
+
+/// Counts the allocations of the calling thread per stage of a loop, and logs them every LOG_INTERVAL frames.
+/// Does nothing unless IsCountingAllocations.
+template <int NStages>
+class AllocationAudit
+{
+public:
+    static constexpr int LOG_INTERVAL = 300;
+
+    /// @param stageNames string literals, logged with the counts
+    constexpr explicit AllocationAudit(std::string_view name, std::array<std::string_view, NStages> stageNames)
+        : mName(name), mStageNames(stageNames) {}
+
+    void BeginFrame()
+    {
+        if constexpr (!IsCountingAllocations()) return;
+        mFrameStart = GetThisThreadAllocationCount();
+        mMark = mFrameStart;
+        mLastFrameStages.fill(0);
+    }
+    /// allocations since the previous EndStage or BeginFrame are added to stage
+    void EndStage(int stage)
+    {
+        if constexpr (!IsCountingAllocations()) return;
+        const std::uint64_t now = GetThisThreadAllocationCount();
+        mStageTotals[stage] += now - mMark;
+        mLastFrameStages[stage] += now - mMark;
+        mMark = now;
+    }
+    void EndFrame()
+    {
+        if constexpr (!IsCountingAllocations()) return;
+        mLastFrame = GetThisThreadAllocationCount() - mFrameStart;
+        if (++mFrames < LOG_INTERVAL) return;
+        Log();
+        mFrames = 0;
+        mStageTotals.fill(0);
+    }
+
+    /// allocations between the last BeginFrame and EndFrame
+    std::uint64_t GetLastFrameCount() const { return mLastFrame; }
+    /// allocations of stage between the last BeginFrame and EndFrame
+    std::uint64_t GetLastFrameCount(int stage) const { return mLastFrameStages[stage]; }
+
+private:
+    void Log() const;
+
+    std::string_view mName;
+    std::array<std::string_view, NStages> mStageNames;
+    std::array<std::uint64_t, NStages> mStageTotals{};
+    std::array<std::uint64_t, NStages> mLastFrameStages{};
+    std::uint64_t mFrameStart = 0;
+    std::uint64_t mMark = 0;
+    std::uint64_t mLastFrame = 0;
+    int mFrames = 0;
+};
+
+namespace detail
+{
+void LogAllocationAudit(std::string_view name, const std::string_view* stageNames, const std::uint64_t* stageTotals, int stageCount, int frames);
+} // namespace detail
+
+template <int NStages>
+void AllocationAudit<NStages>::Log() const
+{
+    detail::LogAllocationAudit(mName, mStageNames.data(), mStageTotals.data(), NStages, mFrames);
+}
+
+} // namespace utils
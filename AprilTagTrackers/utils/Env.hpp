@@ -42,6 +42,8 @@ inline fs::path GetBindingsDir() { return GetRuntimeDir() / "bindings"; }
 inline fs::path GetLogsDir() { return GetRuntimeDir() / "logs"; }
 inline fs::path GetConfigDir() { return GetRuntimeDir() / "config"; }
 inline fs::path GetLocalesDir() { return GetRuntimeDir() / "locales"; }
+inline fs::path GetCacheDir() { return GetRuntimeDir() / "cache"; }
+inline fs::path GetRecordingsDir() { return GetRuntimeDir() / "recordings"; }
 /// BridgeDriver version
 constexpr SemVer GetBridgeDriverVersion() { return detail::BRIDGE_DRIVER_VERSION; }
 
@@ -0,0 +1,176 @@
+#include "TaskScheduler.hpp"
+
+#include "utils/Test.hpp"
+
+#include <taskflow/taskflow.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <latch>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+namespace
+{
+
+int ResolveThreadCount(int threadCount)
+{
+    if (threadCount > 0) return threadCount;
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/// the thread waiting in ParallelFor runs tasks too, so one fewer worker is needed
+std::shared_ptr<tf::Executor> CreateExecutor(int threadCount)
+{
+    const auto workerCount = static_cast<size_t>(std::max(1, threadCount - 1));
+    return std::make_shared<tf::Executor>(workerCount);
+}
+
+} // namespace
+
+TaskScheduler::TaskScheduler(int threadCount)
+    : mThreadCount(ResolveThreadCount(threadCount)),
+      mExecutor(CreateExecutor(mThreadCount))
+{
+}
+
+TaskScheduler::~TaskScheduler() = default;
+
+TaskScheduler& TaskScheduler::Get()
+{
+    static TaskScheduler scheduler{};
+    return scheduler;
+}
+
+void TaskScheduler::SetThreadCount(int threadCount)
+{
+    threadCount = ResolveThreadCount(threadCount);
+    std::shared_ptr<tf::Executor> previous;
+    {
+        const std::lock_guard lock{mMutex};
+        if (threadCount == mThreadCount) return;
+        mThreadCount = threadCount;
+        previous = std::exchange(mExecutor, CreateExecutor(threadCount));
+    }
+    // if this was the last reference, waits for running tasks and joins the previous workers outside the lock
+}
+
+int TaskScheduler::GetThreadCount() const
+{
+    const std::lock_guard lock{mMutex};
+    return mThreadCount;
+}
+
+std::shared_ptr<tf::Executor> TaskScheduler::GetExecutor() const
+{
+    const std::lock_guard lock{mMutex};
+    return mExecutor;
+}
+
+void TaskScheduler::ParallelFor(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0) return;
+    const std::shared_ptr<tf::Executor> executor = GetExecutor();
+    // a worker blocking on other workers could wait on itself, and the work is already spread over the pool
+    if (count == 1 || executor->this_worker_id() >= 0)
+    {
+        for (int index = 0; index < count; ++index) task(index);
+        return;
+    }
+
+    std::latch remaining{count - 1};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    const auto runIndex = [&](int index) {
+        try
+        {
+            task(index);
+        }
+        catch (...)
+        {
+            const std::lock_guard lock{errorMutex};
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    const auto runAndCountDown = [&](int index) {
+        runIndex(index);
+        remaining.count_down();
+    };
+    for (int index = 1; index < count; ++index)
+    {
+        // one reference and the index fit the small buffer of std::function in libstdc++, two references do not
+        executor->silent_async([&runAndCountDown, index] { runAndCountDown(index); });
+    }
+    runIndex(0);
+    // tasks reference this stack frame, so always wait, even when index 0 failed
+    remaining.wait();
+
+    if (error) std::rethrow_exception(error);
+}
+
+std::future<void> TaskScheduler::Async(std::function<void()> task)
+{
+    return GetExecutor()->async(std::move(task));
+}
+
+TEST_CASE("TaskScheduler.ParallelFor runs every index once")
+{
+    TaskScheduler scheduler{3};
+    CHECK(scheduler.GetThreadCount() == 3);
+
+    constexpr int count = 64;
+    std::vector<std::atomic<int>> visits(count);
+    scheduler.ParallelFor(count, [&](int index) { visits[index].fetch_add(1); });
+    CHECK(std::all_of(visits.begin(), visits.end(), [](const auto& visit) { return visit.load() == 1; }));
+
+    // nested calls from a worker run inline
+    std::atomic<int> total = 0;
+    scheduler.ParallelFor(4, [&](int) {
+        scheduler.ParallelFor(8, [&](int) { total.fetch_add(1); });
+    });
+    CHECK(total.load() == 32);
+}
+
+TEST_CASE("TaskScheduler.ParallelFor rethrows after every index finished")
+{
+    TaskScheduler scheduler{3};
+    std::atomic<int> finished = 0;
+    bool threw = false;
+    try
+    {
+        scheduler.ParallelFor(16, [&](int index) {
+            if (index == 5) throw std::runtime_error("task failed");
+            finished.fetch_add(1);
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(finished.load() == 15);
+}
+
+TEST_CASE("TaskScheduler.SetThreadCount keeps running tasks")
+{
+    TaskScheduler scheduler{3};
+    std::atomic<bool> ran = false;
+    std::future<void> done = scheduler.Async([&] { ran = true; });
+    scheduler.SetThreadCount(2);
+    done.get();
+    CHECK(ran.load());
+    CHECK(scheduler.GetThreadCount() == 2);
+
+    std::atomic<int> total = 0;
+    scheduler.ParallelFor(10, [&](int index) { total.fetch_add(index); });
+    CHECK(total.load() == 45);
+}
+
+} // namespace utils
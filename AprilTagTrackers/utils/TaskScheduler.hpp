@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace tf
+{
+class Executor;
+} // namespace tf
+
+namespace utils
+{
+
+/// Process wide work stealing scheduler, used by marker detection, pose estimation,
+/// frame conversion and preview drawing, so together they never run more threads than the configured core count.
+class TaskScheduler
+{
+public:
+    explicit TaskScheduler(int threadCount = 0);
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    static TaskScheduler& Get();
+
+    /// @param threadCount threads running tasks, including a thread waiting in ParallelFor, 0 uses every hardware thread.
+    ///   Work already started finishes on the previous workers.
+    void SetThreadCount(int threadCount);
+    int GetThreadCount() const;
+
+    /// run task(index) for every index in [0, count) and return once all have finished,
+    /// the calling thread runs index 0. Called from within a task, the indices run inline on that worker.
+    /// An exception thrown by a task is rethrown here, after every other index has finished.
+    void ParallelFor(int count, const std::function<void(int)>& task);
+
+    /// start task on a worker, anything task references must outlive the returned future
+    std::future<void> Async(std::function<void()> task);
+
+private:
+    std::shared_ptr<tf::Executor> GetExecutor() const;
+
+    mutable std::mutex mMutex;
+    int mThreadCount = 0;
+    /// replaced by SetThreadCount, callers hold a reference until their work is done
+    std::shared_ptr<tf::Executor> mExecutor;
+};
+
+} // namespace utils
@@ -30,3 +30,5 @@
 #define CHECK_NOT(...) DOCTEST_CHECK_FALSE(__VA_ARGS__)
 /// CHECK with message, see LOG_INFO
 #define CHECK_M(expr, ...) DOCTEST_CHECK_MESSAGE(expr, __VA_ARGS__)
+/// print a message when the test case runs, pass or fail, for results worth reading like benchmarks
+#define MESSAGE(...) DOCTEST_MESSAGE(__VA_ARGS__)